@@ -0,0 +1,428 @@
+#define _GNU_SOURCE  /* clock_gettime, CLOCK_MONOTONIC_COARSE, pthread_atfork */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "alog.h"
+
+#define REC_ALIGN 16              /* 记录长度的对齐，保证环尾的剩余空间放得下一个填充头 */
+#define ROUND_REC(n) (((n) + REC_ALIGN - 1) / REC_ALIGN * REC_ALIGN)
+#define REC_HDR ROUND_REC(sizeof(struct alog_rec))
+#define RING_MASK (ALOG_RING_SIZE - 1)
+#define IDLE_MS 10                /* 写线程无事可做时的等待间隔 */
+#define OUT_BUF 65536             /* 写线程每个输出的拼接缓冲 */
+#define DROP_REPORT_MS 1000       /* 丢弃计数的报告间隔 */
+
+enum { REC_PAD, REC_TEXT, REC_EVENT };
+
+/* 环中的记录头；REC_TEXT 后跟文本，REC_EVENT 后跟 4 个 unsigned long */
+struct alog_rec {
+    unsigned int len;             /* 整条记录的字节数（含头，REC_ALIGN 的倍数） */
+    unsigned char type;
+    unsigned char level;          /* 含 ALOG_TS 标志 */
+    unsigned short id;            /* 事件号 */
+    unsigned long ts_ms;          /* 提交时的墙钟时间 */
+};
+
+/* 一个线程的环；head 只由生产者推进，tail 只由写线程推进，分在不同缓存行 */
+struct alog_ring {
+    unsigned long head;
+    char pad1[64 - sizeof(unsigned long)];
+    unsigned long tail;
+    char pad2[64 - sizeof(unsigned long)];
+    unsigned long dropped;        /* 生产者统计，写线程读取 */
+    int dead;                     /* 所属线程已退出，排空后可给新线程复用 */
+    struct alog_ring *next;
+    char *buf;
+};
+
+/* 写线程的一个输出 */
+struct out_buf {
+    int fd;
+    size_t len;
+    char data[OUT_BUF];
+};
+
+int alog_level = ALOG_INFO;
+
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;    /* 唤醒写线程 */
+static pthread_cond_t g_passed = PTHREAD_COND_INITIALIZER;  /* 写线程完成了一轮 */
+static struct alog_ring *g_rings;                            /* 只增不减的环链表 */
+static pthread_t g_writer;
+static int g_running;             /* 写线程在运行：记录进环，否则同步输出 */
+static int g_stop;
+static unsigned long g_pass;      /* 写线程完成的轮数 */
+static unsigned long g_dropped;   /* 已报告过的丢弃总数 */
+static int g_out_fd = 1;
+static int g_err_fd = 2;
+static const char *g_events[ALOG_EVENTS];
+static int g_nevents;
+static struct out_buf g_out;
+static struct out_buf g_err;
+
+static unsigned long wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
+static unsigned long mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
+static int level_fd(int level) {
+    return (level & 0x0f) <= ALOG_WARN ? g_err_fd : g_out_fd;
+}
+
+static void write_all(int fd, const char *p, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;                /* 输出已坏（如管道对端关闭），日志不能让程序出错 */
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+/* 把一条记录格式化成一行（含换行），返回长度 */
+static size_t format_rec(const struct alog_rec *r, char *dst, size_t cap) {
+    const unsigned long *a;
+    const char *fmt;
+    size_t n = 0;
+    int m;
+
+    if (r->level & ALOG_TS) {
+        m = sprintf(dst, "[%lu] ", r->ts_ms);
+        n = (size_t)m;
+    }
+    if (r->type == REC_TEXT) {    /* 文本以 '\0' 结尾，长度不超过 ALOG_LINE_MAX - 1 */
+        fmt = (const char *)r + REC_HDR;
+        m = (int)strlen(fmt);
+        memcpy(dst + n, fmt, (size_t)m);
+        n += (size_t)m;
+    } else {
+        a = (const unsigned long *)((const char *)r + REC_HDR);
+        fmt = r->id < g_nevents ? g_events[r->id] : "event %lu";
+        m = snprintf(dst + n, cap - n - 1, fmt, a[0], a[1], a[2], a[3]);
+        if (m < 0) m = 0;
+        n += (size_t)m < cap - n - 1 ? (size_t)m : cap - n - 2;
+    }
+    dst[n++] = '\n';
+    return n;
+}
+
+/* 同步输出一条记录：写线程未运行时使用 */
+static void emit_sync(const struct alog_rec *r) {
+    char line[ALOG_LINE_MAX + 32];
+    size_t n = format_rec(r, line, sizeof(line));
+    write_all(level_fd(r->level), line, n);
+}
+
+static void ring_release(void *p) {
+    __atomic_store_n(&((struct alog_ring *)p)->dead, 1, __ATOMIC_RELEASE);
+}
+
+static void child_after_fork(void) {
+    /* 写线程没有跟过来；父进程环里没写完的记录由父进程负责 */
+    g_running = 0;
+    g_stop = 0;
+    pthread_mutex_init(&g_lock, NULL);  /* 锁和条件变量的状态可能是 fork 时写线程留下的 */
+    pthread_cond_init(&g_wake, NULL);
+    pthread_cond_init(&g_passed, NULL);
+}
+
+static void once_init(void) {
+    pthread_key_create(&g_key, ring_release);
+    pthread_atfork(NULL, NULL, child_after_fork);
+}
+
+/* 当前线程的环：优先复用已退出线程留下的空环 */
+static struct alog_ring *my_ring(void) {
+    struct alog_ring *r = (struct alog_ring *)pthread_getspecific(g_key);
+
+    if (r != NULL) return r;
+    pthread_mutex_lock(&g_lock);
+    for (r = g_rings; r != NULL; r = r->next) {
+        if (__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) break;
+    }
+    if (r != NULL) {
+        r->dead = 0;
+    } else {
+        r = (struct alog_ring *)calloc(1, sizeof(*r));
+        if (r != NULL) r->buf = (char *)malloc(ALOG_RING_SIZE);
+        if (r != NULL && r->buf == NULL) {
+            free(r);
+            r = NULL;
+        }
+        if (r != NULL) {
+            r->next = g_rings;
+            __atomic_store_n(&g_rings, r, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (r != NULL) pthread_setspecific(g_key, r);
+    return r;
+}
+
+/* 在环中预留 len 字节（已对齐），放不下返回 NULL；必要时先用填充记录跳过环尾，
+ * 填充的字节数存入 *pad，head 此时不动 */
+static struct alog_rec *ring_reserve(struct alog_ring *r, unsigned int len, unsigned long *pad) {
+    unsigned long tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    unsigned long off = r->head & RING_MASK;
+    struct alog_rec *p;
+
+    *pad = off + len > ALOG_RING_SIZE ? ALOG_RING_SIZE - off : 0;
+    if (ALOG_RING_SIZE - (r->head - tail) < *pad + len) return NULL;
+    if (*pad > 0) {
+        p = (struct alog_rec *)(r->buf + off);
+        p->len = (unsigned int)*pad;
+        p->type = REC_PAD;
+    }
+    return (struct alog_rec *)(r->buf + ((r->head + *pad) & RING_MASK));
+}
+
+/* 填充和记录一次发布：写线程看到新 head 时两者都已写好 */
+static void ring_commit(struct alog_ring *r, unsigned long pad, unsigned int len) {
+    __atomic_store_n(&r->head, r->head + pad + len, __ATOMIC_RELEASE);
+}
+
+/* 提交一条记录，body_len 不超过 ALOG_LINE_MAX - 1；内容后补 '\0' */
+static void submit(int level, int type, int id, const void *body, size_t body_len) {
+    unsigned long line[(REC_HDR + ALOG_LINE_MAX) / sizeof(unsigned long) + 1]; /* 同步输出时拼记录 */
+    struct alog_rec *tmp = (struct alog_rec *)line;
+    struct alog_ring *r;
+    struct alog_rec *p;
+    unsigned long pad;
+    unsigned int len = (unsigned int)ROUND_REC(REC_HDR + body_len + 1);
+
+    if (!ALOG_ENABLED(level)) return;
+    if (!__atomic_load_n(&g_running, __ATOMIC_ACQUIRE) || (r = my_ring()) == NULL) {
+        tmp->len = len;
+        tmp->type = (unsigned char)type;
+        tmp->level = (unsigned char)level;
+        tmp->id = (unsigned short)id;
+        tmp->ts_ms = level & ALOG_TS ? wall_ms() : 0;
+        memcpy((char *)tmp + REC_HDR, body, body_len);
+        ((char *)tmp + REC_HDR)[body_len] = '\0';
+        emit_sync(tmp);
+        return;
+    }
+    p = ring_reserve(r, len, &pad);
+    if (p == NULL) {
+        r->dropped++;
+        return;
+    }
+    p->len = len;
+    p->type = (unsigned char)type;
+    p->level = (unsigned char)level;
+    p->id = (unsigned short)id;
+    p->ts_ms = level & ALOG_TS ? wall_ms() : 0;
+    memcpy((char *)p + REC_HDR, body, body_len);
+    ((char *)p + REC_HDR)[body_len] = '\0';
+    ring_commit(r, pad, len);
+}
+
+void alog_vprintf(int level, const char *fmt, va_list ap) {
+    char line[ALOG_LINE_MAX];
+    int n;
+
+    if (!ALOG_ENABLED(level)) return;
+    n = vsnprintf(line, sizeof(line), fmt, ap);
+    if (n < 0) return;
+    if (n >= (int)sizeof(line)) n = (int)sizeof(line) - 1;  /* 截断 */
+    submit(level, REC_TEXT, 0, line, (size_t)n);
+}
+
+void alog_printf(int level, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    alog_vprintf(level, fmt, ap);
+    va_end(ap);
+}
+
+void alog_write(int level, const char *msg, size_t len) {
+    if (len > ALOG_LINE_MAX - 1) len = ALOG_LINE_MAX - 1;
+    submit(level, REC_TEXT, 0, msg, len);
+}
+
+int alog_event_define(const char *fmt) {
+    int id = -1;
+
+    pthread_mutex_lock(&g_lock);
+    if (g_nevents < ALOG_EVENTS) {
+        g_events[g_nevents] = fmt;
+        id = __atomic_add_fetch(&g_nevents, 1, __ATOMIC_RELEASE) - 1;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return id;
+}
+
+void alog_event(int level, int id, unsigned long a, unsigned long b, unsigned long c, unsigned long d) {
+    unsigned long args[4];
+
+    args[0] = a;
+    args[1] = b;
+    args[2] = c;
+    args[3] = d;
+    submit(level, REC_EVENT, id, args, sizeof(args));
+}
+
+int alog_allow(struct alog_limit *l, unsigned long per_sec) {
+    unsigned long now = mono_ms() / 1000;
+    unsigned long w = __atomic_load_n(&l->window, __ATOMIC_RELAXED);
+    unsigned long skipped;
+
+    if (w != now && __atomic_compare_exchange_n(&l->window, &w, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&l->count, 0, __ATOMIC_RELAXED);
+        skipped = __atomic_exchange_n(&l->suppressed, 0, __ATOMIC_RELAXED);
+        if (skipped > 0) alog_printf(ALOG_INFO, "(%lu similar messages suppressed)", skipped);
+    }
+    if (__atomic_add_fetch(&l->count, 1, __ATOMIC_RELAXED) <= per_sec) return 1;
+    __atomic_add_fetch(&l->suppressed, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int alog_sample(struct alog_limit *l, unsigned long every) {
+    if (every <= 1 || __atomic_fetch_add(&l->count, 1, __ATOMIC_RELAXED) % every == 0) return 1;
+    __atomic_add_fetch(&l->suppressed, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+unsigned long alog_dropped(void) {
+    const struct alog_ring *r;
+    unsigned long n = 0;
+
+    for (r = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        n += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    }
+    return n;
+}
+
+static void out_flush(struct out_buf *o) {
+    write_all(o->fd, o->data, o->len);
+    o->len = 0;
+}
+
+/* 取出一个环中已发布的记录，返回取出的条数 */
+static unsigned long drain_ring(struct alog_ring *r) {
+    unsigned long tail = r->tail;
+    unsigned long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    const struct alog_rec *p;
+    struct out_buf *o;
+    unsigned long n = 0;
+
+    while (tail != head) {
+        p = (const struct alog_rec *)(r->buf + (tail & RING_MASK));
+        if (p->type != REC_PAD) {
+            o = level_fd(p->level) == g_err_fd ? &g_err : &g_out;
+            if (OUT_BUF - o->len < ALOG_LINE_MAX + 32) out_flush(o);
+            o->len += format_rec(p, o->data + o->len, OUT_BUF - o->len);
+            n++;
+        }
+        tail += p->len;
+        if (n % 64 == 0) __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);  /* 尽早腾出空间 */
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void *writer_main(void *arg) {
+    struct alog_ring *r;
+    struct timespec until;
+    unsigned long moved, dropped, last_report = 0;
+    int stop;
+
+    (void)arg;
+    for (;;) {
+        moved = 0;
+        for (r = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) moved += drain_ring(r);
+        if (mono_ms() - last_report >= DROP_REPORT_MS || __atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+            last_report = mono_ms();
+            dropped = alog_dropped();
+            if (dropped != g_dropped) {
+                if (OUT_BUF - g_err.len < 64) out_flush(&g_err);  /* 上一条记录可能几乎占满缓冲 */
+                g_err.len += (size_t)sprintf(g_err.data + g_err.len, "alog: %lu records dropped (ring full)\n",
+                                             dropped - g_dropped);
+                g_dropped = dropped;
+            }
+        }
+        if (g_out.len > 0) out_flush(&g_out);
+        if (g_err.len > 0) out_flush(&g_err);
+
+        pthread_mutex_lock(&g_lock);
+        g_pass++;
+        pthread_cond_broadcast(&g_passed);
+        stop = g_stop;
+        if (moved == 0 && !stop) {
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += IDLE_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&g_wake, &g_lock, &until);
+        }
+        pthread_mutex_unlock(&g_lock);
+        if (stop && moved == 0) break;  /* 停止前再空跑一轮，确保排空 */
+    }
+    return NULL;
+}
+
+int alog_init(int out_fd, int err_fd) {
+    static int atexit_done = 0;
+    struct alog_ring *r;
+
+    pthread_once(&g_once, once_init);
+    if (g_running) return 0;
+    g_out_fd = g_out.fd = out_fd;
+    g_err_fd = g_err.fd = err_fd;
+    g_out.len = g_err.len = 0;
+    g_stop = 0;
+    /* fork 后的子进程：丢掉从父进程继承的未写记录，环本身继续用 */
+    for (r = g_rings; r != NULL; r = r->next) r->tail = r->head;
+    g_dropped = alog_dropped();
+    if (pthread_create(&g_writer, NULL, writer_main, NULL) != 0) return -1;
+    __atomic_store_n(&g_running, 1, __ATOMIC_RELEASE);
+    if (!atexit_done) {
+        atexit(alog_shutdown);
+        atexit_done = 1;
+    }
+    return 0;
+}
+
+void alog_flush(void) {
+    unsigned long target;
+
+    if (!__atomic_load_n(&g_running, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&g_lock);
+    target = g_pass + 2;          /* 等一整轮在本次调用之后开始的扫描 */
+    pthread_cond_signal(&g_wake);
+    while (g_pass < target) pthread_cond_wait(&g_passed, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void alog_shutdown(void) {
+    if (!__atomic_load_n(&g_running, __ATOMIC_ACQUIRE)) return;
+    alog_flush();
+    __atomic_store_n(&g_running, 0, __ATOMIC_RELEASE);  /* 之后的记录同步输出 */
+    pthread_mutex_lock(&g_lock);
+    g_stop = 1;
+    pthread_cond_signal(&g_wake);
+    pthread_mutex_unlock(&g_lock);
+    pthread_join(g_writer, NULL);
+}
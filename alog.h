@@ -0,0 +1,85 @@
+#ifndef ALOG_H
+#define ALOG_H
+
+#include <stdarg.h>        /* va_list */
+#include <stddef.h>        /* size_t */
+
+/*
+ * 异步日志：调用线程只把记录写进自己的无锁环形缓冲（单生产者单消费者），
+ * 由后台写线程集中取出、拼好后用 write() 成批写到输出，数据路径上不再
+ * 有 stdio 锁、不会因终端或管道写不动而阻塞。
+ *
+ * 环满时记录被丢弃并计数，写线程定期报告丢了多少条。同一线程的记录
+ * 保持顺序；不同线程之间只保证大致按时间先后。
+ *
+ * 三种记录：
+ *   alog_printf()  在调用线程格式化，写线程原样输出一行；
+ *   alog_write()   输出已拼好的一行；
+ *   alog_event()   高频事件只存事件号和 4 个整数，格式化推迟到写线程，
+ *                  调用方的开销只有几次存储。
+ *
+ * 逐包日志用 alog_allow()（每秒最多 N 条）或 alog_sample()（每 N 条取
+ * 一条）节流；alog_allow() 跳过的条数在下一秒汇总成一行输出。
+ *
+ * 未调用 alog_init()（或 fork 出的子进程还没有重新 alog_init()）时，
+ * 每条记录直接同步 write()，程序行为照旧只是没有异步的好处。
+ */
+
+#define ALOG_ERROR 0              /* 写到 err_fd */
+#define ALOG_WARN 1               /* 写到 err_fd */
+#define ALOG_INFO 2
+#define ALOG_DEBUG 3
+#define ALOG_TS 0x10              /* 与级别按位或：行首加 "[毫秒级墙钟时间] " */
+
+#define ALOG_RING_SIZE 65536      /* 每线程环形缓冲字节数（2 的幂） */
+#define ALOG_LINE_MAX 2048        /* 一行的最大长度，超出部分截断 */
+#define ALOG_EVENTS 64            /* 可定义的事件格式个数 */
+
+extern int alog_level;            /* 高于此级别的记录直接丢弃，默认 ALOG_INFO */
+
+/* 级别是否输出；用于跳过昂贵的参数准备 */
+#define ALOG_ENABLED(lvl) (((lvl) & 0x0f) <= alog_level)
+
+/* 节流状态，每个调用点一个，用 ALOG_LIMIT_INIT 静态初始化；可被多个线程共用 */
+struct alog_limit {
+    unsigned long window;         /* alog_allow：当前一秒窗口 */
+    unsigned long count;          /* 窗口内（或采样周期内）的调用次数 */
+    unsigned long suppressed;     /* 被跳过、尚未报告的条数 */
+};
+#define ALOG_LIMIT_INIT { 0, 0, 0 }
+
+/*
+ * 启动后台写线程：INFO/DEBUG 写到 out_fd，ERROR/WARN 写到 err_fd。
+ * 进程退出时（atexit）自动写完剩余记录。fork 后子进程需要重新调用。
+ * 成功返回 0，失败返回 -1（此后仍以同步方式输出）。
+ */
+int alog_init(int out_fd, int err_fd);
+
+/* 写完所有已提交的记录并停止写线程 */
+void alog_shutdown(void);
+
+/* 等到调用前提交的记录全部写出 */
+void alog_flush(void);
+
+void alog_printf(int level, const char *fmt, ...);
+void alog_vprintf(int level, const char *fmt, va_list ap);
+
+/* 输出 msg 的前 len 字节作为一行（不含换行） */
+void alog_write(int level, const char *msg, size_t len);
+
+/* 定义一个事件格式（最多 4 个 %lu 之类的整数转换），返回事件号；满了返回 -1 */
+int alog_event_define(const char *fmt);
+
+/* 提交一个事件；参数按定义的格式由写线程格式化 */
+void alog_event(int level, int id, unsigned long a, unsigned long b, unsigned long c, unsigned long d);
+
+/* 本秒内第 per_sec 条以内返回 1，否则计入 suppressed 并返回 0 */
+int alog_allow(struct alog_limit *l, unsigned long per_sec);
+
+/* 每 every 次调用返回一次 1，其余计入 suppressed 并返回 0 */
+int alog_sample(struct alog_limit *l, unsigned long every);
+
+/* 因环满丢弃的记录总数 */
+unsigned long alog_dropped(void);
+
+#endif /* ALOG_H */
@@ -0,0 +1,156 @@
+#include <string.h>  /* strcmp */
+#include "ascii_xform.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XFORM_X86
+#include <immintrin.h>  /* SSE2 / AVX2 intrinsics */
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define XFORM_NEON
+#include <arm_neon.h>
+#endif
+
+/* 标量实现：保持 tcp_server 原来的写法，编译器能把它向量化，
+ * 手写的无分支异或形式反而更慢 */
+static void upper_scalar(char *dst, const char *src, size_t n) {
+    size_t i;
+    char c;
+
+    for (i = 0; i < n; i++) {
+        c = src[i];
+        if (c >= 'a' && c <= 'z') c -= 32;
+        dst[i] = c;
+    }
+}
+
+#ifdef XFORM_X86
+#if defined(__SSE2__)
+/* SSE2：一次 16 字节。SSE2 只有有符号比较，先把 'a' 平移到 -128，
+ * 则 'a'..'z' 对应 -128..-103，小于 -102 即为小写字母 */
+static void upper_sse2(char *dst, const char *src, size_t n) {
+    const __m128i shift = _mm_set1_epi8((char)(128 - 'a'));
+    const __m128i limit = _mm_set1_epi8((char)(-128 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    __m128i v, m;
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(src + i));
+        m = _mm_cmplt_epi8(_mm_add_epi8(v, shift), limit);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, _mm_and_si128(m, flip)));
+    }
+    upper_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+/* AVX2：一次 32 字节，原理同 SSE2；仅在运行时检测到 AVX2 后调用 */
+__attribute__((target("avx2")))
+static void upper_avx2(char *dst, const char *src, size_t n) {
+    const __m256i shift = _mm256_set1_epi8((char)(128 - 'a'));
+    const __m256i limit = _mm256_set1_epi8((char)(-128 + 26));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    __m256i v, m;
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        v = _mm256_loadu_si256((const __m256i *)(src + i));
+        m = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, shift));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, _mm256_and_si256(m, flip)));
+    }
+    if (i + 16 <= n) {
+        /* 剩余不足 32 字节时再用一次 128 位操作，短消息不至于全走标量 */
+        __m128i v16 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i m16 = _mm_cmplt_epi8(_mm_add_epi8(v16, _mm256_castsi256_si128(shift)),
+                                     _mm256_castsi256_si128(limit));
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_xor_si128(v16, _mm_and_si128(m16, _mm256_castsi256_si128(flip))));
+        i += 16;
+    }
+    upper_scalar(dst + i, src + i, n - i);
+}
+#endif /* XFORM_X86 */
+
+#ifdef XFORM_NEON
+/* NEON：一次 16 字节，有无符号比较可直接用 c - 'a' < 26 */
+static void upper_neon(char *dst, const char *src, size_t n) {
+    const uint8x16_t a = vdupq_n_u8('a');
+    const uint8x16_t limit = vdupq_n_u8(26);
+    const uint8x16_t flip = vdupq_n_u8(0x20);
+    uint8x16_t v, m;
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        v = vld1q_u8((const uint8_t *)(src + i));
+        m = vcltq_u8(vsubq_u8(v, a), limit);
+        vst1q_u8((uint8_t *)(dst + i), veorq_u8(v, vandq_u8(m, flip)));
+    }
+    upper_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+/* 实现表，按优先级从高到低排列 */
+struct xform_impl {
+    const char *name;
+    ascii_xform_fn fn;
+};
+
+static const struct xform_impl impls[] = {
+#ifdef XFORM_X86
+    { "avx2", upper_avx2 },
+#if defined(__SSE2__)
+    { "sse2", upper_sse2 },
+#endif
+#endif
+#ifdef XFORM_NEON
+    { "neon", upper_neon },
+#endif
+    { "scalar", upper_scalar }
+};
+
+/* 首次调用时确定，与 inet_csum 相同：表项以一个指针 release 发布、acquire 读取，
+ * 并发首次调用的工作线程不会看到只写了一半的选择结果 */
+static const struct xform_impl *selected = NULL;
+
+/* 本机是否能运行名为 name 的实现 */
+static int impl_supported(const char *name) {
+#ifdef XFORM_X86
+    if (strcmp(name, "avx2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)name;
+    return 1;  /* 其余实现是编译目标的基线指令集 */
+}
+
+/* 取得本机支持的最快实现。并发首次调用时各线程选出同一表项，重复发布无害 */
+static const struct xform_impl *get_impl(void) {
+    const struct xform_impl *im = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    size_t i;
+
+    if (im != NULL) return im;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]) - 1; i++) {
+        if (impl_supported(impls[i].name)) break;
+    }
+    im = &impls[i];              /* 表尾的 scalar 总是可用 */
+    __atomic_store_n(&selected, im, __ATOMIC_RELEASE);
+    return im;
+}
+
+void ascii_upper(char *dst, const char *src, size_t n) {
+    get_impl()->fn(dst, src, n);
+}
+
+const char *ascii_upper_impl(void) {
+    return get_impl()->name;
+}
+
+ascii_xform_fn ascii_upper_get(const char *name) {
+    size_t i;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (strcmp(impls[i].name, name) == 0) {
+            return impl_supported(name) ? impls[i].fn : NULL;
+        }
+    }
+    return NULL;
+}
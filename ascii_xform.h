@@ -0,0 +1,23 @@
+#ifndef ASCII_XFORM_H
+#define ASCII_XFORM_H
+
+#include <stddef.h>  /* size_t */
+
+/*
+ * ASCII 小写转大写内核：'a'..'z' 转为 'A'..'Z'，其他字节原样复制。
+ * 提供标量、SSE2、AVX2（x86）与 NEON（ARM）实现，首次调用时按 CPU 能力选择。
+ * dst 可以等于 src（原地转换），但两者不能部分重叠。
+ */
+
+typedef void (*ascii_xform_fn)(char *dst, const char *src, size_t n);
+
+/* 使用当前 CPU 上最快的实现 */
+void ascii_upper(char *dst, const char *src, size_t n);
+
+/* 当前选中的实现名称："scalar"、"sse2"、"avx2" 或 "neon" */
+const char *ascii_upper_impl(void);
+
+/* 按名称取得某个实现（用于基准测试）；本机不支持或未编译时返回 NULL */
+ascii_xform_fn ascii_upper_get(const char *name);
+
+#endif /* ASCII_XFORM_H */
@@ -0,0 +1,200 @@
+/*
+ * Internet 校验和内核的微基准：对比 raw_icmp / raw_voice_proto 原有的 16 位逐字累加
+ * 与 inet_csum 各实现在常见报文长度下的吞吐，以及 csum_copy 与 memcpy + 校验和分两遍的差别。
+ * 用法：./bench_csum [总字节数MB]，建议以 make release 编译后运行。
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "inet_csum.h"
+
+#define MAX_LEN 65536
+
+/* raw_icmp 原实现：16 位逐字累加，奇数字节放在低地址字节 */
+static unsigned short legacy_checksum(unsigned short *ptr, int nbytes) {
+    unsigned long sum = 0UL;
+    unsigned short odd_byte = 0;
+
+    while (nbytes > 1) {
+        sum += (unsigned long)(*ptr);
+        ptr++;
+        nbytes -= 2;
+    }
+    if (nbytes == 1) {
+        *((unsigned char *)&odd_byte) = *((unsigned char *)ptr);
+        sum += (unsigned long)odd_byte;
+    }
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+    return (unsigned short)(~sum);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static volatile unsigned int sink;  /* 保存结果，防止编译器省略循环 */
+
+/* 原实现处理 total 字节（每次 len 字节），返回 MB/s */
+static double run_legacy(unsigned char *buf, size_t len, size_t total) {
+    size_t iters = total / len;
+    size_t i;
+    unsigned int acc = 0;
+    double t0, t1;
+
+    if (iters == 0) iters = 1;
+    t0 = now_sec();
+    for (i = 0; i < iters; i++) {
+        acc += legacy_checksum((unsigned short *)buf, (int)len);
+        buf[i % len] ^= (unsigned char)(acc & 1);  /* 制造依赖，防止编译器把调用提到循环外 */
+    }
+    t1 = now_sec();
+    sink = acc;
+    return (double)iters * (double)len / (t1 - t0) / 1e6;
+}
+
+static double run(csum_fn fn, unsigned char *buf, size_t len, size_t total) {
+    size_t iters = total / len;
+    size_t i;
+    unsigned int acc = 0;
+    double t0, t1;
+
+    if (iters == 0) iters = 1;
+    t0 = now_sec();
+    for (i = 0; i < iters; i++) {
+        acc += csum_fold(fn(buf, len, 0));
+        buf[i % len] ^= (unsigned char)(acc & 1);
+    }
+    t1 = now_sec();
+    sink = acc;
+    return (double)iters * (double)len / (t1 - t0) / 1e6;
+}
+
+/* 复制并求校验和：fn 为 NULL 时用 memcpy 加 csum 分两遍 */
+static double run_copy(csum_copy_fn fn, csum_fn csum, unsigned char *dst, unsigned char *src, size_t len, size_t total) {
+    size_t iters = total / len;
+    size_t i;
+    unsigned int acc = 0;
+    double t0, t1;
+
+    if (iters == 0) iters = 1;
+    t0 = now_sec();
+    for (i = 0; i < iters; i++) {
+        if (fn != NULL) {
+            acc += csum_fold(fn(dst, src, len, 0));
+        } else {
+            memcpy(dst, src, len);
+            acc += csum_fold(csum(dst, len, 0));
+        }
+        src[i % len] ^= (unsigned char)(acc & 1);
+    }
+    t1 = now_sec();
+    sink = acc;
+    return (double)iters * (double)len / (t1 - t0) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = { 20, 64, 576, 1500, 9000, MAX_LEN };
+    static const char *names[] = { "scalar", "sse2", "avx2", "neon" };
+    unsigned char *src, *dst, *al;
+    size_t total, i, k, n;
+    unsigned short ref;
+    unsigned int part;
+    csum_fn fn;
+    csum_copy_fn cp;
+    double base, mbs;
+
+    total = (size_t)(argc > 1 ? atoi(argv[1]) : 256) * 1024 * 1024;
+    src = (unsigned char *)malloc(MAX_LEN + 64);
+    dst = (unsigned char *)malloc(MAX_LEN + 64);
+    al = (unsigned char *)malloc(MAX_LEN + 64);  /* malloc 的结果满足 legacy_checksum 的 2 字节对齐 */
+    if (src == NULL || dst == NULL || al == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < MAX_LEN + 64; i++) src[i] = (unsigned char)(rand() & 0xff);
+
+#ifndef __OPTIMIZE__
+    printf("警告：未开启优化编译，结果仅供参考（请使用 make release）\n");
+#endif
+    printf("默认实现: %s, 每项处理 %lu MB\n", csum_impl(), (unsigned long)(total >> 20));
+
+    /* 正确性：任意起始偏移、任意长度（含奇数）都须与原实现一致，分段累加与整段一致，
+     * 融合复制的结果与数据都须正确 */
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        fn = csum_get(names[k]);
+        cp = csum_copy_get(names[k]);
+        if (fn == NULL) continue;
+        for (i = 0; i < 64; i++) {
+            for (n = 0; n < 600; n = n < 80 ? n + 1 : n * 2 + 1) {
+                memcpy(al, src + i, n);
+                ref = legacy_checksum((unsigned short *)al, (int)n);
+                if (csum_fold(fn(src + i, n, 0)) != ref) {
+                    fprintf(stderr, "%s: 结果与原实现不一致（偏移 %lu，长度 %lu）\n", names[k], (unsigned long)i, (unsigned long)n);
+                    return 1;
+                }
+                memset(dst, 0, n + 64);
+                if (csum_fold(cp(dst + (63 - i), src + i, n, 0)) != ref || memcmp(dst + (63 - i), src + i, n) != 0) {
+                    fprintf(stderr, "%s: 复制校验结果错误（偏移 %lu，长度 %lu）\n", names[k], (unsigned long)i, (unsigned long)n);
+                    return 1;
+                }
+                part = fn(src + i, n & ~(size_t)1, 0);
+                if (csum_fold(fn(src + i + (n & ~(size_t)1), n & 1, part)) != ref) {
+                    fprintf(stderr, "%s: 分段累加结果错误（长度 %lu）\n", names[k], (unsigned long)n);
+                    return 1;
+                }
+            }
+        }
+        memcpy(al, src, MAX_LEN);
+        if (csum_fold(fn(src, MAX_LEN, 0)) != legacy_checksum((unsigned short *)al, MAX_LEN)) {
+            fprintf(stderr, "%s: 长报文结果错误\n", names[k]);
+            return 1;
+        }
+    }
+    memset(al, 0xff, MAX_LEN);  /* 全 1 数据：检验进位回卷 */
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        fn = csum_get(names[k]);
+        if (fn != NULL && csum_fold(fn(al, MAX_LEN, 0)) != legacy_checksum((unsigned short *)al, MAX_LEN)) {
+            fprintf(stderr, "%s: 全 1 数据结果错误\n", names[k]);
+            return 1;
+        }
+    }
+
+    printf("%10s %12s", "长度", "原循环MB/s");
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        if (csum_get(names[k]) != NULL) printf(" %16s", names[k]);
+    }
+    printf("\n");
+
+    memcpy(al, src, MAX_LEN);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        base = run_legacy(al, sizes[i], total);
+        printf("%10lu %12.0f", (unsigned long)sizes[i], base);
+        for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+            fn = csum_get(names[k]);
+            if (fn == NULL) continue;
+            mbs = run(fn, src, sizes[i], total);
+            printf(" %9.0f(%5.1fx)", mbs, mbs / base);
+        }
+        printf("\n");
+    }
+
+    /* 复制 + 校验和：memcpy 后再用同一实现读一遍，对比一遍完成的 csum_copy */
+    printf("\n%s 复制并求校验和 MB/s\n", csum_impl());
+    printf("%10s %16s %16s\n", "长度", "memcpy+csum", "csum_copy");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        base = run_copy(NULL, csum_partial, dst, src, sizes[i], total);
+        mbs = run_copy(csum_copy, NULL, dst, src, sizes[i], total);
+        printf("%10lu %16.0f %9.0f(%5.1fx)\n", (unsigned long)sizes[i], base, mbs, mbs / base);
+    }
+
+    free(src);
+    free(dst);
+    free(al);
+    return 0;
+}
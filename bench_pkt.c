@@ -0,0 +1,56 @@
+/*
+ * 逐包热函数的微基准：raw_voice_proto 的 IP 封包/解包、raw_icmp 的回显请求构建与
+ * 回复解析、tcp_server 的消息处理。各程序的源文件在 bench_pkt_*.c 中直接编入，
+ * 测的就是发布的那份代码。结果与基线文件比较，慢于阈值时以非零状态退出。
+ * 用法：./bench_pkt [-b 基线文件] [-u] [-t 阈值%] [-m 每批ms] [-n 批数] [名字过滤]
+ * 一般通过 make bench / make bench-baseline 调用（-O2 编译）。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microbench.h"
+
+void bench_pkt_voice(void);
+void bench_pkt_icmp(void);
+void bench_pkt_tcp(void);
+
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [-b 基线文件] [-u] [-t 阈值%%] [-m 每批ms] [-n 批数] [名字过滤]\n", prog);
+    fprintf(stderr, "  -b 基线文件，默认 bench_baseline.txt\n");
+    fprintf(stderr, "  -u 把本次结果写成新的基线\n");
+    fprintf(stderr, "  -t 慢于基线超过该百分比视为退化，默认 10\n");
+    fprintf(stderr, "  -m / -n 每批时长与批数，默认 100ms × 7\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *baseline = "bench_baseline.txt";
+    double threshold = 10.0;
+    int update = 0;
+    int batch_ms = 0, samples = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0) {
+            update = 1;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            batch_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            mb_filter(argv[i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    mb_config(batch_ms, samples);
+
+    bench_pkt_voice();
+    bench_pkt_icmp();
+    bench_pkt_tcp();
+    return mb_report(baseline, threshold, update);
+}
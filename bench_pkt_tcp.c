@@ -0,0 +1,41 @@
+/*
+ * tcp_server 的逐消息函数：程序源文件整个编进来（main 改名），测的就是发布的那份
+ * process_packet（前缀 + 大写转换）。
+ */
+#define main tcp_server_main
+#include "tcp_server.c"
+#undef main
+#include "microbench.h"
+
+struct bt_ctx {
+    char data[BUFFER_SIZE];
+    ssize_t len;
+    char response[BUFFER_SIZE];
+};
+
+static void bt_process(void *arg, unsigned long iters) {
+    struct bt_ctx *c = (struct bt_ctx *)arg;
+    unsigned long acc = 0;
+    unsigned long i;
+
+    for (i = 0; i < iters; i++) {
+        process_packet(c->data, c->len, c->response);
+        acc += (unsigned char)c->response[c->len / 2];
+    }
+    mb_sink = acc;
+}
+
+void bench_pkt_tcp(void) {
+    static const int sizes[] = { 16, 64, 512, 1000 }; /* 1000 加上前缀仍在 BUFFER_SIZE 以内 */
+    static struct bt_ctx c;
+    char name[48];
+    size_t i;
+    int k;
+
+    for (k = 0; k < BUFFER_SIZE; k++) c.data[k] = (char)("hello, World 123 "[k % 17]);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        c.len = sizes[i];
+        sprintf(name, "tcp.process_packet/%d", sizes[i]);
+        mb_run(name, bt_process, &c, (size_t)sizes[i]);
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * raw_voice_proto 的逐包函数：程序源文件整个编进来（main 改名），测的就是发布的那份
+ * build_ip_packet / parse_ip_packet，static 函数也能直接调用；另测 4 帧聚合包的
+ * 编码（vb_add）与解码（vb_parse）。
+ */
+#define main raw_voice_proto_main
+#include "raw_voice_proto.c"
+#undef main
+#include "microbench.h"
+
+struct bv_ctx {
+    unsigned char pkt[2][MAX_PACKET_SIZE];  /* 两个不同的合法报文轮流解析，防止调用被提到循环外 */
+    int len;
+    unsigned char payload[PRIV_HDR_SIZE + FRAME_BYTES];
+    struct in_addr src, dst;
+    struct vb_frame frames[4];   /* 同一发送方连续 4 帧 */
+    struct vb_writer wr[2];      /* 两个不同的聚合包轮流解析 */
+};
+
+static void bv_build(void *arg, unsigned long iters) {
+    struct bv_ctx *c = (struct bv_ctx *)arg;
+    unsigned long acc = 0;
+    unsigned long i;
+
+    for (i = 0; i < iters; i++) {
+        acc += (unsigned long)build_ip_packet(c->pkt[0], c->src, c->dst, c->payload, (int)sizeof(c->payload));
+        acc += c->pkt[0][10];    /* 校验和字节 */
+    }
+    mb_sink = acc;
+}
+
+static void bv_parse(void *arg, unsigned long iters) {
+    struct bv_ctx *c = (struct bv_ctx *)arg;
+    struct in_addr from;
+    unsigned char *p;
+    int plen;
+    unsigned long acc = 0;
+    unsigned long i;
+
+    for (i = 0; i < iters; i++) {
+        if (parse_ip_packet(c->pkt[i & 1], c->len, &from, &p, &plen) > 0) acc += p[0] + from.s_addr;
+    }
+    mb_sink = acc;
+}
+
+static void bv_bundle(void *arg, unsigned long iters) {
+    struct bv_ctx *c = (struct bv_ctx *)arg;
+    unsigned long acc = 0;
+    unsigned long i;
+    int k;
+
+    for (i = 0; i < iters; i++) {
+        vb_begin(&c->wr[0], 1, 0, 4, 0);
+        for (k = 0; k < 4; k++) acc += (unsigned long)vb_add(&c->wr[0], &c->frames[k]);
+        acc += c->wr[0].len;
+    }
+    mb_sink = acc;
+}
+
+static void bv_unbundle(void *arg, unsigned long iters) {
+    struct bv_ctx *c = (struct bv_ctx *)arg;
+    struct vb_frame out[VB_MAX_FRAMES];
+    struct vb_info info;
+    unsigned long acc = 0;
+    unsigned long i;
+
+    for (i = 0; i < iters; i++) {
+        if (vb_parse(c->wr[i & 1].buf, (int)c->wr[i & 1].len, &info, out, VB_MAX_FRAMES) == 4)
+            acc += out[3].seq + out[3].data[0];
+    }
+    mb_sink = acc;
+}
+
+void bench_pkt_voice(void) {
+    static struct bv_ctx c;
+    int i;
+
+    for (i = 0; i < (int)sizeof(c.payload); i++) c.payload[i] = (unsigned char)(i * 7);
+    inet_pton(AF_INET, "10.0.0.1", &c.src);
+    inet_pton(AF_INET, "10.0.0.2", &c.dst);
+    c.len = build_ip_packet(c.pkt[0], c.src, c.dst, c.payload, (int)sizeof(c.payload));
+    c.payload[0] ^= 0xff;
+    build_ip_packet(c.pkt[1], c.src, c.dst, c.payload, (int)sizeof(c.payload));
+    c.payload[0] ^= 0xff;
+
+    for (i = 0; i < 4; i++) {
+        c.frames[i].id = 1;
+        c.frames[i].seq = 100 + (unsigned long)i;
+        c.frames[i].ts_sec = 1000;
+        c.frames[i].ts_usec = 20000UL * (unsigned long)i;
+        c.frames[i].data = c.payload + PRIV_HDR_SIZE;
+        c.frames[i].len = FRAME_BYTES;
+        c.frames[i].buf = NULL;
+    }
+    for (i = 0; i < 2; i++) {
+        int k;
+        vb_begin(&c.wr[i], 1, 0, 4, 0);
+        for (k = 0; k < 4; k++) {
+            c.frames[k].seq += 4;
+            vb_add(&c.wr[i], &c.frames[k]);
+        }
+    }
+
+    mb_run("voice.build_ip_packet", bv_build, &c, (size_t)c.len);
+    mb_run("voice.parse_ip_packet", bv_parse, &c, (size_t)c.len);
+    mb_run("voice.vb_add/4", bv_bundle, &c, c.wr[0].len);
+    mb_run("voice.vb_parse/4", bv_unbundle, &c, c.wr[0].len);
+}
@@ -0,0 +1,118 @@
+/*
+ * 大写转换内核的微基准：对比 tcp_server 原有的逐字节循环（含每条消息两次 memset）
+ * 与 ascii_xform 各实现在不同负载长度下的吞吐。
+ * 用法：./bench_xform [总字节数MB]，建议以 make release 编译后运行。
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ascii_xform.h"
+
+#define MAX_LEN (1024 * 1024)
+
+/* tcp_server 原实现：先清零两个缓冲，再逐字节判断 */
+static void legacy_upper(char *dst, const char *src, size_t n) {
+    size_t i;
+
+    memset(dst, 0, n + 1);
+    memset((char *)src + n, 0, 1);  /* 原代码在 recv 前清零接收缓冲，这里只清结尾以免破坏输入 */
+    for (i = 0; i < n; i++) {
+        if (src[i] >= 'a' && src[i] <= 'z') {
+            dst[i] = src[i] - 32;
+        } else {
+            dst[i] = src[i];
+        }
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* 以 fn 处理 total 字节（每次 len 字节），返回 MB/s */
+static double run(ascii_xform_fn fn, char *dst, char *src, size_t len, size_t total) {
+    size_t iters = total / len;
+    size_t i;
+    double t0, t1;
+
+    if (iters == 0) iters = 1;
+    t0 = now_sec();
+    for (i = 0; i < iters; i++) {
+        fn(dst, src, len);
+        src[i % len] ^= dst[len - 1] & 1;  /* 制造依赖，防止编译器省略循环 */
+    }
+    t1 = now_sec();
+    return (double)iters * (double)len / (t1 - t0) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536, MAX_LEN };
+    static const char *names[] = { "scalar", "sse2", "avx2", "neon" };
+    char *src, *dst, *ref;
+    size_t total, i, k;
+    ascii_xform_fn fn;
+    double base, mbs;
+
+    total = (size_t)(argc > 1 ? atoi(argv[1]) : 256) * 1024 * 1024;
+    src = (char *)malloc(MAX_LEN + 1);
+    dst = (char *)malloc(MAX_LEN + 1);
+    ref = (char *)malloc(MAX_LEN + 1);
+    if (src == NULL || dst == NULL || ref == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < MAX_LEN; i++) src[i] = (char)(rand() & 0xff);  /* 覆盖全部字节值 */
+
+#ifndef __OPTIMIZE__
+    printf("警告：未开启优化编译，结果仅供参考（请使用 make release）\n");
+#endif
+    printf("默认实现: %s, 每项处理 %lu MB\n", ascii_upper_impl(), (unsigned long)(total >> 20));
+
+    /* 正确性：各实现的输出必须与原循环一致（含原地转换） */
+    legacy_upper(ref, src, MAX_LEN);
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        fn = ascii_upper_get(names[k]);
+        if (fn == NULL) continue;
+        for (i = 0; i < 64; i++) {
+            fn(dst, src + i, MAX_LEN - 64);
+            if (memcmp(dst, ref + i, MAX_LEN - 64) != 0) {
+                fprintf(stderr, "%s: 输出与原实现不一致（偏移 %lu）\n", names[k], (unsigned long)i);
+                return 1;
+            }
+        }
+        memcpy(dst, src, MAX_LEN);
+        fn(dst, dst, MAX_LEN);
+        if (memcmp(dst, ref, MAX_LEN) != 0) {
+            fprintf(stderr, "%s: 原地转换结果错误\n", names[k]);
+            return 1;
+        }
+    }
+
+    printf("%10s %12s", "长度", "原循环MB/s");
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        if (ascii_upper_get(names[k]) != NULL) printf(" %16s", names[k]);
+    }
+    printf("\n");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        base = run(legacy_upper, dst, src, sizes[i], total);
+        printf("%10lu %12.0f", (unsigned long)sizes[i], base);
+        for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+            fn = ascii_upper_get(names[k]);
+            if (fn == NULL) continue;
+            mbs = run(fn, dst, src, sizes[i], total);
+            printf(" %9.0f(%5.1fx)", mbs, mbs / base);
+        }
+        printf("\n");
+    }
+
+    free(src);
+    free(dst);
+    free(ref);
+    return 0;
+}
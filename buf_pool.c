@@ -0,0 +1,151 @@
+#define _GNU_SOURCE  /* posix_memalign */
+
+#include <stdlib.h>
+#include <string.h>
+#include "buf_pool.h"
+
+#define CHUNK_BYTES 65536         /* per_chunk 为 0 时每块的目标大小 */
+#define ROUND_UP(n) (((n) + BP_ALIGN - 1) / BP_ALIGN * BP_ALIGN)
+#define PBUF_HDR ROUND_UP(sizeof(struct pbuf)) /* 数据区相对头部的偏移 */
+
+/* 各尺寸类的数据区容量：小报文、默认收发缓冲、MTU 级报文、页、大响应与 GSO/GRO 报文 */
+static const size_t class_size[PBUF_CLASSES] = { 256, 1024, 2048, 4096, 16384, 65536 };
+
+int slab_init(struct slab *s, size_t obj_size, unsigned int per_chunk, unsigned long limit) {
+    memset(s, 0, sizeof(*s));
+    if (obj_size < sizeof(void *)) obj_size = sizeof(void *);  /* 空闲时存放链表指针 */
+    s->obj_size = ROUND_UP(obj_size);
+    if (per_chunk == 0) per_chunk = (unsigned int)(CHUNK_BYTES / s->obj_size);
+    s->per_chunk = per_chunk > 0 ? per_chunk : 1;
+    s->limit = limit;
+    return 0;
+}
+
+void slab_destroy(struct slab *s) {
+    void *c, *next;
+
+    for (c = s->chunks; c != NULL; c = next) {
+        next = *(void **)c;
+        free(c);
+    }
+    s->chunks = NULL;
+    s->free = NULL;
+    s->total = 0;
+    s->in_use = 0;
+}
+
+/* 再申请一块对象挂到空闲链表；块首 BP_ALIGN 字节存放下一块的指针 */
+static int slab_grow(struct slab *s) {
+    unsigned long n = s->per_chunk;
+    void *mem;
+    char *obj;
+    unsigned long i;
+
+    if (s->limit != 0) {
+        if (s->total >= s->limit) return -1;
+        if (n > s->limit - s->total) n = s->limit - s->total;
+    }
+    if (posix_memalign(&mem, BP_ALIGN, BP_ALIGN + n * s->obj_size) != 0) return -1;
+    *(void **)mem = s->chunks;
+    s->chunks = mem;
+    obj = (char *)mem + BP_ALIGN;
+    for (i = 0; i < n; i++, obj += s->obj_size) {
+        *(void **)obj = s->free;
+        s->free = obj;
+    }
+    s->total += n;
+    return 0;
+}
+
+void *slab_alloc(struct slab *s) {
+    void *obj;
+
+    if (s->free == NULL && slab_grow(s) != 0) {
+        s->fails++;
+        return NULL;
+    }
+    obj = s->free;
+    s->free = *(void **)obj;
+    if (++s->in_use > s->high_water) s->high_water = s->in_use;
+    return obj;
+}
+
+void slab_free(struct slab *s, void *p) {
+    if (p == NULL) return;
+    *(void **)p = s->free;
+    s->free = p;
+    s->in_use--;
+}
+
+void slab_print_stats(const struct slab *s, const char *name, FILE *f) {
+    fprintf(f, "%s: obj %lu B, in use %lu, high water %lu, allocated %lu, failed %lu\n",
+            name, (unsigned long)s->obj_size, s->in_use, s->high_water, s->total, s->fails);
+}
+
+int pbuf_pool_init(struct pbuf_pool *p, unsigned long per_class_limit) {
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    for (i = 0; i < PBUF_CLASSES; i++) {
+        if (slab_init(&p->cls[i], PBUF_HDR + class_size[i], 0, per_class_limit) != 0) return -1;
+    }
+    return 0;
+}
+
+void pbuf_pool_destroy(struct pbuf_pool *p) {
+    int i;
+
+    for (i = 0; i < PBUF_CLASSES; i++) slab_destroy(&p->cls[i]);
+}
+
+struct pbuf *pbuf_get(struct pbuf_pool *p, size_t size) {
+    struct pbuf *b;
+    void *mem;
+    unsigned int c = 0;
+
+    while (c < PBUF_CLASSES && class_size[c] < size) c++;
+    if (c < PBUF_CLASSES) {
+        b = (struct pbuf *)slab_alloc(&p->cls[c]);
+        if (b == NULL) return NULL;
+        b->cap = class_size[c];
+    } else {                       /* 超过最大尺寸类：单独申请，放回时直接释放 */
+        if (size > (size_t)-1 - PBUF_HDR) return NULL;
+        if (posix_memalign(&mem, BP_ALIGN, PBUF_HDR + size) != 0) return NULL;
+        b = (struct pbuf *)mem;
+        b->cap = size;
+        p->oversize++;
+        p->oversize_in_use++;
+    }
+    b->pool = p;
+    b->cls = c;
+    b->refs = 1;
+    b->len = 0;
+    b->data = (unsigned char *)b + PBUF_HDR;
+    return b;
+}
+
+struct pbuf *pbuf_ref(struct pbuf *b) {
+    b->refs++;
+    return b;
+}
+
+void pbuf_put(struct pbuf *b) {
+    if (b == NULL || --b->refs > 0) return;
+    if (b->cls < PBUF_CLASSES) {
+        slab_free(&b->pool->cls[b->cls], b);
+    } else {
+        b->pool->oversize_in_use--;
+        free(b);
+    }
+}
+
+void pbuf_pool_print_stats(const struct pbuf_pool *p, FILE *f) {
+    char name[32];
+    int i;
+
+    for (i = 0; i < PBUF_CLASSES; i++) {
+        sprintf(name, "pbuf %lu", (unsigned long)class_size[i]);
+        slab_print_stats(&p->cls[i], name, f);
+    }
+    fprintf(f, "pbuf oversize: in use %lu, allocated %lu\n", p->oversize_in_use, p->oversize);
+}
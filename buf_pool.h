@@ -0,0 +1,93 @@
+#ifndef BUF_POOL_H
+#define BUF_POOL_H
+
+#include <stdio.h>         /* FILE */
+#include <stddef.h>        /* size_t */
+
+/*
+ * 对象 slab 与按尺寸分级的引用计数缓冲池，供事件循环在热路径上
+ * 取用连接状态和收发缓冲而不调用 malloc。
+ *
+ * slab 管理一种固定大小的对象：内存按块向系统申请，每个对象都从
+ * 缓存行（BP_ALIGN）边界开始，释放的对象挂在空闲链表上复用，直到
+ * slab_destroy() 才归还系统。pbuf_pool 是一组 slab，每个尺寸类一个，
+ * pbuf_get() 取不小于所需容量的最小类；超过最大类的请求直接 malloc
+ * 并单独计数。
+ *
+ * pbuf 带引用计数：接收路径拿到缓冲后，转发、排队等每多一个持有者
+ * 就 pbuf_ref() 一次，各自用完 pbuf_put()，最后一个放回时缓冲回到
+ * 所属的尺寸类，数据全程不复制。
+ *
+ * 池不加锁，引用计数也不是原子的：每个线程（或工作进程）使用自己
+ * 的池，缓冲不跨线程传递。
+ */
+
+#define BP_ALIGN 64               /* 缓存行大小：对象与数据区的对齐 */
+#define PBUF_CLASSES 6            /* 尺寸类个数，见 buf_pool.c 中的 class_size */
+
+/* 一种固定大小对象的分配器及其占用统计 */
+struct slab {
+    size_t obj_size;              /* 对象大小，已向上取整到 BP_ALIGN */
+    unsigned int per_chunk;       /* 每次向系统申请的对象个数 */
+    unsigned long limit;          /* 对象总数上限，0 表示不限 */
+    void *chunks;                 /* 已申请块的链表，用于 slab_destroy() */
+    void *free;                   /* 空闲对象链表 */
+    unsigned long total;          /* 已申请的对象总数（空闲 + 在用） */
+    unsigned long in_use;         /* 在用对象数 */
+    unsigned long high_water;     /* in_use 的历史最大值 */
+    unsigned long fails;          /* 分配失败次数（达到上限或内存不足） */
+};
+
+/* 引用计数数据缓冲；data 指向紧跟在头部之后、对齐到 BP_ALIGN 的数据区 */
+struct pbuf {
+    struct pbuf_pool *pool;       /* 所属的池 */
+    unsigned int cls;             /* 尺寸类下标，PBUF_CLASSES 表示单独 malloc 的大缓冲 */
+    unsigned int refs;            /* 持有者个数 */
+    size_t cap;                   /* 数据区容量 */
+    size_t len;                   /* 已用长度，由使用者维护 */
+    unsigned char *data;
+};
+
+struct pbuf_pool {
+    struct slab cls[PBUF_CLASSES];
+    unsigned long oversize;       /* 超过最大尺寸类、直接 malloc 的次数 */
+    unsigned long oversize_in_use; /* 仍未放回的大缓冲个数 */
+};
+
+/*
+ * 初始化 slab：对象大小 obj_size，每次申请 per_chunk 个（0 表示按约
+ * 64 KB 一块估算），最多 limit 个对象（0 表示不限）。成功返回 0。
+ */
+int slab_init(struct slab *s, size_t obj_size, unsigned int per_chunk, unsigned long limit);
+
+/* 释放 slab 的全部内存，之前分配的对象随之失效 */
+void slab_destroy(struct slab *s);
+
+/* 取一个对象（内容未初始化），失败返回 NULL */
+void *slab_alloc(struct slab *s);
+
+/* 放回 slab_alloc() 得到的对象；p 为 NULL 时什么也不做 */
+void slab_free(struct slab *s, void *p);
+
+/* 打印一行占用统计，name 用作行首标签 */
+void slab_print_stats(const struct slab *s, const char *name, FILE *f);
+
+/* 初始化缓冲池；每个尺寸类最多 per_class_limit 个缓冲（0 表示不限） */
+int pbuf_pool_init(struct pbuf_pool *p, unsigned long per_class_limit);
+
+/* 释放整个池；仍在外面的小缓冲随之失效，大缓冲需先 pbuf_put() */
+void pbuf_pool_destroy(struct pbuf_pool *p);
+
+/* 取一个容量不小于 size 的缓冲，len 为 0、引用计数为 1；失败返回 NULL */
+struct pbuf *pbuf_get(struct pbuf_pool *p, size_t size);
+
+/* 增加一个持有者，返回 b 本身 */
+struct pbuf *pbuf_ref(struct pbuf *b);
+
+/* 放弃一个持有者；计数归零时缓冲回到池中。b 为 NULL 时什么也不做 */
+void pbuf_put(struct pbuf *b);
+
+/* 每个尺寸类打印一行占用统计 */
+void pbuf_pool_print_stats(const struct pbuf_pool *p, FILE *f);
+
+#endif /* BUF_POOL_H */
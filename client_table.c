@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "client_table.h"
+
+/* A snapshot (and the entries it alone referenced) waiting for readers to leave */
+struct ct_retired
+{
+    struct ct_retired *next;
+    struct ct_snap *snap;
+    struct ct_entry **dead;       /* entries to free with the snapshot */
+    unsigned int ndead;
+    unsigned long gen;            /* free once every reader is at gen or later */
+};
+
+/* One cache line per reader so announcing a section does not bounce others */
+struct ct_reader
+{
+    unsigned long gen;            /* generation entered under, 0 = outside */
+    char pad[64 - sizeof(unsigned long)];
+};
+
+struct client_table
+{
+    pthread_mutex_t lock;         /* serializes writers */
+    unsigned int capacity;
+    struct ct_snap *cur;          /* published snapshot, swapped atomically */
+    unsigned long gen;            /* bumped after every publish, starts at 1 */
+    int nreaders;
+    struct ct_reader readers[CT_MAX_READERS];
+    struct ct_retired *retired;
+};
+
+static unsigned long ct_hash(unsigned long id)
+{
+    unsigned long h = id * 2654435761UL;
+    return h ^ (h >> 15);
+}
+
+static void snap_free(struct ct_snap *s)
+{
+    if (s == NULL)
+        return;
+    free(s->index);
+    free(s);
+}
+
+/* Build an immutable snapshot over members[0..count) */
+static struct ct_snap *snap_build(struct ct_entry *const *members, unsigned int count)
+{
+    struct ct_snap *s;
+    unsigned int nslots = 4;
+    unsigned int i, j;
+
+    s = (struct ct_snap *)malloc(sizeof(*s) + (count > 0 ? count - 1 : 0) * sizeof(s->members[0]));
+    if (s == NULL)
+        return NULL;
+    while (nslots < 2 * count)
+        nslots *= 2;
+    s->index = (struct ct_entry **)calloc(nslots, sizeof(s->index[0]));
+    if (s->index == NULL) {
+        free(s);
+        return NULL;
+    }
+    s->count = count;
+    s->mask = nslots - 1;
+    for (i = 0; i < count; i++) {
+        s->members[i] = members[i];
+        j = (unsigned int)ct_hash(members[i]->id) & s->mask;
+        while (s->index[j] != NULL)
+            j = (j + 1) & s->mask;
+        s->index[j] = members[i];
+    }
+    return s;
+}
+
+/* Free retired snapshots that no reader can still see (lock held) */
+static void ct_reclaim(struct client_table *t)
+{
+    struct ct_retired **pp, *r;
+    unsigned long min_gen = (unsigned long)-1, g;
+    unsigned int i;
+    int n;
+
+    n = __atomic_load_n(&t->nreaders, __ATOMIC_ACQUIRE);
+    if (n > CT_MAX_READERS)
+        n = CT_MAX_READERS;
+    for (i = 0; i < (unsigned int)n; i++) {
+        g = __atomic_load_n(&t->readers[i].gen, __ATOMIC_SEQ_CST);
+        if (g != 0 && g < min_gen)
+            min_gen = g;
+    }
+    pp = &t->retired;
+    while ((r = *pp) != NULL) {
+        if (r->gen <= min_gen) {
+            *pp = r->next;
+            for (i = 0; i < r->ndead; i++)
+                free(r->dead[i]);
+            free(r->dead);
+            snap_free(r->snap);
+            free(r);
+        } else {
+            pp = &r->next;
+        }
+    }
+}
+
+/* Switch readers to snap and retire the previous snapshot together with
+   the entries it no longer shares (lock held; dead is taken over) */
+static void ct_publish(struct client_table *t, struct ct_snap *snap,
+                       struct ct_entry **dead, unsigned int ndead)
+{
+    struct ct_retired *r;
+    struct ct_snap *old = t->cur;
+    unsigned long gen;
+
+    __atomic_store_n(&t->cur, snap, __ATOMIC_SEQ_CST);
+    gen = __atomic_add_fetch(&t->gen, 1, __ATOMIC_SEQ_CST);
+
+    r = (struct ct_retired *)malloc(sizeof(*r));
+    if (r == NULL) {
+        /* cannot defer: leak rather than free memory a reader may hold */
+        free(dead);
+        return;
+    }
+    r->snap = old;
+    r->dead = dead;
+    r->ndead = ndead;
+    r->gen = gen;
+    r->next = t->retired;
+    t->retired = r;
+    ct_reclaim(t);
+}
+
+struct client_table *ct_create(unsigned int capacity)
+{
+    struct client_table *t;
+
+    t = (struct client_table *)calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->cur = snap_build(NULL, 0);
+    if (t->cur == NULL) {
+        free(t);
+        return NULL;
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    t->capacity = capacity;
+    t->gen = 1;
+    return t;
+}
+
+void ct_destroy(struct client_table *t)
+{
+    struct ct_retired *r;
+    unsigned int i;
+
+    if (t == NULL)
+        return;
+    while ((r = t->retired) != NULL) {
+        t->retired = r->next;
+        for (i = 0; i < r->ndead; i++)
+            free(r->dead[i]);
+        free(r->dead);
+        snap_free(r->snap);
+        free(r);
+    }
+    for (i = 0; i < t->cur->count; i++)
+        free(t->cur->members[i]);
+    snap_free(t->cur);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+int ct_reader_register(struct client_table *t)
+{
+    int id = __atomic_fetch_add(&t->nreaders, 1, __ATOMIC_ACQ_REL);
+    return id < CT_MAX_READERS ? id : -1;
+}
+
+const struct ct_snap *ct_read_begin(struct client_table *t, int reader)
+{
+    unsigned long gen = __atomic_load_n(&t->gen, __ATOMIC_SEQ_CST);
+    /* the announcement must be visible before the snapshot pointer is read */
+    __atomic_store_n(&t->readers[reader].gen, gen, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&t->cur, __ATOMIC_SEQ_CST);
+}
+
+void ct_read_end(struct client_table *t, int reader)
+{
+    __atomic_store_n(&t->readers[reader].gen, 0UL, __ATOMIC_RELEASE);
+}
+
+struct ct_entry *ct_lookup(const struct ct_snap *s, unsigned long id)
+{
+    unsigned int j = (unsigned int)ct_hash(id) & s->mask;
+    while (s->index[j] != NULL) {
+        if (s->index[j]->id == id)
+            return s->index[j];
+        j = (j + 1) & s->mask;
+    }
+    return NULL;
+}
+
+void ct_touch(struct ct_entry *e, unsigned long now_ms)
+{
+    /* skip the store when unchanged to keep the line shared between readers */
+    if (__atomic_load_n(&e->last_seen_ms, __ATOMIC_RELAXED) != now_ms)
+        __atomic_store_n(&e->last_seen_ms, now_ms, __ATOMIC_RELAXED);
+}
+
+void ct_set_bundle(struct ct_entry *e, int bundle, int loss)
+{
+    if (__atomic_load_n(&e->bundle, __ATOMIC_RELAXED) != bundle)
+        __atomic_store_n(&e->bundle, bundle, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&e->loss, __ATOMIC_RELAXED) != loss)
+        __atomic_store_n(&e->loss, loss, __ATOMIC_RELAXED);
+}
+
+int ct_same_addr(const struct ct_entry *e, const struct sockaddr_in *addr,
+                 const unsigned char *lladdr, unsigned int lladdr_len)
+{
+    if (e->addr.sin_addr.s_addr != addr->sin_addr.s_addr || e->addr.sin_port != addr->sin_port)
+        return 0;
+    if (lladdr_len > CT_LLADDR_MAX)
+        lladdr_len = CT_LLADDR_MAX;
+    return e->lladdr_len == lladdr_len && (lladdr_len == 0 || memcmp(e->lladdr, lladdr, lladdr_len) == 0);
+}
+
+int ct_register(struct client_table *t, unsigned long id, const struct sockaddr_in *addr,
+                const unsigned char *lladdr, unsigned int lladdr_len, unsigned long now_ms)
+{
+    struct ct_entry **members, **dead = NULL;
+    struct ct_entry *old, *e;
+    struct ct_snap *cur, *snap;
+    unsigned int i, n;
+    int ret = -1;
+
+    pthread_mutex_lock(&t->lock);
+    cur = t->cur;
+    old = ct_lookup(cur, id);
+    if (lladdr_len > CT_LLADDR_MAX)
+        lladdr_len = CT_LLADDR_MAX;
+    if (old != NULL && ct_same_addr(old, addr, lladdr, lladdr_len)) {
+        ct_touch(old, now_ms);
+        ret = 0;
+        goto out;
+    }
+    if (old == NULL && cur->count >= t->capacity)
+        goto out;
+
+    e = (struct ct_entry *)malloc(sizeof(*e));
+    n = cur->count + (old == NULL ? 1 : 0);
+    members = (struct ct_entry **)malloc(n * sizeof(members[0]));
+    if (old != NULL)
+        dead = (struct ct_entry **)malloc(sizeof(dead[0]));
+    if (e == NULL || members == NULL || (old != NULL && dead == NULL)) {
+        free(e);
+        free(members);
+        free(dead);
+        goto out;
+    }
+    e->id = id;
+    e->addr = *addr;
+    memset(e->lladdr, 0, sizeof(e->lladdr));
+    if (lladdr_len > 0)
+        memcpy(e->lladdr, lladdr, lladdr_len);
+    e->lladdr_len = lladdr_len;
+    e->last_seen_ms = now_ms;
+    /* an address change keeps what was negotiated */
+    e->bundle = old != NULL ? __atomic_load_n(&old->bundle, __ATOMIC_RELAXED) : 0;
+    e->loss = old != NULL ? __atomic_load_n(&old->loss, __ATOMIC_RELAXED) : -1;
+
+    /* readers may still use the replaced entry, so the new address goes
+       into a fresh entry and the old one is retired with the snapshot */
+    for (i = 0; i < cur->count; i++)
+        members[i] = cur->members[i] == old ? e : cur->members[i];
+    if (old == NULL)
+        members[cur->count] = e;
+    snap = snap_build(members, n);
+    free(members);
+    if (snap == NULL) {
+        free(e);
+        free(dead);
+        goto out;
+    }
+    if (old != NULL)
+        dead[0] = old;
+    ct_publish(t, snap, dead, old != NULL ? 1 : 0);
+    ret = old == NULL ? 1 : 0;
+out:
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
+
+unsigned int ct_expire(struct client_table *t, unsigned long now_ms, unsigned long idle_ms)
+{
+    struct ct_entry **keep, **dead;
+    struct ct_snap *cur, *snap;
+    unsigned int i, nkeep = 0, ndead = 0;
+    unsigned long seen;
+
+    pthread_mutex_lock(&t->lock);
+    cur = t->cur;
+    keep = (struct ct_entry **)malloc((cur->count + 1) * sizeof(keep[0]));
+    dead = (struct ct_entry **)malloc((cur->count + 1) * sizeof(dead[0]));
+    if (keep == NULL || dead == NULL) {
+        free(keep);
+        free(dead);
+        ct_reclaim(t);
+        pthread_mutex_unlock(&t->lock);
+        return 0;
+    }
+    for (i = 0; i < cur->count; i++) {
+        seen = __atomic_load_n(&cur->members[i]->last_seen_ms, __ATOMIC_RELAXED);
+        if (now_ms - seen > idle_ms && now_ms > seen)
+            dead[ndead++] = cur->members[i];
+        else
+            keep[nkeep++] = cur->members[i];
+    }
+    snap = ndead > 0 ? snap_build(keep, nkeep) : NULL;
+    free(keep);
+    if (snap != NULL) {
+        ct_publish(t, snap, dead, ndead);
+    } else {
+        free(dead);
+        ndead = 0;
+        ct_reclaim(t);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return ndead;
+}
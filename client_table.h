@@ -0,0 +1,82 @@
+#ifndef CLIENT_TABLE_H
+#define CLIENT_TABLE_H
+
+#include <netinet/in.h>  /* struct sockaddr_in */
+
+/*
+ * Voice room membership with a lock-free read path.
+ *
+ * Readers (the receive/forward loop) see an immutable snapshot: a hash
+ * index by client id plus a flat member array for fan-out. The only
+ * per-packet write is the last_seen_ms of an existing entry, stored
+ * atomically. Joins, address changes and expiry take the table mutex,
+ * build a new snapshot and publish it with one atomic pointer store.
+ *
+ * Old snapshots are reclaimed RCU-style: every reader thread owns a slot
+ * where it announces the generation it entered under, and a retired
+ * snapshot is freed only once no reader can still be inside it. Writers
+ * never wait for readers; reclamation is retried on later updates and by
+ * ct_expire().
+ */
+
+#define CT_MAX_READERS 64         /* reader threads per table */
+#define CT_LLADDR_MAX 8           /* longest link-layer address kept */
+
+struct ct_entry
+{
+    unsigned long id;
+    struct sockaddr_in addr;
+    unsigned char lladdr[CT_LLADDR_MAX]; /* link-layer next hop, learned from received frames */
+    unsigned int lladdr_len;      /* 0 if unknown */
+    unsigned long last_seen_ms;   /* updated by readers, atomically */
+    int bundle;                   /* largest multi-frame packet it accepts, 0 = single frames */
+    int loss;                     /* loss percent it last reported on what it receives */
+};
+
+struct ct_snap
+{
+    unsigned int count;           /* members[0..count) */
+    unsigned int mask;            /* index has mask + 1 slots (power of two) */
+    struct ct_entry **index;      /* open-addressed by id, NULL = empty */
+    struct ct_entry *members[1];  /* allocated with room for count entries */
+};
+
+struct client_table;              /* opaque */
+
+/* Create a table admitting at most capacity members; NULL on failure */
+struct client_table *ct_create(unsigned int capacity);
+void ct_destroy(struct client_table *t);
+
+/* Claim a reader slot for the calling thread; returns its id or -1 */
+int ct_reader_register(struct client_table *t);
+
+/* Enter / leave a read-side section; the snapshot stays valid in between */
+const struct ct_snap *ct_read_begin(struct client_table *t, int reader);
+void ct_read_end(struct client_table *t, int reader);
+
+/* Find a member in a snapshot (O(1) expected); NULL if absent */
+struct ct_entry *ct_lookup(const struct ct_snap *s, unsigned long id);
+
+/* Record activity of an entry found through ct_lookup() */
+void ct_touch(struct ct_entry *e, unsigned long now_ms);
+
+/* Record what the member advertised about bundling (atomic, like ct_touch) */
+void ct_set_bundle(struct ct_entry *e, int bundle, int loss);
+
+/*
+ * Add a member or update its addresses (writer path, takes the mutex).
+ * lladdr may be NULL (lladdr_len 0) when the link-layer source is unknown.
+ * Returns 1 if added, 0 if updated or unchanged, -1 if the room is full
+ * or memory ran out.
+ */
+int ct_register(struct client_table *t, unsigned long id, const struct sockaddr_in *addr,
+                const unsigned char *lladdr, unsigned int lladdr_len, unsigned long now_ms);
+
+/* Nonzero if e already has exactly this IP address and link-layer address */
+int ct_same_addr(const struct ct_entry *e, const struct sockaddr_in *addr,
+                 const unsigned char *lladdr, unsigned int lladdr_len);
+
+/* Remove members idle for more than idle_ms; returns how many were removed */
+unsigned int ct_expire(struct client_table *t, unsigned long now_ms, unsigned long idle_ms);
+
+#endif /* CLIENT_TABLE_H */
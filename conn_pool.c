@@ -0,0 +1,307 @@
+#define _GNU_SOURCE              /* SOCK_NONBLOCK、MSG_NOSIGNAL */
+
+#include <stdlib.h>              /* calloc, free */
+#include <errno.h>               /* errno */
+#include <unistd.h>              /* close */
+#include <sys/socket.h>          /* socket, connect, send, recv */
+#include <netinet/tcp.h>         /* TCP_NODELAY, TCP_FASTOPEN_CONNECT */
+#include "poller.h"
+#include "frame.h"
+#include "conn_pool.h"
+
+#define MAX_EVENTS 64
+#define RECV_CHUNK 65536         /* 每次 recv 预留的空间 */
+
+/* 一个挂起的请求 */
+struct cp_req {
+    unsigned long tag;
+    size_t len;                  /* 请求长度，CP_ECHO 据此切分响应 */
+};
+
+struct cp_conn {
+    int fd;                      /* -1：尚未连接（或已出错关闭） */
+    int connecting;              /* 非阻塞 connect 尚未完成 */
+    unsigned int events;         /* 当前关注的 POLLER_* */
+    struct frame_buf in;         /* 尚未切分的响应 */
+    struct frame_buf out;        /* 尚未发出的请求 */
+    struct cp_req *reqs;         /* depth 个槽位的环形队列，按提交顺序 */
+    int head;
+    int count;
+};
+
+struct conn_pool {
+    struct cp_config cfg;
+    struct poller *poller;
+    struct cp_conn *conns;
+    int next;                    /* 下一次提交从这条连接开始找 */
+    int inflight;
+};
+
+struct conn_pool *cp_create(const struct cp_config *cfg) {
+    struct conn_pool *p;
+    int i;
+
+    if (cfg->conns <= 0 || cfg->depth <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    p = (struct conn_pool *)calloc(1, sizeof(*p));
+    if (p == NULL) return NULL;
+    p->cfg = *cfg;
+    if (p->cfg.proto == CP_RAW) p->cfg.depth = 1;  /* 响应没有边界，只能一问一答 */
+    p->poller = poller_create(POLLER_AUTO);
+    p->conns = (struct cp_conn *)calloc((size_t)p->cfg.conns, sizeof(p->conns[0]));
+    /* 先把所有 fd 置为 -1：下面任何一步失败，cp_destroy 都不会去关 fd 0 */
+    for (i = 0; p->conns != NULL && i < p->cfg.conns; i++) p->conns[i].fd = -1;
+    if (p->poller == NULL || p->conns == NULL) {
+        cp_destroy(p);
+        return NULL;
+    }
+    for (i = 0; i < p->cfg.conns; i++) {
+        p->conns[i].reqs = (struct cp_req *)calloc((size_t)p->cfg.depth, sizeof(struct cp_req));
+        if (p->conns[i].reqs == NULL) {
+            cp_destroy(p);
+            return NULL;
+        }
+    }
+    return p;
+}
+
+/* 按连接状态调整关注的事件：有待发数据（或正在连接）时才关注可写 */
+static void cp_want(struct conn_pool *p, struct cp_conn *c) {
+    unsigned int ev = POLLER_IN;
+
+    if (c->connecting || frame_buf_pending(&c->out) > 0) ev |= POLLER_OUT;
+    if (ev != c->events && poller_mod(p->poller, c->fd, ev, c) == 0) c->events = ev;
+}
+
+/* 建立一条非阻塞连接，成功返回 0 */
+static int cp_open(struct conn_pool *p, struct cp_conn *c) {
+    int fd, on = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (p->cfg.nodelay) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef TCP_FASTOPEN_CONNECT
+    /* connect 立即返回，第一次 send 的数据随 SYN 发出；内核不支持时忽略 */
+    if (p->cfg.fastopen) setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on));
+#endif
+    c->connecting = 0;
+    if (connect(fd, (const struct sockaddr *)&p->cfg.addr, sizeof(p->cfg.addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return -1;
+        }
+        c->connecting = 1;
+    }
+    c->events = POLLER_IN | POLLER_OUT;
+    if (poller_add(p->poller, fd, c->events, c) != 0) {
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    return 0;
+}
+
+/* 关闭连接，其上挂起的请求以 err 失败；返回失败的请求数 */
+static int cp_fail(struct conn_pool *p, struct cp_conn *c, int err, cp_done_fn done, void *ctx) {
+    struct cp_req r;
+    int n = c->count;
+
+    poller_del(p->poller, c->fd);
+    close(c->fd);
+    c->fd = -1;
+    c->connecting = 0;
+    c->events = 0;
+    frame_buf_consume(&c->in, frame_buf_pending(&c->in));
+    frame_buf_consume(&c->out, frame_buf_pending(&c->out));
+    while (c->count > 0) {
+        r = c->reqs[c->head];
+        c->head = (c->head + 1) % p->cfg.depth;
+        c->count--;
+        p->inflight--;
+        if (done != NULL) done(ctx, r.tag, err != 0 ? err : EIO, NULL, 0);
+    }
+    c->head = 0;
+    return n;
+}
+
+int cp_submit(struct conn_pool *p, const char *msg, size_t len, unsigned long tag) {
+    struct cp_conn *c = NULL;
+    int i, k, r;
+
+    for (k = 0; k < p->cfg.conns; k++) {
+        i = (p->next + k) % p->cfg.conns;
+        if (p->conns[i].count < p->cfg.depth) {
+            c = &p->conns[i];
+            p->next = (i + 1) % p->cfg.conns;  /* 轮流使用各连接 */
+            break;
+        }
+    }
+    if (c == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (p->cfg.proto == CP_FRAMED && len > FRAME_REQ_MAX) {
+        errno = EMSGSIZE;        /* 服务器会拒绝并断开，不必发出 */
+        return -1;
+    }
+    if (c->fd < 0 && cp_open(p, c) != 0) return -1;
+
+    if (p->cfg.proto == CP_FRAMED) r = frame_append(&c->out, msg, len);
+    else r = frame_buf_append(&c->out, msg, len);
+    if (r != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    c->reqs[(c->head + c->count) % p->cfg.depth].tag = tag;
+    c->reqs[(c->head + c->count) % p->cfg.depth].len = len;
+    c->count++;
+    p->inflight++;
+    cp_want(p, c);
+    return 0;
+}
+
+/* 最早的挂起请求完成 */
+static void cp_complete(struct conn_pool *p, struct cp_conn *c, const char *resp, size_t len,
+                        cp_done_fn done, void *ctx) {
+    struct cp_req r = c->reqs[c->head];
+
+    c->head = (c->head + 1) % p->cfg.depth;
+    c->count--;
+    p->inflight--;
+    if (done != NULL) done(ctx, r.tag, 0, resp, len);
+}
+
+/* 尽量发出待发数据；失败返回 -1 */
+static int cp_flush(struct cp_conn *c) {
+    ssize_t n;
+
+    while (frame_buf_pending(&c->out) > 0) {
+        n = send(c->fd, c->out.data + c->out.off, frame_buf_pending(&c->out), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        /* TFO 还没有 cookie 时返回 EINPROGRESS：等握手完成后再写 */
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS)) return 0;
+        if (n < 0) return -1;
+        frame_buf_consume(&c->out, (size_t)n);
+    }
+    return 0;
+}
+
+/* 读一次并按协议切出完整的响应；返回完成数，连接出错或协议错误返回 -1 */
+static int cp_read(struct conn_pool *p, struct cp_conn *c, cp_done_fn done, void *ctx) {
+    const char *msg;
+    size_t len;
+    ssize_t n;
+    int got = 0;
+    int r = 0;
+
+    if (frame_buf_reserve(&c->in, RECV_CHUNK) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    n = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    if (n == 0) {
+        errno = EPIPE;
+        return -1;
+    }
+    c->in.len += (size_t)n;
+
+    switch (p->cfg.proto) {
+    case CP_FRAMED:
+        while (c->count > 0 && (r = frame_next(&c->in, &msg, &len)) == 1) {
+            cp_complete(p, c, msg, len, done, ctx);
+            got++;
+        }
+        if (r < 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        frame_buf_consume(&c->in, 0);  /* 全部切完时复位缓冲 */
+        break;
+    case CP_ECHO:
+        while (c->count > 0 && frame_buf_pending(&c->in) >= c->reqs[c->head].len) {
+            len = c->reqs[c->head].len;
+            cp_complete(p, c, c->in.data + c->in.off, len, done, ctx);
+            frame_buf_consume(&c->in, len);
+            got++;
+        }
+        break;
+    case CP_RAW:
+        if (c->count > 0) {
+            len = frame_buf_pending(&c->in);
+            cp_complete(p, c, c->in.data + c->in.off, len, done, ctx);
+            frame_buf_consume(&c->in, len);
+            got++;
+        }
+        break;
+    }
+    if (c->count == 0 && frame_buf_pending(&c->in) > 0) {
+        errno = EPROTO;          /* 没有请求与之对应的多余数据 */
+        return -1;
+    }
+    return got;
+}
+
+int cp_poll(struct conn_pool *p, int timeout_ms, cp_done_fn done, void *ctx) {
+    struct poller_event evs[MAX_EVENTS];
+    struct cp_conn *c;
+    socklen_t elen;
+    int n, i, r, err;
+    int got = 0;
+
+    n = poller_wait(p->poller, evs, MAX_EVENTS, timeout_ms);
+    if (n < 0) return -1;
+    for (i = 0; i < n; i++) {
+        c = (struct cp_conn *)evs[i].data;
+        if (c->fd < 0) continue;
+        if (c->connecting && (evs[i].events & (POLLER_OUT | POLLER_ERR))) {
+            err = 0;
+            elen = sizeof(err);
+            getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &elen);
+            if (err != 0) {
+                got += cp_fail(p, c, err, done, ctx);
+                continue;
+            }
+            c->connecting = 0;
+        }
+        if ((evs[i].events & POLLER_OUT) && !c->connecting && cp_flush(c) != 0) {
+            got += cp_fail(p, c, errno, done, ctx);
+            continue;
+        }
+        if (evs[i].events & (POLLER_IN | POLLER_ERR)) {
+            /* 出错时也先读：错误之前到达的响应仍然有效 */
+            r = cp_read(p, c, done, ctx);
+            if (r < 0) {
+                got += cp_fail(p, c, errno, done, ctx);
+                continue;
+            }
+            got += r;
+        }
+        cp_want(p, c);
+    }
+    return got;
+}
+
+int cp_inflight(const struct conn_pool *p) {
+    return p->inflight;
+}
+
+void cp_destroy(struct conn_pool *p) {
+    int i;
+
+    if (p == NULL) return;
+    for (i = 0; p->conns != NULL && i < p->cfg.conns; i++) {
+        if (p->conns[i].fd >= 0) {
+            if (p->poller != NULL) poller_del(p->poller, p->conns[i].fd);
+            close(p->conns[i].fd);
+        }
+        frame_buf_free(&p->conns[i].in);
+        frame_buf_free(&p->conns[i].out);
+        free(p->conns[i].reqs);
+    }
+    free(p->conns);
+    if (p->poller != NULL) poller_destroy(p->poller);
+    free(p);
+}
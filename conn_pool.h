@@ -0,0 +1,59 @@
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <stddef.h>      /* size_t */
+#include <netinet/in.h>  /* struct sockaddr_in */
+
+/*
+ * 非阻塞 TCP 客户端连接池：tcp_client、select_io_client 的请求都经由这里发出。
+ * 池中最多 conns 条到同一服务器的连接，首次使用时才建立（非阻塞 connect），
+ * 之后一直复用；每条连接上最多同时挂起 depth 个请求（流水线），请求按提交顺序
+ * 写入发送缓冲，多次提交在下一次 cp_poll 时合并为一次 send。服务器按顺序应答，
+ * 所以每条连接的响应按 FIFO 与请求对应，怎样切分响应由协议决定：
+ *   CP_FRAMED  长度前缀分帧（frame.h，tcp_server -f）
+ *   CP_ECHO    响应与请求等长（select_io_server 的 TCP 回显）
+ *   CP_RAW     一次 recv 即一条响应（tcp_server 原始模式），无法区分边界，depth 固定为 1
+ * 连接出错或被对端关闭时，其上挂起的请求以失败回调结束，连接在下次提交时重建。
+ *
+ * 新连接默认设置 TCP_NODELAY（小请求不等 Nagle 合并）；fastopen 非零时设置
+ * TCP_FASTOPEN_CONNECT，首批请求随 SYN 发出（需要服务器端也开启 TFO 并已拿到
+ * cookie，否则内核自动退回普通握手）。所有调用都在同一线程中进行。
+ */
+
+enum cp_proto { CP_FRAMED, CP_ECHO, CP_RAW };
+
+struct cp_config {
+    struct sockaddr_in addr;     /* 服务器地址 */
+    enum cp_proto proto;
+    int conns;                   /* 连接数上限 */
+    int depth;                   /* 每连接挂起请求数上限 */
+    int nodelay;                 /* 设置 TCP_NODELAY */
+    int fastopen;                /* 设置 TCP_FASTOPEN_CONNECT */
+};
+
+/* 请求完成回调：status 为 0 时 resp/len 为响应内容（回调返回后失效）；
+ * 否则为失败原因的 errno 值（EPIPE 表示服务器关闭了连接，EPROTO 表示响应
+ * 无法解析），resp 为 NULL。回调中不能调用 cp_submit / cp_destroy */
+typedef void (*cp_done_fn)(void *ctx, unsigned long tag, int status, const char *resp, size_t len);
+
+struct conn_pool;                /* opaque */
+
+/* 创建连接池（不立即连接）；失败返回 NULL */
+struct conn_pool *cp_create(const struct cp_config *cfg);
+
+/* 提交一个请求，tag 原样交给完成回调。所有连接都已挂满 depth 个请求时
+ * 返回 -1 且 errno 为 EAGAIN（先 cp_poll 收取响应）；CP_FRAMED 的请求超过
+ * FRAME_REQ_MAX 时返回 -1 且 errno 为 EMSGSIZE；建立连接失败返回 -1 */
+int cp_submit(struct conn_pool *p, const char *msg, size_t len, unsigned long tag);
+
+/* 收发数据，最多等待 timeout_ms（-1 为一直等），对每个完成的请求调用 done；
+ * 返回本次完成的请求数，出错返回 -1（EINTR 原样返回给调用者） */
+int cp_poll(struct conn_pool *p, int timeout_ms, cp_done_fn done, void *ctx);
+
+/* 已提交尚未完成的请求数 */
+int cp_inflight(const struct conn_pool *p);
+
+/* 关闭所有连接并释放；未完成的请求不再回调 */
+void cp_destroy(struct conn_pool *p);
+
+#endif /* CONN_POOL_H */
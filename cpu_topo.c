@@ -0,0 +1,240 @@
+#define _GNU_SOURCE              /* sched_getaffinity、pthread_setaffinity_np、syscall */
+
+#include <stdio.h>               /* fopen, sprintf */
+#include <stdlib.h>              /* strtol */
+#include <string.h>              /* memset, strcmp */
+#include <errno.h>               /* errno */
+#include <unistd.h>              /* syscall */
+#include <sched.h>               /* cpu_set_t */
+#include <pthread.h>             /* pthread_setaffinity_np */
+#include <sys/syscall.h>         /* SYS_set_mempolicy */
+#include <linux/mempolicy.h>     /* MPOL_PREFERRED, MPOL_DEFAULT */
+#include "cpu_topo.h"
+
+#define LONG_BITS (8 * sizeof(unsigned long))
+
+static int g_cpu_node[CPU_TOPO_MAX]; /* 各 CPU 的节点，cpu_topo_init 时读入 */
+
+/* 读一个 sysfs 小文件，去掉末尾换行；失败返回 -1 */
+static int read_line(const char *path, char *buf, size_t len) {
+    FILE *f = fopen(path, "r");
+    size_t n;
+
+    if (f == NULL) return -1;
+    n = fread(buf, 1, len - 1, f);
+    fclose(f);
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' ')) n--;
+    buf[n] = '\0';
+    return n > 0 ? 0 : -1;
+}
+
+/* 解析 "0-3,8,10-11"：按出现顺序写入 out（最多 CPU_TOPO_MAX 个，去重），返回个数，格式错误返回 -1 */
+static int parse_list(const char *s, int *out) {
+    unsigned char seen[CPU_TOPO_MAX];
+    char *end;
+    long lo, hi, i;
+    int n = 0;
+
+    memset(seen, 0, sizeof(seen));
+    while (*s != '\0') {
+        lo = strtol(s, &end, 10);
+        if (end == s || lo < 0 || lo >= CPU_TOPO_MAX) return -1;
+        hi = lo;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo || hi >= CPU_TOPO_MAX) return -1;
+            s = end;
+        }
+        for (i = lo; i <= hi; i++) {
+            if (!seen[i]) {
+                seen[i] = 1;
+                out[n++] = (int)i;
+            }
+        }
+        if (*s == ',') {
+            s++;
+        } else if (*s != '\0') {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/* 从 /sys/devices/system/node 读出每个 CPU 的节点 */
+static void load_nodes(void) {
+    static int ids[CPU_TOPO_MAX], cpus[CPU_TOPO_MAX];
+    char path[96], line[4096];
+    int nn, nc, i, k;
+
+    memset(g_cpu_node, 0, sizeof(g_cpu_node));
+    if (read_line("/sys/devices/system/node/online", line, sizeof(line)) != 0) return;
+    nn = parse_list(line, ids);
+    for (i = 0; i < nn; i++) {
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", ids[i]);
+        if (read_line(path, line, sizeof(line)) != 0) continue; /* 只有内存的节点 */
+        nc = parse_list(line, cpus);
+        for (k = 0; k < nc; k++) g_cpu_node[cpus[k]] = ids[i];
+    }
+}
+
+/* cpu 是否为某个超线程兄弟（它所在物理核上编号最小的以外的逻辑 CPU） */
+static int is_sibling(int cpu) {
+    int sib[CPU_TOPO_MAX];
+    char path[96], line[4096];
+    int n, i;
+
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if (read_line(path, line, sizeof(line)) != 0) return 0;
+    n = parse_list(line, sib);
+    for (i = 0; i < n; i++) {
+        if (sib[i] < cpu) return 1;
+    }
+    return 0;
+}
+
+/* auto 顺序的排序键：先物理核后兄弟，同层内优先节点 pref，再按节点、按编号 */
+static long order_key(int cpu, int sibling, int pref) {
+    int node = g_cpu_node[cpu];
+    return (long)sibling * CPU_TOPO_MAX * (CPU_TOPO_MAX + 1) +
+           (long)(node == pref ? 0 : node + 1) * CPU_TOPO_MAX + cpu;
+}
+
+static void sort_auto(struct cpu_topo *t, int pref) {
+    static unsigned char sib[CPU_TOPO_MAX];
+    int i, j, c;
+
+    for (i = 0; i < t->ncpus; i++) sib[t->cpu[i]] = (unsigned char)is_sibling(t->cpu[i]);
+    for (i = 1; i < t->ncpus; i++) { /* 插入排序，CPU 数不大 */
+        c = t->cpu[i];
+        for (j = i; j > 0 && order_key(t->cpu[j - 1], sib[t->cpu[j - 1]], pref) > order_key(c, sib[c], pref); j--) {
+            t->cpu[j] = t->cpu[j - 1];
+        }
+        t->cpu[j] = c;
+    }
+    for (i = 0; i < t->ncpus; i++) t->node[i] = g_cpu_node[t->cpu[i]];
+}
+
+int cpu_topo_init(struct cpu_topo *t, const char *spec) {
+    static int list[CPU_TOPO_MAX];
+    unsigned char node_seen[CPU_TOPO_MAX];
+    cpu_set_t allowed;
+    int n, i;
+
+    memset(t, 0, sizeof(*t));
+    load_nodes();
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+    if (spec == NULL || strcmp(spec, "auto") == 0) {
+        for (i = 0; i < CPU_TOPO_MAX; i++) {
+            if (CPU_ISSET(i, &allowed)) t->cpu[t->ncpus++] = i;
+        }
+        sort_auto(t, -1);
+    } else {
+        n = parse_list(spec, list);
+        if (n <= 0) return -1;
+        for (i = 0; i < n; i++) {
+            if (!CPU_ISSET(list[i], &allowed)) { /* 离线或被 taskset / cgroup 排除 */
+                errno = EINVAL;
+                return -1;
+            }
+            t->cpu[i] = list[i];
+            t->node[i] = g_cpu_node[list[i]];
+        }
+        t->ncpus = n;
+        t->listed = 1;
+    }
+    if (t->ncpus == 0) return -1;
+    memset(node_seen, 0, sizeof(node_seen));
+    for (i = 0; i < t->ncpus; i++) {
+        if (!node_seen[t->node[i]]) {
+            node_seen[t->node[i]] = 1;
+            t->nnodes++;
+        }
+    }
+    return 0;
+}
+
+void cpu_topo_prefer_node(struct cpu_topo *t, int node) {
+    if (t->listed || node < 0) return; /* 用户给出的顺序不动 */
+    sort_auto(t, node);
+}
+
+int cpu_topo_netdev_node(const char *ifname) {
+    char path[128], line[32];
+    long v;
+
+    if (strlen(ifname) > 64) return -1;
+    sprintf(path, "/sys/class/net/%s/device/numa_node", ifname);
+    if (read_line(path, line, sizeof(line)) != 0) return -1; /* 虚拟设备没有 device */
+    v = strtol(line, NULL, 10);
+    return v >= 0 && v < CPU_TOPO_MAX ? (int)v : -1;
+}
+
+int cpu_topo_node_of(int cpu) {
+    return cpu >= 0 && cpu < CPU_TOPO_MAX ? g_cpu_node[cpu] : 0;
+}
+
+int cpu_topo_mem_node(const struct cpu_topo *t, int node) {
+    unsigned long mask[CPU_TOPO_MAX / LONG_BITS];
+
+    if (t->nnodes <= 1) return 0; /* 单节点：默认策略即是本地 */
+    if (node < 0) return (int)syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0UL);
+    memset(mask, 0, sizeof(mask));
+    mask[node / LONG_BITS] |= 1UL << (node % LONG_BITS);
+    /* maxnode 比位数多 1，这是该系统调用的历史约定 */
+    return (int)syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long)CPU_TOPO_MAX + 1);
+}
+
+/* 在 t 中查找 cpu 的位置，不在其中返回 -1 */
+static int index_of(const struct cpu_topo *t, int cpu) {
+    int i;
+    for (i = 0; i < t->ncpus; i++) {
+        if (t->cpu[i] == cpu) return i;
+    }
+    return -1;
+}
+
+int cpu_topo_pin_cpu(const struct cpu_topo *t, int cpu) {
+    cpu_set_t set;
+    int i = index_of(t, cpu);
+
+    if (i < 0) return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return -1;
+    cpu_topo_mem_node(t, t->node[i]); /* 内存策略失败不影响绑定 */
+    return cpu;
+}
+
+int cpu_topo_pin(const struct cpu_topo *t, int index) {
+    if (t->ncpus <= 0 || index < 0) return -1;
+    return cpu_topo_pin_cpu(t, t->cpu[index % t->ncpus]);
+}
+
+int cpu_topo_pin_all(const struct cpu_topo *t) {
+    cpu_set_t set;
+    int i;
+
+    CPU_ZERO(&set);
+    for (i = 0; i < t->ncpus; i++) CPU_SET(t->cpu[i], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return -1;
+    cpu_topo_mem_node(t, -1);
+    return 0;
+}
+
+void cpu_topo_describe(const struct cpu_topo *t, int n, char *buf, size_t len) {
+    size_t off = 0;
+    char item[32];
+    int i, k;
+
+    if (len == 0) return;
+    buf[0] = '\0';
+    for (i = 0; i < n && t->ncpus > 0; i++) {
+        k = i % t->ncpus;
+        sprintf(item, "%scpu%d/node%d", i > 0 ? " " : "", t->cpu[k], t->node[k]);
+        if (off + strlen(item) + 1 > len) break;
+        strcpy(buf + off, item);
+        off += strlen(item);
+    }
+}
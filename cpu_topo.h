@@ -0,0 +1,58 @@
+#ifndef CPU_TOPO_H
+#define CPU_TOPO_H
+
+#include <stddef.h>              /* size_t */
+
+/*
+ * CPU 拓扑与线程放置：从 sysfs 读出本进程可用的 CPU、各自的 NUMA 节点和
+ * 超线程兄弟，按放置顺序排好；第 i 个工作线程调用 cpu_topo_pin(t, i) 把
+ * 自己绑到第 i 个 CPU（超出个数时循环），同时把本线程的内存策略设为优先
+ * 从该 CPU 所在节点分配，此后它首次写入的缓冲都落在本地内存上。
+ *
+ * "auto" 的顺序：先每个物理核取一个逻辑 CPU，再用其超线程兄弟；同一层里
+ * 按节点分组，线程数少时集中在一个节点上（cpu_topo_prefer_node 可指定先用
+ * 哪个节点，例如网卡所在的节点）。也可以给出 "0-3,8" 形式的列表，按给出
+ * 的顺序放置。
+ *
+ * 读不到 sysfs 时退化成一个节点、没有超线程；单节点机器上不设内存策略。
+ */
+
+#define CPU_TOPO_MAX 1024        /* 支持的最大 CPU 编号 + 1（与 CPU_SETSIZE 相同） */
+
+struct cpu_topo {
+    int ncpus;                   /* 参与放置的 CPU 数 */
+    int nnodes;                  /* 这些 CPU 分布在几个节点上 */
+    int listed;                  /* 由 CPU 列表给出：保持给出的顺序 */
+    int cpu[CPU_TOPO_MAX];       /* 放置顺序 */
+    int node[CPU_TOPO_MAX];      /* cpu[i] 所在的节点 */
+};
+
+/* 按 spec（"auto" 或 CPU 列表）建立放置顺序；列表中有本进程不能使用的 CPU
+ * 或格式错误时返回 -1 */
+int cpu_topo_init(struct cpu_topo *t, const char *spec);
+
+/* 把节点 node 的 CPU 挪到同一层的最前面（auto 顺序下使用） */
+void cpu_topo_prefer_node(struct cpu_topo *t, int node);
+
+/* 网卡 ifname 所在的 NUMA 节点，不知道时返回 -1 */
+int cpu_topo_netdev_node(const char *ifname);
+
+/* CPU 所在的节点，不知道时返回 0 */
+int cpu_topo_node_of(int cpu);
+
+/* 把调用线程绑到第 index 个 CPU 并优先使用其节点的内存，返回绑定的 CPU，失败返回 -1 */
+int cpu_topo_pin(const struct cpu_topo *t, int index);
+
+/* 把调用线程绑到指定 CPU（例如 SO_INCOMING_CPU 报告的那个），其余同上 */
+int cpu_topo_pin_cpu(const struct cpu_topo *t, int cpu);
+
+/* 允许调用线程在 t 的全部 CPU 上运行，并恢复默认内存策略 */
+int cpu_topo_pin_all(const struct cpu_topo *t);
+
+/* 调用线程之后的内存优先从 node 分配；node < 0 恢复默认策略 */
+int cpu_topo_mem_node(const struct cpu_topo *t, int node);
+
+/* 把前 n 个放置位置写成 "cpu0/node0 cpu2/node0 ..."，超出 len 时截断 */
+void cpu_topo_describe(const struct cpu_topo *t, int n, char *buf, size_t len);
+
+#endif /* CPU_TOPO_H */
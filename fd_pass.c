@@ -0,0 +1,97 @@
+#define _GNU_SOURCE              /* MSG_CMSG_CLOEXEC 等声明 */
+
+#include <string.h>              /* memset, memcpy */
+#include <errno.h>               /* errno */
+#include <unistd.h>              /* close */
+#include <sys/socket.h>          /* sendmsg, recvmsg, CMSG_* */
+#include <sys/uio.h>             /* struct iovec */
+#include "fd_pass.h"
+
+/* 控制消息缓冲，用 union 保证 cmsghdr 的对齐 */
+union fd_ctrl {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * FD_PASS_MAX)];
+};
+
+int fd_send(int sock, const void *data, size_t len, const int *fds, int nfds) {
+    union fd_ctrl ctrl;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *c;
+    ssize_t n;
+
+    if (nfds < 0 || nfds > FD_PASS_MAX || len == 0) { /* 至少要有 1 字节数据，描述符才能随之送达 */
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void *)data;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        memset(&ctrl, 0, sizeof(ctrl));
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+        c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)nfds);
+    }
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+    if ((size_t)n != len) {      /* SOCK_SEQPACKET 与 SOCK_DGRAM 不会部分发送 */
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return 0;
+}
+
+int fd_recv(int sock, void *data, size_t len, int *fds, int max, int *nfds) {
+    union fd_ctrl ctrl;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *c;
+    ssize_t n;
+    int got = 0;
+    int over = 0;                /* 描述符多于调用者容量 */
+    int k, i;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = data;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    for (c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        k = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (i = 0; i < k; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + sizeof(int) * (size_t)i, sizeof(int));
+            if (got < max) {
+                fds[got++] = fd;
+            } else {
+                close(fd);       /* 超出调用者容量：不能泄漏 */
+                over = 1;
+            }
+        }
+    }
+    *nfds = got;
+    if (over || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        for (i = 0; i < got; i++) close(fds[i]);
+        *nfds = 0;
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return (int)n;
+}
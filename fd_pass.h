@@ -0,0 +1,22 @@
+#ifndef FD_PASS_H
+#define FD_PASS_H
+
+#include <stddef.h>              /* size_t */
+
+/*
+ * 通过 UNIX 域套接字（SCM_RIGHTS）在进程之间传递文件描述符。
+ * 接收方得到的是同一个打开的文件（例如同一个监听套接字及其连接队列），
+ * 双方随后各自关闭自己的描述符互不影响。
+ */
+
+#define FD_PASS_MAX 128          /* 一条消息最多携带的描述符数（内核上限为 253） */
+
+/* 在 sock 上发送 len 字节的 data，并附带 fds[0..nfds)；成功返回 0 */
+int fd_send(int sock, const void *data, size_t len, const int *fds, int nfds);
+
+/* 接收一条消息：数据写入 data（最多 len 字节），描述符写入 fds（最多 max 个），
+ * *nfds 为收到的描述符数。返回数据字节数，出错返回 -1。
+ * 数据或描述符被截断时已收到的描述符全部关闭，返回 -1（errno = EMSGSIZE） */
+int fd_recv(int sock, void *data, size_t len, int *fds, int max, int *nfds);
+
+#endif /* FD_PASS_H */
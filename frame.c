@@ -0,0 +1,85 @@
+#include <stdlib.h>  /* realloc, free */
+#include <string.h>  /* memcpy, memmove */
+#include "frame.h"
+
+int frame_buf_reserve(struct frame_buf *b, size_t need) {
+    size_t ncap;
+    char *nd;
+
+    if (b->off > 0 && b->cap - b->len < need) {
+        /* 先回收已消费的空间 */
+        memmove(b->data, b->data + b->off, b->len - b->off);
+        b->len -= b->off;
+        b->off = 0;
+    }
+    if (b->cap - b->len >= need) return 0;
+    ncap = b->cap == 0 ? 1024 : b->cap;
+    while (ncap - b->len < need) ncap *= 2;
+    nd = (char *)realloc(b->data, ncap);
+    if (nd == NULL) return -1;
+    b->data = nd;
+    b->cap = ncap;
+    return 0;
+}
+
+int frame_buf_append(struct frame_buf *b, const char *p, size_t n) {
+    if (frame_buf_reserve(b, n) != 0) return -1;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+void frame_buf_consume(struct frame_buf *b, size_t n) {
+    b->off += n;
+    if (b->off >= b->len) {
+        b->off = 0;
+        b->len = 0;
+    }
+}
+
+void frame_buf_free(struct frame_buf *b) {
+    free(b->data);
+    b->data = NULL;
+    b->off = 0;
+    b->len = 0;
+    b->cap = 0;
+}
+
+int frame_next(struct frame_buf *in, const char **payload, size_t *len) {
+    const unsigned char *h;
+    unsigned long n;
+
+    if (frame_buf_pending(in) < FRAME_HDR_LEN) return 0;
+    h = (const unsigned char *)in->data + in->off;
+    n = ((unsigned long)h[0] << 24) | ((unsigned long)h[1] << 16) |
+        ((unsigned long)h[2] << 8) | (unsigned long)h[3];
+    if (n > FRAME_MAX) return -1;
+    if (frame_buf_pending(in) < FRAME_HDR_LEN + n) return 0;  /* 半条消息，等待更多数据 */
+
+    *payload = in->data + in->off + FRAME_HDR_LEN;
+    *len = (size_t)n;
+    in->off += FRAME_HDR_LEN + n;  /* 不立即复位：payload 在下次修改 in 之前仍有效 */
+    return 1;
+}
+
+char *frame_begin(struct frame_buf *out, size_t max) {
+    if (max > FRAME_MAX || frame_buf_reserve(out, FRAME_HDR_LEN + max) != 0) return NULL;
+    return out->data + out->len + FRAME_HDR_LEN;
+}
+
+void frame_commit(struct frame_buf *out, size_t n) {
+    unsigned char *h = (unsigned char *)out->data + out->len;
+    h[0] = (unsigned char)(n >> 24);
+    h[1] = (unsigned char)(n >> 16);
+    h[2] = (unsigned char)(n >> 8);
+    h[3] = (unsigned char)n;
+    out->len += FRAME_HDR_LEN + n;
+}
+
+int frame_append(struct frame_buf *out, const char *p, size_t n) {
+    char *dst = frame_begin(out, n);
+    if (dst == NULL) return -1;
+    memcpy(dst, p, n);
+    frame_commit(out, n);
+    return 0;
+}
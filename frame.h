@@ -0,0 +1,56 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>  /* size_t */
+
+/*
+ * 长度前缀分帧：每条消息前带 4 字节大端长度（不含头部本身）。
+ * TCP 是字节流，一次 recv 可能只收到半条消息，也可能收到多条；
+ * frame_next 在接收缓冲中逐条切出完整消息，不完整的尾部留待后续数据。
+ */
+
+#define FRAME_HDR_LEN 4            /* 长度头字节数 */
+#define FRAME_MAX (1024 * 1024)    /* 单条消息最大长度，超过视为协议错误 */
+
+/* tcp_server -f 的响应是请求加上 "Processed[N bytes]: " 前缀，请求因此不能用满
+ * FRAME_MAX：超过 FRAME_REQ_MAX 的请求，服务器拒绝，客户端也不发送 */
+#define FRAME_REQ_EXTRA 48         /* 响应比请求多出的前缀上限 */
+#define FRAME_REQ_MAX (FRAME_MAX - FRAME_REQ_EXTRA)
+
+/* 可增长缓冲：[off, len) 为尚未消费（或尚未发送）的数据 */
+struct frame_buf {
+    char *data;
+    size_t off;                    /* 已消费/已发送的字节数 */
+    size_t len;                    /* 已写入的字节数 */
+    size_t cap;                    /* 容量 */
+};
+
+/* 未消费的字节数 */
+#define frame_buf_pending(b) ((b)->len - (b)->off)
+
+/* 保证 len 之后至少有 need 字节空闲（先把未消费数据移到开头再扩容），成功返回 0 */
+int frame_buf_reserve(struct frame_buf *b, size_t need);
+
+/* 追加 n 字节原始数据，成功返回 0 */
+int frame_buf_append(struct frame_buf *b, const char *p, size_t n);
+
+/* 标记 n 字节已消费；全部消费后复位到开头 */
+void frame_buf_consume(struct frame_buf *b, size_t n);
+
+/* 释放缓冲内存 */
+void frame_buf_free(struct frame_buf *b);
+
+/* 从 in 中切出下一条完整消息：返回 1 并通过 payload/len 给出消息
+ * （指针在下一次修改 in 之前有效），返回 0 表示数据不完整，
+ * 返回 -1 表示长度超过 FRAME_MAX */
+int frame_next(struct frame_buf *in, const char **payload, size_t *len);
+
+/* 向 out 追加一条消息（长度头 + 内容），成功返回 0 */
+int frame_append(struct frame_buf *out, const char *p, size_t n);
+
+/* 在 out 尾部预留一条最长 max 字节的消息，返回内容区指针供调用者直接写入，
+ * 写完后以实际长度调用 frame_commit；失败返回 NULL */
+char *frame_begin(struct frame_buf *out, size_t max);
+void frame_commit(struct frame_buf *out, size_t n);
+
+#endif /* FRAME_H */
@@ -0,0 +1,109 @@
+#include <string.h>  /* memset */
+#include "hdr_hist.h"
+
+/* 打印分布时使用的百分位刻度 */
+static const double ticks[] = {
+    0.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.5, 99.9, 99.95, 99.99, 99.999, 100.0
+};
+
+/* 数值到桶号：小于 2*HDR_SUB_HALF 的数值各占一个桶，
+ * 更大的数值右移到 [HDR_SUB_HALF, 2*HDR_SUB_HALF) 区间，按移位数分段 */
+static unsigned long bucket_of(unsigned long v) {
+    unsigned long shift = 0;
+
+    while ((v >> shift) >= 2 * HDR_SUB_HALF) shift++;
+    if (shift > HDR_SHIFTS) return HDR_BUCKETS - 1;
+    return shift * HDR_SUB_HALF + (v >> shift);
+}
+
+/* 桶内可能出现的最大数值 */
+static unsigned long bucket_upper(unsigned long idx) {
+    unsigned long shift, sub;
+
+    if (idx < 2 * HDR_SUB_HALF) return idx;
+    shift = idx / HDR_SUB_HALF - 1;
+    sub = idx - shift * HDR_SUB_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+void hdr_hist_init(struct hdr_hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hdr_hist_record(struct hdr_hist *h, unsigned long v) {
+    h->counts[bucket_of(v)]++;
+    if (h->total == 0 || v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+    h->total++;
+    h->sum += (double)v;
+}
+
+void hdr_hist_merge(struct hdr_hist *dst, const struct hdr_hist *src) {
+    unsigned long i;
+
+    if (src->total == 0) return;
+    for (i = 0; i < HDR_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    if (dst->total == 0 || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->total += src->total;
+    dst->sum += src->sum;
+}
+
+/* 百分位 p 所在的桶号，同时给出截止该桶的累计次数 */
+static unsigned long find_bucket(const struct hdr_hist *h, double p, unsigned long *cum) {
+    unsigned long target, acc = 0, i;
+
+    target = (unsigned long)(p / 100.0 * (double)h->total + 0.999999);
+    if (target == 0) target = 1;
+    for (i = 0; i < HDR_BUCKETS; i++) {
+        acc += h->counts[i];
+        if (acc >= target) break;
+    }
+    if (i == HDR_BUCKETS) i = HDR_BUCKETS - 1;
+    *cum = acc;
+    return i;
+}
+
+unsigned long hdr_hist_percentile(const struct hdr_hist *h, double p) {
+    unsigned long cum, v;
+
+    if (h->total == 0) return 0;
+    if (p <= 0.0) return h->min;
+    v = bucket_upper(find_bucket(h, p, &cum));
+    return v > h->max ? h->max : v;
+}
+
+double hdr_hist_mean(const struct hdr_hist *h) {
+    return h->total == 0 ? 0.0 : h->sum / (double)h->total;
+}
+
+void hdr_hist_print(const struct hdr_hist *h, FILE *fp, double scale) {
+    unsigned long i, cum;
+    double p;
+
+    fprintf(fp, "%12s %14s %10s %14s\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    if (h->total == 0) return;
+    for (i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++) {
+        p = ticks[i];
+        find_bucket(h, p, &cum);
+        if (p >= 100.0) {
+            fprintf(fp, "%12.3f %14.12f %10lu %14s\n",
+                    (double)h->max / scale, 1.0, h->total, "inf");
+        } else {
+            fprintf(fp, "%12.3f %14.12f %10lu %14.2f\n",
+                    (double)hdr_hist_percentile(h, p) / scale, p / 100.0, cum, 100.0 / (100.0 - p));
+        }
+    }
+}
+
+void hdr_hist_print_json(const struct hdr_hist *h, FILE *fp, double scale) {
+    unsigned long i, cum;
+
+    fprintf(fp, "[");
+    for (i = 0; h->total > 0 && i < sizeof(ticks) / sizeof(ticks[0]); i++) {
+        find_bucket(h, ticks[i], &cum);
+        fprintf(fp, "%s{\"value\": %.3f, \"percentile\": %.3f, \"count\": %lu}",
+                i == 0 ? "" : ", ", (double)hdr_hist_percentile(h, ticks[i]) / scale, ticks[i], cum);
+    }
+    fprintf(fp, "]");
+}
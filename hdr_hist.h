@@ -0,0 +1,46 @@
+#ifndef HDR_HIST_H
+#define HDR_HIST_H
+
+#include <stdio.h>   /* FILE */
+
+/*
+ * HDR 风格的对数-线性延迟直方图：数值按 2 的幂分段，每段再线性细分为
+ * HDR_SUB_HALF 个桶，相对误差不超过 1/HDR_SUB_HALF（约 3%），
+ * 内存固定，记录一次只需少量整数运算，可在热路径上直接调用。
+ * 数值单位由调用者决定（netbench 使用纳秒）。
+ */
+
+#define HDR_SUB_BITS 6                           /* 每段精度：2^HDR_SUB_BITS 个桶 */
+#define HDR_SUB_HALF (1UL << (HDR_SUB_BITS - 1))
+#define HDR_SHIFTS 32                            /* 量程上限 2^(HDR_SUB_BITS+HDR_SHIFTS) */
+#define HDR_BUCKETS ((HDR_SHIFTS + 2) * HDR_SUB_HALF)
+
+struct hdr_hist {
+    unsigned long counts[HDR_BUCKETS];
+    unsigned long total;     /* 记录次数 */
+    unsigned long min;
+    unsigned long max;
+    double sum;              /* 用于计算平均值 */
+};
+
+void hdr_hist_init(struct hdr_hist *h);
+
+/* 记录一个数值；超出量程的数值计入最后一个桶 */
+void hdr_hist_record(struct hdr_hist *h, unsigned long v);
+
+/* 把 src 累加到 dst（合并各线程的直方图） */
+void hdr_hist_merge(struct hdr_hist *dst, const struct hdr_hist *src);
+
+/* 百分位 p（0~100）处的数值，返回所在桶的上界（不超过 max） */
+unsigned long hdr_hist_percentile(const struct hdr_hist *h, double p);
+
+double hdr_hist_mean(const struct hdr_hist *h);
+
+/* 以 HdrHistogram 的百分位分布格式打印（Value Percentile TotalCount 1/(1-Percentile)），
+ * 数值先除以 scale（例如纳秒转微秒传 1000） */
+void hdr_hist_print(const struct hdr_hist *h, FILE *fp, double scale);
+
+/* 以 JSON 数组输出同一分布：[{"value":..,"percentile":..,"count":..},...] */
+void hdr_hist_print_json(const struct hdr_hist *h, FILE *fp, double scale);
+
+#endif /* HDR_HIST_H */
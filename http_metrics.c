@@ -0,0 +1,150 @@
+#define _GNU_SOURCE              /* posix_memalign、clock_gettime 等声明 */
+
+#include <stdio.h>               /* sprintf */
+#include <stdlib.h>              /* posix_memalign */
+#include <string.h>              /* memset, strlen */
+#include <time.h>                /* clock_gettime */
+#include <pthread.h>             /* pthread_once, pthread_key_t */
+#include "http_metrics.h"
+
+#define CACHE_LINE 64            /* 计数器组之间不共享缓存行 */
+#define GROUP_SIZE ((sizeof(struct http_metrics) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+
+/* 首字节延迟桶上界（微秒），与 Prometheus 客户端库的默认桶相近，覆盖 100us 到 10s */
+static const unsigned long lat_bounds_us[HTTP_METRICS_LAT_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+    50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+__thread struct http_metrics *http_metrics_tls;
+
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;      /* 线程退出时交还计数器组 */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER; /* 保护链表与 owned */
+static struct http_metrics *g_groups; /* 全部计数器组 */
+static struct http_metrics g_spare; /* 分配失败时共用，不参与交接 */
+
+static void group_release(void *p) {
+    pthread_mutex_lock(&g_lock);
+    ((struct http_metrics *)p)->owned = 0; /* 计数保留，由下一个线程接着累加 */
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void once_init(void) {
+    pthread_key_create(&g_key, group_release);
+    g_spare.next = g_groups;     /* 备用组也参与求和 */
+    g_groups = &g_spare;
+    g_spare.owned = 1;
+}
+
+struct http_metrics *http_metrics_register(void) {
+    struct http_metrics *m;
+    void *mem;
+
+    pthread_once(&g_once, once_init);
+    pthread_mutex_lock(&g_lock);
+    for (m = g_groups; m != NULL; m = m->next) { /* 优先接手已退出线程留下的组 */
+        if (!m->owned) break;
+    }
+    if (m == NULL && posix_memalign(&mem, CACHE_LINE, GROUP_SIZE) == 0) {
+        m = (struct http_metrics *)mem;
+        memset(m, 0, sizeof(*m));
+        m->next = g_groups;
+        g_groups = m;
+    }
+    if (m != NULL) m->owned = 1;
+    pthread_mutex_unlock(&g_lock);
+    if (m == NULL) return &g_spare;
+    pthread_setspecific(g_key, m);
+    http_metrics_tls = m;
+    return m;
+}
+
+unsigned long http_metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000UL + (unsigned long)ts.tv_nsec / 1000UL;
+}
+
+void http_metrics_first_byte(struct http_metrics *m, unsigned long accept_us) {
+    unsigned long us = http_metrics_now_us() - accept_us;
+    int i = 0;
+
+    while (i < HTTP_METRICS_LAT_BUCKETS && us > lat_bounds_us[i]) i++;
+    m->lat[i]++;
+    m->lat_sum_us += us;
+}
+
+/* 读取其他线程正在自增的计数器 */
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+unsigned long http_metrics_active(void) {
+    struct http_metrics *m;
+    unsigned long accepted = 0, closed = 0;
+
+    pthread_once(&g_once, once_init);
+    pthread_mutex_lock(&g_lock);
+    for (m = g_groups; m != NULL; m = m->next) {
+        accepted += LOAD(m->accepted);
+        closed += LOAD(m->closed);
+    }
+    pthread_mutex_unlock(&g_lock);
+    return accepted > closed ? accepted - closed : 0;
+}
+
+/* 追加一个计数器或仪表，name 同时用于 HELP 与 TYPE 行 */
+static int put_metric(struct http_buf *b, const char *name, const char *type, const char *help, unsigned long v) {
+    char line[256];
+    int n = sprintf(line, "# HELP %s %s\n# TYPE %s %s\n%s %lu\n", name, help, name, type, name, v);
+    return http_buf_append(b, line, (size_t)n);
+}
+
+int http_metrics_render(struct http_buf *b) {
+    struct http_metrics sum;
+    struct http_metrics *m;
+    unsigned long cum = 0;
+    char line[128];
+    int rc = 0;
+    int i, n;
+
+    pthread_once(&g_once, once_init);
+    memset(&sum, 0, sizeof(sum));
+    pthread_mutex_lock(&g_lock); /* 只防止链表增长时读到一半；不阻塞计数 */
+    for (m = g_groups; m != NULL; m = m->next) {
+        sum.accepted += LOAD(m->accepted);
+        sum.closed += LOAD(m->closed);
+        sum.requests += LOAD(m->requests);
+        sum.bytes_in += LOAD(m->bytes_in);
+        sum.bytes_out += LOAD(m->bytes_out);
+        sum.recv_errors += LOAD(m->recv_errors);
+        sum.send_errors += LOAD(m->send_errors);
+        sum.lat_sum_us += LOAD(m->lat_sum_us);
+        for (i = 0; i <= HTTP_METRICS_LAT_BUCKETS; i++) sum.lat[i] += LOAD(m->lat[i]);
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    rc |= put_metric(b, "http_connections_accepted_total", "counter", "Connections accepted.", sum.accepted);
+    rc |= put_metric(b, "http_connections_active", "gauge", "Connections currently open.",
+                     sum.accepted > sum.closed ? sum.accepted - sum.closed : 0); /* 两个计数读取时刻不同 */
+    rc |= put_metric(b, "http_requests_total", "counter", "Requests parsed.", sum.requests);
+    rc |= put_metric(b, "http_received_bytes_total", "counter", "Bytes received from clients.", sum.bytes_in);
+    rc |= put_metric(b, "http_sent_bytes_total", "counter", "Bytes sent to clients.", sum.bytes_out);
+    rc |= put_metric(b, "http_recv_errors_total", "counter", "Failed receives.", sum.recv_errors);
+    rc |= put_metric(b, "http_send_errors_total", "counter", "Failed sends.", sum.send_errors);
+
+    n = sprintf(line, "# HELP http_first_byte_seconds Time from accept to the first response byte.\n"
+                      "# TYPE http_first_byte_seconds histogram\n");
+    rc |= http_buf_append(b, line, (size_t)n);
+    for (i = 0; i < HTTP_METRICS_LAT_BUCKETS; i++) { /* Prometheus 的桶是累计的 */
+        cum += sum.lat[i];
+        n = sprintf(line, "http_first_byte_seconds_bucket{le=\"%g\"} %lu\n", (double)lat_bounds_us[i] / 1e6, cum);
+        rc |= http_buf_append(b, line, (size_t)n);
+    }
+    cum += sum.lat[HTTP_METRICS_LAT_BUCKETS];
+    n = sprintf(line, "http_first_byte_seconds_bucket{le=\"+Inf\"} %lu\n"
+                      "http_first_byte_seconds_sum %.6f\n"
+                      "http_first_byte_seconds_count %lu\n",
+                cum, (double)sum.lat_sum_us / 1e6, cum);
+    rc |= http_buf_append(b, line, (size_t)n);
+    return rc != 0 ? -1 : 0;
+}
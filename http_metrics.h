@@ -0,0 +1,53 @@
+#ifndef HTTP_METRICS_H
+#define HTTP_METRICS_H
+
+#include "http_proto.h"          /* struct http_buf */
+
+/*
+ * HTTP 服务器的运行计数。每个线程第一次计数时领取一组自己的计数器，
+ * 各组按缓存行对齐分开存放，热路径上只是对本线程计数器的普通自增，
+ * 没有共享的原子变量也没有锁。线程退出后它的那组计数器原样交给下一个
+ * 新线程继续累加，所以每连接一个线程的模式下数值同样单调、内存有界。
+ *
+ * 只有在抓取 /metrics 时才遍历所有组求和，输出 Prometheus 文本格式。
+ * 求和不与写线程同步，各计数器单独看是准确的，彼此之间可能差几次自增。
+ */
+
+/* 首字节延迟桶的个数（不含 +Inf），上界见 http_metrics.c */
+#define HTTP_METRICS_LAT_BUCKETS 16
+
+struct http_metrics {
+    unsigned long accepted;      /* 接受的连接 */
+    unsigned long closed;        /* 关闭的连接（活动连接数 = accepted - closed） */
+    unsigned long requests;      /* 完整解析的请求 */
+    unsigned long bytes_in;      /* 收到的字节 */
+    unsigned long bytes_out;     /* 发出的字节 */
+    unsigned long recv_errors;   /* 接收出错 */
+    unsigned long send_errors;   /* 发送出错 */
+    unsigned long lat_sum_us;    /* 首字节延迟之和（微秒） */
+    unsigned long lat[HTTP_METRICS_LAT_BUCKETS + 1]; /* 各桶计数（非累计），最后一个为 +Inf */
+    struct http_metrics *next;   /* 全部计数器组的链表，只增不减 */
+    int owned;                   /* 是否有线程在使用 */
+};
+
+extern __thread struct http_metrics *http_metrics_tls; /* 本线程的计数器组 */
+
+/* 领取本线程的计数器组；失败时返回一个共享的备用组，计数只是不再精确 */
+struct http_metrics *http_metrics_register(void);
+
+/* 本线程的计数器组，首次调用时领取 */
+#define HTTP_METRICS() (http_metrics_tls != NULL ? http_metrics_tls : http_metrics_register())
+
+/* 单调时钟微秒数，用来记录接受连接的时刻 */
+unsigned long http_metrics_now_us(void);
+
+/* 记录一次从接受连接（accept_us）到发出第一个响应字节的延迟 */
+void http_metrics_first_byte(struct http_metrics *m, unsigned long accept_us);
+
+/* 当前打开的连接数（各组 accepted - closed 之和），热重启排空时轮询 */
+unsigned long http_metrics_active(void);
+
+/* 汇总所有线程的计数器，以 Prometheus 文本格式追加到 b，成功返回 0 */
+int http_metrics_render(struct http_buf *b);
+
+#endif /* HTTP_METRICS_H */
@@ -0,0 +1,224 @@
+#include <stdlib.h>              /* realloc, free */
+#include <string.h>              /* memchr, memcmp, memmove */
+#include "http_proto.h"
+
+/* 各错误对应的响应，发送后服务器关闭连接 */
+static const char resp_400[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char resp_413[] =
+    "HTTP/1.1 413 Payload Too Large\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char resp_431[] =
+    "HTTP/1.1 431 Request Header Fields Too Large\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char resp_501[] =
+    "HTTP/1.1 501 Not Implemented\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+/* ASCII 小写转换（不依赖 locale） */
+static int lower(int c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* 比较长度为 n 的 a 与以 NUL 结尾的 b（不区分大小写） */
+static int ci_equal(const char *a, size_t n, const char *b) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (b[i] == '\0' || lower((unsigned char)a[i]) != lower((unsigned char)b[i])) {
+            return 0;
+        }
+    }
+    return b[n] == '\0';
+}
+
+/* 判断逗号分隔的头部取值中是否包含 token（不区分大小写） */
+static int ci_has_token(const char *v, size_t vlen, const char *token) {
+    size_t start = 0;
+    size_t end;
+    size_t a, b;
+    while (start < vlen) {
+        end = start;
+        while (end < vlen && v[end] != ',') end++;
+        a = start;
+        b = end;
+        while (a < b && (v[a] == ' ' || v[a] == '\t')) a++;
+        while (b > a && (v[b - 1] == ' ' || v[b - 1] == '\t')) b--;
+        if (ci_equal(v + a, b - a, token)) return 1;
+        start = end + 1;
+    }
+    return 0;
+}
+
+/* 从 from 开始查找 CRLF，返回 '\r' 的位置；未找到返回 len */
+static size_t find_crlf(const char *buf, size_t from, size_t len) {
+    size_t i;
+    for (i = from; i + 1 < len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n') return i;
+    }
+    return len;
+}
+
+/* 从 from 开始查找空行 "\r\n\r\n"，返回其起始位置；未找到返回 len */
+static size_t find_header_end(const char *buf, size_t from, size_t len) {
+    size_t i;
+    for (i = from; i + 4 <= len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n') {
+            return i;
+        }
+    }
+    return len;
+}
+
+/* 解析请求行 "METHOD SP target SP HTTP/1.x"，成功返回 0 */
+static int parse_request_line(const char *line, size_t n, struct http_request *req) {
+    const char *sp1;
+    const char *sp2;
+    const char *ver;
+
+    sp1 = (const char *)memchr(line, ' ', n);
+    if (sp1 == NULL || sp1 == line) return -1;
+    sp2 = (const char *)memchr(sp1 + 1, ' ', n - (size_t)(sp1 + 1 - line));
+    if (sp2 == NULL || sp2 == sp1 + 1) return -1;
+    ver = sp2 + 1;
+    if ((size_t)(line + n - ver) != 8 || memcmp(ver, "HTTP/1.", 7) != 0 ||
+        ver[7] < '0' || ver[7] > '9') {
+        return -1;
+    }
+
+    req->line = line;
+    req->line_len = n;
+    req->method = line;
+    req->method_len = (size_t)(sp1 - line);
+    req->target = sp1 + 1;
+    req->target_len = (size_t)(sp2 - sp1 - 1);
+    req->minor_version = ver[7] - '0';
+    req->keep_alive = req->minor_version >= 1; /* HTTP/1.1 默认持久连接，HTTP/1.0 默认关闭 */
+    req->head_only = req->method_len == 4 && memcmp(line, "HEAD", 4) == 0;
+    req->if_none_match = NULL;
+    req->if_none_match_len = 0;
+    return 0;
+}
+
+int http_parse_request(const char *buf, size_t len, struct http_request *req) {
+    size_t pos = 0;              /* 请求起点（跳过前导空行后） */
+    size_t hdr_end;              /* 空行位置 */
+    size_t eol;                  /* 当前行结束位置 */
+    size_t p;                    /* 当前头部行起点 */
+    const char *colon;           /* 头部字段名与取值的分隔符 */
+    const char *v;               /* 头部取值 */
+    size_t vlen;                 /* 头部取值长度 */
+    size_t cl = 0;               /* Content-Length */
+    int have_cl = 0;             /* 是否出现过 Content-Length */
+    int chunked = 0;             /* 是否出现过 Transfer-Encoding */
+    size_t total;                /* 请求总长度 */
+
+    /* RFC 7230 3.5：忽略请求之前的空行 */
+    while (pos + 1 < len && buf[pos] == '\r' && buf[pos + 1] == '\n') pos += 2;
+
+    hdr_end = find_header_end(buf, pos, len);
+    if (hdr_end == len) {        /* 请求头尚未接收完整 */
+        return len - pos > HTTP_MAX_HEADER ? HTTP_ERR_HEADER_TOO_BIG : 0;
+    }
+    if (hdr_end - pos > HTTP_MAX_HEADER) return HTTP_ERR_HEADER_TOO_BIG;
+
+    eol = find_crlf(buf, pos, hdr_end + 2);
+    if (parse_request_line(buf + pos, eol - pos, req) != 0) return HTTP_ERR_BAD_REQUEST;
+
+    /* 逐行解析头部字段，只关心影响分帧与连接管理的字段 */
+    for (p = eol + 2; p < hdr_end + 2; p = eol + 2) {
+        eol = find_crlf(buf, p, hdr_end + 2);
+        if (buf[p] == ' ' || buf[p] == '\t') return HTTP_ERR_BAD_REQUEST; /* 不接受过时的折行 */
+        colon = (const char *)memchr(buf + p, ':', eol - p);
+        if (colon == NULL || colon == buf + p) return HTTP_ERR_BAD_REQUEST;
+        if (colon[-1] == ' ' || colon[-1] == '\t') return HTTP_ERR_BAD_REQUEST; /* 字段名后不允许空白 */
+
+        v = colon + 1;
+        vlen = (size_t)(buf + eol - v);
+        while (vlen > 0 && (*v == ' ' || *v == '\t')) { v++; vlen--; }
+        while (vlen > 0 && (v[vlen - 1] == ' ' || v[vlen - 1] == '\t')) vlen--;
+
+        if (ci_equal(buf + p, (size_t)(colon - (buf + p)), "content-length")) {
+            size_t i;
+            size_t val = 0;
+            if (vlen == 0) return HTTP_ERR_BAD_REQUEST;
+            for (i = 0; i < vlen; i++) {
+                if (v[i] < '0' || v[i] > '9') return HTTP_ERR_BAD_REQUEST;
+                val = val * 10 + (size_t)(v[i] - '0');
+                if (val > HTTP_MAX_BODY) return HTTP_ERR_BODY_TOO_BIG;
+            }
+            if (have_cl && val != cl) return HTTP_ERR_BAD_REQUEST; /* 互相矛盾的 Content-Length */
+            cl = val;
+            have_cl = 1;
+        } else if (ci_equal(buf + p, (size_t)(colon - (buf + p)), "transfer-encoding")) {
+            chunked = 1;
+        } else if (ci_equal(buf + p, (size_t)(colon - (buf + p)), "connection")) {
+            if (ci_has_token(v, vlen, "close")) req->keep_alive = 0;
+            else if (ci_has_token(v, vlen, "keep-alive")) req->keep_alive = 1;
+        } else if (ci_equal(buf + p, (size_t)(colon - (buf + p)), "if-none-match")) {
+            req->if_none_match = v;
+            req->if_none_match_len = vlen;
+        }
+    }
+    if (chunked) return HTTP_ERR_NOT_IMPL;
+
+    total = hdr_end + 4 + cl;
+    if (len < total) return 0;   /* 请求体尚未接收完整 */
+
+    req->content_length = cl;
+    req->total_len = total;
+    return (int)total;
+}
+
+const char *http_error_response(int err) {
+    switch (err) {
+    case HTTP_ERR_BODY_TOO_BIG: return resp_413;
+    case HTTP_ERR_HEADER_TOO_BIG: return resp_431;
+    case HTTP_ERR_NOT_IMPL: return resp_501;
+    default: return resp_400;
+    }
+}
+
+int http_buf_reserve(struct http_buf *b, size_t need) {
+    size_t ncap;
+    char *nd;
+    if (b->cap - b->len >= need) return 0;
+    ncap = b->cap == 0 ? 1024 : b->cap;
+    while (ncap - b->len < need) ncap *= 2;
+    nd = (char *)realloc(b->data, ncap);
+    if (nd == NULL) return -1;
+    b->data = nd;
+    b->cap = ncap;
+    return 0;
+}
+
+int http_buf_append(struct http_buf *b, const char *p, size_t n) {
+    if (http_buf_reserve(b, n) != 0) return -1;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+void http_buf_consume(struct http_buf *b, size_t n) {
+    if (n >= b->len) {
+        b->len = 0;
+        return;
+    }
+    memmove(b->data, b->data + n, b->len - n);
+    b->len -= n;
+}
+
+void http_buf_free(struct http_buf *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef HTTP_PROTO_H
+#define HTTP_PROTO_H
+
+#include <stddef.h>              /* size_t */
+
+/* 单个请求头部分（请求行 + 头部字段）的最大长度 */
+#define HTTP_MAX_HEADER 8192
+/* 请求体的最大长度（请求体被读取后丢弃） */
+#define HTTP_MAX_BODY (1024 * 1024)
+
+/* http_parse_request 的错误返回值：取相应 HTTP 状态码的相反数 */
+#define HTTP_ERR_BAD_REQUEST   (-400) /* 请求格式错误 */
+#define HTTP_ERR_BODY_TOO_BIG  (-413) /* 请求体超过 HTTP_MAX_BODY */
+#define HTTP_ERR_HEADER_TOO_BIG (-431) /* 请求头超过 HTTP_MAX_HEADER */
+#define HTTP_ERR_NOT_IMPL      (-501) /* 不支持的特性（如分块传输编码的请求体） */
+
+/* 一个已完整接收的请求；指针指向输入缓冲，仅在缓冲被移动之前有效 */
+struct http_request {
+    const char *method;          /* 方法，例如 "GET" */
+    size_t method_len;           /* 方法长度 */
+    const char *target;          /* 请求目标，例如 "/index.html" */
+    size_t target_len;           /* 请求目标长度 */
+    const char *line;            /* 完整请求行（不含 CRLF），用于日志 */
+    size_t line_len;             /* 请求行长度 */
+    int minor_version;           /* HTTP/1.x 中的 x */
+    int keep_alive;              /* 响应后是否保持连接 */
+    int head_only;               /* 是否为 HEAD 请求（响应不带正文） */
+    const char *if_none_match;   /* If-None-Match 取值（无则为 NULL） */
+    size_t if_none_match_len;    /* If-None-Match 取值长度 */
+    size_t content_length;       /* 请求体长度 */
+    size_t total_len;            /* 请求在输入流中占用的总字节数（头 + 体） */
+};
+
+/* 简单的可增长字节缓冲 */
+struct http_buf {
+    char *data;                  /* 数据 */
+    size_t len;                  /* 已用长度 */
+    size_t cap;                  /* 容量 */
+};
+
+/* 从 buf[0..len) 中解析一个完整请求。
+ * 返回值 > 0：请求完整，返回占用的字节数（同 req->total_len）；
+ * 返回 0：数据不完整，需要继续接收；
+ * 返回 < 0：HTTP_ERR_* 错误，连接应在发送错误响应后关闭。 */
+int http_parse_request(const char *buf, size_t len, struct http_request *req);
+
+/* 返回与 HTTP_ERR_* 对应的完整错误响应（Connection: close） */
+const char *http_error_response(int err);
+
+/* 确保缓冲至少还有 need 字节空闲，成功返回 0 */
+int http_buf_reserve(struct http_buf *b, size_t need);
+
+/* 向缓冲追加 n 字节，成功返回 0 */
+int http_buf_append(struct http_buf *b, const char *p, size_t n);
+
+/* 丢弃缓冲开头的 n 字节，将剩余数据移到开头 */
+void http_buf_consume(struct http_buf *b, size_t n);
+
+/* 释放缓冲内存 */
+void http_buf_free(struct http_buf *b);
+
+#endif /* HTTP_PROTO_H */
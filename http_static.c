@@ -0,0 +1,869 @@
+#define _GNU_SOURCE              /* openat、sendfile、inotify、gmtime_r、snprintf 等声明 */
+
+#include <stdio.h>               /* snprintf, fprintf */
+#include <stdlib.h>              /* malloc, free, realpath */
+#include <string.h>              /* memcpy, strlen, strrchr */
+#include <errno.h>               /* errno */
+#include <fcntl.h>               /* openat, O_RDONLY */
+#include <unistd.h>              /* close, pread, read, sysconf */
+#include <limits.h>              /* PATH_MAX */
+#include <time.h>                /* gmtime_r, strftime */
+#include <pthread.h>             /* pthread_rwlock_t, 失效线程 */
+#include <sys/stat.h>            /* fstat */
+#include <sys/uio.h>             /* writev */
+#include <sys/mman.h>            /* mmap（sendfile 不可用时的回退） */
+#include <sys/sendfile.h>        /* sendfile */
+#include <sys/inotify.h>         /* inotify */
+#include "http_static.h"
+
+#define OUTQ_MAX_IOV 64          /* 每次 writev 合并的最大段数 */
+#define CACHE_BUCKETS 1024       /* 缓存哈希桶数（2 的幂） */
+#define HDR_MAX 512              /* 生成的响应头最大长度 */
+#define SENDFILE_CHUNK (1 << 30) /* 单次 sendfile 的最大长度 */
+#define WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* 热点缓存项：预生成的两种响应头（保持连接/关闭连接）和文件内容放在同一块内存中 */
+struct http_cache_entry {
+    char *key;                   /* 规范化的相对路径 */
+    unsigned long hash;          /* key 的哈希 */
+    char *mem;                   /* hdr_ka + hdr_close + body */
+    const char *hdr_ka;          /* Connection: keep-alive 版本的响应头 */
+    size_t hdr_ka_len;
+    const char *hdr_close;       /* Connection: close 版本的响应头 */
+    size_t hdr_close_len;
+    const char *body;            /* 文件内容 */
+    size_t body_len;
+    size_t charge;               /* 计入缓存总量的字节数 */
+    char etag[48];               /* ETag（含引号） */
+    int refcnt;                  /* 引用计数：缓存表持有 1，每个排队中的段各持有 1 */
+    int referenced;              /* CLOCK 淘汰的访问位 */
+    struct http_cache_entry *hnext; /* 哈希链 */
+    struct http_cache_entry *cprev; /* CLOCK 环 */
+    struct http_cache_entry *cnext;
+};
+
+/* inotify 监视的目录 */
+struct watch {
+    int wd;                      /* 监视描述符 */
+    char *dir;                   /* 相对 docroot 的目录（根目录为 ""） */
+};
+
+static int g_root_fd = -1;       /* docroot 目录 fd，所有文件都相对它打开 */
+static char g_root_path[PATH_MAX]; /* docroot 绝对路径（inotify 需要路径） */
+static size_t g_cache_limit;     /* 缓存总上限，0 表示不缓存 */
+static size_t g_cache_used;      /* 已用缓存字节数 */
+static unsigned long g_inval_gen; /* 失效事件计数：填充期间有失效发生则放弃插入 */
+static struct http_cache_entry *g_table[CACHE_BUCKETS]; /* 哈希表 */
+static struct http_cache_entry *g_clock; /* CLOCK 指针（环形双向链表中的当前位置） */
+static pthread_rwlock_t g_cache_lock = PTHREAD_RWLOCK_INITIALIZER; /* 读多写少 */
+static int g_inotify_fd = -1;    /* inotify 实例 */
+static struct watch *g_watches;  /* 已监视目录 */
+static size_t g_nwatches;
+static size_t g_watch_cap;
+static pthread_mutex_t g_watch_lock = PTHREAD_MUTEX_INITIALIZER; /* 保护 g_watches */
+
+/* ---------------- 输出队列 ---------------- */
+
+/* 追加一个段，成功返回 0 */
+static int outq_push(struct http_outq *q, const struct http_seg *s) {
+    if (q->nsegs == q->cap) {
+        size_t ncap = q->cap == 0 ? 8 : q->cap * 2;
+        struct http_seg *ns = (struct http_seg *)realloc(q->segs, ncap * sizeof(*ns));
+        if (ns == NULL) return -1;
+        q->segs = ns;
+        q->cap = ncap;
+    }
+    q->segs[q->nsegs++] = *s;
+    q->pending += s->len;
+    return 0;
+}
+
+/* 释放缓存项引用 */
+static void entry_release(struct http_cache_entry *e) {
+    if (__atomic_sub_fetch(&e->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(e->mem);
+        free(e->key);
+        free(e);
+    }
+}
+
+/* 段已发完或被丢弃：释放它持有的资源 */
+static void seg_done(struct http_seg *s) {
+    if (s->kind == HTTP_SEG_REF) {
+        entry_release(s->ref);
+    } else if (s->kind == HTTP_SEG_FILE) {
+        if (s->map != NULL) munmap(s->map, s->map_len);
+        close(s->fd);
+    }
+    s->kind = HTTP_SEG_BUF;      /* 防止重复释放 */
+    s->len = 0;
+}
+
+int http_outq_append(struct http_outq *q, const char *p, size_t n) {
+    struct http_seg s;
+    struct http_seg *last;
+    size_t off = q->buf.len;
+    if (n == 0) return 0;
+    if (http_buf_append(&q->buf, p, n) != 0) return -1;
+    last = q->nsegs > q->head ? &q->segs[q->nsegs - 1] : NULL;
+    if (last != NULL && last->kind == HTTP_SEG_BUF && (size_t)last->off + last->len == off) {
+        last->len += n;          /* 与上一段连续，直接合并 */
+        q->pending += n;
+        return 0;
+    }
+    memset(&s, 0, sizeof(s));
+    s.kind = HTTP_SEG_BUF;
+    s.off = (off_t)off;
+    s.len = n;
+    if (outq_push(q, &s) != 0) {
+        q->buf.len = off;
+        return -1;
+    }
+    return 0;
+}
+
+/* 追加一个引用缓存项内存的段；调用者转交一个引用给该段 */
+static int outq_append_ref(struct http_outq *q, struct http_cache_entry *e, const char *p, size_t n) {
+    struct http_seg s;
+    memset(&s, 0, sizeof(s));
+    s.kind = HTTP_SEG_REF;
+    s.mem = p;
+    s.ref = e;
+    s.len = n;
+    if (outq_push(q, &s) != 0) {
+        entry_release(e);
+        return -1;
+    }
+    return 0;
+}
+
+/* 追加一个文件段；fd 的所有权转交给队列 */
+static int outq_append_file(struct http_outq *q, int fd, off_t off, size_t n) {
+    struct http_seg s;
+    memset(&s, 0, sizeof(s));
+    s.kind = HTTP_SEG_FILE;
+    s.fd = fd;
+    s.off = off;
+    s.len = n;
+    if (outq_push(q, &s) != 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+/* 标记队列开头 n 字节已发出，推进（并释放）对应的段 */
+static void outq_advance(struct http_outq *q, size_t n) {
+    struct http_seg *s;
+    q->pending -= n;
+    while (n > 0) {              /* 按已写字节推进各段 */
+        s = &q->segs[q->head];
+        if (n >= s->len) {
+            n -= s->len;
+            seg_done(s);
+            q->head++;
+        } else {
+            if (s->kind == HTTP_SEG_BUF) s->off += (off_t)n;
+            else if (s->kind == HTTP_SEG_REF) s->mem += n;
+            else {
+                s->off += (off_t)n;
+                if (s->map != NULL) s->map_skip += n;
+            }
+            s->len -= n;
+            n = 0;
+        }
+    }
+}
+
+/* 发送文件段的一部分。优先 sendfile；文件系统不支持时改为 mmap 后直接从映射写出。
+ * 两种方式都不把文件内容复制到用户态缓冲。返回已发送字节数或 -1（errno） */
+static ssize_t seg_send_file(struct http_seg *s, int sockfd) {
+    ssize_t n;
+    if (s->map == NULL) {
+        n = sendfile(sockfd, s->fd, &s->off, s->len < SENDFILE_CHUNK ? s->len : SENDFILE_CHUNK);
+        if (n > 0) return n;
+        if (n == 0) {            /* 文件在发送期间被截断 */
+            errno = EIO;
+            return -1;
+        }
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+        {                        /* sendfile 不可用：映射剩余区间 */
+            long page = sysconf(_SC_PAGESIZE);
+            off_t aligned = s->off & ~((off_t)page - 1);
+            void *m;
+            s->map_skip = (size_t)(s->off - aligned);
+            s->map_len = s->map_skip + s->len;
+            m = mmap(NULL, s->map_len, PROT_READ, MAP_SHARED, s->fd, aligned);
+            if (m == MAP_FAILED) return -1;
+            s->map = (char *)m;
+        }
+    }
+    n = write(sockfd, s->map + s->map_skip, s->len);
+    if (n > 0) {
+        s->map_skip += (size_t)n;
+        s->off += n;
+    }
+    return n;
+}
+
+int http_outq_flush(struct http_outq *q, int sockfd) {
+    struct iovec iov[OUTQ_MAX_IOV];
+    struct http_seg *s;
+    ssize_t n;
+    size_t cnt;
+    size_t i;
+
+    while (q->head < q->nsegs) {
+        s = &q->segs[q->head];
+        if (s->len == 0) {
+            seg_done(s);
+            q->head++;
+            continue;
+        }
+        if (s->kind == HTTP_SEG_FILE) {
+            n = seg_send_file(s, sockfd);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            }
+            s->len -= (size_t)n;
+            q->pending -= (size_t)n;
+            continue;
+        }
+
+        /* 连续的内存段（头部、缓存内容、固定响应）合并为一次 writev */
+        cnt = 0;
+        for (i = q->head; i < q->nsegs && cnt < OUTQ_MAX_IOV && q->segs[i].kind != HTTP_SEG_FILE; i++) {
+            if (q->segs[i].kind == HTTP_SEG_BUF) {
+                iov[cnt].iov_base = q->buf.data + q->segs[i].off;
+            } else {
+                iov[cnt].iov_base = (void *)q->segs[i].mem;
+            }
+            iov[cnt].iov_len = q->segs[i].len;
+            cnt++;
+        }
+        n = writev(sockfd, iov, (int)cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        outq_advance(q, (size_t)n);
+    }
+    http_outq_reset(q);
+    return 1;
+}
+
+size_t http_outq_peek(const struct http_outq *q, char *dst, size_t cap) {
+    const struct http_seg *s;
+    size_t i;
+    size_t n;
+    size_t got = 0;
+
+    for (i = q->head; i < q->nsegs && got < cap; i++) {
+        s = &q->segs[i];
+        n = s->len < cap - got ? s->len : cap - got;
+        if (n == 0) continue;
+        if (s->kind == HTTP_SEG_FILE) break;  /* 文件内容不在这里同步读取 */
+        memcpy(dst + got, s->kind == HTTP_SEG_BUF ? q->buf.data + s->off : s->mem, n);
+        got += n;
+    }
+    return got;
+}
+
+int http_outq_file(const struct http_outq *q, int *fd, off_t *off, size_t *len) {
+    size_t i;
+
+    for (i = q->head; i < q->nsegs; i++) {
+        if (q->segs[i].len == 0) continue;
+        if (q->segs[i].kind != HTTP_SEG_FILE) return 0;
+        *fd = q->segs[i].fd;
+        *off = q->segs[i].off;
+        *len = q->segs[i].len;
+        return 1;
+    }
+    return 0;
+}
+
+void http_outq_advance(struct http_outq *q, size_t n) {
+    outq_advance(q, n);
+    if (q->head == q->nsegs) http_outq_reset(q);
+}
+
+void http_outq_reset(struct http_outq *q) {
+    size_t i;
+    for (i = q->head; i < q->nsegs; i++) seg_done(&q->segs[i]);
+    q->nsegs = 0;
+    q->head = 0;
+    q->pending = 0;
+    q->buf.len = 0;
+}
+
+void http_outq_free(struct http_outq *q) {
+    http_outq_reset(q);
+    free(q->segs);
+    q->segs = NULL;
+    q->cap = 0;
+    http_buf_free(&q->buf);
+}
+
+/* ---------------- 路径与响应头 ---------------- */
+
+/* 十六进制字符取值，非法返回 -1 */
+static int hexval(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* 将请求目标转换为相对 docroot 的规范路径（无前导 '/'，不含 "." 与 ".."），
+ * 以 '/' 结尾的目录请求映射到 index.html。成功返回 0 */
+static int normalize_target(const char *t, size_t n, char *out, size_t outsz) {
+    char dec[PATH_MAX];
+    size_t dlen = 0;
+    size_t i;
+    size_t olen = 0;
+    size_t seg;
+    int dir_request;
+
+    if (n == 0 || t[0] != '/') return -1;
+    for (i = 0; i < n && t[i] != '?' && t[i] != '#'; i++) { /* 去掉查询串并做百分号解码 */
+        int c = (unsigned char)t[i];
+        if (c == '%') {
+            int hi, lo;
+            if (i + 2 >= n) return -1;
+            hi = hexval((unsigned char)t[i + 1]);
+            lo = hexval((unsigned char)t[i + 2]);
+            if (hi < 0 || lo < 0) return -1;
+            c = hi * 16 + lo;
+            i += 2;
+        }
+        if (c == '\0' || dlen + 1 >= sizeof(dec)) return -1;
+        dec[dlen++] = (char)c;
+    }
+    dir_request = dec[dlen - 1] == '/';
+
+    for (i = 0; i < dlen; i = seg + 1) { /* 逐段复制，跳过空段与 "."，拒绝 ".." */
+        size_t len;
+        for (seg = i; seg < dlen && dec[seg] != '/'; seg++) {}
+        len = seg - i;
+        if (len == 0 || (len == 1 && dec[i] == '.')) continue;
+        if (len == 2 && dec[i] == '.' && dec[i + 1] == '.') return -1;
+        if (olen + len + 2 >= outsz) return -1;
+        if (olen > 0) out[olen++] = '/';
+        memcpy(out + olen, dec + i, len);
+        olen += len;
+    }
+    if (dir_request || olen == 0) {
+        if (olen + sizeof("/index.html") >= outsz) return -1;
+        if (olen > 0) out[olen++] = '/';
+        memcpy(out + olen, "index.html", sizeof("index.html"));
+        olen += sizeof("index.html") - 1;
+    }
+    out[olen] = '\0';
+    return 0;
+}
+
+/* 按扩展名推断 Content-Type */
+static const char *content_type(const char *path) {
+    static const char *const map[] = {
+        ".html", "text/html; charset=utf-8",
+        ".htm", "text/html; charset=utf-8",
+        ".css", "text/css",
+        ".js", "application/javascript",
+        ".json", "application/json",
+        ".txt", "text/plain; charset=utf-8",
+        ".xml", "application/xml",
+        ".svg", "image/svg+xml",
+        ".png", "image/png",
+        ".jpg", "image/jpeg",
+        ".jpeg", "image/jpeg",
+        ".gif", "image/gif",
+        ".ico", "image/x-icon",
+        ".wasm", "application/wasm",
+        ".pdf", "application/pdf",
+        NULL, NULL
+    };
+    const char *dot = strrchr(path, '.');
+    int i;
+    if (dot != NULL && strchr(dot, '/') == NULL) {
+        for (i = 0; map[i] != NULL; i += 2) {
+            if (strcmp(dot, map[i]) == 0) return map[i + 1];
+        }
+    }
+    return "application/octet-stream";
+}
+
+/* 由 inode、大小与修改时间生成 ETag 与 Last-Modified */
+static void file_validators(const struct stat *st, char *etag, size_t etag_sz, char *lastmod, size_t lm_sz) {
+    struct tm tm;
+    snprintf(etag, etag_sz, "\"%lx-%lx-%lx\"", (unsigned long)st->st_ino,
+             (unsigned long)st->st_size, (unsigned long)st->st_mtime);
+    gmtime_r(&st->st_mtime, &tm);
+    strftime(lastmod, lm_sz, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/* 生成 200 响应头，返回长度 */
+static size_t build_file_header(char *dst, size_t cap, size_t clen, const char *ctype,
+                                const char *etag, const char *lastmod, int keep_alive) {
+    int n = snprintf(dst, cap,
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Length: %lu\r\n"
+                     "Content-Type: %s\r\n"
+                     "ETag: %s\r\n"
+                     "Last-Modified: %s\r\n"
+                     "Connection: %s\r\n"
+                     "\r\n",
+                     (unsigned long)clen, ctype, etag, lastmod, keep_alive ? "keep-alive" : "close");
+    return n < 0 || (size_t)n >= cap ? 0 : (size_t)n;
+}
+
+/* 追加一个无正文的响应（状态行 + 可选的附加头） */
+static int append_status(struct http_outq *q, const char *status, const char *extra, int keep_alive) {
+    char hdr[HDR_MAX];
+    int n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                     status, extra, keep_alive ? "keep-alive" : "close");
+    if (n < 0 || (size_t)n >= sizeof(hdr)) return -1;
+    return http_outq_append(q, hdr, (size_t)n);
+}
+
+/* 追加 304 响应 */
+static int append_not_modified(struct http_outq *q, const char *etag, int keep_alive) {
+    char extra[96];
+    snprintf(extra, sizeof(extra), "ETag: %s\r\n", etag);
+    return append_status(q, "304 Not Modified", extra, keep_alive);
+}
+
+/* If-None-Match 是否与 etag 匹配：值为 "*"，或逗号分隔的列表中有一项与之相同。
+ * 按 RFC 9110 用弱比较：每项去掉首尾空白和可选的 W/ 前缀后，整个带引号的标签
+ * 与 etag 逐字节相等才算匹配 */
+static int etag_matches(const struct http_request *req, const char *etag) {
+    size_t elen = strlen(etag);
+    const char *p, *end, *tag;
+    if (req->if_none_match == NULL) return 0;
+    p = req->if_none_match;
+    end = p + req->if_none_match_len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++; /* 项间的逗号与空白 */
+        if (p == end) break;
+        if (*p == '*') {
+            tag = p++;
+        } else {
+            if (end - p >= 2 && p[0] == 'W' && p[1] == '/') p += 2; /* 弱标签 */
+            tag = p;
+            if (p < end && *p == '"') {
+                p++;
+                while (p < end && *p != '"') p++; /* 标签内可以有逗号 */
+                if (p < end) p++;
+            }
+        }
+        if (*tag == '*' && p - tag == 1) {
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            if (p == end || *p == ',') return 1;
+        } else if ((size_t)(p - tag) == elen && tag[0] == '"' && memcmp(tag, etag, elen) == 0) {
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            if (p == end || *p == ',') return 1;
+        }
+        while (p < end && *p != ',') p++;   /* 跳过这一项的剩余部分（格式不对的项） */
+    }
+    return 0;
+}
+
+/* ---------------- 热点缓存 ---------------- */
+
+static unsigned long hash_key(const char *s) {
+    unsigned long h = 5381UL;
+    while (*s) h = h * 33UL + (unsigned char)*s++;
+    return h;
+}
+
+/* 查找缓存项，命中时返回一个新引用 */
+static struct http_cache_entry *cache_lookup(const char *key, unsigned long h) {
+    struct http_cache_entry *e;
+    pthread_rwlock_rdlock(&g_cache_lock);
+    for (e = g_table[h & (CACHE_BUCKETS - 1)]; e != NULL; e = e->hnext) {
+        if (e->hash == h && strcmp(e->key, key) == 0) {
+            __atomic_add_fetch(&e->refcnt, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&e->referenced, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&g_cache_lock);
+    return e;
+}
+
+/* 从表与 CLOCK 环中移除缓存项并释放表持有的引用（需持有写锁） */
+static void cache_unlink_locked(struct http_cache_entry *e) {
+    struct http_cache_entry **pp = &g_table[e->hash & (CACHE_BUCKETS - 1)];
+    while (*pp != e) pp = &(*pp)->hnext;
+    *pp = e->hnext;
+    if (e->cnext == e) {
+        g_clock = NULL;
+    } else {
+        e->cprev->cnext = e->cnext;
+        e->cnext->cprev = e->cprev;
+        if (g_clock == e) g_clock = e->cnext;
+    }
+    g_cache_used -= e->charge;
+    entry_release(e);            /* 正在发送该项的连接仍持有各自的引用 */
+}
+
+/* 使 key 对应的缓存项失效 */
+static void cache_invalidate(const char *key) {
+    unsigned long h = hash_key(key);
+    struct http_cache_entry *e;
+    pthread_rwlock_wrlock(&g_cache_lock);
+    g_inval_gen++;
+    for (e = g_table[h & (CACHE_BUCKETS - 1)]; e != NULL; e = e->hnext) {
+        if (e->hash == h && strcmp(e->key, key) == 0) {
+            cache_unlink_locked(e);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&g_cache_lock);
+}
+
+/* 清空缓存（目录被删除/改名或 inotify 队列溢出时无法精确定位失效项） */
+static void cache_flush_all(void) {
+    pthread_rwlock_wrlock(&g_cache_lock);
+    g_inval_gen++;
+    while (g_clock != NULL) cache_unlink_locked(g_clock);
+    pthread_rwlock_unlock(&g_cache_lock);
+}
+
+/* 插入新项，必要时用 CLOCK 算法淘汰近期未被访问的项（需持有写锁）。
+ * 空间不足返回 -1，此时 e 未被插入 */
+static int cache_insert_locked(struct http_cache_entry *e) {
+    size_t scans = 0;
+    size_t limit_scans = 2 * (g_cache_used / 64 + 1);
+    if (e->charge > g_cache_limit) return -1;
+    while (g_cache_used + e->charge > g_cache_limit && g_clock != NULL && scans++ < limit_scans) {
+        struct http_cache_entry *victim = g_clock;
+        if (__atomic_load_n(&victim->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&victim->referenced, 0, __ATOMIC_RELAXED); /* 给第二次机会 */
+            g_clock = victim->cnext;
+        } else {
+            cache_unlink_locked(victim);
+        }
+    }
+    if (g_cache_used + e->charge > g_cache_limit) return -1;
+
+    e->hnext = g_table[e->hash & (CACHE_BUCKETS - 1)];
+    g_table[e->hash & (CACHE_BUCKETS - 1)] = e;
+    if (g_clock == NULL) {       /* 插到 CLOCK 指针之前，即最晚被扫描的位置 */
+        e->cprev = e;
+        e->cnext = e;
+        g_clock = e;
+    } else {
+        e->cnext = g_clock;
+        e->cprev = g_clock->cprev;
+        g_clock->cprev->cnext = e;
+        g_clock->cprev = e;
+    }
+    g_cache_used += e->charge;
+    return 0;
+}
+
+/* 确保 key 所在目录已被 inotify 监视，成功返回 0 */
+static int ensure_watch(const char *key) {
+    char path[PATH_MAX];
+    const char *slash = strrchr(key, '/');
+    size_t dlen = slash != NULL ? (size_t)(slash - key) : 0;
+    size_t i;
+    int wd;
+    int rc = 0;
+
+    pthread_mutex_lock(&g_watch_lock);
+    for (i = 0; i < g_nwatches; i++) {
+        if (strlen(g_watches[i].dir) == dlen && memcmp(g_watches[i].dir, key, dlen) == 0) {
+            pthread_mutex_unlock(&g_watch_lock);
+            return 0;
+        }
+    }
+    snprintf(path, sizeof(path), "%s/%.*s", g_root_path, (int)dlen, key);
+    wd = inotify_add_watch(g_inotify_fd, path, WATCH_MASK);
+    if (wd < 0) {
+        rc = -1;
+    } else {
+        if (g_nwatches == g_watch_cap) {
+            size_t ncap = g_watch_cap == 0 ? 16 : g_watch_cap * 2;
+            struct watch *nw = (struct watch *)realloc(g_watches, ncap * sizeof(*nw));
+            if (nw == NULL) {
+                rc = -1;
+            } else {
+                g_watches = nw;
+                g_watch_cap = ncap;
+            }
+        }
+        if (rc == 0) {
+            char *d = (char *)malloc(dlen + 1);
+            if (d == NULL) {
+                rc = -1;
+            } else {
+                memcpy(d, key, dlen);
+                d[dlen] = '\0';
+                g_watches[g_nwatches].wd = wd;
+                g_watches[g_nwatches].dir = d;
+                g_nwatches++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_watch_lock);
+    return rc;
+}
+
+/* 读取小文件并生成缓存项；成功时返回一个供调用者使用的引用（缓存表另持有一个）。
+ * 监视先于读取建立，且读取期间若有失效事件则放弃插入，避免缓存过期内容 */
+static struct http_cache_entry *cache_fill(const char *key, unsigned long h, int fd, const struct stat *st) {
+    struct http_cache_entry *e;
+    struct stat st2;
+    char hdr[HDR_MAX];
+    char lastmod[64];
+    const char *ctype = content_type(key);
+    size_t body_len = (size_t)st->st_size;
+    size_t ka_len, close_len, got;
+    unsigned long gen;
+    char *mem;
+
+    if (ensure_watch(key) != 0) return NULL; /* 无法保证失效通知就不缓存 */
+    pthread_rwlock_rdlock(&g_cache_lock);
+    gen = g_inval_gen;
+    pthread_rwlock_unlock(&g_cache_lock);
+
+    e = (struct http_cache_entry *)calloc(1, sizeof(*e));
+    if (e == NULL) return NULL;
+    file_validators(st, e->etag, sizeof(e->etag), lastmod, sizeof(lastmod));
+    ka_len = build_file_header(hdr, sizeof(hdr), body_len, ctype, e->etag, lastmod, 1);
+    close_len = ka_len - (sizeof("keep-alive") - sizeof("close"));
+    e->key = (char *)malloc(strlen(key) + 1);
+    mem = (char *)malloc(ka_len + close_len + body_len + 1);
+    if (ka_len == 0 || e->key == NULL || mem == NULL) goto fail;
+    strcpy(e->key, key);
+    e->mem = mem;
+    memcpy(mem, hdr, ka_len);
+    build_file_header(mem + ka_len, close_len + 1, body_len, ctype, e->etag, lastmod, 0);
+    e->hdr_ka = mem;
+    e->hdr_ka_len = ka_len;
+    e->hdr_close = mem + ka_len;
+    e->hdr_close_len = close_len;
+    e->body = mem + ka_len + close_len;
+    e->body_len = body_len;
+    e->charge = ka_len + close_len + body_len + sizeof(*e);
+    e->hash = h;
+    e->refcnt = 2;
+    e->referenced = 1;
+
+    for (got = 0; got < body_len;) { /* 读取文件内容 */
+        ssize_t n = pread(fd, (char *)e->body + got, body_len - got, (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) goto fail;
+        got += (size_t)n;
+    }
+    if (fstat(fd, &st2) != 0 || st2.st_size != st->st_size || st2.st_mtime != st->st_mtime) {
+        goto fail;               /* 读取期间文件被修改 */
+    }
+
+    pthread_rwlock_wrlock(&g_cache_lock);
+    if (gen != g_inval_gen) {    /* 期间发生过失效事件，内容可能已过期 */
+        pthread_rwlock_unlock(&g_cache_lock);
+        goto fail;
+    }
+    {                            /* 另一个线程可能已插入同一文件 */
+        struct http_cache_entry *x;
+        for (x = g_table[h & (CACHE_BUCKETS - 1)]; x != NULL; x = x->hnext) {
+            if (x->hash == h && strcmp(x->key, key) == 0) {
+                __atomic_add_fetch(&x->refcnt, 1, __ATOMIC_RELAXED);
+                pthread_rwlock_unlock(&g_cache_lock);
+                free(mem);
+                free(e->key);
+                free(e);
+                return x;
+            }
+        }
+    }
+    if (cache_insert_locked(e) != 0) {
+        pthread_rwlock_unlock(&g_cache_lock);
+        goto fail;
+    }
+    pthread_rwlock_unlock(&g_cache_lock);
+    return e;
+
+fail:
+    free(mem);
+    free(e->key);
+    free(e);
+    return NULL;
+}
+
+/* inotify 线程：把文件变更翻译为缓存失效 */
+static void *inotify_thread(void *arg) {
+    char buf[8192];
+    ssize_t n;
+    char *p;
+    (void)arg;
+    for (;;) {
+        n = read(g_inotify_fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "inotify read failed: %s, disabling cache\n", strerror(errno));
+            pthread_rwlock_wrlock(&g_cache_lock);
+            g_cache_limit = 0;   /* 失去失效通知后不能再缓存 */
+            pthread_rwlock_unlock(&g_cache_lock);
+            cache_flush_all();
+            return NULL;
+        }
+        for (p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT) ||
+                ((ev->mask & IN_ISDIR) && (ev->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))) {
+                if (ev->mask & IN_IGNORED) { /* 监视已失效，下次填充时重新建立 */
+                    size_t i;
+                    pthread_mutex_lock(&g_watch_lock);
+                    for (i = 0; i < g_nwatches; i++) {
+                        if (g_watches[i].wd == ev->wd) {
+                            free(g_watches[i].dir);
+                            g_watches[i] = g_watches[--g_nwatches];
+                            break;
+                        }
+                    }
+                    pthread_mutex_unlock(&g_watch_lock);
+                }
+                cache_flush_all();
+            } else if (ev->len > 0 && !(ev->mask & IN_ISDIR)) {
+                char key[PATH_MAX];
+                size_t i;
+                key[0] = '\0';
+                pthread_mutex_lock(&g_watch_lock);
+                for (i = 0; i < g_nwatches; i++) {
+                    if (g_watches[i].wd == ev->wd) {
+                        if (g_watches[i].dir[0] != '\0') {
+                            snprintf(key, sizeof(key), "%s/%s", g_watches[i].dir, ev->name);
+                        } else {
+                            snprintf(key, sizeof(key), "%s", ev->name);
+                        }
+                        break;
+                    }
+                }
+                pthread_mutex_unlock(&g_watch_lock);
+                if (key[0] != '\0') cache_invalidate(key);
+            }
+        }
+    }
+    return NULL;
+}
+
+int http_static_init(const char *docroot, size_t cache_bytes) {
+    pthread_t tid;
+    if (realpath(docroot, g_root_path) == NULL) {
+        fprintf(stderr, "docroot %s: %s\n", docroot, strerror(errno));
+        return -1;
+    }
+    g_root_fd = open(g_root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (g_root_fd < 0) {
+        fprintf(stderr, "open docroot %s: %s\n", g_root_path, strerror(errno));
+        return -1;
+    }
+    if (cache_bytes == 0) return 0;
+
+    g_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (g_inotify_fd < 0) {
+        fprintf(stderr, "inotify_init1 failed: %s, cache disabled\n", strerror(errno));
+        return 0;
+    }
+    if (pthread_create(&tid, NULL, inotify_thread, NULL) != 0) {
+        fprintf(stderr, "pthread_create for inotify failed, cache disabled\n");
+        close(g_inotify_fd);
+        g_inotify_fd = -1;
+        return 0;
+    }
+    pthread_detach(tid);
+    g_cache_limit = cache_bytes;
+    return 0;
+}
+
+/* 用缓存项响应；消耗调用者持有的一个引用 */
+static int respond_entry(const struct http_request *req, struct http_cache_entry *e, struct http_outq *q) {
+    if (etag_matches(req, e->etag)) {
+        int rc = append_not_modified(q, e->etag, req->keep_alive);
+        entry_release(e);
+        return rc;
+    }
+    if (!req->head_only && e->body_len > 0) {
+        __atomic_add_fetch(&e->refcnt, 1, __ATOMIC_RELAXED); /* 正文段另持有一个引用 */
+    }
+    if (req->keep_alive) {
+        if (outq_append_ref(q, e, e->hdr_ka, e->hdr_ka_len) != 0) {
+            if (!req->head_only && e->body_len > 0) entry_release(e);
+            return -1;
+        }
+    } else if (outq_append_ref(q, e, e->hdr_close, e->hdr_close_len) != 0) {
+        if (!req->head_only && e->body_len > 0) entry_release(e);
+        return -1;
+    }
+    if (req->head_only || e->body_len == 0) return 0;
+    return outq_append_ref(q, e, e->body, e->body_len);
+}
+
+int http_static_respond(const struct http_request *req, struct http_outq *q) {
+    char rel[PATH_MAX];
+    char hdr[HDR_MAX];
+    char etag[48];
+    char lastmod[64];
+    struct stat st;
+    struct http_cache_entry *e;
+    unsigned long h;
+    size_t hlen;
+    size_t limit;
+    int fd;
+
+    if (!(req->method_len == 3 && memcmp(req->method, "GET", 3) == 0) && !req->head_only) {
+        return append_status(q, "405 Method Not Allowed", "Allow: GET, HEAD\r\n", req->keep_alive);
+    }
+    if (normalize_target(req->target, req->target_len, rel, sizeof(rel)) != 0) {
+        return append_status(q, "404 Not Found", "", req->keep_alive);
+    }
+    h = hash_key(rel);
+
+    limit = __atomic_load_n(&g_cache_limit, __ATOMIC_RELAXED);
+    if (limit > 0 && (e = cache_lookup(rel, h)) != NULL) {
+        return respond_entry(req, e, q);
+    }
+
+    fd = openat(g_root_fd, rel, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == EACCES) return append_status(q, "403 Forbidden", "", req->keep_alive);
+        if (errno == ENOENT || errno == ENOTDIR || errno == ELOOP || errno == ENAMETOOLONG) {
+            return append_status(q, "404 Not Found", "", req->keep_alive);
+        }
+        return append_status(q, "500 Internal Server Error", "", req->keep_alive);
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return append_status(q, "404 Not Found", "", req->keep_alive);
+    }
+
+    if (limit > 0 && st.st_size <= HTTP_CACHE_MAX_FILE &&
+        (e = cache_fill(rel, h, fd, &st)) != NULL) {
+        close(fd);
+        return respond_entry(req, e, q);
+    }
+
+    /* 大文件（或缓存已满）：生成头部，内容交给 sendfile */
+    file_validators(&st, etag, sizeof(etag), lastmod, sizeof(lastmod));
+    if (etag_matches(req, etag)) {
+        close(fd);
+        return append_not_modified(q, etag, req->keep_alive);
+    }
+    hlen = build_file_header(hdr, sizeof(hdr), (size_t)st.st_size, content_type(rel), etag, lastmod,
+                             req->keep_alive);
+    if (hlen == 0 || http_outq_append(q, hdr, hlen) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (req->head_only || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    return outq_append_file(q, fd, 0, (size_t)st.st_size);
+}
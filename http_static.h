@@ -0,0 +1,75 @@
+#ifndef HTTP_STATIC_H
+#define HTTP_STATIC_H
+
+#include <stddef.h>              /* size_t */
+#include <sys/types.h>           /* off_t */
+#include "http_proto.h"
+
+/* 不超过此大小的文件才会进入热点缓存，更大的文件始终用 sendfile 发送 */
+#define HTTP_CACHE_MAX_FILE (64 * 1024)
+
+struct http_cache_entry;         /* 缓存项（引用计数，定义在 http_static.c） */
+
+/* 输出队列中的一段数据 */
+struct http_seg {
+    int kind;                    /* HTTP_SEG_* */
+    const char *mem;             /* HTTP_SEG_REF：缓存项内存 */
+    struct http_cache_entry *ref; /* HTTP_SEG_REF：持有的缓存项引用 */
+    int fd;                      /* HTTP_SEG_FILE：文件描述符（由队列负责关闭） */
+    char *map;                   /* HTTP_SEG_FILE：sendfile 不可用时的 mmap 映射 */
+    size_t map_len;              /* 映射长度 */
+    size_t map_skip;             /* 映射起点到 off 的偏移（页对齐所致） */
+    off_t off;                   /* HTTP_SEG_BUF：在 buf 中的偏移；HTTP_SEG_FILE：文件偏移 */
+    size_t len;                  /* 剩余未发送的字节数 */
+};
+
+#define HTTP_SEG_BUF  0          /* 复制到队列内部缓冲的数据（生成的头部、固定响应） */
+#define HTTP_SEG_REF  1          /* 引用缓存项中的预生成头部或文件内容，不复制 */
+#define HTTP_SEG_FILE 2          /* 文件区间，用 sendfile（或 mmap 回退）发送，不经过用户态复制 */
+
+/* 一个连接的待发送响应：多个流水线请求的响应依次排队，
+ * 连续的内存段合并为一次 writev，文件段用 sendfile 发送 */
+struct http_outq {
+    struct http_buf buf;         /* HTTP_SEG_BUF 段的数据 */
+    struct http_seg *segs;       /* 段数组 */
+    size_t nsegs;                /* 已用段数 */
+    size_t cap;                  /* 段数组容量 */
+    size_t head;                 /* 第一个未发完的段 */
+    size_t pending;              /* 尚未发送的总字节数 */
+};
+
+/* 复制 n 字节到队列尾部，成功返回 0 */
+int http_outq_append(struct http_outq *q, const char *p, size_t n);
+
+/* 发送队列中的数据，直到发完、套接字不可写或出错。
+ * 返回 1：全部发完（队列已复位）；0：遇到 EAGAIN；-1：出错 */
+int http_outq_flush(struct http_outq *q, int sockfd);
+
+/* 把队列开头连续的内存段最多 cap 字节复制到 dst，遇到文件段即停止，不改变队列。
+ * 供不能直接使用 fd 的发送方式（io_uring 注册缓冲）使用；返回复制的字节数，
+ * 队列开头就是文件段时返回 0，由调用者用 http_outq_file 取出区间自行（异步）读取 */
+size_t http_outq_peek(const struct http_outq *q, char *dst, size_t cap);
+
+/* 队列开头是文件段时返回 1，并给出其 fd、当前文件偏移与剩余字节数；否则返回 0 */
+int http_outq_file(const struct http_outq *q, int *fd, off_t *off, size_t *len);
+
+/* 标记队列开头 n 字节已发出；全部发完时复位队列 */
+void http_outq_advance(struct http_outq *q, size_t n);
+
+/* 丢弃队列中所有未发送的数据并释放其持有的资源（内存保留复用） */
+void http_outq_reset(struct http_outq *q);
+
+/* 释放队列 */
+void http_outq_free(struct http_outq *q);
+
+/* 启用文档根目录模式。cache_bytes 为热点缓存的总上限，0 表示不缓存。
+ * 缓存启用时会创建 inotify 线程，在文件被修改、删除或改名时使对应缓存项失效。
+ * 成功返回 0 */
+int http_static_init(const char *docroot, size_t cache_bytes);
+
+/* 将 req 对应的静态文件响应追加到 q。小文件命中缓存时，头部与内容都引用缓存项，
+ * 随后一次 writev 发出；其他文件的内容以文件段排队，由 sendfile 发送。
+ * 成功返回 0，内存不足时返回 -1 */
+int http_static_respond(const struct http_request *req, struct http_outq *q);
+
+#endif /* HTTP_STATIC_H */
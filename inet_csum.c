@@ -0,0 +1,343 @@
+#include <string.h>  /* memcpy, strcmp */
+#include <limits.h>  /* ULONG_MAX */
+#include "inet_csum.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CSUM_X86
+#include <immintrin.h>  /* SSE2 / AVX2 intrinsics */
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define CSUM_NEON
+#include <arm_neon.h>
+#endif
+
+#define SIMD_MIN 128  /* 短于此长度时向量寄存器的装载与归约开销超过收益，直接走标量 */
+
+/* 带回卷进位的加法：反码和对任意 16 位整数倍的字宽都成立 */
+static unsigned long add_carry(unsigned long a, unsigned long b) {
+    a += b;
+    return a + (a < b);
+}
+
+/* 机器字宽的累加值折叠为 32 位部分和 */
+static unsigned int fold_word(unsigned long s) {
+#if ULONG_MAX > 0xffffffffUL
+    s = (s & 0xffffffffUL) + (s >> 32);
+    s = (s & 0xffffffffUL) + (s >> 32);
+#endif
+    return (unsigned int)s;
+}
+
+/* 标量实现：按机器字读取（memcpy 避免非对齐访问），两个累加器交替以缩短依赖链。
+ * 任何从偶数偏移开始的偶数长度片段都可以整体相加（2^16 ≡ 1 mod 0xffff），
+ * 奇数长度的最后一个字节按 RFC 1071 补零成一个 16 位单元 */
+static unsigned int csum_scalar(const void *buf, size_t len, unsigned int sum) {
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned long a0 = sum, a1 = 0, w0, w1;
+    unsigned int u32;
+    unsigned short u16;
+
+    while (len >= 2 * sizeof(w0)) {
+        memcpy(&w0, p, sizeof(w0));
+        memcpy(&w1, p + sizeof(w0), sizeof(w1));
+        a0 = add_carry(a0, w0);
+        a1 = add_carry(a1, w1);
+        p += 2 * sizeof(w0);
+        len -= 2 * sizeof(w0);
+    }
+    if (len >= sizeof(w0)) {
+        memcpy(&w0, p, sizeof(w0));
+        a0 = add_carry(a0, w0);
+        p += sizeof(w0);
+        len -= sizeof(w0);
+    }
+    /* 不足一个字的尾部按 4、2、1 字节取，固定长度的 memcpy 会被编译成单条访存 */
+    if (len & 4) {
+        memcpy(&u32, p, 4);
+        a1 = add_carry(a1, u32);
+        p += 4;
+    }
+    if (len & 2) {
+        memcpy(&u16, p, 2);
+        a0 = add_carry(a0, u16);
+        p += 2;
+    }
+    if (len & 1) {
+        u16 = 0;
+        memcpy(&u16, p, 1);  /* 最后一个字节是 16 位单元的前半，后半补零 */
+        a1 = add_carry(a1, u16);
+    }
+    return fold_word(add_carry(a0, a1));
+}
+
+static unsigned int copy_scalar(void *dst, const void *src, size_t len, unsigned int sum) {
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned long a = sum, w;
+    unsigned int u32;
+    unsigned short u16;
+
+    while (len >= sizeof(w)) {
+        memcpy(&w, s, sizeof(w));
+        memcpy(d, &w, sizeof(w));
+        a = add_carry(a, w);
+        s += sizeof(w);
+        d += sizeof(w);
+        len -= sizeof(w);
+    }
+    if (len & 4) {
+        memcpy(&u32, s, 4);
+        memcpy(d, &u32, 4);
+        a = add_carry(a, u32);
+        s += 4;
+        d += 4;
+    }
+    if (len & 2) {
+        memcpy(&u16, s, 2);
+        memcpy(d, &u16, 2);
+        a = add_carry(a, u16);
+        s += 2;
+        d += 2;
+    }
+    if (len & 1) {
+        u16 = 0;
+        memcpy(&u16, s, 1);
+        *d = *s;
+        a = add_carry(a, u16);
+    }
+    return fold_word(a);
+}
+
+#ifdef CSUM_X86
+/* 把 4 个 64 位通道加进部分和 */
+static unsigned int sum_lanes(__m128i a0, __m128i a1, unsigned int sum) {
+    unsigned long lanes[4];
+    unsigned long acc = sum;
+    int i;
+
+    _mm_storeu_si128((__m128i *)lanes, a0);
+    _mm_storeu_si128((__m128i *)(lanes + 2), a1);
+    for (i = 0; i < 4; i++) acc = add_carry(acc, lanes[i]);
+    return fold_word(acc);
+}
+
+/* SSE2：每 16 字节拆成 4 个 32 位字，零扩展到 64 位通道累加（2^32 轮内不会溢出），
+ * 最后统一回卷进位。32 位字之和与 16 位反码和同余，所以不必逐 16 位处理 */
+static unsigned int csum_sse2(const void *buf, size_t len, unsigned int sum) {
+    const unsigned char *p = (const unsigned char *)buf;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0 = zero, a1 = zero, v;
+
+    if (len < SIMD_MIN) return csum_scalar(buf, len, sum);
+    for (; len >= 16; p += 16, len -= 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v, zero));
+    }
+    return csum_scalar(p, len, sum_lanes(a0, a1, sum));
+}
+
+static unsigned int copy_sse2(void *dst, const void *src, size_t len, unsigned int sum) {
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0 = zero, a1 = zero, v;
+
+    if (len < SIMD_MIN) return copy_scalar(dst, src, len, sum);
+    for (; len >= 16; s += 16, d += 16, len -= 16) {
+        v = _mm_loadu_si128((const __m128i *)s);
+        _mm_storeu_si128((__m128i *)d, v);
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v, zero));
+    }
+    return copy_scalar(d, s, len, sum_lanes(a0, a1, sum));
+}
+
+/* AVX2：一次 32 字节，原理同 SSE2；两个 256 位累加器最后合并成 128 位。
+ * 仅在运行时检测到 AVX2 后调用 */
+__attribute__((target("avx2")))
+static unsigned int csum_avx2(const void *buf, size_t len, unsigned int sum) {
+    const unsigned char *p = (const unsigned char *)buf;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a0 = zero, a1 = zero, v;
+
+    if (len < SIMD_MIN) return csum_scalar(buf, len, sum);
+    for (; len >= 32; p += 32, len -= 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v, zero));
+    }
+    a0 = _mm256_add_epi64(a0, a1);  /* 每通道最多 2^33 量级，相加不会溢出 */
+    sum = sum_lanes(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1), sum);
+    _mm256_zeroupper();  /* 尾调用不会自动插入 vzeroupper，接着执行非 VEX 的 SSE2 代码前手动清掉 */
+    return csum_sse2(p, len, sum);
+}
+
+__attribute__((target("avx2")))
+static unsigned int copy_avx2(void *dst, const void *src, size_t len, unsigned int sum) {
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a0 = zero, a1 = zero, v;
+
+    if (len < SIMD_MIN) return copy_scalar(dst, src, len, sum);
+    for (; len >= 32; s += 32, d += 32, len -= 32) {
+        v = _mm256_loadu_si256((const __m256i *)s);
+        _mm256_storeu_si256((__m256i *)d, v);
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v, zero));
+    }
+    a0 = _mm256_add_epi64(a0, a1);
+    sum = sum_lanes(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1), sum);
+    _mm256_zeroupper();
+    return copy_sse2(d, s, len, sum);
+}
+#endif /* CSUM_X86 */
+
+#ifdef CSUM_NEON
+/* NEON：vpadalq_u32 把相邻两个 32 位字加进 64 位通道 */
+static unsigned int csum_neon(const void *buf, size_t len, unsigned int sum) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64x2_t a = vdupq_n_u64(0);
+    unsigned long acc = sum;
+
+    if (len < SIMD_MIN) return csum_scalar(buf, len, sum);
+    for (; len >= 16; p += 16, len -= 16) {
+        a = vpadalq_u32(a, vreinterpretq_u32_u8(vld1q_u8(p)));
+    }
+    acc = add_carry(acc, (unsigned long)vgetq_lane_u64(a, 0));
+    acc = add_carry(acc, (unsigned long)vgetq_lane_u64(a, 1));
+    return csum_scalar(p, len, fold_word(acc));
+}
+
+static unsigned int copy_neon(void *dst, const void *src, size_t len, unsigned int sum) {
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+    uint64x2_t a = vdupq_n_u64(0);
+    uint8x16_t v;
+    unsigned long acc = sum;
+
+    if (len < SIMD_MIN) return copy_scalar(dst, src, len, sum);
+    for (; len >= 16; s += 16, d += 16, len -= 16) {
+        v = vld1q_u8(s);
+        vst1q_u8(d, v);
+        a = vpadalq_u32(a, vreinterpretq_u32_u8(v));
+    }
+    acc = add_carry(acc, (unsigned long)vgetq_lane_u64(a, 0));
+    acc = add_carry(acc, (unsigned long)vgetq_lane_u64(a, 1));
+    return copy_scalar(d, s, len, fold_word(acc));
+}
+#endif /* CSUM_NEON */
+
+/* 实现表，按优先级从高到低排列 */
+struct csum_impl {
+    const char *name;
+    csum_fn csum;
+    csum_copy_fn copy;
+};
+
+static const struct csum_impl impls[] = {
+#ifdef CSUM_X86
+    { "avx2", csum_avx2, copy_avx2 },
+    { "sse2", csum_sse2, copy_sse2 },
+#endif
+#ifdef CSUM_NEON
+    { "neon", csum_neon, copy_neon },
+#endif
+    { "scalar", csum_scalar, copy_scalar }
+};
+
+/* 首次调用时确定。多个工作线程可能同时首次调用：整个表项以一个指针 release 发布、
+ * acquire 读取，读到非 NULL 的线程一定看到完整的表项，不会拿到只写了一半的函数指针 */
+static const struct csum_impl *selected = NULL;
+
+/* 本机是否能运行名为 name 的实现 */
+static int impl_supported(const char *name) {
+#ifdef CSUM_X86
+    if (strcmp(name, "avx2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)name;
+    return 1;  /* 其余实现是编译目标的基线指令集 */
+}
+
+/* 取得本机支持的最快实现。并发首次调用时各线程选出同一表项，重复发布无害 */
+static const struct csum_impl *get_impl(void) {
+    const struct csum_impl *im = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    size_t i;
+
+    if (im != NULL) return im;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]) - 1; i++) {
+        if (impl_supported(impls[i].name)) break;
+    }
+    im = &impls[i];              /* 表尾的 scalar 总是可用 */
+    __atomic_store_n(&selected, im, __ATOMIC_RELEASE);
+    return im;
+}
+
+unsigned int csum_partial(const void *buf, size_t len, unsigned int sum) {
+    return get_impl()->csum(buf, len, sum);
+}
+
+unsigned int csum_copy(void *dst, const void *src, size_t len, unsigned int sum) {
+    return get_impl()->copy(dst, src, len, sum);
+}
+
+unsigned short csum_fold(unsigned int sum) {
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (unsigned short)~sum;
+}
+
+unsigned short inet_csum(const void *buf, size_t len) {
+    return csum_fold(csum_partial(buf, len, 0));
+}
+
+unsigned short csum_update16(unsigned short check, unsigned short old_field, unsigned short new_field) {
+    unsigned int sum = (unsigned short)~check;
+
+    sum += (unsigned short)~old_field;
+    sum += new_field;
+    return csum_fold(sum);
+}
+
+unsigned short csum_update32(unsigned short check, unsigned int old_field, unsigned int new_field) {
+    unsigned short o[2];
+    unsigned short n[2];
+    unsigned int sum = (unsigned short)~check;
+
+    /* 按内存中的两个 16 位单元处理，与 csum_partial 的累加顺序一致 */
+    memcpy(o, &old_field, sizeof(o));
+    memcpy(n, &new_field, sizeof(n));
+    sum += (unsigned short)~o[0];
+    sum += (unsigned short)~o[1];
+    sum += n[0];
+    sum += n[1];
+    return csum_fold(sum);
+}
+
+const char *csum_impl(void) {
+    return get_impl()->name;
+}
+
+csum_fn csum_get(const char *name) {
+    size_t i;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (strcmp(impls[i].name, name) == 0) {
+            return impl_supported(name) ? impls[i].csum : NULL;
+        }
+    }
+    return NULL;
+}
+
+csum_copy_fn csum_copy_get(const char *name) {
+    size_t i;
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (strcmp(impls[i].name, name) == 0) {
+            return impl_supported(name) ? impls[i].copy : NULL;
+        }
+    }
+    return NULL;
+}
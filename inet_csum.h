@@ -0,0 +1,47 @@
+#ifndef INET_CSUM_H
+#define INET_CSUM_H
+
+#include <stddef.h>  /* size_t */
+
+/*
+ * Internet 校验和（RFC 1071：16 位反码和再取反）。
+ *
+ * 累加按内存顺序进行，结果可直接存进报文的校验和字段，与主机字节序无关。
+ * 内部用机器字宽（64 位平台上即 64 位）的带回卷进位加法，SSE2、AVX2（x86-64）
+ * 与 NEON（ARM）实现一次处理 16 或 32 字节，首次调用时按 CPU 能力选择。
+ *
+ * 部分和（unsigned int，未取反）可以分段累加后再 csum_fold()，例如先算伪首部
+ * 再算数据；除最后一段外各段长度须为偶数。
+ */
+
+typedef unsigned int (*csum_fn)(const void *buf, size_t len, unsigned int sum);
+typedef unsigned int (*csum_copy_fn)(void *dst, const void *src, size_t len, unsigned int sum);
+
+/* 把 buf 的 len 字节累加到部分和 sum 上，返回新的部分和 */
+unsigned int csum_partial(const void *buf, size_t len, unsigned int sum);
+
+/* 复制 src 到 dst（不可重叠），同时累加，数据只读一遍 */
+unsigned int csum_copy(void *dst, const void *src, size_t len, unsigned int sum);
+
+/* 部分和折叠到 16 位并取反，即校验和字段的值 */
+unsigned short csum_fold(unsigned int sum);
+
+/* 整段数据的校验和；对含正确校验和的报文结果为 0 */
+unsigned short inet_csum(const void *buf, size_t len);
+
+/*
+ * RFC 1624 式 3 增量更新：HC' = ~(~HC + ~m + m')。字段把 old 改为 new 时，
+ * 由旧校验和 check 得到新校验和，不必重算整个报文。参数都按报文中的存储
+ * 形式（网络字节序）给出。
+ */
+unsigned short csum_update16(unsigned short check, unsigned short old_field, unsigned short new_field);
+unsigned short csum_update32(unsigned short check, unsigned int old_field, unsigned int new_field);
+
+/* 当前选中的实现名称："scalar"、"sse2"、"avx2" 或 "neon" */
+const char *csum_impl(void);
+
+/* 按名称取得某个实现（用于基准测试）；本机不支持或未编译时返回 NULL */
+csum_fn csum_get(const char *name);
+csum_copy_fn csum_copy_get(const char *name);
+
+#endif /* INET_CSUM_H */
@@ -0,0 +1,183 @@
+#include <string.h>
+#include "jitter_buf.h"
+
+#define SEQ_MASK 0xffffffffUL
+
+/* Signed distance a - b between two 32-bit sequence numbers */
+static long seq_diff(unsigned long a, unsigned long b)
+{
+    unsigned long d = (a - b) & SEQ_MASK;
+    if (d & 0x80000000UL)
+        return -(long)((~d + 1) & SEQ_MASK);
+    return (long)d;
+}
+
+/* Forget all buffered frames and restart playout from seq (stats and
+   jitter estimate are kept, so a restarted sender does not reset them) */
+static void jb_restart(struct jitter_buf *jb, unsigned long seq, unsigned long arrival_ms)
+{
+    int i;
+    for (i = 0; i < JB_SLOTS; i++)
+        jb->slots[i].used = 0;
+    jb->started = 0;
+    jb->have_seq = 1;
+    jb->play_seq = seq;
+    jb->max_seq = seq;
+    jb->first_arrival = arrival_ms;
+    jb->idle_ticks = 0;
+}
+
+/* RFC 3550 section 6.4.1: J += (|D| - J) / 16, where D is the change in
+   transit time between consecutive frames */
+static void jb_update_jitter(struct jitter_buf *jb, unsigned long send_ts_ms, unsigned long arrival_ms)
+{
+    long transit, d;
+    double want;
+
+    transit = (long)(arrival_ms - send_ts_ms);
+    if (jb->samples > 0) {
+        d = transit - jb->prev_transit;
+        if (d < 0)
+            d = -d;
+        jb->jitter_ms += ((double)d - jb->jitter_ms) / 16.0;
+    }
+    jb->prev_transit = transit;
+    jb->samples++;
+
+    if (jb->samples <= JB_WARMUP)
+        return;
+    /* one frame of slack plus four jitter deviations, approached slowly so
+       a single delay spike does not swing the target */
+    want = (double)jb->frame_ms + 4.0 * jb->jitter_ms;
+    if (want < (double)jb->frame_ms)
+        want = (double)jb->frame_ms;
+    if (want > (double)JB_MAX_DELAY_MS)
+        want = (double)JB_MAX_DELAY_MS;
+    jb->target_ms += (want - jb->target_ms) / 32.0;
+}
+
+void jb_init(struct jitter_buf *jb, unsigned int frame_ms, unsigned int initial_delay_ms)
+{
+    memset(jb, 0, sizeof(*jb));
+    jb->frame_ms = frame_ms;
+    jb->target_ms = (double)initial_delay_ms;
+}
+
+long jb_level_ms(const struct jitter_buf *jb)
+{
+    long frames;
+    if (!jb->started)
+        return 0;
+    frames = seq_diff(jb->max_seq, jb->play_seq) + 1;
+    return frames > 0 ? frames * (long)jb->frame_ms : 0;
+}
+
+int jb_put(struct jitter_buf *jb, unsigned long seq, unsigned long send_ts_ms,
+           unsigned long arrival_ms, const unsigned char *data, int len)
+{
+    struct jb_slot *slot;
+    long d;
+
+    if (len < 0 || len > JB_FRAME_MAX)
+        return JB_TOO_BIG;
+    seq &= SEQ_MASK;
+    jb_update_jitter(jb, send_ts_ms, arrival_ms);
+
+    if (!jb->have_seq)
+        jb_restart(jb, seq, arrival_ms);
+    d = seq_diff(seq, jb->play_seq);
+    if (d < -JB_SLOTS || d >= 2 * JB_SLOTS) {
+        /* far outside the window: the sender restarted its sequence */
+        jb_restart(jb, seq, arrival_ms);
+    } else if (d < 0) {
+        if (jb->started || seq_diff(jb->max_seq, seq) >= JB_SLOTS) {
+            jb->stats.late++;
+            return JB_LATE;
+        }
+        /* reordered ahead of the first frame before playout: start earlier */
+        jb->play_seq = seq;
+    }
+
+    /* keep the ring covering [play_seq, seq]: evict the oldest frames */
+    while (seq_diff(seq, jb->play_seq) >= JB_SLOTS) {
+        slot = &jb->slots[jb->play_seq % JB_SLOTS];
+        if (slot->used && slot->seq == jb->play_seq)
+            jb->stats.dropped++;
+        else if (jb->started)
+            jb->stats.lost++;
+        slot->used = 0;
+        jb->play_seq = (jb->play_seq + 1) & SEQ_MASK;
+    }
+
+    slot = &jb->slots[seq % JB_SLOTS];
+    if (slot->used && slot->seq == seq) {
+        jb->stats.duplicate++;
+        return JB_DUPLICATE;
+    }
+    slot->used = 1;
+    slot->seq = seq;
+    slot->send_ts_ms = send_ts_ms;
+    slot->len = len;
+    memcpy(slot->data, data, (size_t)len);
+    jb->stats.received++;
+    if (seq_diff(seq, jb->max_seq) > 0)
+        jb->max_seq = seq;
+    return JB_STORED;
+}
+
+int jb_get(struct jitter_buf *jb, unsigned long now_ms,
+           unsigned char *data, int *len, unsigned long *send_ts_ms)
+{
+    struct jb_slot *slot;
+    long level;
+
+    if (!jb->have_seq)
+        return JB_WAIT;
+    if (!jb->started) {
+        if ((double)(now_ms - jb->first_arrival) < jb->target_ms)
+            return JB_WAIT;
+        jb->started = 1;
+        jb->idle_ticks = 0;
+    }
+
+    level = jb_level_ms(jb);
+    slot = &jb->slots[jb->play_seq % JB_SLOTS];
+    if (slot->used && slot->seq == jb->play_seq && (double)level > jb->target_ms + (double)jb->frame_ms) {
+        /* more buffered than the target: skip one frame to catch up */
+        slot->used = 0;
+        jb->stats.dropped++;
+        jb->play_seq = (jb->play_seq + 1) & SEQ_MASK;
+        level -= (long)jb->frame_ms;
+        slot = &jb->slots[jb->play_seq % JB_SLOTS];
+    }
+
+    if (slot->used && slot->seq == jb->play_seq) {
+        memcpy(data, slot->data, (size_t)slot->len);
+        *len = slot->len;
+        *send_ts_ms = slot->send_ts_ms;
+        slot->used = 0;
+        jb->play_seq = (jb->play_seq + 1) & SEQ_MASK;
+        jb->stats.played++;
+        jb->idle_ticks = 0;
+        return JB_PLAY;
+    }
+
+    if (seq_diff(jb->max_seq, jb->play_seq) < 0) {
+        /* buffer ran dry; after a full ring of silence treat the sender as
+           gone and rebuffer from its next frame */
+        jb->stats.stalled++;
+        if (++jb->idle_ticks > JB_SLOTS) {
+            jb->started = 0;
+            jb->have_seq = 0;
+        }
+        return JB_WAIT;
+    }
+    if ((double)level < jb->target_ms) {
+        /* the gap may still be filled by a late frame */
+        jb->stats.stalled++;
+        return JB_WAIT;
+    }
+    jb->stats.lost++;
+    jb->play_seq = (jb->play_seq + 1) & SEQ_MASK;
+    return JB_LOST;
+}
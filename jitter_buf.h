@@ -0,0 +1,91 @@
+#ifndef JITTER_BUF_H
+#define JITTER_BUF_H
+
+/*
+ * Playout jitter buffer for one voice sender.
+ *
+ * Frames are stored in a ring indexed by sequence number, so reordered
+ * frames fall into place and gaps are detected as losses. The caller
+ * pulls exactly one frame per frame interval with jb_get(); playout
+ * starts once the first frame has waited target_ms. The target delay
+ * starts at the configured value and then follows the RFC 3550
+ * inter-arrival jitter estimate: frames are dropped when the buffer
+ * holds more than the target (bounding mouth-to-ear latency) and playout
+ * stalls for a frame when it runs short (giving late frames a chance).
+ *
+ * All times are milliseconds on a clock chosen by the caller; only
+ * differences are used, so sender and receiver clocks need not agree.
+ */
+
+#define JB_SLOTS 64               /* ring size in frames (1.28 s at 20 ms) */
+#define JB_FRAME_MAX 512          /* largest frame payload accepted */
+#define JB_MAX_DELAY_MS 400       /* upper bound for the adaptive target */
+#define JB_WARMUP 50              /* frames measured before the target adapts */
+
+/* jb_put() results */
+#define JB_STORED 0
+#define JB_LATE 1                 /* already played or declared lost */
+#define JB_DUPLICATE 2
+#define JB_TOO_BIG -1
+
+/* jb_get() results */
+#define JB_PLAY 0                 /* a frame was copied out */
+#define JB_LOST 1                 /* the next frame is missing; conceal it */
+#define JB_WAIT 2                 /* buffering or stalled; play silence */
+
+struct jb_slot
+{
+    int used;
+    unsigned long seq;
+    unsigned long send_ts_ms;     /* sender timestamp from the frame header */
+    int len;
+    unsigned char data[JB_FRAME_MAX];
+};
+
+struct jb_stats
+{
+    unsigned long received;       /* frames accepted into the ring */
+    unsigned long played;
+    unsigned long lost;           /* gaps played out as concealment */
+    unsigned long late;           /* arrived after their playout slot */
+    unsigned long duplicate;
+    unsigned long dropped;        /* discarded to shrink the buffer */
+    unsigned long stalled;        /* ticks that played silence while buffering */
+};
+
+struct jitter_buf
+{
+    unsigned int frame_ms;
+    struct jb_slot slots[JB_SLOTS];
+    int started;                  /* playout clock running */
+    int have_seq;                 /* play_seq/max_seq are valid */
+    unsigned long play_seq;       /* next sequence number to play */
+    unsigned long max_seq;        /* newest sequence number seen */
+    unsigned long first_arrival;  /* arrival of the first buffered frame */
+    unsigned long idle_ticks;     /* consecutive ticks without a frame */
+    long prev_transit;            /* arrival - send timestamp of the last frame */
+    unsigned long samples;        /* transit samples seen */
+    double jitter_ms;             /* RFC 3550 smoothed inter-arrival jitter */
+    double target_ms;             /* current playout delay target */
+    struct jb_stats stats;
+};
+
+/* Reset jb with the given frame interval and initial playout delay */
+void jb_init(struct jitter_buf *jb, unsigned int frame_ms, unsigned int initial_delay_ms);
+
+/* Insert a received frame (seq is the 32-bit header sequence number) */
+int jb_put(struct jitter_buf *jb, unsigned long seq, unsigned long send_ts_ms,
+           unsigned long arrival_ms, const unsigned char *data, int len);
+
+/*
+ * Called once per frame interval. On JB_PLAY the frame is copied to data
+ * (JB_FRAME_MAX bytes), its length to *len and its sender timestamp to
+ * *send_ts_ms.
+ */
+int jb_get(struct jitter_buf *jb, unsigned long now_ms,
+           unsigned char *data, int *len, unsigned long *send_ts_ms);
+
+/* Playout delay currently buffered, in ms (0 before playout starts) */
+long jb_level_ms(const struct jitter_buf *jb);
+
+#endif /* JITTER_BUF_H */
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE              /* syscall、clock_gettime */
+
+#include <stdio.h>               /* printf, fopen */
+#include <stdlib.h>              /* qsort */
+#include <string.h>              /* strstr, strncpy */
+#include <time.h>                /* clock_gettime */
+#include <unistd.h>              /* syscall, read, close */
+#include <sys/ioctl.h>           /* ioctl */
+#include <sys/syscall.h>         /* __NR_perf_event_open */
+#include <linux/perf_event.h>    /* struct perf_event_attr */
+#include "microbench.h"
+
+#define WARMUP_MS 50             /* 每项先空跑这么久：填满缓存、分支预测器，让频率升上去 */
+#define CALIBRATE_MS 10          /* 定批次数时单批至少跑这么久，计时误差可以忽略 */
+#define MAX_SAMPLES 31
+
+volatile unsigned long mb_sink;
+
+static struct mb_result g_results[MB_MAX];
+static int g_nresults = 0;
+static const char *g_filter = NULL;
+static int g_batch_ms = 100;
+static int g_samples = 7;
+static int g_perf_fd = -2;       /* 计数器组的组长（cycles），-1 为不可用，-2 为尚未打开 */
+static int g_perf_ins = -1;      /* 组员：instructions */
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int perf_open(__u64 config, int group) {
+    struct perf_event_attr a;
+
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = config;
+    a.disabled = group < 0;      /* 组员跟随组长启停 */
+    a.exclude_kernel = 1;        /* 只计用户态：perf_event_paranoid = 2 时也能打开 */
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(__NR_perf_event_open, &a, 0, -1, group, 0);
+}
+
+/* 打开 cycles + instructions 计数器组；虚拟机或容器里常常没有硬件计数器 */
+static void perf_init(void) {
+    g_perf_fd = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (g_perf_fd < 0) return;
+    g_perf_ins = perf_open(PERF_COUNT_HW_INSTRUCTIONS, g_perf_fd);
+}
+
+static void perf_start(void) {
+    if (g_perf_fd < 0) return;
+    ioctl(g_perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g_perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/* 停止计数并取出 cycles 与 instructions，不可用时返回 -1 */
+static int perf_stop(double *cycles, double *instr) {
+    __u64 v[3];                  /* nr, cycles, instructions */
+    ssize_t n;
+
+    if (g_perf_fd < 0) return -1;
+    ioctl(g_perf_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    memset(v, 0, sizeof(v));
+    n = read(g_perf_fd, v, sizeof(v));
+    if (n < (ssize_t)(2 * sizeof(__u64)) || v[1] == 0) return -1;
+    *cycles = (double)v[1];
+    *instr = v[0] > 1 ? (double)v[2] : -1.0;
+    return 0;
+}
+
+void mb_filter(const char *filter) {
+    g_filter = filter;
+}
+
+void mb_config(int batch_ms, int samples) {
+    if (batch_ms > 0) g_batch_ms = batch_ms;
+    if (samples > 0) g_samples = samples < MAX_SAMPLES ? samples : MAX_SAMPLES;
+}
+
+/* 一批的耗时与计数 */
+struct sample {
+    double ns;
+    double cycles;
+    double instr;
+};
+
+static int cmp_sample(const void *a, const void *b) {
+    double x = ((const struct sample *)a)->ns, y = ((const struct sample *)b)->ns;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+const struct mb_result *mb_run(const char *name, mb_fn fn, void *ctx, size_t bytes_op) {
+    struct sample s[MAX_SAMPLES];
+    struct mb_result *r;
+    unsigned long iters = 1, batch;
+    double t0, t, start;
+    int i;
+
+    if (g_filter != NULL && strstr(name, g_filter) == NULL) return NULL;
+    if (g_nresults == MB_MAX) return NULL;
+    if (g_perf_fd == -2) perf_init();
+
+    /* 预热的同时找出单批至少 CALIBRATE_MS 的次数 */
+    start = now_ns();
+    for (;;) {
+        t0 = now_ns();
+        fn(ctx, iters);
+        t = now_ns() - t0;
+        if (t >= CALIBRATE_MS * 1e6 && t0 - start >= WARMUP_MS * 1e6) break;
+        if (t < CALIBRATE_MS * 1e6) iters *= 2;
+    }
+    batch = (unsigned long)((double)iters * g_batch_ms * 1e6 / t);
+    if (batch == 0) batch = 1;
+
+    for (i = 0; i < g_samples; i++) {
+        perf_start();
+        t0 = now_ns();
+        fn(ctx, batch);
+        s[i].ns = (now_ns() - t0) / (double)batch;
+        if (perf_stop(&s[i].cycles, &s[i].instr) != 0) s[i].cycles = s[i].instr = -1.0;
+    }
+    qsort(s, (size_t)g_samples, sizeof(s[0]), cmp_sample);
+
+    r = &g_results[g_nresults++];
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = '\0';
+    r->ns_op = s[g_samples / 2].ns;
+    r->ns_min = s[0].ns;
+    r->cycles_op = s[g_samples / 2].cycles >= 0 ? s[g_samples / 2].cycles / (double)batch : -1.0;
+    r->ipc = s[g_samples / 2].instr >= 0 && s[g_samples / 2].cycles > 0
+             ? s[g_samples / 2].instr / s[g_samples / 2].cycles : -1.0;
+    r->mbs = bytes_op > 0 ? (double)bytes_op / r->ns_op * 1e3 : 0.0;
+    return r;
+}
+
+/* 在基线文件中查找 name，找不到返回 < 0 */
+static double baseline_lookup(FILE *f, const char *name) {
+    char line[128], key[64];
+    double v;
+
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %lf", key, &v) == 2 && strcmp(key, name) == 0) return v;
+    }
+    return -1.0;
+}
+
+int mb_report(const char *path, double threshold, int update) {
+    FILE *f = NULL;
+    char cyc[16], ipc[16], tput[16], cmp[40];
+    double base, d;
+    int regressed = 0;
+    int i;
+
+    if (path != NULL && !update) f = fopen(path, "r");
+    if (path != NULL && !update && f == NULL) {
+        printf("没有基线文件 %s，先运行 make bench-baseline 生成\n", path);
+    }
+    printf("%-28s %10s %10s %10s %6s %10s  %s\n", "benchmark", "ns/op", "min", "cycles/op", "IPC", "MB/s", "vs baseline");
+    for (i = 0; i < g_nresults; i++) {
+        const struct mb_result *r = &g_results[i];
+        if (r->cycles_op >= 0) sprintf(cyc, "%.1f", r->cycles_op);
+        else strcpy(cyc, "-");
+        if (r->ipc >= 0) sprintf(ipc, "%.2f", r->ipc);
+        else strcpy(ipc, "-");
+        if (r->mbs > 0) sprintf(tput, "%.0f", r->mbs);
+        else strcpy(tput, "-");
+        cmp[0] = '\0';
+        if (f != NULL) {
+            base = baseline_lookup(f, r->name);
+            if (base > 0) {
+                d = (r->ns_op - base) / base * 100.0;
+                sprintf(cmp, "%+.1f%%%s", d, d > threshold ? "  REGRESSION" : d < -threshold ? "  faster" : "");
+                if (d > threshold) regressed = 1;
+            } else {
+                strcpy(cmp, "(新项)");
+            }
+        }
+        printf("%-28s %10.2f %10.2f %10s %6s %10s  %s\n", r->name, r->ns_op, r->ns_min, cyc, ipc, tput, cmp);
+    }
+    if (f != NULL) fclose(f);
+    if (g_perf_fd < 0) printf("（硬件计数器不可用：cycles/op 与 IPC 未测量）\n");
+
+    if (path != NULL && update) {
+        f = fopen(path, "w");
+        if (f == NULL) {
+            perror(path);
+            return 1;
+        }
+        fprintf(f, "# microbench 基线：基准项 中位数ns/op（与机器、编译选项相关）\n");
+        for (i = 0; i < g_nresults; i++) fprintf(f, "%s %.3f\n", g_results[i].name, g_results[i].ns_op);
+        fclose(f);
+        printf("基线已写入 %s\n", path);
+    } else if (regressed) {
+        printf("有基准项慢于基线超过 %.0f%%\n", threshold);
+    }
+    return regressed;
+}
@@ -0,0 +1,48 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stddef.h>              /* size_t */
+
+/*
+ * 逐包热函数的微基准框架：被测函数包在一个循环体里（mb_fn 一次调用跑 iters 次，
+ * 函数调用开销摊到整批上），先预热，再按目标时长定出每批次数，取若干批中的
+ * 中位数作为 ns/op。能打开硬件计数器（perf_event_open，只计用户态，
+ * perf_event_paranoid <= 2 即可）时同时报告 cycles/op 与 IPC，否则显示 "-"。
+ *
+ * 基线是一个文本文件，每行 "名字 ns/op"。mb_report 把本次结果与基线比较，
+ * 慢于基线超过阈值的项标记为 REGRESSION 并返回非零，用于 make bench 把关；
+ * update 非零时改为把本次结果写成新的基线。基线与机器相关，不要跨机器比较。
+ */
+
+#define MB_MAX 64                /* 一次运行最多的基准项 */
+
+/* 被测循环：对 ctx 描述的输入执行 iters 次被测函数 */
+typedef void (*mb_fn)(void *ctx, unsigned long iters);
+
+struct mb_result {
+    char name[48];               /* 基准项名，也是基线文件中的键 */
+    double ns_op;                /* 中位数 ns/op */
+    double ns_min;               /* 最快一批的 ns/op，衡量噪声 */
+    double cycles_op;            /* 中位数批的 cycles/op，< 0 表示计数器不可用 */
+    double ipc;                  /* 每周期指令数，< 0 表示不可用 */
+    double mbs;                  /* 按 bytes_op 折算的 MB/s，bytes_op 为 0 时为 0 */
+};
+
+/* 防止编译器把被测调用当作无用代码删掉：把结果的一部分写到这里 */
+extern volatile unsigned long mb_sink;
+
+/* 按 mb_config 的设置运行一项基准，结果追加到内部表中并返回；被 mb_filter 跳过时返回 NULL。
+ * bytes_op 为每次处理的字节数，用于折算吞吐 */
+const struct mb_result *mb_run(const char *name, mb_fn fn, void *ctx, size_t bytes_op);
+
+/* 只运行名字包含 filter 的项；NULL 表示全部 */
+void mb_filter(const char *filter);
+
+/* 调整每批时长（毫秒）与批数，默认 100ms × 7 */
+void mb_config(int batch_ms, int samples);
+
+/* 打印结果表并与基线文件 path 比较（path 为 NULL 时只打印）；阈值 threshold 为百分比。
+ * update 非零时把结果写入 path。有退化项时返回 1，否则 0 */
+int mb_report(const char *path, double threshold, int update);
+
+#endif /* MICROBENCH_H */
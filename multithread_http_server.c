@@ -1,3 +1,5 @@
+#define _GNU_SOURCE              /* 启用 getopt、sysconf(_SC_NPROCESSORS_ONLN) 等 POSIX/GNU 扩展声明 */
+
 #include <stdio.h>               /* 标准输入输出 */
 #include <stdlib.h>              /* 标准库：malloc、free、exit */
 #include <string.h>              /* 字符串操作 */
@@ -9,13 +11,79 @@
 #include <netinet/in.h>          /* sockaddr_in, sockaddr_in6 */
 #include <pthread.h>             /* pthreads */
 #include <signal.h>              /* 信号处理 */
+#include <fcntl.h>               /* fcntl, O_NONBLOCK */
+#include <sys/epoll.h>           /* epoll 事件循环 */
+#include <sys/resource.h>        /* setrlimit(RLIMIT_NOFILE) */
+#include <sys/time.h>            /* struct timeval */
+#include <time.h>                /* clock_gettime */
+#include <poll.h>                /* poll：等待监听套接字或交接应答 */
+#include <sys/un.h>              /* sockaddr_un：热重启控制套接字 */
+#include "http_proto.h"          /* HTTP/1.1 请求分帧 */
+#include "http_static.h"         /* 静态文件：sendfile 与热点缓存 */
+#include "uring.h"               /* io_uring 完成事件模式 */
+#include "alog.h"                /* 异步日志：请求路径上不写 stderr */
+#include "http_metrics.h"        /* 每线程计数器与 /metrics */
+#include "fd_pass.h"             /* SCM_RIGHTS：热重启时交接监听套接字 */
+#include "cpu_topo.h"            /* 线程绑核与 NUMA 本地内存 */
+
+/* 运行模式 */
+enum server_mode {                /* 连接处理模式 */
+    MODE_THREAD,                  /* 每连接一个线程（原有行为） */
+    MODE_POOL,                    /* 固定工作线程池 + 有界连接队列 */
+    MODE_EPOLL,                   /* 每核一个非阻塞 epoll 边沿触发事件循环 */
+    MODE_URING                    /* 每核一个 io_uring 完成事件循环（不可用时回退到 epoll） */
+};
+
+/* 连接队列已满时的背压策略 */
+enum backpressure {               /* 背压策略 */
+    BP_BLOCK,                     /* 阻塞 accept 线程，由内核 listen backlog 吸收突发 */
+    BP_DROP,                      /* 直接关闭新连接 */
+    BP_REJECT                     /* 尽力发送 503 后关闭新连接 */
+};
+
+#define DEFAULT_QUEUE_LEN 1024   /* 默认连接队列长度 */
+#define LISTEN_BACKLOG SOMAXCONN /* listen backlog（实际值受 net.core.somaxconn 限制） */
+#define DEFAULT_IDLE_TIMEOUT 60  /* 默认持久连接空闲超时（秒） */
+#define RECV_CHUNK 1024          /* 每次 recv 前保证的最小空闲缓冲 */
+#define BUF_KEEP_MAX 65536       /* 连接结束后仍保留以供复用的最大缓冲容量 */
+#define DEFAULT_CACHE_MB 32      /* 默认热点文件缓存大小（MB） */
+#define LOG_REQ_PER_SEC 100      /* 逐请求日志每秒的上限（所有线程合计），超出的条数汇总成一行 */
+#define DEFAULT_DRAIN_TIMEOUT 30 /* 热重启后旧进程等待已有连接结束的最长秒数 */
+#define MAX_LISTEN_SLOTS FD_PASS_MAX /* 监听套接字槽位数（每个事件循环两个） */
+
+/* 服务器配置（由命令行填充） */
+struct server_config {            /* 配置结构 */
+    enum server_mode mode;        /* 连接处理模式 */
+    int workers;                  /* 池模式工作线程数 / epoll 模式事件循环数 */
+    unsigned int queue_len;       /* 池模式连接队列长度 */
+    enum backpressure policy;     /* 队列满时的策略 */
+    const char *port;             /* 监听端口 */
+    int idle_timeout;             /* 持久连接空闲超时（秒），0 表示不超时 */
+    const char *docroot;          /* 静态文件根目录，NULL 时返回固定的 Hello World */
+    int cache_mb;                 /* 热点文件缓存大小（MB），0 表示不缓存 */
+    const char *handoff_path;     /* 热重启控制套接字路径，NULL 表示不启用 */
+    int drain_timeout;            /* 热重启后旧进程的排空期限（秒） */
+    const char *cpus;             /* 绑核的 CPU 集合（"auto" 或列表），NULL 表示不绑核 */
+    int incoming_cpu;             /* 按 SO_INCOMING_CPU 让连接留在收包的 CPU 上 */
+};
+
+static struct server_config g_cfg = { /* 默认配置 */
+    MODE_THREAD, 0, DEFAULT_QUEUE_LEN, BP_BLOCK, "80", DEFAULT_IDLE_TIMEOUT, NULL, DEFAULT_CACHE_MB,
+    NULL, DEFAULT_DRAIN_TIMEOUT, NULL, 0
+};
 
-/* 全局变量：在程序退出时关闭这些监听套接字 */
-static int listen_fd_v4 = -1;    /* IPv4 监听套接字 */
-static int listen_fd_v6 = -1;    /* IPv6 监听套接字 */
+/* 全局变量：在程序退出时关闭这些监听套接字，热重启时把它们交给新进程 */
+static int g_listen_fds[MAX_LISTEN_SLOTS]; /* 按槽位存放的监听套接字，-1 表示空 */
+static int g_nslots = 0;         /* 使用的槽位数 */
+static int g_draining = 0;       /* 监听已交给新进程：停止接受连接，持久连接不再保持 */
+static int g_accepting = 0;      /* 仍在接受连接的线程 / 事件循环数，排空时降到 0 */
+static struct alog_limit req_log = ALOG_LIMIT_INIT; /* 逐请求日志的节流 */
+static struct cpu_topo g_topo;    /* -A 选定的 CPU 放置顺序 */
+static int g_pin = 0;             /* 是否绑核 */
+static int g_next_worker = 0;     /* 池工作线程领取放置位置的计数 */
 
 /* 简单响应常量 */
-static const char response[] = /* HTTP/1.1 200 响应及 Hello World 正文 */
+static const char response[] = /* HTTP/1.1 200 响应及 Hello World 正文（响应后关闭） */
     "HTTP/1.1 200 OK\r\n"
     "Content-Length: 11\r\n"
     "Content-Type: text/plain\r\n"
@@ -23,74 +91,429 @@ static const char response[] = /* HTTP/1.1 200 响应及 Hello World 正文 */
     "\r\n"
     "Hello World";
 
+static const char response_keepalive[] = /* 同上，但保持连接 */
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 11\r\n"
+    "Content-Type: text/plain\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "Hello World";
+
+#define RESPONSE_BODY_LEN 11     /* 上面两个响应的正文长度（HEAD 请求时省略） */
+
+/* 池模式下队列满且策略为 reject 时返回的响应 */
+static const char response_503[] = /* HTTP/1.1 503 响应 */
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
 /* 客户端处理线程函数参数结构 */
 struct client_arg {                /* 参数结构 */
     int fd;                        /* 已接受的已连接套接字 */
+    unsigned long accept_us;       /* 接受连接的时刻（单调时钟微秒），用于首字节延迟 */
     char addrstr[INET6_ADDRSTRLEN];/* 对端地址的文本形式 */
 };
 
 /* 关闭监听套接字并安全退出的信号处理函数（例如 SIGINT） */
 static void handle_sigint(int signo) { /* 信号处理函数 */
+    int i;                         /* 循环索引 */
     (void)signo;                   /* 避免未使用警告 */
-    if (listen_fd_v4 >= 0) {       /* 若 IPv4 监听存在 */
-        close(listen_fd_v4);       /* 关闭 IPv4 监听套接字 */
-        listen_fd_v4 = -1;         /* 标记为已关闭 */
-    }
-    if (listen_fd_v6 >= 0) {       /* 若 IPv6 监听存在 */
-        close(listen_fd_v6);       /* 关闭 IPv6 监听套接字 */
-        listen_fd_v6 = -1;         /* 标记为已关闭 */
+    for (i = 0; i < g_nslots; i++) { /* 关闭所有监听套接字 */
+        if (g_listen_fds[i] >= 0) close(g_listen_fds[i]);
+        g_listen_fds[i] = -1;      /* 标记为已关闭 */
     }
     /* 直接正常退出进程 */
     _exit(0);                      /* 使用 _exit 避免在信号处理时复杂清理 */
 }
 
-/* 处理单个客户端连接的线程主函数 */
-static void *client_thread(void *arg) { /* pthread 线程入口 */
-    struct client_arg *carg = (struct client_arg *)arg; /* 强制转换参数 */
+/* 将对端地址转换为文本形式，便于日志 */
+static void sockaddr_to_str(const struct sockaddr_storage *peer, char *buf, size_t len) { /* 地址文本化 */
+    if (peer->ss_family == AF_INET) { /* IPv4 */
+        const struct sockaddr_in *s4 = (const struct sockaddr_in *)peer; /* 强制转换 */
+        inet_ntop(AF_INET, &s4->sin_addr, buf, (socklen_t)len); /* 转换文本 */
+    } else {                      /* IPv6 */
+        const struct sockaddr_in6 *s6 = (const struct sockaddr_in6 *)peer; /* 强制转换 */
+        inet_ntop(AF_INET6, &s6->sin6_addr, buf, (socklen_t)len); /* 转换文本 */
+    }
+}
+
+/* 启用 -A 时把调用线程绑到放置顺序中的第 index 个 CPU，内存优先取自该 CPU 的节点 */
+static void pin_thread(int index) { /* 绑核 */
+    if (g_pin && cpu_topo_pin(&g_topo, index) < 0) {
+        alog_printf(ALOG_WARN, "pthread_setaffinity_np failed: %s", strerror(errno));
+    }
+}
+
+/* 每连接线程：启用 -I 时绑到处理该连接收包的 CPU（网卡 RSS 队列的中断所在核），
+ * 否则放开到 -A 的全部 CPU，不继承 accept 线程的单核绑定 */
+static void pin_connection(int fd) { /* 按连接绑核 */
+    int cpu = -1;                 /* 收包的 CPU */
+    socklen_t len = sizeof(cpu);  /* 选项长度 */
+    if (!g_pin) return;
+    if (g_cfg.incoming_cpu && getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+        cpu >= 0 && cpu_topo_pin_cpu(&g_topo, cpu) >= 0) {
+        return;                   /* 该 CPU 不在 -A 集合中时退回全部 CPU */
+    }
+    cpu_topo_pin_all(&g_topo);
+}
+
+/* 启用 -I 时让 SO_REUSEPORT 组里的监听套接字 fd 优先接收在 cpu 上收到的连接（内核 6.1 起生效） */
+static void listen_incoming_cpu(int fd, int index) { /* 设置 SO_INCOMING_CPU */
+    int cpu;                      /* 第 index 个放置位置的 CPU */
+    if (!g_pin || !g_cfg.incoming_cpu) return;
+    cpu = g_topo.cpu[index % g_topo.ncpus];
+    if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) != 0) {
+        fprintf(stderr, "setsockopt SO_INCOMING_CPU failed: %s\n", strerror(errno)); /* 打印但继续 */
+    }
+}
+
+/* 启动时打印放置结果：what 为线程类别，前 n 个线程各自的 CPU 与节点 */
+static void report_layout(const char *what, int n) { /* 打印布局 */
+    char buf[512];                /* 布局文本 */
+    if (!g_pin) return;
+    cpu_topo_describe(&g_topo, n, buf, sizeof(buf));
+    fprintf(stderr, "CPU layout: %d CPUs on %d NUMA node(s); %s -> %s%s\n", g_topo.ncpus, g_topo.nnodes,
+            what, buf, g_cfg.incoming_cpu ? " (SO_INCOMING_CPU)" : "");
+}
+
+/* 为一个已解析的请求向 out 追加响应，成功返回 0 */
+static int append_response(struct http_outq *out, const struct http_request *req) { /* 生成响应 */
+    const char *r;                /* 响应模板 */
+    size_t n;                     /* 响应长度 */
+    if (req->keep_alive) {        /* 持久连接 */
+        r = response_keepalive;
+        n = sizeof(response_keepalive) - 1;
+    } else {                      /* 响应后关闭 */
+        r = response;
+        n = sizeof(response) - 1;
+    }
+    if (req->head_only) n -= RESPONSE_BODY_LEN; /* HEAD 请求不带正文 */
+    return http_outq_append(out, r, n);
+}
+
+/* 请求目标是否为 /metrics（允许带查询串），只拦截 GET 与 HEAD */
+static int is_metrics_request(const struct http_request *req) { /* 判断指标请求 */
+    if (!((req->method_len == 3 && memcmp(req->method, "GET", 3) == 0) ||
+          (req->method_len == 4 && memcmp(req->method, "HEAD", 4) == 0))) return 0;
+    if (req->target_len < 8 || memcmp(req->target, "/metrics", 8) != 0) return 0;
+    return req->target_len == 8 || req->target[8] == '?';
+}
+
+/* 汇总各线程计数器，以 Prometheus 文本格式响应，成功返回 0 */
+static int append_metrics(struct http_outq *out, const struct http_request *req) { /* 生成指标响应 */
+    struct http_buf body = { NULL, 0, 0 }; /* 抓取很少发生，每次临时分配 */
+    char hdr[192];                /* 响应头 */
+    int n;                        /* 响应头长度 */
+    int rc;                       /* 结果 */
+
+    if (http_metrics_render(&body) != 0) {
+        http_buf_free(&body);
+        return -1;
+    }
+    n = sprintf(hdr, "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %lu\r\n"
+                     "Connection: %s\r\n"
+                     "\r\n",
+                (unsigned long)body.len, req->keep_alive ? "keep-alive" : "close");
+    rc = http_outq_append(out, hdr, (size_t)n);
+    if (rc == 0 && !req->head_only) rc = http_outq_append(out, body.data, body.len);
+    http_buf_free(&body);
+    return rc;
+}
+
+/* 从 in 中解析所有已完整到达的（可能是流水线的）请求，并把响应依次追加到 out；
+ * 已处理的请求从 in 中移除，不完整的尾部保留等待后续数据。
+ * 返回 1 表示发送完 out 后应关闭连接，返回 0 表示保持连接。 */
+static int process_requests(struct http_buf *in, struct http_outq *out, const char *addrstr) { /* 处理请求 */
+    size_t off = 0;               /* 已处理的输入字节数 */
+    struct http_request req;      /* 当前请求 */
+    int r;                        /* 解析结果 */
+    int closing = 0;              /* 是否需要关闭连接 */
+
+    while (off < in->len) {       /* 逐个解析 */
+        r = http_parse_request(in->data + off, in->len - off, &req); /* 分帧 */
+        if (r == 0) break;        /* 剩余数据不足一个请求 */
+        if (r < 0) {              /* 格式错误或超限：回复错误并关闭 */
+            const char *e = http_error_response(r); /* 错误响应 */
+            alog_printf(ALOG_WARN, "Bad request from %s (%d)", addrstr, -r); /* 打印 */
+            if (http_outq_append(out, e, strlen(e)) != 0) { /* 追加失败 */
+                http_outq_reset(out);
+            }
+            off = in->len;        /* 丢弃剩余输入 */
+            closing = 1;
+            break;
+        }
+        HTTP_METRICS()->requests++; /* 本线程计数 */
+        if (alog_allow(&req_log, LOG_REQ_PER_SEC)) { /* 逐请求日志节流 */
+            alog_printf(ALOG_INFO, "Received request from %s: %.*s", addrstr,
+                        (int)req.line_len, req.line); /* 打印请求行 */
+        }
+        if (__atomic_load_n(&g_draining, __ATOMIC_RELAXED)) req.keep_alive = 0; /* 排空中：响应后关闭 */
+        if ((is_metrics_request(&req) ? append_metrics(out, &req)
+             : g_cfg.docroot != NULL ? http_static_respond(&req, out)
+                                     : append_response(out, &req)) != 0) { /* 内存不足 */
+            off = in->len;
+            closing = 1;
+            break;
+        }
+        off += (size_t)r;         /* 跳过该请求 */
+        if (!req.keep_alive) {    /* 客户端要求关闭：忽略其后的流水线请求 */
+            off = in->len;
+            closing = 1;
+            break;
+        }
+    }
+    http_buf_consume(in, off);    /* 移除已处理数据 */
+    return closing;
+}
+
+/* 为阻塞套接字设置空闲超时：超过 idle_timeout 秒无数据则 recv/send 返回 EAGAIN */
+static void set_idle_timeout(int fd) { /* 设置超时 */
+    struct timeval tv;            /* 超时时间 */
+    if (g_cfg.idle_timeout <= 0) return; /* 未启用 */
+    tv.tv_sec = g_cfg.idle_timeout;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv)); /* 接收超时 */
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void *)&tv, sizeof(tv)); /* 发送超时 */
+}
+
+/* 线程 / 池模式下阻塞在 recv 中的连接。热重启排空时，空闲连接（缓冲中没有半个请求）
+ * 被 shutdown(SHUT_RD) 唤醒并关闭，不必等到空闲超时或排空期限；shutdown 之前已到达
+ * 的数据仍可读出，其请求会照常得到响应（排空中响应后即关闭）。仅在启用 -H 时登记 */
+struct blocking_conn {            /* 登记项（位于 serve_client 的栈上） */
+    int fd;                       /* 已连接套接字 */
+    int idle;                     /* 正在等待下一个请求（原子访问） */
+    struct blocking_conn *prev;
+    struct blocking_conn *next;
+};
+
+static struct blocking_conn *g_blocking = NULL; /* 登记链表 */
+static pthread_mutex_t g_blocking_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void blocking_register(struct blocking_conn *b, int fd) { /* 登记 */
+    b->fd = fd;
+    b->idle = 0;
+    b->prev = NULL;
+    pthread_mutex_lock(&g_blocking_lock);
+    b->next = g_blocking;
+    if (g_blocking != NULL) g_blocking->prev = b;
+    g_blocking = b;
+    pthread_mutex_unlock(&g_blocking_lock);
+}
+
+static void blocking_unregister(struct blocking_conn *b) { /* 注销：必须在 close 之前，fd 不会被复用 */
+    pthread_mutex_lock(&g_blocking_lock);
+    if (b->prev != NULL) b->prev->next = b->next;
+    else g_blocking = b->next;
+    if (b->next != NULL) b->next->prev = b->prev;
+    pthread_mutex_unlock(&g_blocking_lock);
+}
+
+static void blocking_shutdown_idle(void) { /* 排空：唤醒所有空闲连接 */
+    struct blocking_conn *b;      /* 遍历 */
+    pthread_mutex_lock(&g_blocking_lock);
+    for (b = g_blocking; b != NULL; b = b->next) {
+        if (__atomic_load_n(&b->idle, __ATOMIC_ACQUIRE)) shutdown(b->fd, SHUT_RD);
+    }
+    pthread_mutex_unlock(&g_blocking_lock);
+}
+
+/* 处理单个客户端连接：在持久连接上循环接收、分帧并批量响应，直到关闭或空闲超时。
+ * in/out 由调用者提供以便在多个连接之间复用；返回时两者均被清空。 */
+static void serve_client(struct client_arg *carg, struct http_buf *in, struct http_outq *out) { /* 连接处理函数 */
     int connfd = carg->fd;         /* 取出已连接套接字 */
-    char buf[1024];                /* 用于接收请求的缓冲区 */
     ssize_t n;                     /* 接收返回值 */
-    (void)buf;                     /* 避免未使用时的警告（下面会使用） */
-
-    /* 首先试图读取请求（读取但不作严格解析），以便等待客户端发送 */
-    n = recv(connfd, buf, sizeof(buf) - 1, 0); /* 从套接字读取数据 */
-    if (n > 0) {                   /* 若读取到了数据 */
-        buf[n] = '\0';             /* 终止字符串（安全） */
-        /* 这里我们不解析 HTTP 请求，只打印一行简要日志 */
-        /* 使用 fprintf 打印到 stderr，以免与客户端数据冲突 */
-        fprintf(stderr, "Received request from %s: %.40s\n", carg->addrstr, buf); /* 打印 */
-    } else if (n == 0) {           /* 对端关闭连接 */
-        fprintf(stderr, "Client %s closed connection before sending data\n", carg->addrstr); /* 打印 */
-    } else {                       /* 读取出错 */
-        fprintf(stderr, "recv error from %s: %s\n", carg->addrstr, strerror(errno)); /* 打印 */
-    }
-
-    /* 发送固定的 HTTP/1.1 响应 */
-    {                             /* 新的块用于在 C89 下声明变量 */
-        const char *p = response; /* 指针指向响应 */
-        size_t tosend = strlen(response); /* 计算要发送的字节数 */
-        ssize_t sent_total = 0;   /* 已发送的累计字节数 */
-        while ((size_t)sent_total < tosend) { /* 循环直至全部发送 */
-            ssize_t s = send(connfd, p + sent_total, tosend - sent_total, 0); /* 发送 */
-            if (s <= 0) {         /* 发送失败或连接被中断 */
-                if (s < 0) {      /* 出错 */
-                    fprintf(stderr, "send error to %s: %s\n", carg->addrstr, strerror(errno)); /* 打印 */
+    int rc;                        /* 发送结果 */
+    int closing = 0;               /* 是否在发送后关闭 */
+    int got_data = 0;              /* 是否收到过任何数据 */
+    int sent_any = 0;              /* 是否已发出过响应字节 */
+    size_t before;                 /* 发送前的积压 */
+    struct http_metrics *m = HTTP_METRICS(); /* 本线程计数器 */
+    struct blocking_conn reg;      /* 热重启排空用的登记 */
+    int track = g_cfg.handoff_path != NULL; /* 是否登记 */
+
+    in->len = 0;                   /* 清空复用的缓冲 */
+    http_outq_reset(out);
+    set_idle_timeout(connfd);      /* 启用空闲超时 */
+    if (track) blocking_register(&reg, connfd);
+
+    while (!closing) {             /* 直到需要关闭 */
+        if (http_buf_reserve(in, RECV_CHUNK) != 0) { /* 保证有空间接收 */
+            alog_printf(ALOG_ERROR, "malloc failed"); /* 打印 */
+            break;
+        }
+        if (track) {               /* 没有半个请求时属于空闲，排空时可以直接关闭 */
+            __atomic_store_n(&reg.idle, in->len == 0, __ATOMIC_RELEASE);
+            if (in->len == 0 && __atomic_load_n(&g_draining, __ATOMIC_ACQUIRE)) shutdown(connfd, SHUT_RD);
+        }
+        n = recv(connfd, in->data + in->len, in->cap - in->len, 0); /* 从套接字读取数据 */
+        if (track) __atomic_store_n(&reg.idle, 0, __ATOMIC_RELEASE);
+        if (n > 0) {               /* 读到数据：可能包含多个或半个请求 */
+            got_data = 1;
+            in->len += (size_t)n;
+            m->bytes_in += (unsigned long)n;
+            closing = process_requests(in, out, carg->addrstr); /* 分帧并生成响应 */
+            before = out->pending;
+            if (before == 0) continue; /* 请求尚不完整 */
+            rc = http_outq_flush(out, connfd); /* 本批响应一次写出 */
+            m->bytes_out += (unsigned long)(before - out->pending);
+            if (!sent_any && out->pending < before) { /* 第一个响应字节 */
+                http_metrics_first_byte(m, carg->accept_us);
+                sent_any = 1;
+            }
+            if (rc != 1) {         /* 未能全部发出 */
+                if (errno != EAGAIN && errno != EWOULDBLOCK) { /* 超时以外的错误 */
+                    m->send_errors++;
+                    alog_printf(ALOG_ERROR, "send error to %s: %s", carg->addrstr, strerror(errno)); /* 打印 */
                 }
-                break;            /* 跳出发送循环 */
+                break;
+            }
+        } else if (n == 0) {       /* 对端关闭连接 */
+            if (!got_data && !__atomic_load_n(&g_draining, __ATOMIC_ACQUIRE)) { /* 排空时是本端关闭 */
+                alog_printf(ALOG_WARN, "Client %s closed connection before sending data", carg->addrstr); /* 打印 */
             }
-            sent_total += s;     /* 累计已发送字节数 */
+            break;
+        } else if (errno == EINTR) { /* 被信号打断 */
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) { /* 空闲超时 */
+            break;
+        } else {                   /* 读取出错 */
+            m->recv_errors++;
+            alog_printf(ALOG_ERROR, "recv error from %s: %s", carg->addrstr, strerror(errno)); /* 打印 */
+            break;
         }
     }
 
-    /* 关闭已连接套接字并释放参数结构 */
+    /* 关闭已连接套接字；异常增大的缓冲不在连接之间保留 */
+    if (track) blocking_unregister(&reg);
     close(connfd);                /* 关闭连接套接字 */
+    m->closed++;
+    if (in->cap > BUF_KEEP_MAX) http_buf_free(in);
+    http_outq_reset(out);          /* 关闭未发完的文件、释放缓存项引用 */
+    if (out->buf.cap > BUF_KEEP_MAX) http_buf_free(&out->buf);
+    in->len = 0;
+}
+
+/* 每连接线程模式下处理单个客户端连接的线程主函数 */
+static void *client_thread(void *arg) { /* pthread 线程入口 */
+    struct client_arg *carg = (struct client_arg *)arg; /* 强制转换参数 */
+    struct http_buf in = { NULL, 0, 0 };  /* 请求缓冲 */
+    struct http_outq out;         /* 响应队列 */
+    pin_connection(carg->fd);     /* 先绑核，缓冲随后在本地节点分配 */
+    memset(&out, 0, sizeof(out));
+    serve_client(carg, &in, &out); /* 处理连接 */
+    http_buf_free(&in);           /* 释放缓冲 */
+    http_outq_free(&out);
     free(carg);                   /* 释放分配的参数结构 */
     return NULL;                  /* 线程返回 */
 }
 
+/* 池模式的有界连接队列：client_arg 按值保存在预分配的环形槽位中循环复用 */
+struct conn_queue {               /* 连接队列 */
+    struct client_arg *slots;     /* 环形槽位数组（启动时一次性分配） */
+    unsigned int cap;             /* 槽位数 */
+    unsigned int head;            /* 下一个出队位置 */
+    unsigned int count;           /* 当前排队连接数 */
+    pthread_mutex_t lock;         /* 保护队列 */
+    pthread_cond_t not_empty;     /* 队列非空条件 */
+    pthread_cond_t not_full;      /* 队列非满条件 */
+};
+
+static struct conn_queue g_queue; /* 全局连接队列（所有 accept 线程共享） */
+
+/* 初始化连接队列，成功返回 0 */
+static int conn_queue_init(struct conn_queue *q, unsigned int cap) { /* 初始化 */
+    q->slots = (struct client_arg *)calloc(cap, sizeof(struct client_arg)); /* 一次性分配槽位 */
+    if (q->slots == NULL) {       /* 分配失败 */
+        return -1;
+    }
+    q->cap = cap;                 /* 容量 */
+    q->head = 0;                  /* 队首 */
+    q->count = 0;                 /* 为空 */
+    pthread_mutex_init(&q->lock, NULL); /* 初始化互斥量 */
+    pthread_cond_init(&q->not_empty, NULL); /* 初始化条件变量 */
+    pthread_cond_init(&q->not_full, NULL);  /* 初始化条件变量 */
+    return 0;
+}
+
+/* 将连接放入队列；队列满时按 policy 处理，成功入队返回 0，未入队返回 -1 */
+static int conn_queue_push(struct conn_queue *q, const struct client_arg *carg,
+                           enum backpressure policy) { /* 入队 */
+    pthread_mutex_lock(&q->lock); /* 加锁 */
+    while (q->count == q->cap) {  /* 队列已满 */
+        if (policy != BP_BLOCK) { /* 非阻塞策略：放弃入队 */
+            pthread_mutex_unlock(&q->lock); /* 解锁 */
+            return -1;            /* 由调用者关闭连接 */
+        }
+        pthread_cond_wait(&q->not_full, &q->lock); /* 等待工作线程取走连接 */
+    }
+    q->slots[(q->head + q->count) % q->cap] = *carg; /* 复制到队尾槽位 */
+    q->count++;                   /* 计数加一 */
+    pthread_cond_signal(&q->not_empty); /* 唤醒一个工作线程 */
+    pthread_mutex_unlock(&q->lock); /* 解锁 */
+    return 0;
+}
+
+/* 从队列取出一个连接（队列空时阻塞），复制到 out */
+static void conn_queue_pop(struct conn_queue *q, struct client_arg *out) { /* 出队 */
+    pthread_mutex_lock(&q->lock); /* 加锁 */
+    while (q->count == 0) {       /* 队列为空 */
+        pthread_cond_wait(&q->not_empty, &q->lock); /* 等待新连接 */
+    }
+    *out = q->slots[q->head];     /* 复制出槽位内容，槽位随即可复用 */
+    q->head = (q->head + 1) % q->cap; /* 移动队首 */
+    q->count--;                   /* 计数减一 */
+    pthread_cond_signal(&q->not_full); /* 唤醒可能阻塞的 accept 线程 */
+    pthread_mutex_unlock(&q->lock); /* 解锁 */
+}
+
+/* 池模式工作线程：不断从队列取出连接并处理 */
+static void *pool_worker(void *arg) { /* 工作线程入口 */
+    struct client_arg carg;       /* 线程内复用的参数结构 */
+    struct http_buf in = { NULL, 0, 0 };  /* 线程内复用的请求缓冲 */
+    struct http_outq out;         /* 线程内复用的响应队列 */
+    (void)arg;                    /* 避免未使用警告 */
+    pin_thread(__atomic_fetch_add(&g_next_worker, 1, __ATOMIC_RELAXED)); /* 工作线程依次占用放置位置 */
+    memset(&out, 0, sizeof(out));
+    for (;;) {                    /* 永久循环 */
+        conn_queue_pop(&g_queue, &carg); /* 取出一个连接 */
+        serve_client(&carg, &in, &out); /* 处理连接 */
+    }
+    return NULL;                  /* 不会返回 */
+}
+
+/* 启动 n 个池工作线程，返回成功启动的线程数 */
+static int start_pool_workers(int n) { /* 启动线程池 */
+    int i;                        /* 循环索引 */
+    int started = 0;              /* 成功启动数 */
+    pthread_t tid;                /* 线程 id */
+    for (i = 0; i < n; i++) {     /* 逐个创建 */
+        if (pthread_create(&tid, NULL, pool_worker, NULL) != 0) { /* 创建失败 */
+            fprintf(stderr, "pthread_create for pool worker %d failed\n", i); /* 打印 */
+            continue;             /* 尝试下一个 */
+        }
+        pthread_detach(tid);      /* 分离线程 */
+        started++;                /* 计数 */
+    }
+    return started;
+}
+
+/* 队列满时按背压策略处理无法入队的连接 */
+static void reject_client(int connfd, enum backpressure policy) { /* 拒绝连接 */
+    if (policy == BP_REJECT) {    /* 尽力发送 503，不阻塞 accept 线程 */
+        (void)send(connfd, response_503, sizeof(response_503) - 1, MSG_DONTWAIT | MSG_NOSIGNAL); /* 非阻塞发送 */
+    }
+    close(connfd);                /* 关闭连接 */
+    HTTP_METRICS()->closed++;     /* 已计入 accepted */
+}
+
 /* 为给定的文字地址和端口创建、绑定并监听套接字，返回套接字 fd 或 -1 */
 /* 不使用 getaddrinfo，直接用 inet_pton 填充 sockaddr_in / sockaddr_in6 */
-static int make_and_bind(const char *host, const char *port, int v6only) { /* 创建并绑定 */
+/* reuseport 非零时设置 SO_REUSEPORT，使多个事件循环各自拥有一个监听套接字，由内核分发连接 */
+static int make_and_bind(const char *host, const char *port, int v6only, int reuseport) { /* 创建并绑定 */
     int sfd = -1;                 /* 返回的套接字 */
     int reuse = 1;                /* SO_REUSEADDR 选项值 */
     int family;                   /* AF_INET 或 AF_INET6 */
@@ -139,6 +562,13 @@ static int make_and_bind(const char *host, const char *port, int v6only) { /* 
             fprintf(stderr, "setsockopt SO_REUSEADDR failed: %s\n", strerror(errno)); /* 打印但继续 */
         }
 
+        /* 按需开启 SO_REUSEPORT；失败则无法与其他循环共享端口，直接报错 */
+        if (reuseport && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(reuse)) < 0) {
+            fprintf(stderr, "setsockopt SO_REUSEPORT failed: %s\n", strerror(errno)); /* 打印 */
+            close(sfd);
+            return -1;
+        }
+
         /* 绑定 IPv4 地址 */
         if (bind(sfd, (struct sockaddr *)&s4, sizeof(s4)) != 0) {
             fprintf(stderr, "bind(%s:%s) failed: %s\n", host, port, strerror(errno)); /* 打印 */
@@ -147,7 +577,7 @@ static int make_and_bind(const char *host, const char *port, int v6only) { /* 
         }
 
         /* 监听该套接字 */
-        if (listen(sfd, 16) < 0) {
+        if (listen(sfd, LISTEN_BACKLOG) < 0) {
             fprintf(stderr, "listen failed: %s\n", strerror(errno)); /* 打印错误 */
             close(sfd);
             return -1;
@@ -178,6 +608,13 @@ static int make_and_bind(const char *host, const char *port, int v6only) { /* 
             fprintf(stderr, "setsockopt SO_REUSEADDR failed: %s\n", strerror(errno)); /* 打印但继续 */
         }
 
+        /* 按需开启 SO_REUSEPORT；失败则无法与其他循环共享端口，直接报错 */
+        if (reuseport && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(reuse)) < 0) {
+            fprintf(stderr, "setsockopt SO_REUSEPORT failed: %s\n", strerror(errno)); /* 打印 */
+            close(sfd);
+            return -1;
+        }
+
         /* 如果要求仅 IPv6，则设置 IPV6_V6ONLY */
         if (v6only) {
             int on = 1;
@@ -194,7 +631,7 @@ static int make_and_bind(const char *host, const char *port, int v6only) { /* 
         }
 
         /* 监听该套接字 */
-        if (listen(sfd, 16) < 0) {
+        if (listen(sfd, LISTEN_BACKLOG) < 0) {
             fprintf(stderr, "listen failed: %s\n", strerror(errno)); /* 打印错误 */
             close(sfd);
             return -1;
@@ -204,47 +641,1068 @@ static int make_and_bind(const char *host, const char *port, int v6only) { /* 
     }
 }
 
-/* 接受循环线程：对一个监听套接字不断 accept 并为每个连接创建处理线程 */
-struct accept_arg {               /* 接受线程参数结构 */
+/* ======== 热重启：监听套接字交接 ======== */
+/* 新进程以相同的 -H 路径启动时先连接该 UNIX 套接字，旧进程用 SCM_RIGHTS 把全部监听 */
+/* 套接字交给它。两个进程此时共享同一批套接字和连接队列，端口从不重新绑定，SYN 也不会 */
+/* 被丢弃。新进程开始接受连接后回复确认，旧进程随即停止接受、排空已有连接并退出。 */
+/* 槽位 2i / 2i+1 为第 i 个事件循环的 IPv6 / IPv4 监听（线程与池模式只用槽 0、1）。 */
+
+#define HANDOFF_MAGIC 0x48525354UL /* "HRST" */
+#define HANDOFF_ACK 'R'          /* 新进程就绪的确认字节 */
+#define HANDOFF_TIMEOUT 10       /* 等待对方应答的秒数 */
+
+/* 交接消息的数据部分；描述符按槽号顺序附在控制消息中 */
+struct handoff_hdr {              /* 交接消息头 */
+    unsigned long magic;          /* HANDOFF_MAGIC */
+    int nslots;                   /* 槽位数 */
+    unsigned char present[MAX_LISTEN_SLOTS]; /* 各槽位是否有套接字 */
+};
+
+static int g_inherited[MAX_LISTEN_SLOTS]; /* 从旧进程继承的套接字，按槽号 */
+static int g_ninherited = 0;      /* 继承的槽位数，0 表示全新启动 */
+static int g_handoff_peer = -1;   /* 与旧进程的连接，就绪后发确认 */
+
+/* 取得槽位 slot 的监听套接字：继承的直接使用，否则新建；记入 g_listen_fds 以备下次交接 */
+static int listen_slot(int slot, const char *host, int v6only, int reuseport) { /* 取得监听套接字 */
+    int fd;                       /* 监听套接字 */
+    if (g_ninherited > 0) {       /* 热重启：不重新绑定 */
+        fd = slot < g_ninherited ? g_inherited[slot] : -1;
+    } else {
+        fd = make_and_bind(host, g_cfg.port, v6only, reuseport);
+    }
+    if (slot < MAX_LISTEN_SLOTS) g_listen_fds[slot] = fd;
+    return fd;
+}
+
+/* 等待 fd 可读，最多 ms 毫秒；超时或出错返回 0 */
+static int wait_readable(int fd, int ms) { /* 等待可读 */
+    struct pollfd p;              /* poll 参数 */
+    p.fd = fd;
+    p.events = POLLIN;
+    p.revents = 0;
+    return poll(&p, 1, ms) > 0;
+}
+
+static void handoff_ready(void); /* 监听就绪后调用，定义见接受线程之后 */
+
+/* ======== epoll 边沿触发事件循环（reactor）模式 ======== */
+/* 每个事件循环独占一个线程、一个 epoll 实例以及一组 SO_REUSEPORT 监听套接字， */
+/* 连接由内核在各循环的监听套接字之间分发，循环之间不共享任何可变状态。 */
+
+#define MAX_EVENTS 256            /* 每次 epoll_wait 最多取回的事件数 */
+#define OUT_HIGH_WATER (256 * 1024) /* 未发出的响应超过此值时暂停读取流水线请求 */
+
+/* 连接状态机 */
+enum conn_state {                 /* 连接状态 */
+    CONN_LISTEN,                  /* 监听套接字（复用 conn 结构以便统一分派事件） */
+    CONN_OPEN,                    /* 持久连接：读取并分帧请求，发送响应 */
+    CONN_CLOSING                  /* 不再读取，发送完剩余响应后关闭 */
+};
+
+/* 每连接状态：空闲连接只占这一个结构，缓冲在首次收到数据时才分配 */
+struct conn {                     /* 连接结构 */
+    enum conn_state state;        /* 当前状态 */
+    int fd;                       /* 套接字 */
+    int read_paused;              /* 因响应积压而暂停读取（边沿触发下需主动恢复） */
+    struct http_buf in;           /* 未分帧的请求数据（可能跨多次 recv） */
+    struct http_outq out;         /* 待发送的响应（同一批流水线请求的响应合并发送） */
+    time_t last_active;           /* 最近一次读写进展的时间（单调时钟，秒） */
+    unsigned long accept_us;      /* 接受连接的时刻（单调时钟微秒） */
+    int sent_any;                 /* 是否已发出过响应字节（首字节延迟只记一次） */
+    struct conn *lru_prev;        /* 空闲 LRU 链表：越靠前越久未活动 */
+    struct conn *lru_next;
+    struct conn *next_free;       /* 空闲链表指针 */
+    char addrstr[INET6_ADDRSTRLEN]; /* 对端地址的文本形式 */
+};
+
+/* 单个事件循环 */
+struct event_loop {               /* 事件循环结构 */
+    int index;                    /* 循环编号 */
+    int epfd;                     /* epoll 实例 */
+    struct conn listeners[2];     /* 本循环的 IPv4 / IPv6 监听套接字 */
+    int nlisteners;               /* 有效监听套接字数 */
+    struct conn *free_list;       /* 已关闭连接的回收链表 */
+    struct conn *lru_head;        /* 最久未活动的连接 */
+    struct conn *lru_tail;        /* 最近活动的连接 */
+    time_t now;                   /* 本轮事件处理的当前时间 */
+    struct http_metrics *metrics; /* 运行本循环的线程的计数器 */
+};
+
+/* 单调时钟秒数，用于空闲超时 */
+static time_t mono_seconds(void) { /* 当前时间 */
+    struct timespec ts;           /* 时间 */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* 将套接字设为非阻塞，成功返回 0 */
+static int set_nonblock(int fd) { /* 设置非阻塞 */
+    int flags = fcntl(fd, F_GETFL, 0); /* 读取当前标志 */
+    if (flags < 0) return -1;     /* 失败 */
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK); /* 加上 O_NONBLOCK */
+}
+
+/* 将打开文件数软限制提升到硬限制，使单进程可以持有大量空闲连接 */
+static void raise_nofile_limit(void) { /* 提升 fd 上限 */
+    struct rlimit rl;             /* 资源限制 */
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return; /* 查询失败则保持原样 */
+    if (rl.rlim_cur < rl.rlim_max) { /* 软限制低于硬限制 */
+        rl.rlim_cur = rl.rlim_max; /* 提升到硬限制 */
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0) { /* 设置失败 */
+            fprintf(stderr, "setrlimit(RLIMIT_NOFILE) failed: %s\n", strerror(errno)); /* 打印但继续 */
+        }
+    }
+}
+
+/* 从 LRU 链表摘下连接 */
+static void lru_unlink(struct event_loop *loop, struct conn *c) { /* 摘链 */
+    if (c->lru_prev) c->lru_prev->lru_next = c->lru_next;
+    else if (loop->lru_head == c) loop->lru_head = c->lru_next;
+    if (c->lru_next) c->lru_next->lru_prev = c->lru_prev;
+    else if (loop->lru_tail == c) loop->lru_tail = c->lru_prev;
+    c->lru_prev = NULL;
+    c->lru_next = NULL;
+}
+
+/* 记录连接有进展：移到 LRU 链表尾部，O(1) */
+static void conn_touch(struct event_loop *loop, struct conn *c) { /* 更新活动时间 */
+    c->last_active = loop->now;
+    if (loop->lru_tail == c) return; /* 已在尾部 */
+    lru_unlink(loop, c);
+    c->lru_prev = loop->lru_tail;
+    if (loop->lru_tail) loop->lru_tail->lru_next = c;
+    else loop->lru_head = c;
+    loop->lru_tail = c;
+}
+
+/* 从回收链表取一个连接结构，链表为空时才分配新结构 */
+static struct conn *conn_get(struct event_loop *loop) { /* 获取连接结构 */
+    struct conn *c = loop->free_list; /* 先尝试复用 */
+    if (c != NULL) {              /* 有可复用结构 */
+        loop->free_list = c->next_free; /* 从链表摘下 */
+    } else {                      /* 无可复用结构 */
+        c = (struct conn *)calloc(1, sizeof(struct conn)); /* 分配新结构 */
+        if (c == NULL) return NULL; /* 分配失败 */
+    }
+    c->state = CONN_OPEN;         /* 初始状态：等待请求 */
+    c->read_paused = 0;
+    c->sent_any = 0;
+    c->in.len = 0;                /* 缓冲清空（内存保留复用） */
+    c->next_free = NULL;
+    return c;
+}
+
+/* 关闭连接并放回回收链表（close 会自动把 fd 从 epoll 中移除） */
+static void conn_close(struct event_loop *loop, struct conn *c) { /* 关闭连接 */
+    lru_unlink(loop, c);          /* 移出空闲跟踪 */
+    close(c->fd);                 /* 关闭套接字 */
+    c->fd = -1;                   /* 标记无效 */
+    loop->metrics->closed++;
+    if (c->in.cap > BUF_KEEP_MAX) http_buf_free(&c->in); /* 异常增大的缓冲不保留 */
+    http_outq_reset(&c->out);     /* 关闭未发完的文件、释放缓存项引用 */
+    if (c->out.buf.cap > BUF_KEEP_MAX) http_buf_free(&c->out.buf);
+    c->next_free = loop->free_list; /* 挂回回收链表 */
+    loop->free_list = c;
+}
+
+/* 读取到 EAGAIN（边沿触发要求）并对请求分帧；响应积压过多时暂停读取。
+ * 返回 0 表示连接仍有效，-1 表示连接已被关闭。 */
+static int conn_read(struct event_loop *loop, struct conn *c) { /* 读取 */
+    ssize_t n;                    /* recv 返回值 */
+
+    while (c->state == CONN_OPEN) { /* 关闭中的连接不再读取 */
+        if (c->out.pending > OUT_HIGH_WATER) { /* 客户端读得太慢 */
+            c->read_paused = 1;   /* 等响应发完再继续读 */
+            return 0;
+        }
+        if (http_buf_reserve(&c->in, RECV_CHUNK) != 0) { /* 扩容失败 */
+            conn_close(loop, c);
+            return -1;
+        }
+        n = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0); /* 非阻塞读取 */
+        if (n > 0) {              /* 读到数据 */
+            c->in.len += (size_t)n;
+            loop->metrics->bytes_in += (unsigned long)n;
+            conn_touch(loop, c);
+            if (process_requests(&c->in, &c->out, c->addrstr)) { /* 分帧并追加响应 */
+                c->state = CONN_CLOSING; /* 发送完后关闭 */
+            }
+            continue;
+        }
+        if (n == 0) {             /* 对端关闭：若还有响应未发完，发完再关 */
+            if (c->out.pending == 0) {
+                conn_close(loop, c);
+                return -1;
+            }
+            c->state = CONN_CLOSING;
+            return 0;
+        }
+        if (errno == EINTR) continue; /* 被信号打断，重试 */
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0; /* 暂无更多数据 */
+        loop->metrics->recv_errors++;
+        alog_printf(ALOG_ERROR, "recv error from %s: %s", c->addrstr, strerror(errno)); /* 打印 */
+        conn_close(loop, c);      /* 出错关闭 */
+        return -1;
+    }
+    return 0;
+}
+
+/* 记录发出的字节；连接上第一次发出时记录首字节延迟 */
+static void conn_sent(struct event_loop *loop, struct conn *c, size_t n) { /* 发送计数 */
+    loop->metrics->bytes_out += (unsigned long)n;
+    if (!c->sent_any) {
+        http_metrics_first_byte(loop->metrics, c->accept_us);
+        c->sent_any = 1;
+    }
+}
+
+/* 尽可能多地发送积压的响应。返回 1 表示已全部发完，0 表示需等待 EPOLLOUT，-1 表示连接已关闭 */
+static int conn_write(struct event_loop *loop, struct conn *c) { /* 发送 */
+    size_t before = c->out.pending; /* 发送前的积压 */
+    int r = http_outq_flush(&c->out, c->fd); /* writev 内存段，sendfile 文件段 */
+    if (c->out.pending != before) { /* 有进展 */
+        conn_sent(loop, c, before - c->out.pending);
+        conn_touch(loop, c);
+    }
+    if (r >= 0) return r;         /* 全部发完或发送缓冲满 */
+    loop->metrics->send_errors++;
+    alog_printf(ALOG_ERROR, "send error to %s: %s", c->addrstr, strerror(errno)); /* 打印 */
+    conn_close(loop, c);          /* 出错关闭 */
+    return -1;
+}
+
+/* 处理连接上的任意事件：读 -> 批量写 -> （积压清空后）恢复读，直到需要等待内核通知 */
+static void conn_service(struct event_loop *loop, struct conn *c) { /* 驱动状态机 */
+    int w;                        /* conn_write 结果 */
+    for (;;) {
+        if (!c->read_paused && conn_read(loop, c) < 0) return; /* 连接已关闭 */
+        w = conn_write(loop, c);  /* 本轮所有响应合并发送 */
+        if (w <= 0) return;       /* 等待 EPOLLOUT 或连接已关闭 */
+        if (c->state == CONN_CLOSING) { /* 最后的响应已发完 */
+            conn_close(loop, c);
+            return;
+        }
+        if (!c->read_paused) return; /* 输入已读到 EAGAIN，等待 EPOLLIN */
+        c->read_paused = 0;       /* 积压已清空，继续读取剩余流水线请求 */
+    }
+}
+
+/* 关闭空闲超过 idle_timeout 的连接：LRU 链表头部总是最久未活动的连接 */
+static void loop_expire_idle(struct event_loop *loop) { /* 空闲超时 */
+    while (loop->lru_head != NULL &&
+           loop->now - loop->lru_head->last_active >= (time_t)g_cfg.idle_timeout) {
+        conn_close(loop, loop->lru_head);
+    }
+}
+
+/* 接受监听套接字上所有待处理连接（监听套接字使用水平触发，出错时下次仍会通知） */
+static void loop_accept(struct event_loop *loop, int lfd) { /* 接受连接 */
+    struct sockaddr_storage peer; /* 对端地址 */
+    socklen_t peerlen;            /* 地址长度 */
+    struct epoll_event ev;        /* 注册事件 */
+    struct conn *c;               /* 新连接 */
+    int fd;                       /* 新连接套接字 */
+
+    for (;;) {                    /* 直到 EAGAIN */
+        peerlen = sizeof(peer);
+        fd = accept4(lfd, (struct sockaddr *)&peer, &peerlen, SOCK_NONBLOCK | SOCK_CLOEXEC); /* 非阻塞接受 */
+        if (fd < 0) {             /* 出错或暂无连接 */
+            if (errno == EINTR || errno == ECONNABORTED) continue; /* 可重试错误 */
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { /* 其他错误（如 EMFILE） */
+                alog_printf(ALOG_ERROR, "accept error: %s", strerror(errno)); /* 打印 */
+            }
+            return;
+        }
+        loop->metrics->accepted++;
+        c = conn_get(loop);       /* 获取连接结构 */
+        if (c == NULL) {          /* 分配失败 */
+            alog_printf(ALOG_ERROR, "malloc failed"); /* 打印 */
+            close(fd);
+            loop->metrics->closed++;
+            continue;
+        }
+        c->fd = fd;
+        c->accept_us = http_metrics_now_us();
+        sockaddr_to_str(&peer, c->addrstr, sizeof(c->addrstr)); /* 记录对端地址 */
+
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; /* 一次注册读写，边沿触发 */
+        ev.data.ptr = c;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) { /* 注册失败 */
+            alog_printf(ALOG_ERROR, "epoll_ctl ADD failed: %s", strerror(errno)); /* 打印 */
+            close(fd);
+            loop->metrics->closed++;
+            c->next_free = loop->free_list; /* 尚未加入 LRU，直接回收 */
+            loop->free_list = c;
+            continue;
+        }
+        conn_touch(loop, c);      /* 开始空闲计时 */
+    }
+}
+
+/* 连接上是否有已到达但尚未读取的数据（边沿触发下其事件可能还在下一轮 epoll_wait 中） */
+static int conn_has_input(int fd) { /* 探测输入 */
+    char ch;                      /* 窥视缓冲 */
+    return recv(fd, &ch, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+/* 热重启排空：停止接受新连接，立即关闭没有请求在处理的连接（包括尚未发来请求的新连接），
+ * 其余连接处理完当前请求后关闭（排空中的响应都不再保持连接） */
+static void loop_stop_accepting(struct event_loop *loop) { /* 停止接受 */
+    struct conn *c, *next;        /* LRU 遍历 */
+    int i;                        /* 循环索引 */
+
+    for (i = 0; i < loop->nlisteners; i++) { /* 套接字仍在新进程中打开，close 不会把它移出 epoll */
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, loop->listeners[i].fd, NULL);
+        close(loop->listeners[i].fd);
+    }
+    loop->nlisteners = 0;
+    for (c = loop->lru_head; c != NULL; c = next) {
+        next = c->lru_next;
+        if (c->state == CONN_OPEN && c->in.len == 0 && c->out.pending == 0 && !conn_has_input(c->fd)) {
+            conn_close(loop, c);  /* 有未读数据的连接留给下一轮：它的请求会被响应后关闭 */
+        }
+    }
+    __atomic_sub_fetch(&g_accepting, 1, __ATOMIC_RELEASE);
+}
+
+/* 事件循环主体 */
+static void *event_loop_run(void *arg) { /* 事件循环线程入口 */
+    struct event_loop *loop = (struct event_loop *)arg; /* 参数 */
+    struct epoll_event events[MAX_EVENTS]; /* 就绪事件 */
+    int timeout_ms;               /* epoll_wait 超时：启用空闲超时或热重启时每秒醒来检查一次 */
+    int n;                        /* 就绪事件数 */
+    int i;                        /* 循环索引 */
+
+    pin_thread(loop->index);      /* 循环 i 绑到第 i 个 CPU，连接结构随后在本地节点分配 */
+    loop->metrics = HTTP_METRICS(); /* 在运行本循环的线程里领取 */
+    timeout_ms = g_cfg.idle_timeout > 0 || g_cfg.handoff_path != NULL ? 1000 : -1;
+    for (;;) {                    /* 永久循环 */
+        n = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout_ms); /* 等待事件 */
+        if (n < 0) {              /* 出错 */
+            if (errno == EINTR) continue; /* 被信号打断 */
+            alog_printf(ALOG_ERROR, "epoll_wait failed: %s", strerror(errno)); /* 打印 */
+            break;
+        }
+        loop->now = mono_seconds(); /* 每轮取一次时间 */
+        for (i = 0; i < n; i++) { /* 逐个分派 */
+            struct conn *c = (struct conn *)events[i].data.ptr; /* 事件对应的连接 */
+            if (c->state == CONN_LISTEN) { /* 监听套接字 */
+                loop_accept(loop, c->fd);
+            } else {              /* 已连接套接字：错误由 recv/send 报告 */
+                conn_service(loop, c);
+            }
+        }
+        if (g_cfg.idle_timeout > 0) loop_expire_idle(loop); /* 清理空闲连接 */
+        if (loop->nlisteners > 0 && __atomic_load_n(&g_draining, __ATOMIC_ACQUIRE)) {
+            loop_stop_accepting(loop); /* 监听已交给新进程 */
+        }
+    }
+    return NULL;
+}
+
+/* 为事件循环取得槽位 slot 的 SO_REUSEPORT 监听套接字（新建或继承）并注册到 epoll，成功返回 0 */
+static int loop_add_listener(struct event_loop *loop, int slot, const char *host, int v6only) { /* 添加监听 */
+    struct conn *l = &loop->listeners[loop->nlisteners]; /* 监听槽位 */
+    struct epoll_event ev;        /* 注册事件 */
+    int fd;                       /* 监听套接字 */
+
+    fd = listen_slot(slot, host, v6only, 1); /* 复用既有的 IPv4/IPv6 建立逻辑 */
+    if (fd < 0) return -1;        /* 失败 */
+    if (set_nonblock(fd) != 0) {  /* 监听套接字必须非阻塞 */
+        close(fd);
+        g_listen_fds[slot] = -1;
+        return -1;
+    }
+    memset(l, 0, sizeof(*l));
+    l->state = CONN_LISTEN;
+    l->fd = fd;
+    ev.events = EPOLLIN;          /* 监听套接字用水平触发 */
+    ev.data.ptr = l;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) { /* 注册失败 */
+        close(fd);
+        g_listen_fds[slot] = -1;
+        return -1;
+    }
+    listen_incoming_cpu(fd, loop->index); /* 与本循环绑定的 CPU 对齐 */
+    loop->nlisteners++;
+    return 0;
+}
+
+/* epoll 模式入口：创建 g_cfg.workers 个事件循环，每个拥有自己的监听套接字 */
+static int run_epoll_mode(void) { /* 运行 epoll 模式 */
+    struct event_loop *loops;     /* 事件循环数组 */
+    pthread_t tid;                /* 线程 id */
+    int i;                        /* 循环索引 */
+
+    raise_nofile_limit();         /* 为大量空闲连接提升 fd 上限 */
+
+    loops = (struct event_loop *)calloc((size_t)g_cfg.workers, sizeof(struct event_loop)); /* 分配 */
+    if (loops == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return 1;
+    }
+    g_nslots = 2 * g_cfg.workers; /* 每个循环两个槽位 */
+    g_accepting = g_cfg.workers;
+
+    for (i = 0; i < g_cfg.workers; i++) { /* 初始化每个循环 */
+        loops[i].index = i;
+        loops[i].now = mono_seconds();
+        loops[i].epfd = epoll_create1(EPOLL_CLOEXEC); /* 创建 epoll 实例 */
+        if (loops[i].epfd < 0) {
+            fprintf(stderr, "epoll_create1 failed: %s\n", strerror(errno));
+            return 1;
+        }
+        if (loop_add_listener(&loops[i], 2 * i, "::1", 1) != 0) { /* IPv6 监听 */
+            fprintf(stderr, "Loop %d: failed to bind IPv6 [::1]:%s\n", i, g_cfg.port);
+        }
+        if (loop_add_listener(&loops[i], 2 * i + 1, "127.0.0.1", 0) != 0) { /* IPv4 监听 */
+            fprintf(stderr, "Loop %d: failed to bind IPv4 127.0.0.1:%s\n", i, g_cfg.port);
+        }
+        if (loops[i].nlisteners == 0) { /* 本循环没有任何监听套接字 */
+            fprintf(stderr, "No sockets bound. Exiting.\n");
+            return 1;
+        }
+    }
+    fprintf(stderr, "Epoll mode: %d event loops\n", g_cfg.workers); /* 打印配置 */
+    report_layout("event loops", g_cfg.workers);
+
+    for (i = 1; i < g_cfg.workers; i++) { /* 循环 1..N-1 各自一个线程 */
+        if (pthread_create(&tid, NULL, event_loop_run, &loops[i]) != 0) {
+            fprintf(stderr, "pthread_create for event loop %d failed\n", i);
+            return 1;
+        }
+        pthread_detach(tid);
+    }
+    handoff_ready();              /* 所有监听已在 epoll 中 */
+    event_loop_run(&loops[0]);    /* 循环 0 在主线程中运行 */
+    return 0;
+}
+
+/* ======== io_uring 完成事件（proactor）模式 ======== */
+/* 与 epoll 模式一样每个循环独占一个线程和一组 SO_REUSEPORT 监听套接字。 */
+/* 每个监听套接字挂一个多次接受请求，新连接直接放进注册文件表，之后按槽号引用； */
+/* 每个连接挂一个多次接收请求，数据落在提供缓冲环中；响应从输出队列复制到该连接 */
+/* 在注册缓冲中的发送块（文件段由 READ_FIXED 异步读入，冷文件不会让整个循环阻塞在 */
+/* 磁盘上），由 WRITE_FIXED 发出。需要关闭时 */
+/* 最后一块写与关闭链接提交，写不完整时内核取消关闭，补发剩余部分后再关。 */
+/* 提交队列满且一时腾不出来时，连接（或监听）记为待重试，下一轮重新推进。 */
+
+#define URING_CONNS 4096          /* 每个循环的注册文件表大小，即连接上限 */
+#define URING_BUFS 1024           /* 每个循环的接收提供缓冲个数 */
+#define URING_BUF_SIZE 4096       /* 每个接收缓冲的大小 */
+#define URING_SEND_CHUNK 4096     /* 每连接一块注册发送缓冲 */
+
+enum { UOP_ACCEPT, UOP_RECV, UOP_WRITE, UOP_CLOSE, UOP_CANCEL, UOP_READ }; /* 完成事件类型 */
+#define UDATA(op, slot) (((unsigned long)(slot) << 8) | (unsigned long)(op)) /* user_data 编码 */
+
+/* io_uring 模式的连接：缓冲、状态与空闲 LRU 复用 epoll 模式的结构，c.fd 存放槽号 */
+struct uring_conn {               /* 连接结构 */
+    struct conn c;                /* 必须是第一个成员：LRU 链表中的指针可直接转换 */
+    int recv_armed;               /* 多次接收请求仍在内核中（它持有文件引用） */
+    int cancel_sent;              /* 已请求取消接收 */
+    int writing;                  /* 有一个 WRITE_FIXED 在途 */
+    int reading;                  /* 有一个读文件段的 READ_FIXED 在途（发送块被它占用） */
+    int close_queued;             /* 已提交关闭（可能链接在写之后） */
+    int retry;                    /* 取不到提交项，等下一轮再推进 */
+};
+
+/* 单个 io_uring 循环 */
+struct uring_loop {               /* 循环结构 */
+    struct event_loop base;       /* 复用 LRU 链表与本轮时间 */
+    struct uring ring;            /* 提交/完成队列 */
+    struct uring_bufs bufs;       /* 接收缓冲环，组号 0 */
+    char *send_area;              /* URING_CONNS 个发送块，整体注册为固定缓冲 0 */
+    struct uring_conn *conns;     /* 按槽号索引的连接 */
+    int lfds[2];                  /* 本循环的监听套接字 */
+    int nlfds;                    /* 有效监听套接字数 */
+    int draining;                 /* 已取消接受请求（热重启排空） */
+    int lfds_open;                /* 排空时尚未结束接受请求的监听套接字数 */
+    int retry;                    /* 有连接记为待重试 */
+    int accept_retry[2];          /* 接受请求（排空时为它的取消）没能提交 */
+};
+
+static int g_loops_ready = 0;     /* 环已建立的循环 1..N-1 个数 */
+static int g_loops_failed = 0;    /* 环建立失败的循环 1..N-1 个数 */
+static int g_loops_go = 0;        /* 主线程的决定：1 取得监听并运行，-1 放弃 io_uring */
+static int g_loops_listening = 0; /* 已取得监听套接字的循环 1..N-1 个数 */
+
+static void uring_loop_free(struct uring_loop *l) { /* 释放循环 */
+    int i;                        /* 循环索引 */
+    uring_bufs_free(&l->ring, &l->bufs);
+    uring_exit(&l->ring);
+    for (i = 0; i < l->nlfds; i++) close(l->lfds[i]);
+    free(l->send_area);
+    free(l->conns);
+}
+
+/* 建立一个 io_uring 循环的环与缓冲，不碰监听套接字；内核缺少所需功能或注册内存
+ * 超出 RLIMIT_MEMLOCK 时返回 -1（errno），调用者回退到 epoll 模式 */
+static int uring_loop_init(struct uring_loop *l, int index) { /* 初始化循环 */
+    /* 多次接收是 6.0 加入的，探测不到它本身，用同版本加入的 SEND_ZC 代替 */
+    static const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_WRITE_FIXED,
+                               IORING_OP_READ_FIXED, IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL,
+                               IORING_OP_SEND_ZC };
+    int i;                        /* 循环索引 */
+
+    memset(l, 0, sizeof(*l));
+    l->base.index = index;
+    l->base.now = mono_seconds();
+    if (uring_init(&l->ring, 512, 8192) != 0) return -1; /* 多次请求的完成事件多，CQ 开大 */
+    if (!uring_supported(&l->ring, ops, (int)(sizeof(ops) / sizeof(ops[0])))) {
+        uring_exit(&l->ring);
+        errno = ENOSYS;
+        return -1;
+    }
+    l->send_area = (char *)malloc((size_t)URING_CONNS * URING_SEND_CHUNK);
+    l->conns = (struct uring_conn *)calloc(URING_CONNS, sizeof(*l->conns));
+    if (l->send_area == NULL || l->conns == NULL ||
+        uring_register_files(&l->ring, URING_CONNS) != 0 ||
+        uring_register_buffer(&l->ring, l->send_area, (size_t)URING_CONNS * URING_SEND_CHUNK) != 0 ||
+        uring_bufs_init(&l->ring, &l->bufs, 0, URING_BUFS, URING_BUF_SIZE) != 0) {
+        uring_loop_free(l);
+        return -1;
+    }
+    for (i = 0; i < URING_CONNS; i++) l->conns[i].c.fd = -1; /* 空槽 */
+    return 0;
+}
+
+/* 取得循环的监听套接字（热重启时为继承来的）；所有循环的环都建好后才调用，
+ * 回退到 epoll 模式时不会有监听被本模式占用或关闭 */
+static void uring_loop_listen(struct uring_loop *l) { /* 取得监听 */
+    int index = l->base.index;    /* 循环序号 */
+    int fd;                       /* 监听套接字 */
+    int i;                        /* 循环索引 */
+
+    for (i = 0; i < 2; i++) {     /* IPv6 与 IPv4 监听 */
+        fd = listen_slot(2 * index + i, i == 0 ? "::1" : "127.0.0.1", i == 0, 1); /* 复用既有的建立逻辑 */
+        if (fd < 0) {
+            fprintf(stderr, "Loop %d: failed to bind %s:%s\n", index, i == 0 ? "IPv6 [::1]" : "IPv4 127.0.0.1", g_cfg.port);
+            continue;
+        }
+        listen_incoming_cpu(fd, index);
+        l->lfds[l->nlfds++] = fd;
+    }
+}
+
+/* 取不到提交项：记下连接，uring_retry() 在下一轮重新推进它 */
+static void uconn_defer(struct uring_loop *l, int slot) { /* 待重试 */
+    l->conns[slot].retry = 1;
+    l->retry = 1;
+}
+
+static void uq_accept(struct uring_loop *l, int li) { /* 挂上多次接受 */
+    struct io_uring_sqe *sqe = uring_sqe(&l->ring);
+    l->accept_retry[li] = sqe == NULL;
+    if (sqe != NULL) uring_prep_accept_multi(sqe, l->lfds[li], UDATA(UOP_ACCEPT, li));
+}
+
+static void uq_cancel_accept(struct uring_loop *l, int li) { /* 取消接受（排空） */
+    struct io_uring_sqe *sqe = uring_sqe(&l->ring);
+    l->accept_retry[li] = sqe == NULL;
+    if (sqe != NULL) uring_prep_cancel(sqe, UDATA(UOP_ACCEPT, li), UDATA(UOP_CANCEL, 0));
+}
+
+static void uq_recv(struct uring_loop *l, int slot) { /* 挂上多次接收 */
+    struct io_uring_sqe *sqe = uring_sqe(&l->ring);
+    if (sqe == NULL) {
+        uconn_defer(l, slot);
+        return;
+    }
+    uring_prep_recv_multi(sqe, slot, l->bufs.bgid, UDATA(UOP_RECV, slot));
+    l->conns[slot].recv_armed = 1;
+    l->conns[slot].cancel_sent = 0;
+}
+
+static void uq_cancel_recv(struct uring_loop *l, int slot) { /* 取消接收 */
+    struct io_uring_sqe *sqe;
+    if (l->conns[slot].cancel_sent) return;
+    sqe = uring_sqe(&l->ring);
+    if (sqe == NULL) {
+        uconn_defer(l, slot);
+        return;
+    }
+    uring_prep_cancel(sqe, UDATA(UOP_RECV, slot), UDATA(UOP_CANCEL, slot));
+    l->conns[slot].cancel_sent = 1;
+}
+
+static void uconn_finish(struct uring_loop *l, int slot);
+
+/* 发送块中已备好的 n 字节：提交 WRITE_FIXED；正在关闭且这是最后一块时，把关闭链接在写之后。
+ * 两个提交项先一起预留，链接的写与关闭总在同一次 io_uring_enter 中提交；
+ * 预留失败时输出队列未动，重试时重新准备发送块 */
+static void uconn_write(struct uring_loop *l, int slot, size_t n) { /* 写发送块 */
+    struct uring_conn *u = &l->conns[slot];
+    struct io_uring_sqe *sqe;     /* 写 */
+    struct io_uring_sqe *close_sqe; /* 链接的关闭 */
+    char *chunk = l->send_area + (size_t)slot * URING_SEND_CHUNK; /* 本连接的发送块 */
+    int link = u->c.state == CONN_CLOSING && !u->recv_armed && (size_t)n == u->c.out.pending; /* 最后一块 */
+
+    if (uring_sq_reserve(&l->ring, link ? 2 : 1) != 0) {
+        uconn_defer(l, slot);
+        return;
+    }
+    sqe = uring_sqe(&l->ring);
+    uring_prep_write_fixed(sqe, slot, chunk, (unsigned int)n, UDATA(UOP_WRITE, slot));
+    u->writing = 1;
+    if (link) {
+        close_sqe = uring_sqe(&l->ring);
+        uring_prep_close(close_sqe, slot, UDATA(UOP_CLOSE, slot));
+        sqe->flags |= IOSQE_IO_LINK; /* 关闭已取得，才把它链接在写之后 */
+        u->close_queued = 1;
+    }
+}
+
+/* 发出输出队列中的下一块：内存段直接复制进发送块；文件段先异步读入发送块，
+ * 读完成（UOP_READ）后再写 */
+static void uconn_send(struct uring_loop *l, int slot) { /* 发送 */
+    struct uring_conn *u = &l->conns[slot];
+    struct io_uring_sqe *sqe;
+    char *chunk = l->send_area + (size_t)slot * URING_SEND_CHUNK; /* 本连接的发送块 */
+    size_t n;                     /* 本块的字节数 */
+    int fd;                       /* 文件段的描述符 */
+    off_t off;                    /* 文件段的当前偏移 */
+
+    if (u->writing || u->reading || u->close_queued) return;
+    if (u->c.out.pending == 0) {  /* 已全部发完 */
+        if (u->c.state == CONN_CLOSING) uconn_finish(l, slot);
+        return;
+    }
+    if (http_outq_file(&u->c.out, &fd, &off, &n)) { /* 文件段：普通 fd，读入注册缓冲 */
+        sqe = uring_sqe(&l->ring);
+        if (sqe == NULL) {
+            uconn_defer(l, slot);
+            return;
+        }
+        uring_prep_read_fixed(sqe, fd, chunk, (unsigned int)(n < URING_SEND_CHUNK ? n : URING_SEND_CHUNK),
+                              off, UDATA(UOP_READ, slot));
+        u->reading = 1;
+        return;
+    }
+    uconn_write(l, slot, http_outq_peek(&u->c.out, chunk, URING_SEND_CHUNK)); /* 复制到注册缓冲 */
+}
+
+/* 推进关闭：先让接收请求结束，再发完剩余响应，最后关闭槽位 */
+static void uconn_finish(struct uring_loop *l, int slot) { /* 关闭连接 */
+    struct uring_conn *u = &l->conns[slot];
+    struct io_uring_sqe *sqe;
+
+    if (u->c.state != CONN_CLOSING) {
+        u->c.state = CONN_CLOSING;
+        lru_unlink(&l->base, &u->c); /* 不再参与空闲超时 */
+    }
+    if (u->recv_armed) {
+        uq_cancel_recv(l, slot);
+        return;
+    }
+    if (u->writing || u->reading || u->close_queued) return;
+    if (u->c.out.pending > 0) {
+        uconn_send(l, slot);
+        return;
+    }
+    sqe = uring_sqe(&l->ring);
+    if (sqe == NULL) {
+        uconn_defer(l, slot);
+        return;
+    }
+    uring_prep_close(sqe, slot, UDATA(UOP_CLOSE, slot));
+    u->close_queued = 1;
+}
+
+/* 重新推进记为待重试的接受请求和连接；仍取不到提交项的会再次记下 */
+static void uring_retry(struct uring_loop *l) { /* 重试 */
+    struct uring_conn *u;         /* 连接 */
+    int i;                        /* 循环索引 */
+
+    for (i = 0; i < l->nlfds; i++) {
+        if (!l->accept_retry[i]) continue;
+        if (l->draining) uq_cancel_accept(l, i);
+        else uq_accept(l, i);
+    }
+    if (!l->retry) return;
+    l->retry = 0;
+    for (i = 0; i < URING_CONNS; i++) {
+        u = &l->conns[i];
+        if (!u->retry) continue;
+        u->retry = 0;
+        if (u->c.state == CONN_CLOSING) {
+            uconn_finish(l, i);
+            continue;
+        }
+        if (u->c.read_paused && u->recv_armed) uq_cancel_recv(l, i);
+        uconn_send(l, i);
+        if (!u->recv_armed && !u->c.read_paused) uq_recv(l, i);
+    }
+}
+
+/* 分派一个完成事件 */
+static void uring_complete(struct uring_loop *l, const struct io_uring_cqe *cqe) { /* 处理完成事件 */
+    int op = (int)(cqe->user_data & 0xff); /* 事件类型 */
+    int slot = (int)(cqe->user_data >> 8); /* 槽号（接受事件为监听套接字下标） */
+    int res = cqe->res;           /* 结果 */
+    struct uring_conn *u = op == UOP_ACCEPT ? NULL : &l->conns[slot]; /* 对应连接 */
+
+    switch (op) {
+    case UOP_ACCEPT:
+        if (res >= 0 && res < URING_CONNS) { /* 新连接放在槽 res */
+            u = &l->conns[res];
+            u->c.state = CONN_OPEN;
+            u->c.fd = res;
+            u->c.read_paused = 0;
+            u->c.in.len = 0;      /* 缓冲清空（内存保留复用） */
+            u->recv_armed = u->cancel_sent = u->writing = u->reading = u->close_queued = u->retry = 0;
+            u->c.sent_any = 0;
+            u->c.accept_us = http_metrics_now_us();
+            l->base.metrics->accepted++;
+            sprintf(u->c.addrstr, "slot %d", res); /* 直接描述符取不到对端地址 */
+            conn_touch(&l->base, &u->c); /* 开始空闲计时 */
+            uq_recv(l, res);
+        } else if (res < 0 && !l->draining) { /* 如 ENFILE：文件表已满 */
+            alog_printf(ALOG_ERROR, "accept error: %s", strerror(-res));
+        }
+        if (cqe->flags & IORING_CQE_F_MORE) break;
+        if (!l->draining) {       /* 被内核终止，重新挂上 */
+            uq_accept(l, slot);
+        } else {                  /* 接受请求已取消：监听交给新进程 */
+            close(l->lfds[slot]);
+            if (--l->lfds_open == 0) __atomic_sub_fetch(&g_accepting, 1, __ATOMIC_RELEASE);
+        }
+        break;
+    case UOP_RECV:
+        if (!(cqe->flags & IORING_CQE_F_MORE)) u->recv_armed = 0;
+        if (res > 0) {            /* 读到数据 */
+            unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT; /* 使用的缓冲 */
+            if (u->c.state == CONN_OPEN) {
+                l->base.metrics->bytes_in += (unsigned long)res;
+                if (http_buf_append(&u->c.in, uring_buf(&l->bufs, bid), (size_t)res) != 0) {
+                    http_outq_reset(&u->c.out);
+                    u->c.state = CONN_CLOSING; /* 内存不足 */
+                } else if (process_requests(&u->c.in, &u->c.out, u->c.addrstr)) {
+                    u->c.state = CONN_CLOSING; /* 发送完后关闭 */
+                }
+                conn_touch(&l->base, &u->c);
+            }
+            uring_buf_recycle(&l->bufs, bid); /* 数据已复制，立即还给内核 */
+        } else if (res == 0) {    /* 对端关闭：发完剩余响应再关 */
+            u->c.state = CONN_CLOSING;
+        } else if (res != -ENOBUFS && res != -ECANCELED) { /* ENOBUFS：缓冲暂时用完，重新挂上即可 */
+            l->base.metrics->recv_errors++;
+            alog_printf(ALOG_ERROR, "recv error from %s: %s", u->c.addrstr, strerror(-res));
+            http_outq_reset(&u->c.out);
+            u->c.state = CONN_CLOSING;
+        }
+        if (u->c.state == CONN_CLOSING) {
+            lru_unlink(&l->base, &u->c);
+            uconn_finish(l, slot);
+            break;
+        }
+        if (u->c.out.pending > OUT_HIGH_WATER) u->c.read_paused = 1; /* 客户端读得太慢 */
+        if (u->c.read_paused && u->recv_armed) uq_cancel_recv(l, slot);
+        uconn_send(l, slot);
+        if (!u->recv_armed && !u->c.read_paused) uq_recv(l, slot);
+        break;
+    case UOP_WRITE:
+        u->writing = 0;
+        if (res > 0) {            /* 有进展 */
+            http_outq_advance(&u->c.out, (size_t)res);
+            conn_sent(&l->base, &u->c, (size_t)res);
+            if (u->c.state == CONN_OPEN) conn_touch(&l->base, &u->c);
+        } else {                  /* 出错：丢弃剩余响应 */
+            if (res != -ECANCELED) {
+                l->base.metrics->send_errors++;
+                alog_printf(ALOG_ERROR, "send error to %s: %s", u->c.addrstr, strerror(res < 0 ? -res : EIO));
+            }
+            http_outq_reset(&u->c.out);
+            if (u->c.state != CONN_CLOSING) {
+                u->c.state = CONN_CLOSING;
+                lru_unlink(&l->base, &u->c);
+            }
+        }
+        if (u->close_queued) break; /* 结果由链接的关闭报告 */
+        if (u->c.read_paused && u->c.out.pending <= OUT_HIGH_WATER && u->c.state == CONN_OPEN) { /* 积压已下降 */
+            u->c.read_paused = 0;
+            if (!u->recv_armed) uq_recv(l, slot);
+        }
+        if (u->c.state == CONN_CLOSING) uconn_finish(l, slot);
+        else uconn_send(l, slot);
+        break;
+    case UOP_READ:               /* 文件段已读入发送块 */
+        u->reading = 0;
+        if (res > 0 && u->c.out.pending > 0) { /* 队列期间未被丢弃 */
+            uconn_write(l, slot, (size_t)res);
+            break;
+        }
+        if (res <= 0) {           /* 读失败，或文件在发送期间被截断 */
+            alog_printf(ALOG_ERROR, "send error to %s: %s", u->c.addrstr, strerror(res < 0 ? -res : EIO));
+            http_outq_reset(&u->c.out);
+            if (u->c.state != CONN_CLOSING) {
+                u->c.state = CONN_CLOSING;
+                lru_unlink(&l->base, &u->c);
+            }
+        }
+        uconn_finish(l, slot);
+        break;
+    case UOP_CLOSE:
+        u->close_queued = 0;
+        if (res == -ECANCELED) {  /* 链接的写不完整或失败：补发剩余部分后再关 */
+            uconn_finish(l, slot);
+            break;
+        }
+        u->c.fd = -1;             /* 槽位已空 */
+        u->retry = 0;
+        l->base.metrics->closed++;
+        if (u->c.in.cap > BUF_KEEP_MAX) http_buf_free(&u->c.in); /* 异常增大的缓冲不保留 */
+        http_outq_reset(&u->c.out); /* 关闭未发完的文件、释放缓存项引用 */
+        if (u->c.out.buf.cap > BUF_KEEP_MAX) http_buf_free(&u->c.out.buf);
+        break;
+    default:                      /* UOP_CANCEL：结果体现在被取消的接收上 */
+        break;
+    }
+}
+
+/* 关闭空闲超过 idle_timeout 的连接（uconn_finish 会把连接移出 LRU 链表） */
+static void uring_expire_idle(struct uring_loop *l) { /* 空闲超时 */
+    while (l->base.lru_head != NULL &&
+           l->base.now - l->base.lru_head->last_active >= (time_t)g_cfg.idle_timeout) {
+        uconn_finish(l, l->base.lru_head->fd);
+    }
+}
+
+/* 热重启排空：取消接受请求（结束后在完成事件里关闭监听），立即关闭没有请求在处理的连接。
+ * 到达的数据由多次接收立即交付，本轮完成事件已在此前处理，所以 in 为空即为空闲 */
+static void uring_stop_accepting(struct uring_loop *l) { /* 停止接受 */
+    struct conn *c, *next;        /* LRU 遍历 */
+    int i;                        /* 循环索引 */
+
+    l->draining = 1;
+    l->lfds_open = l->nlfds;
+    for (i = 0; i < l->nlfds; i++) {
+        if (l->accept_retry[i]) { /* 接受请求从未挂上：没有完成事件会来，直接关闭 */
+            l->accept_retry[i] = 0;
+            close(l->lfds[i]);
+            if (--l->lfds_open == 0) __atomic_sub_fetch(&g_accepting, 1, __ATOMIC_RELEASE);
+            continue;
+        }
+        uq_cancel_accept(l, i);
+    }
+    for (c = l->base.lru_head; c != NULL; c = next) { /* uconn_finish 会把连接移出链表 */
+        next = c->lru_next;
+        if (c->state == CONN_OPEN && c->in.len == 0 && c->out.pending == 0) {
+            uconn_finish(l, c->fd);
+        }
+    }
+}
+
+/* io_uring 循环主体 */
+static void *uring_loop_run(void *arg) { /* 循环线程入口 */
+    struct uring_loop *l = (struct uring_loop *)arg; /* 参数 */
+    struct io_uring_cqe *cqe;     /* 完成事件 */
+    struct io_uring_cqe ev;       /* 完成事件副本 */
+    int timeout_ms;               /* 启用空闲超时或热重启时每秒醒来检查一次 */
+    int i;                        /* 循环索引 */
+
+    pin_thread(l->base.index);    /* 循环 1..N-1 在建立前已绑定，这里补上主线程中的循环 0 */
+    l->base.metrics = HTTP_METRICS(); /* 在运行本循环的线程里领取 */
+    timeout_ms = g_cfg.idle_timeout > 0 || g_cfg.handoff_path != NULL ? 1000 : -1;
+    for (i = 0; i < l->nlfds; i++) uq_accept(l, i);
+    for (;;) {                    /* 永久循环 */
+        if (uring_submit_wait(&l->ring, 1, timeout_ms) < 0 &&
+            errno != EINTR && errno != ETIME && errno != EBUSY) { /* 出错 */
+            fprintf(stderr, "io_uring_enter failed: %s\n", strerror(errno));
+            break;
+        }
+        l->base.now = mono_seconds(); /* 每轮取一次时间 */
+        while ((cqe = uring_cqe(&l->ring)) != NULL) { /* 逐个分派 */
+            ev = *cqe;            /* 先释放 CQ 槽位，处理中可以继续提交 */
+            uring_cqe_done(&l->ring);
+            uring_complete(l, &ev);
+        }
+        if (g_cfg.idle_timeout > 0) uring_expire_idle(l); /* 清理空闲连接 */
+        if (!l->draining && __atomic_load_n(&g_draining, __ATOMIC_ACQUIRE)) {
+            uring_stop_accepting(l); /* 监听已交给新进程 */
+        }
+        uring_retry(l);           /* 上一轮没能提交的请求 */
+    }
+    return NULL;
+}
+
+/* 建立循环的环，失败时打印原因 */
+static int uring_loop_setup(struct uring_loop *l, int index) { /* 建立一个循环 */
+    if (uring_loop_init(l, index) != 0) {
+        fprintf(stderr, "Loop %d: io_uring setup failed: %s\n", index, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* 取得监听套接字；一个也没有时整个服务退出 */
+static void uring_loop_listen_or_exit(struct uring_loop *l) { /* 取得监听或退出 */
+    uring_loop_listen(l);
+    if (l->nlfds == 0) {          /* 本循环没有任何监听套接字 */
+        fprintf(stderr, "No sockets bound. Exiting.\n");
+        exit(1);
+    }
+}
+
+/* 循环 1..N-1 的线程入口：环以 SINGLE_ISSUER 建立，只能由创建它的线程提交，所以在本线程内建立。
+ * 建好后等主线程确认所有循环都建成，再取得监听并运行；放弃时释放自己的环后退出 */
+static void *uring_loop_thread(void *arg) { /* 线程入口 */
+    struct uring_loop *l = (struct uring_loop *)arg; /* 参数 */
+    int go;                       /* 主线程的决定 */
+
+    pin_thread(l->base.index);    /* 环与缓冲在本地节点分配 */
+    if (uring_loop_setup(l, l->base.index) != 0) {
+        __atomic_add_fetch(&g_loops_failed, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    __atomic_add_fetch(&g_loops_ready, 1, __ATOMIC_RELEASE);
+    while ((go = __atomic_load_n(&g_loops_go, __ATOMIC_ACQUIRE)) == 0) {
+        poll(NULL, 0, 10);
+    }
+    if (go < 0) {
+        uring_loop_free(l);
+        return NULL;
+    }
+    uring_loop_listen_or_exit(l);
+    __atomic_add_fetch(&g_loops_listening, 1, __ATOMIC_RELEASE);
+    return uring_loop_run(l);
+}
+
+/* io_uring 模式入口。每个循环注册的发送缓冲计入 RLIMIT_MEMLOCK，前几个循环建成不代表
+ * 后面的也能建成，所以先建好所有循环的环，全部成功才取得监听；否则返回 -1（此时尚未
+ * 绑定任何端口），由调用者回退到 epoll 模式 */
+static int run_uring_mode(void) { /* 运行 io_uring 模式 */
+    struct uring_loop *loops;     /* 循环数组 */
+    pthread_t *tids;              /* 循环 1..N-1 的线程 */
+    int started;                  /* 已创建的线程数 */
+    int i;                        /* 循环索引 */
+
+    raise_nofile_limit();         /* 与 epoll 模式一致 */
+    loops = (struct uring_loop *)calloc((size_t)g_cfg.workers, sizeof(struct uring_loop)); /* 分配 */
+    tids = (pthread_t *)calloc((size_t)g_cfg.workers, sizeof(pthread_t));
+    if (loops == NULL || tids == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return 1;
+    }
+    if (uring_loop_init(&loops[0], 0) != 0) { /* 循环 0 在主线程建立，同时用来探测内核支持 */
+        fprintf(stderr, "io_uring unavailable (%s), falling back to epoll\n", strerror(errno));
+        free(loops);
+        free(tids);
+        return -1;
+    }
+
+    for (started = 0; started < g_cfg.workers - 1; started++) { /* 循环 1..N-1 各自一个线程 */
+        loops[started + 1].base.index = started + 1;
+        if (pthread_create(&tids[started], NULL, uring_loop_thread, &loops[started + 1]) != 0) {
+            fprintf(stderr, "pthread_create for event loop %d failed\n", started + 1);
+            break;
+        }
+    }
+    while (__atomic_load_n(&g_loops_ready, __ATOMIC_ACQUIRE) +
+           __atomic_load_n(&g_loops_failed, __ATOMIC_ACQUIRE) < started) {
+        poll(NULL, 0, 10);        /* 等每个循环的环建成或失败 */
+    }
+    if (started < g_cfg.workers - 1 || __atomic_load_n(&g_loops_failed, __ATOMIC_ACQUIRE) > 0) {
+        __atomic_store_n(&g_loops_go, -1, __ATOMIC_RELEASE);
+        for (i = 0; i < started; i++) pthread_join(tids[i], NULL);
+        uring_loop_free(&loops[0]);
+        free(loops);
+        free(tids);
+        fprintf(stderr, "io_uring setup failed on some event loops, falling back to epoll\n");
+        return -1;
+    }
+    __atomic_store_n(&g_loops_go, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < started; i++) pthread_detach(tids[i]);
+    free(tids);
+
+    g_nslots = 2 * g_cfg.workers; /* 与 epoll 模式相同的槽位布局 */
+    g_accepting = g_cfg.workers;
+    uring_loop_listen_or_exit(&loops[0]);
+    fprintf(stderr, "io_uring mode: %d event loops\n", g_cfg.workers); /* 打印配置 */
+    report_layout("event loops", g_cfg.workers);
+    while (__atomic_load_n(&g_loops_listening, __ATOMIC_ACQUIRE) < g_cfg.workers - 1) {
+        poll(NULL, 0, 10);        /* 等所有循环取得监听套接字后再通知旧进程 */
+    }
+    handoff_ready();
+    uring_loop_run(&loops[0]);    /* 循环 0 在主线程中运行 */
+    return 0;
+}
+
+/* 接受循环线程：对一个监听套接字不断 accept，并为每个连接创建处理线程或放入池队列 */
+struct acceptor {                 /* 接受线程参数结构 */
+    int slot;                     /* 监听套接字所在槽位 */
     int listen_fd;                /* 监听套接字 */
+    pthread_t tid;                /* 线程 id，排空时向它发 SIGUSR1 */
+    int done;                     /* 线程已退出接受循环（受 g_acceptor_lock 保护） */
 };
 
+static struct acceptor g_acceptors[MAX_LISTEN_SLOTS]; /* 每个监听槽位一个接受线程 */
+static int g_nacceptors = 0;      /* 已启动的接受线程数 */
+static pthread_mutex_t g_acceptor_lock = PTHREAD_MUTEX_INITIALIZER; /* 保护 done */
+
+/* SIGUSR1 只用来打断阻塞的 accept（安装时不带 SA_RESTART） */
+static void handle_wakeup(int signo) { /* 空信号处理函数 */
+    (void)signo;                  /* 避免未使用警告 */
+}
+
 static void *accept_loop(void *arg) { /* 接受循环线程入口 */
-    struct accept_arg *aarg = (struct accept_arg *)arg; /* 参数 */
-    int lfd = aarg->listen_fd;    /* 获取监听套接字 */
+    struct acceptor *a = (struct acceptor *)arg; /* 参数 */
+    int lfd = a->listen_fd;       /* 获取监听套接字 */
     int connfd;                   /* 已接受的连接套接字 */
+    int err;                      /* accept 的 errno */
     struct sockaddr_storage peer; /* 存放对端地址，支持 IPv4/IPv6 */
     socklen_t peerlen;            /* 地址长度 */
     char addrstr[INET6_ADDRSTRLEN]; /* 文本形式地址 */
     pthread_t tid;                /* 客户端线程 id */
+    unsigned long accept_us;      /* 接受连接的时刻 */
+    struct http_metrics *m;       /* 本线程计数器 */
 
-    for (;;) {                    /* 永久循环，直到进程被信号终止 */
+    if (g_cfg.mode == MODE_THREAD) pin_thread(a->slot); /* 池模式下放置位置留给工作线程 */
+    m = HTTP_METRICS();
+    for (;;) {                    /* 直到进程被信号终止或监听交给了新进程 */
         peerlen = sizeof(peer);   /* 初始化长度 */
         connfd = accept(lfd, (struct sockaddr *)&peer, &peerlen); /* 接受连接 */
         if (connfd < 0) {        /* accept 出错 */
-            if (errno == EINTR) continue; /* 被信号中断时重试 */
-            fprintf(stderr, "accept error: %s\n", strerror(errno)); /* 打印并继续 */
+            err = errno;
+            if (err == EINTR || err == EAGAIN || err == EWOULDBLOCK) {
+                if (__atomic_load_n(&g_draining, __ATOMIC_ACQUIRE)) break; /* 热重启排空 */
+                /* 与 epoll 模式的进程交接过的监听套接字是非阻塞的，阻塞等待交给 poll */
+                if (err != EINTR) wait_readable(lfd, 1000);
+                continue;        /* 被信号中断时重试 */
+            }
+            alog_printf(ALOG_ERROR, "accept error: %s", strerror(err)); /* 打印并继续 */
             continue;            /* 继续接受下一个连接 */
         }
 
+        m->accepted++;            /* 本线程计数 */
+        accept_us = http_metrics_now_us(); /* 首字节延迟从这里算起，含排队时间 */
+
         /* 将对端地址转换为文本形式，便于日志 */
-        if (peer.ss_family == AF_INET) { /* IPv4 */
-            struct sockaddr_in *s4 = (struct sockaddr_in *)&peer; /* 强制转换 */
-            inet_ntop(AF_INET, &s4->sin_addr, addrstr, sizeof(addrstr)); /* 转换文本 */
-        } else {                /* IPv6 */
-            struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)&peer; /* 强制转换 */
-            inet_ntop(AF_INET6, &s6->sin6_addr, addrstr, sizeof(addrstr)); /* 转换文本 */
+        sockaddr_to_str(&peer, addrstr, sizeof(addrstr)); /* 转换文本 */
+
+        /* 池模式：将连接按值放入有界队列，由工作线程处理 */
+        if (g_cfg.mode == MODE_POOL) { /* 池模式 */
+            struct client_arg carg; /* 栈上参数结构，入队时按值复制 */
+            carg.fd = connfd;   /* 填充连接套接字 */
+            carg.accept_us = accept_us;
+            strncpy(carg.addrstr, addrstr, sizeof(carg.addrstr) - 1); /* 复制地址文本 */
+            carg.addrstr[sizeof(carg.addrstr) - 1] = '\0'; /* 确保终止 */
+            if (conn_queue_push(&g_queue, &carg, g_cfg.policy) != 0) { /* 队列已满 */
+                reject_client(connfd, g_cfg.policy); /* 按策略丢弃或拒绝 */
+            }
+            continue;           /* 继续接受下一个连接 */
         }
 
         /* 为每个客户端分配参数结构（malloc）并填充 */
         {                       /* 新的块用于变量声明 */
             struct client_arg *carg = (struct client_arg *)malloc(sizeof(struct client_arg)); /* 分配 */
             if (carg == NULL) {  /* 分配失败 */
-                fprintf(stderr, "malloc failed\n"); /* 打印 */
+                alog_printf(ALOG_ERROR, "malloc failed"); /* 打印 */
                 close(connfd);   /* 关闭连接套接字以避免泄漏 */
+                m->closed++;
                 continue;        /* 继续接受下一个连接 */
             }
             carg->fd = connfd;  /* 填充连接套接字 */
+            carg->accept_us = accept_us;
             strncpy(carg->addrstr, addrstr, sizeof(carg->addrstr) - 1); /* 复制地址文本 */
             carg->addrstr[sizeof(carg->addrstr) - 1] = '\0'; /* 确保终止 */
 
@@ -252,6 +1710,7 @@ static void *accept_loop(void *arg) { /* 接受循环线程入口 */
             if (pthread_create(&tid, NULL, client_thread, (void *)carg) != 0) { /* 创建失败 */
                 fprintf(stderr, "pthread_create failed\n"); /* 打印 */
                 close(connfd);   /* 关闭连接套接字 */
+                m->closed++;
                 free(carg);      /* 释放参数结构 */
                 continue;        /* 继续接受下一个连接 */
             }
@@ -259,90 +1718,377 @@ static void *accept_loop(void *arg) { /* 接受循环线程入口 */
             pthread_detach(tid); /* 分离线程资源 */
         }
     }
-    return NULL;                  /* 不会返回 */
+    pthread_mutex_lock(&g_acceptor_lock);
+    a->done = 1;                  /* 此后不再收到唤醒信号 */
+    pthread_mutex_unlock(&g_acceptor_lock);
+    close(lfd);                   /* 新进程持有自己的副本 */
+    g_listen_fds[a->slot] = -1;
+    __atomic_sub_fetch(&g_accepting, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* 启动时调用：若 -H 路径上有正在运行的旧进程，从它那里接收监听套接字。
+ * 没有旧进程时返回 0（全新启动），交接失败返回 -1 */
+static int handoff_receive(void) { /* 接收监听套接字 */
+    struct sockaddr_un sa;        /* 控制套接字地址 */
+    struct handoff_hdr hdr;       /* 消息头 */
+    int fds[MAX_LISTEN_SLOTS];    /* 收到的描述符 */
+    int nfds;                     /* 收到的描述符数 */
+    int s;                        /* 控制连接 */
+    int i, k;                     /* 循环索引 */
+
+    if (g_cfg.handoff_path == NULL) return 0; /* 未启用 */
+    s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (s < 0) return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, g_cfg.handoff_path, sizeof(sa.sun_path) - 1);
+    if (connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0) { /* 没有旧进程（或只剩残留的套接字文件） */
+        close(s);
+        return 0;
+    }
+    if (!wait_readable(s, HANDOFF_TIMEOUT * 1000) ||
+        fd_recv(s, &hdr, sizeof(hdr), fds, MAX_LISTEN_SLOTS, &nfds) != (int)sizeof(hdr)) {
+        fprintf(stderr, "Hot restart: no listeners received from the running server\n");
+        close(s);
+        return -1;
+    }
+    for (i = 0, k = 0; i < hdr.nslots && i < MAX_LISTEN_SLOTS; i++) k += hdr.present[i] ? 1 : 0;
+    if (hdr.magic != HANDOFF_MAGIC || hdr.nslots <= 0 || hdr.nslots > MAX_LISTEN_SLOTS || k != nfds) {
+        fprintf(stderr, "Hot restart: malformed handoff message\n");
+        for (i = 0; i < nfds; i++) close(fds[i]);
+        close(s);
+        return -1;
+    }
+    for (i = 0, k = 0; i < hdr.nslots; i++) { /* 还原槽位 */
+        g_inherited[i] = hdr.present[i] ? fds[k++] : -1;
+    }
+    g_ninherited = hdr.nslots;
+    g_handoff_peer = s;
+    fprintf(stderr, "Hot restart: inherited %d listening sockets\n", nfds); /* 打印 */
+    return 0;
+}
+
+/* 把全部监听套接字发给新进程并等待它确认就绪；确认后返回 0 */
+static int handoff_send(int c) { /* 发送监听套接字 */
+    struct handoff_hdr hdr;       /* 消息头 */
+    int fds[MAX_LISTEN_SLOTS];    /* 待发送的描述符 */
+    int nfds = 0;                 /* 描述符数 */
+    char ack;                     /* 确认字节 */
+    int i;                        /* 循环索引 */
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = HANDOFF_MAGIC;
+    hdr.nslots = g_nslots;
+    for (i = 0; i < g_nslots; i++) {
+        if (g_listen_fds[i] < 0) continue;
+        hdr.present[i] = 1;
+        fds[nfds++] = g_listen_fds[i];
+    }
+    if (fd_send(c, &hdr, sizeof(hdr), fds, nfds) != 0) return -1;
+    if (!wait_readable(c, HANDOFF_TIMEOUT * 1000)) return -1; /* 新进程启动失败或卡住：继续服务 */
+    return recv(c, &ack, 1, 0) == 1 && ack == HANDOFF_ACK ? 0 : -1;
+}
+
+/* 唤醒阻塞在 accept 中的接受线程，让它们看到排空标志后退出 */
+static void wake_acceptors(void) { /* 唤醒接受线程 */
+    int i;                        /* 循环索引 */
+    pthread_mutex_lock(&g_acceptor_lock);
+    for (i = 0; i < g_nacceptors; i++) { /* 已退出的线程可能已被 join，不能再发信号 */
+        if (!g_acceptors[i].done) pthread_kill(g_acceptors[i].tid, SIGUSR1);
+    }
+    pthread_mutex_unlock(&g_acceptor_lock);
+}
+
+/* 停止接受新连接，等已有连接结束或到达期限后退出进程 */
+static void drain_and_exit(void) { /* 排空 */
+    time_t deadline = mono_seconds() + g_cfg.drain_timeout; /* 排空期限 */
+    unsigned long active;         /* 仍打开的连接数 */
+
+    __atomic_store_n(&g_draining, 1, __ATOMIC_RELEASE);
+    alog_printf(ALOG_INFO, "Hot restart: listeners handed off, draining %lu connections", http_metrics_active());
+    for (;;) {
+        wake_acceptors();         /* 信号可能落在两次 accept 之间，持续发到线程退出为止 */
+        blocking_shutdown_idle(); /* 线程 / 池模式：池中排队的连接稍后才开始等待请求，每轮都检查 */
+        active = http_metrics_active();
+        if (__atomic_load_n(&g_accepting, __ATOMIC_ACQUIRE) == 0 && active == 0) break;
+        if (mono_seconds() >= deadline) {
+            alog_printf(ALOG_WARN, "Hot restart: drain deadline reached, %lu connections dropped", active);
+            break;
+        }
+        poll(NULL, 0, 100);       /* 每 100ms 检查一次 */
+    }
+    alog_printf(ALOG_INFO, "Hot restart: old server exiting");
+    exit(0);                      /* atexit 写完剩余日志 */
+}
+
+/* 控制线程：在 -H 路径上等待新进程，交接成功后排空退出 */
+static void *handoff_thread(void *arg) { /* 控制线程入口 */
+    struct sockaddr_un sa;        /* 控制套接字地址 */
+    int sfd;                      /* 控制监听套接字 */
+    int c;                        /* 与新进程的连接 */
+    (void)arg;                    /* 避免未使用警告 */
+
+    sfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sfd < 0) return NULL;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, g_cfg.handoff_path, sizeof(sa.sun_path) - 1);
+    unlink(sa.sun_path);          /* 旧进程已交出或留下的残留文件 */
+    if (bind(sfd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(sfd, 4) != 0) {
+        fprintf(stderr, "Hot restart: cannot listen on %s: %s\n", sa.sun_path, strerror(errno));
+        close(sfd);
+        return NULL;
+    }
+    for (;;) {                    /* 直到交接成功 */
+        c = accept(sfd, NULL, NULL);
+        if (c < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Hot restart: accept failed: %s\n", strerror(errno));
+            close(sfd);
+            return NULL;
+        }
+        if (handoff_send(c) == 0) break; /* 新进程已接手 */
+        alog_printf(ALOG_WARN, "Hot restart: handoff not acknowledged, still serving");
+        close(c);
+    }
+    close(c);
+    close(sfd);                   /* 路径已由新进程重新绑定，不能 unlink */
+    drain_and_exit();
+    return NULL;
+}
+
+/* 监听套接字全部就绪后调用：向旧进程确认，然后开始等待下一次热重启 */
+static void handoff_ready(void) { /* 就绪 */
+    pthread_t tid;                /* 控制线程 id */
+    char ack = HANDOFF_ACK;       /* 确认字节 */
+
+    if (g_handoff_peer >= 0) {    /* 从旧进程接手：它收到确认后停止接受连接 */
+        if (send(g_handoff_peer, &ack, 1, MSG_NOSIGNAL) != 1) {
+            fprintf(stderr, "Hot restart: failed to acknowledge handoff: %s\n", strerror(errno));
+        }
+        close(g_handoff_peer);
+        g_handoff_peer = -1;
+    }
+    if (g_cfg.handoff_path == NULL) return;
+    if (pthread_create(&tid, NULL, handoff_thread, NULL) != 0) {
+        fprintf(stderr, "pthread_create for hot restart control failed\n");
+        return;
+    }
+    pthread_detach(tid);
+}
+
+/* 打印用法 */
+static void usage(const char *prog) { /* 用法说明 */
+    fprintf(stderr,
+            "Usage: %s [-m thread|pool|epoll|uring] [-w workers] [-q queue_len] [-b block|drop|reject] [-p port] [-k idle_s]\n"
+            "          [-r docroot] [-C cache_mb] [-H control_socket] [-D drain_s] [-A cpus] [-I]\n"
+            "  -m  connection handling mode (default: thread; uring falls back to epoll\n"
+            "      when the kernel lacks the needed io_uring ops)\n"
+            "  -w  pool worker threads / epoll or io_uring event loops (default: online CPUs)\n",
+            prog);                /* 打印 */
+    fprintf(stderr,
+            "  -q  pool connection queue length (default: %d)\n"
+            "  -b  policy when the pool queue is full (default: block)\n"
+            "  -p  listen port (default: 80)\n"
+            "  -k  keep-alive idle timeout in seconds, 0 = never (default: %d)\n",
+            DEFAULT_QUEUE_LEN, DEFAULT_IDLE_TIMEOUT); /* 打印 */
+    fprintf(stderr,
+            "  -r  serve static files from docroot instead of Hello World\n"
+            "  -C  hot file cache size in MB for -r, 0 = off (default: %d)\n"
+            "GET /metrics on any listener returns Prometheus-format counters.\n",
+            DEFAULT_CACHE_MB);    /* 打印 */
+    fprintf(stderr,
+            "  -H  hot restart: a new server started with the same UNIX socket path takes over\n"
+            "      the listeners of the running one without closing the port\n"
+            "  -D  seconds the old server waits for requests in progress after a handoff; idle\n"
+            "      connections are closed at once (default: %d)\n",
+            DEFAULT_DRAIN_TIMEOUT); /* 打印 */
+    fprintf(stderr,
+            "  -A  pin event loops / pool workers / accept threads to CPUs, with memory from\n"
+            "      their NUMA node: \"auto\" (one thread per physical core first) or a list\n"
+            "      such as 0-3,8 (default: not pinned)\n"
+            "  -I  keep connections on the CPU that received them (SO_INCOMING_CPU); implies -A auto\n");
+}
+
+/* 解析命令行参数到 g_cfg，成功返回 0 */
+static int parse_args(int argc, char *argv[]) { /* 解析参数 */
+    int opt;                      /* getopt 返回值 */
+    long cpus;                    /* 在线 CPU 数 */
+
+    while ((opt = getopt(argc, argv, "m:w:q:b:p:k:r:C:H:D:A:Ih")) != -1) { /* 逐个解析选项 */
+        switch (opt) {
+        case 'm':                 /* 运行模式 */
+            if (strcmp(optarg, "thread") == 0) g_cfg.mode = MODE_THREAD;
+            else if (strcmp(optarg, "pool") == 0) g_cfg.mode = MODE_POOL;
+            else if (strcmp(optarg, "epoll") == 0) g_cfg.mode = MODE_EPOLL;
+            else if (strcmp(optarg, "uring") == 0) g_cfg.mode = MODE_URING;
+            else return -1;       /* 未知模式 */
+            break;
+        case 'w':                 /* 工作线程数 */
+            g_cfg.workers = atoi(optarg);
+            if (g_cfg.workers <= 0) return -1;
+            break;
+        case 'q':                 /* 队列长度 */
+            if (atoi(optarg) <= 0) return -1;
+            g_cfg.queue_len = (unsigned int)atoi(optarg);
+            break;
+        case 'b':                 /* 背压策略 */
+            if (strcmp(optarg, "block") == 0) g_cfg.policy = BP_BLOCK;
+            else if (strcmp(optarg, "drop") == 0) g_cfg.policy = BP_DROP;
+            else if (strcmp(optarg, "reject") == 0) g_cfg.policy = BP_REJECT;
+            else return -1;       /* 未知策略 */
+            break;
+        case 'p':                 /* 端口 */
+            g_cfg.port = optarg;
+            break;
+        case 'k':                 /* 空闲超时 */
+            g_cfg.idle_timeout = atoi(optarg);
+            if (g_cfg.idle_timeout < 0) return -1;
+            break;
+        case 'r':                 /* 静态文件根目录 */
+            g_cfg.docroot = optarg;
+            break;
+        case 'C':                 /* 缓存大小 */
+            g_cfg.cache_mb = atoi(optarg);
+            if (g_cfg.cache_mb < 0) return -1;
+            break;
+        case 'H':                 /* 热重启控制套接字 */
+            g_cfg.handoff_path = optarg;
+            break;
+        case 'D':                 /* 排空期限 */
+            g_cfg.drain_timeout = atoi(optarg);
+            if (g_cfg.drain_timeout < 0) return -1;
+            break;
+        case 'A':                 /* 绑核 */
+            g_cfg.cpus = optarg;
+            break;
+        case 'I':                 /* 按收包 CPU 放置连接 */
+            g_cfg.incoming_cpu = 1;
+            break;
+        default:                  /* -h 或未知选项 */
+            return -1;
+        }
+    }
+
+    if (g_cfg.workers == 0) {     /* 未指定线程数时按在线 CPU 数设置 */
+        cpus = sysconf(_SC_NPROCESSORS_ONLN); /* 查询 CPU 数 */
+        g_cfg.workers = cpus > 0 ? (int)cpus : 1; /* 至少一个 */
+    }
+    if (g_cfg.cpus != NULL || g_cfg.incoming_cpu) { /* 先于任何线程建立放置顺序 */
+        if (cpu_topo_init(&g_topo, g_cfg.cpus != NULL ? g_cfg.cpus : "auto") != 0) {
+            fprintf(stderr, "invalid or unavailable CPU list: %s\n", g_cfg.cpus != NULL ? g_cfg.cpus : "auto");
+            return -1;
+        }
+        g_pin = 1;
+    }
+    if (g_cfg.handoff_path != NULL && g_cfg.workers > MAX_LISTEN_SLOTS / 2) { /* 一条消息交接全部监听 */
+        fprintf(stderr, "-H supports at most %d event loops\n", MAX_LISTEN_SLOTS / 2);
+        return -1;
+    }
+    return 0;
 }
 
-/* 主函数：创建两个监听套接字并启动对应的 accept 线程 */
+/* 主函数：创建（或从旧进程接手）监听套接字并启动对应的 accept 线程或事件循环 */
 int main(int argc, char *argv[]) { /* 主函数入口 */
-    pthread_t acc_v4_thread;      /* IPv4 accept 线程 id */
-    pthread_t acc_v6_thread;      /* IPv6 accept 线程 id */
-    struct accept_arg *aarg_v4;   /* IPv4 accept 参数 */
-    struct accept_arg *aarg_v6;   /* IPv6 accept 参数 */
+    struct sigaction sa;          /* SIGUSR1 处理 */
     int rc;                       /* 临时返回码 */
+    int i;                        /* 循环索引 */
 
-    (void)argc;                   /* 避免未使用警告 */
-    (void)argv;                   /* 避免未使用警告 */
+    if (parse_args(argc, argv) != 0) { /* 解析命令行 */
+        usage(argv[0]);           /* 打印用法 */
+        return 1;                 /* 参数错误 */
+    }
+    alog_init(STDERR_FILENO, STDERR_FILENO); /* 各级日志都写到 stderr，与原来一致 */
+    for (i = 0; i < MAX_LISTEN_SLOTS; i++) g_listen_fds[i] = -1; /* 所有槽位为空 */
 
     /* 安装 SIGINT 信号处理器以便 Ctrl-C 可以优雅关闭监听套接字 */
     signal(SIGINT, handle_sigint); /* 注册信号处理 */
+    /* writev/sendfile 没有 MSG_NOSIGNAL，对端关闭时改由 EPIPE 报告 */
+    signal(SIGPIPE, SIG_IGN);     /* 忽略 SIGPIPE */
+    /* 热重启排空时用 SIGUSR1 打断阻塞在 accept 中的线程 */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_wakeup;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL); /* 不带 SA_RESTART：accept 返回 EINTR */
 
-    /* 创建并绑定 IPv6 回环地址 ::1:80，设置 v6only 为 1 */
-    listen_fd_v6 = make_and_bind("::1", "80", 1); /* 创建 IPv6 监听 */
-    if (listen_fd_v6 < 0) {       /* 若失败则打印并继续 */
-        fprintf(stderr, "Failed to bind IPv6 ::1:80\n"); /* 打印 */
+    /* 静态文件模式：打开根目录并启动缓存失效线程 */
+    if (g_cfg.docroot != NULL &&
+        http_static_init(g_cfg.docroot, (size_t)g_cfg.cache_mb * 1024 * 1024) != 0) {
+        exit(1);                  /* 根目录不可用 */
     }
 
-    /* 创建并绑定 IPv4 回环地址 127.0.0.1:80 */
-    listen_fd_v4 = make_and_bind("127.0.0.1", "80", 0); /* 创建 IPv4 监听 */
-    if (listen_fd_v4 < 0) {       /* 若失败则打印并继续 */
-        fprintf(stderr, "Failed to bind IPv4 127.0.0.1:80\n"); /* 打印 */
+    /* 热重启：-H 路径上有旧进程时接手它的监听套接字，否则正常绑定 */
+    if (handoff_receive() != 0) exit(1); /* 旧进程仍在服务，不能另行绑定 */
+    if (g_ninherited > 0 && (g_cfg.mode == MODE_EPOLL || g_cfg.mode == MODE_URING) &&
+        g_cfg.workers != g_ninherited / 2) { /* 每个循环对应两个槽位 */
+        g_cfg.workers = g_ninherited / 2 > 0 ? g_ninherited / 2 : 1;
+        fprintf(stderr, "Hot restart: using %d event loops to match the inherited listeners\n", g_cfg.workers);
     }
 
-    /* 检查至少有一个绑定成功，否则退出 */
-    if (listen_fd_v4 < 0 && listen_fd_v6 < 0) { /* 如果两个都失败 */
-        fprintf(stderr, "No sockets bound. Exiting.\n"); /* 打印 */
-        exit(1);                 /* 退出并返回错误状态 */
+    /* io_uring 模式：与 epoll 模式结构相同，内核不支持时回退到 epoll 模式 */
+    if (g_cfg.mode == MODE_URING) { /* io_uring 模式 */
+        rc = run_uring_mode();    /* 正常情况下不会返回 */
+        if (rc >= 0) return rc;
+        g_cfg.mode = MODE_EPOLL;
     }
 
-    /* 为 IPv4 接受线程准备参数并启动（如果已成功绑定） */
-    if (listen_fd_v4 >= 0) {      /* 若 IPv4 监听存在 */
-        aarg_v4 = (struct accept_arg *)malloc(sizeof(struct accept_arg)); /* 分配 */
-        if (aarg_v4 == NULL) {    /* 分配失败 */
-            fprintf(stderr, "malloc failed\n"); /* 打印 */
-            close(listen_fd_v4);  /* 关闭监听套接字 */
-            listen_fd_v4 = -1;    /* 标记为已关闭 */
-        } else {                  /* 成功分配参数 */
-            aarg_v4->listen_fd = listen_fd_v4; /* 填充 */
-            rc = pthread_create(&acc_v4_thread, NULL, accept_loop, (void *)aarg_v4); /* 启动线程 */
-            if (rc != 0) {        /* 创建失败 */
-                fprintf(stderr, "pthread_create for IPv4 accept failed\n"); /* 打印 */
-                close(listen_fd_v4); /* 关闭监听 */
-                listen_fd_v4 = -1; /* 标记 */
-                free(aarg_v4);    /* 释放参数 */
-            }
+    /* epoll 模式：每个事件循环自行创建 SO_REUSEPORT 监听套接字 */
+    if (g_cfg.mode == MODE_EPOLL) { /* epoll 模式 */
+        return run_epoll_mode();  /* 正常情况下不会返回 */
+    }
+
+    /* 池模式：在接受连接之前创建队列与工作线程 */
+    if (g_cfg.mode == MODE_POOL) { /* 池模式 */
+        if (conn_queue_init(&g_queue, g_cfg.queue_len) != 0) { /* 初始化队列 */
+            fprintf(stderr, "Failed to allocate connection queue\n"); /* 打印 */
+            exit(1);              /* 退出 */
+        }
+        if (start_pool_workers(g_cfg.workers) == 0) { /* 一个工作线程都没有 */
+            fprintf(stderr, "No pool workers started. Exiting.\n"); /* 打印 */
+            exit(1);              /* 退出 */
         }
+        fprintf(stderr, "Pool mode: %d workers, queue %u\n", g_cfg.workers, g_cfg.queue_len); /* 打印配置 */
+        report_layout("pool workers", g_cfg.workers);
     }
 
-    /* 为 IPv6 接受线程准备参数并启动（如果已成功绑定） */
-    if (listen_fd_v6 >= 0) {      /* 若 IPv6 监听存在 */
-        aarg_v6 = (struct accept_arg *)malloc(sizeof(struct accept_arg)); /* 分配 */
-        if (aarg_v6 == NULL) {    /* 分配失败 */
-            fprintf(stderr, "malloc failed\n"); /* 打印 */
-            close(listen_fd_v6);  /* 关闭监听套接字 */
-            listen_fd_v6 = -1;    /* 标记 */
-        } else {                  /* 成功分配参数 */
-            aarg_v6->listen_fd = listen_fd_v6; /* 填充 */
-            rc = pthread_create(&acc_v6_thread, NULL, accept_loop, (void *)aarg_v6); /* 启动线程 */
-            if (rc != 0) {        /* 创建失败 */
-                fprintf(stderr, "pthread_create for IPv6 accept failed\n"); /* 打印 */
-                close(listen_fd_v6); /* 关闭监听 */
-                listen_fd_v6 = -1; /* 标记 */
-                free(aarg_v6);    /* 释放参数 */
+    /* 每个槽位一个接受线程：槽 0 为 IPv6 回环地址 ::1（v6only 为 1），槽 1 为 IPv4 127.0.0.1；
+     * 从 epoll / io_uring 模式的进程接手时按继承的槽位数启动 */
+    g_nslots = g_ninherited > 0 ? g_ninherited : 2;
+    for (i = 0; i < g_nslots; i++) { /* 创建监听并启动对应的接受线程 */
+        struct acceptor *a = &g_acceptors[g_nacceptors]; /* 参数 */
+        a->slot = i;
+        a->listen_fd = listen_slot(i, i % 2 == 0 ? "::1" : "127.0.0.1", i % 2 == 0, 0);
+        if (a->listen_fd < 0) {   /* 若失败则打印并继续 */
+            if (g_ninherited == 0) {
+                fprintf(stderr, "Failed to bind %s:%s\n", i == 0 ? "IPv6 [::1]" : "IPv4 127.0.0.1", g_cfg.port); /* 打印 */
             }
+            continue;
+        }
+        rc = pthread_create(&a->tid, NULL, accept_loop, (void *)a); /* 启动线程 */
+        if (rc != 0) {            /* 创建失败 */
+            fprintf(stderr, "pthread_create for accept failed\n"); /* 打印 */
+            close(a->listen_fd);  /* 关闭监听 */
+            g_listen_fds[i] = -1; /* 标记 */
+            continue;
         }
+        g_nacceptors++;
     }
 
-    /* 主线程等待 accept 线程结束（实际上服务器将永久运行，直到 SIGINT） */
-    if (listen_fd_v4 >= 0) {      /* 若 IPv4 线程存在 */
-        pthread_join(acc_v4_thread, NULL); /* 等待 IPv4 accept 线程 */
-    }
-    if (listen_fd_v6 >= 0) {      /* 若 IPv6 线程存在 */
-        pthread_join(acc_v6_thread, NULL); /* 等待 IPv6 accept 线程 */
+    /* 检查至少有一个绑定成功，否则退出 */
+    if (g_nacceptors == 0) {      /* 如果都失败 */
+        fprintf(stderr, "No sockets bound. Exiting.\n"); /* 打印 */
+        exit(1);                 /* 退出并返回错误状态 */
     }
+    g_accepting = g_nacceptors;
+    if (g_cfg.mode == MODE_THREAD) report_layout("accept threads", g_nacceptors);
+    handoff_ready();              /* 所有接受线程已启动 */
 
-    /* 程序通常不会走到这里，但做清理以防万一 */
-    if (listen_fd_v4 >= 0) close(listen_fd_v4); /* 关闭 IPv4 监听 */
-    if (listen_fd_v6 >= 0) close(listen_fd_v6); /* 关闭 IPv6 监听 */
+    /* 主线程等待 accept 线程结束（实际上服务器将永久运行，直到 SIGINT 或热重启） */
+    for (i = 0; i < g_nacceptors; i++) pthread_join(g_acceptors[i].tid, NULL); /* 等待 accept 线程 */
+
+    /* 监听已交给新进程：连接由已有线程处理完，控制线程在排空后退出进程 */
+    for (;;) pause();
     return 0;                     /* 正常退出 */
 }
 
@@ -354,4 +2100,32 @@ curl -v --http1.1 http://127.0.0.1/
 或测试 IPv6：
 curl -v --http1.1 http://[::1]/
 
+验证持久连接（两个请求复用同一条连接，第二个请求 num_connects 为 0）：
+curl -s http://127.0.0.1/ http://127.0.0.1/ -w '%{num_connects}\n'
+
+以固定线程池模式运行（4 个工作线程，队列 256，队列满时返回 503）：
+./multithread_http_server -m pool -w 4 -q 256 -b reject
+
+以 epoll 边沿触发模式运行（每个 CPU 一个事件循环，端口由 SO_REUSEPORT 共享）：
+./multithread_http_server -m epoll
+
+以 io_uring 模式运行（多次接受/接收、注册文件与缓冲；内核不支持时自动回退到 epoll）：
+./multithread_http_server -m uring
+
+提供 /var/www 下的静态文件（不超过 64KB 的文件进入 64MB 热点缓存，其余用 sendfile）：
+./multithread_http_server -m epoll -r /var/www -C 64
+curl -v http://127.0.0.1/index.html -H 'If-None-Match: "..."'
+
+任意模式下，各监听端口上的 /metrics 返回 Prometheus 文本格式的计数器（抓取时才汇总各线程）：
+curl -s http://127.0.0.1/metrics
+
+热重启（升级二进制或改配置时不关闭端口）：新进程以相同的 -H 路径启动，从旧进程接手
+监听套接字后旧进程停止接受连接，立即关闭空闲的持久连接，等正在处理的请求完成
+（最多 -D 秒）后退出：
+./multithread_http_server -m epoll -H /run/httpd.sock &
+./multithread_http_server -m epoll -H /run/httpd.sock &
+
+每个事件循环绑到一个物理核，内存取自本地 NUMA 节点，并让连接留在收包的 CPU 上：
+./multithread_http_server -m epoll -A auto -I
+
 */
@@ -0,0 +1,599 @@
+#define _GNU_SOURCE  /* getopt、clock_gettime、strncasecmp 声明 */
+
+/*
+ * netbench：本仓库各服务器的压测客户端。
+ * 同时维持多条 TCP 连接（或 UDP 流），每条连接最多同时挂起 depth 个请求，
+ * 在指定时长内持续发送，统计吞吐与延迟分布（HDR 风格直方图），
+ * 结果以文本打印，并可另外输出 JSON。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "poller.h"
+#include "frame.h"
+#include "hdr_hist.h"
+
+#define MAX_EVENTS 64
+#define RECV_CHUNK 65536          /* 每次 recv 预留的空间 */
+#define UDP_TAG_LEN 16            /* UDP 请求末尾的十六进制序号 */
+#define UDP_LOST_TIMEOUT 1.0      /* UDP 请求超过该秒数未应答视为丢失 */
+#define TCP_MAX_SIZE 1000         /* tcp_server 原始模式一次 recv 最多 1023 字节，响应还要加前缀 */
+#define UDP_MAX_SIZE 1023         /* udp_server 截断更长的数据报，末尾的序号会随之丢掉 */
+#define UDP_ECHO_PORT 53          /* select_io_server 的 UDP 回显，数据报原样带回、不截断 */
+
+enum bench_mode { MODE_TCP, MODE_FRAME, MODE_ECHO, MODE_UDP, MODE_HTTP };
+
+static const struct {
+    const char *name;
+    enum bench_mode mode;
+    int port;                     /* 对应服务器的默认端口 */
+    const char *desc;
+} modes[] = {
+    { "tcp",   MODE_TCP,   8080, "tcp_server 原始模式（流水线深度固定为 1）" },
+    { "frame", MODE_FRAME, 8080, "tcp_server -f 长度前缀分帧" },
+    { "echo",  MODE_ECHO,  80,   "select_io_server TCP 回显" },
+    { "udp",   MODE_UDP,   8080, "udp_server，或 -p 53 测 select_io_server 的 UDP 回显" },
+    { "http",  MODE_HTTP,  80,   "multithread_http_server 的 GET 请求（keep-alive）" }
+};
+
+/* 压测参数，启动后只读 */
+static struct {
+    int mode_idx;
+    enum bench_mode mode;
+    struct sockaddr_in addr;
+    int conns;                    /* 连接（UDP 流）总数 */
+    int threads;                  /* 线程数，连接平均分给各线程 */
+    size_t size;                  /* 消息大小 */
+    int depth;                    /* 每连接最多挂起的请求数 */
+    double duration;              /* 秒 */
+    const char *path;             /* HTTP 请求路径 */
+    const char *json;             /* JSON 输出文件，"-" 为标准输出 */
+    char *req;                    /* 预先生成的请求报文（每条相同） */
+    size_t req_len;
+    size_t resp_len;              /* tcp/echo 模式下固定的响应长度 */
+    double end;                   /* 结束时刻 */
+} cfg;
+
+/* 一条连接（或一个 UDP 流） */
+struct bench_conn {
+    int fd;
+    int dead;
+    struct frame_buf in;          /* 尚未解析的响应 */
+    struct frame_buf out;         /* 尚未发出的请求 */
+    double *sent;                 /* TCP：按发送顺序排列的发送时刻（环形）；UDP：按序号取模索引 */
+    unsigned long *seq;           /* UDP：槽位中的请求序号，0 表示空闲 */
+    int head;                     /* TCP：最早一个未应答请求的位置 */
+    int inflight;                 /* 已发出未应答的请求数 */
+    unsigned long next_seq;       /* UDP：下一个请求序号 */
+};
+
+/* 每个线程的状态与统计，结束后由主线程合并 */
+struct bench_thread {
+    pthread_t tid;
+    struct bench_conn *conns;
+    int nconns;
+    int alive;
+    struct hdr_hist hist;         /* 延迟，单位纳秒 */
+    unsigned long done;           /* 完成的请求数 */
+    unsigned long errors;         /* 连接断开、协议错误或 HTTP 非 2xx/3xx */
+    unsigned long lost;           /* UDP 超时 */
+    double bytes;                 /* 收到的响应字节数 */
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void record(struct bench_thread *t, double sent, double now) {
+    hdr_hist_record(&t->hist, (unsigned long)((now - sent) * 1e9));
+    t->done++;
+}
+
+/* 连接出错：从 poller 中移除并关闭 */
+static void conn_kill(struct bench_thread *t, struct poller *p, struct bench_conn *c) {
+    if (c->dead) return;
+    poller_del(p, c->fd);
+    close(c->fd);
+    c->dead = 1;
+    t->errors++;
+    t->alive--;
+}
+
+/* 在 data[0..n) 中查找一个完整的 HTTP 响应，返回其总长度；
+ * 不完整返回 0，无法解析返回 -1。*status 为状态码 */
+static long http_response_len(const char *data, size_t n, int *status) {
+    size_t i, hdr_end = 0, line;
+    unsigned long clen = 0;
+
+    for (i = 3; i < n; i++) {
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+            hdr_end = i + 1;
+            break;
+        }
+    }
+    if (hdr_end == 0) return n > FRAME_MAX ? -1 : 0;
+    if (hdr_end < 12 || strncmp(data, "HTTP/1.", 7) != 0) return -1;
+    *status = atoi(data + 9);
+
+    /* 逐行查找 Content-Length */
+    for (line = 0; line < hdr_end; ) {
+        if (hdr_end - line > 15 && strncasecmp(data + line, "Content-Length:", 15) == 0) {
+            clen = strtoul(data + line + 15, NULL, 10);
+        }
+        while (line < hdr_end && data[line] != '\n') line++;
+        line++;
+    }
+    if (n - hdr_end < clen) return 0;
+    return (long)(hdr_end + clen);
+}
+
+/* 解析收到的响应，每完成一条记录一次延迟。出错返回 -1 */
+static int conn_parse(struct bench_thread *t, struct bench_conn *c, double now) {
+    const char *msg;
+    size_t len;
+    long total;
+    int r, status;
+
+    for (;;) {
+        switch (cfg.mode) {
+        case MODE_TCP:
+        case MODE_ECHO:
+            if (frame_buf_pending(&c->in) < cfg.resp_len) return 0;
+            frame_buf_consume(&c->in, cfg.resp_len);
+            break;
+        case MODE_FRAME:
+            r = frame_next(&c->in, &msg, &len);
+            frame_buf_consume(&c->in, 0);  /* 全部取完时复位 */
+            if (r <= 0) return r;
+            break;
+        case MODE_HTTP:
+            total = http_response_len(c->in.data + c->in.off, frame_buf_pending(&c->in), &status);
+            if (total <= 0) return (int)total;
+            frame_buf_consume(&c->in, (size_t)total);
+            if (status < 200 || status >= 400) t->errors++;
+            break;
+        default:
+            return -1;
+        }
+        if (c->inflight == 0) return -1;   /* 多出来的响应 */
+        record(t, c->sent[c->head], now);
+        c->head = (c->head + 1) % cfg.depth;
+        c->inflight--;
+    }
+}
+
+/* 补足 depth 个挂起请求并尽量发出。返回 0 正常，-1 出错 */
+static int conn_fill_flush(struct bench_conn *c, double now) {
+    ssize_t n;
+
+    while (now < cfg.end && c->inflight < cfg.depth) {
+        if (frame_buf_append(&c->out, cfg.req, cfg.req_len) != 0) return -1;
+        c->sent[(c->head + c->inflight) % cfg.depth] = now;
+        c->inflight++;
+    }
+    while (frame_buf_pending(&c->out) > 0) {
+        n = send(c->fd, c->out.data + c->out.off, frame_buf_pending(&c->out), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        frame_buf_consume(&c->out, (size_t)n);
+    }
+    return 0;
+}
+
+/* 读取可用数据并解析。返回 0 正常，-1 连接关闭或出错 */
+static int conn_read(struct bench_thread *t, struct bench_conn *c, double now) {
+    ssize_t n;
+
+    for (;;) {
+        if (frame_buf_reserve(&c->in, RECV_CHUNK) != 0) return -1;
+        n = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return -1;
+        c->in.len += (size_t)n;
+        t->bytes += (double)n;
+    }
+    return conn_parse(t, c, now);
+}
+
+/* UDP：发出请求直到挂起 depth 个；请求末尾写入序号，服务器原样带回 */
+static void udp_fill(struct bench_conn *c, char *buf, double now) {
+    int slot;
+    ssize_t n;
+
+    while (now < cfg.end && c->inflight < cfg.depth) {
+        /* 找一个空闲槽位；序号对 depth 取模即槽位号 */
+        slot = (int)(c->next_seq % (unsigned long)cfg.depth);
+        if (c->seq[slot] != 0) {
+            c->next_seq++;
+            continue;
+        }
+        sprintf(buf + cfg.req_len - UDP_TAG_LEN, "%016lx", c->next_seq);
+        n = send(c->fd, buf, cfg.req_len, MSG_NOSIGNAL);
+        if (n < 0) return;        /* 发送缓冲满，下一轮再发 */
+        c->seq[slot] = c->next_seq++;
+        c->sent[slot] = now;
+        c->inflight++;
+    }
+}
+
+/* UDP：接收应答，按末尾序号找到对应请求 */
+static void udp_read(struct bench_thread *t, struct bench_conn *c, char *buf, double now) {
+    unsigned long seq;
+    ssize_t n;
+    int slot;
+
+    while ((n = recv(c->fd, buf, RECV_CHUNK, 0)) > 0) {
+        t->bytes += (double)n;
+        if (n < UDP_TAG_LEN) continue;
+        buf[n] = '\0';
+        seq = strtoul(buf + n - UDP_TAG_LEN, NULL, 16);
+        slot = (int)(seq % (unsigned long)cfg.depth);
+        if (seq == 0 || c->seq[slot] != seq) continue;  /* 已判定丢失的迟到应答 */
+        record(t, c->sent[slot], now);
+        c->seq[slot] = 0;
+        c->inflight--;
+    }
+}
+
+/* UDP：超时未应答的请求计为丢失，腾出槽位 */
+static void udp_expire(struct bench_thread *t, struct bench_conn *c, double now) {
+    int i;
+
+    for (i = 0; i < cfg.depth; i++) {
+        if (c->seq[i] != 0 && now - c->sent[i] > UDP_LOST_TIMEOUT) {
+            c->seq[i] = 0;
+            c->inflight--;
+            t->lost++;
+        }
+    }
+}
+
+static int conn_open(struct bench_conn *c) {
+    int type = cfg.mode == MODE_UDP ? SOCK_DGRAM : SOCK_STREAM;
+    int one = 1;
+
+    memset(c, 0, sizeof(*c));
+    c->next_seq = 1;
+    c->sent = (double *)calloc((size_t)cfg.depth, sizeof(double));
+    c->seq = (unsigned long *)calloc((size_t)cfg.depth, sizeof(unsigned long));
+    if (c->sent == NULL || c->seq == NULL) return -1;
+
+    c->fd = socket(AF_INET, type, 0);
+    if (c->fd < 0) return -1;
+    /* 先阻塞地建立连接，再切换为非阻塞 */
+    if (connect(c->fd, (struct sockaddr *)&cfg.addr, sizeof(cfg.addr)) < 0) {
+        close(c->fd);
+        return -1;
+    }
+    if (type == SOCK_STREAM) setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+    return 0;
+}
+
+static void *bench_thread_main(void *arg) {
+    struct bench_thread *t = (struct bench_thread *)arg;
+    struct poller_event evs[MAX_EVENTS];
+    struct poller *p;
+    struct bench_conn *c;
+    char *udp_buf = NULL;         /* 请求模板，只改末尾的序号 */
+    char *udp_rx = NULL;          /* 应答另收一处，不覆盖模板 */
+    double now, last_expire = 0;
+    int i, n;
+
+    p = poller_create(POLLER_AUTO);
+    if (p == NULL) {
+        fprintf(stderr, "poller_create failed\n");
+        return NULL;
+    }
+    if (cfg.mode == MODE_UDP) {
+        udp_buf = (char *)malloc(cfg.req_len + 1);
+        udp_rx = (char *)malloc(RECV_CHUNK + 1);
+        if (udp_buf == NULL || udp_rx == NULL) {
+            free(udp_buf);
+            free(udp_rx);
+            poller_destroy(p);
+            return NULL;
+        }
+        memcpy(udp_buf, cfg.req, cfg.req_len);
+    }
+
+    now = now_sec();
+    for (i = 0; i < t->nconns; i++) {
+        c = &t->conns[i];
+        if (cfg.mode == MODE_UDP) {
+            udp_fill(c, udp_buf, now);
+            poller_add(p, c->fd, POLLER_IN, c);
+        } else if (conn_fill_flush(c, now) == 0) {
+            poller_add(p, c->fd, POLLER_IN | (frame_buf_pending(&c->out) ? POLLER_OUT : 0), c);
+        } else {
+            c->dead = 1;
+            close(c->fd);
+            t->errors++;
+            t->alive--;
+        }
+    }
+
+    while (t->alive > 0 && (now = now_sec()) < cfg.end) {
+        n = poller_wait(p, evs, MAX_EVENTS, 100);
+        if (n < 0 && errno != EINTR) break;
+        now = now_sec();
+        for (i = 0; i < n; i++) {
+            c = (struct bench_conn *)evs[i].data;
+            if (c->dead) continue;
+            if (cfg.mode == MODE_UDP) {
+                udp_read(t, c, udp_rx, now);
+                udp_fill(c, udp_buf, now);
+                continue;
+            }
+            if ((evs[i].events & (POLLER_IN | POLLER_ERR)) && conn_read(t, c, now) != 0) {
+                conn_kill(t, p, c);
+                continue;
+            }
+            if (conn_fill_flush(c, now) != 0) {
+                conn_kill(t, p, c);
+                continue;
+            }
+            poller_mod(p, c->fd, POLLER_IN | (frame_buf_pending(&c->out) ? POLLER_OUT : 0), c);
+        }
+        if (cfg.mode == MODE_UDP && now - last_expire > 0.1) {
+            for (i = 0; i < t->nconns; i++) {
+                udp_expire(t, &t->conns[i], now);
+                udp_fill(&t->conns[i], udp_buf, now);
+            }
+            last_expire = now;
+        }
+    }
+
+    for (i = 0; i < t->nconns; i++) {
+        c = &t->conns[i];
+        if (!c->dead) {
+            poller_del(p, c->fd);
+            close(c->fd);
+        }
+        frame_buf_free(&c->in);
+        frame_buf_free(&c->out);
+        free(c->sent);
+        free(c->seq);
+    }
+    free(udp_buf);
+    free(udp_rx);
+    poller_destroy(p);
+    return NULL;
+}
+
+/* 按模式生成请求报文及期望的响应长度 */
+static int build_request(void) {
+    char prefix[64];
+    char *payload;
+    size_t i, hdr = 0;
+
+    if (cfg.mode == MODE_HTTP) {
+        cfg.req = (char *)malloc(strlen(cfg.path) + 128);
+        if (cfg.req == NULL) return -1;
+        sprintf(cfg.req, "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                cfg.path, inet_ntoa(cfg.addr.sin_addr));
+        cfg.req_len = strlen(cfg.req);
+        return 0;
+    }
+
+    if (cfg.mode == MODE_FRAME) hdr = FRAME_HDR_LEN;
+    cfg.req = (char *)malloc(hdr + cfg.size + 1);
+    if (cfg.req == NULL) return -1;
+    payload = cfg.req + hdr;
+    for (i = 0; i < cfg.size; i++) payload[i] = (char)('a' + i % 26);
+    payload[cfg.size] = '\0';
+    cfg.req_len = hdr + cfg.size;
+    if (hdr) {
+        cfg.req[0] = (char)(cfg.size >> 24);
+        cfg.req[1] = (char)(cfg.size >> 16);
+        cfg.req[2] = (char)(cfg.size >> 8);
+        cfg.req[3] = (char)cfg.size;
+    }
+
+    cfg.resp_len = cfg.size;
+    if (cfg.mode == MODE_TCP) {
+        sprintf(prefix, "Processed[%lu bytes]: ", (unsigned long)cfg.size);
+        cfg.resp_len += strlen(prefix);
+    }
+    return 0;
+}
+
+static void print_text(const struct bench_thread *sum, double elapsed) {
+    const struct hdr_hist *h = &sum->hist;
+
+    printf("netbench: %s %s:%d, %d connections, %d threads, %lu bytes, depth %d, %.1f s\n",
+           modes[cfg.mode_idx].name, inet_ntoa(cfg.addr.sin_addr), ntohs(cfg.addr.sin_port),
+           cfg.conns, cfg.threads, (unsigned long)cfg.size, cfg.depth, elapsed);
+    printf("  requests   %lu (%.1f req/s)\n", sum->done, (double)sum->done / elapsed);
+    printf("  received   %.2f MB/s\n", sum->bytes / elapsed / 1e6);
+    printf("  errors     %lu, lost %lu\n", sum->errors, sum->lost);
+    printf("  latency us min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           h->min / 1e3, hdr_hist_mean(h) / 1e3,
+           hdr_hist_percentile(h, 50.0) / 1e3, hdr_hist_percentile(h, 90.0) / 1e3,
+           hdr_hist_percentile(h, 99.0) / 1e3, hdr_hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+    printf("\nLatency distribution (us):\n");
+    hdr_hist_print(h, stdout, 1e3);
+}
+
+static int print_json(const struct bench_thread *sum, double elapsed) {
+    const struct hdr_hist *h = &sum->hist;
+    FILE *fp = stdout;
+
+    if (strcmp(cfg.json, "-") != 0 && (fp = fopen(cfg.json, "w")) == NULL) {
+        perror(cfg.json);
+        return -1;
+    }
+    fprintf(fp, "{\"mode\": \"%s\", \"target\": \"%s:%d\", \"connections\": %d, \"threads\": %d, ",
+            modes[cfg.mode_idx].name, inet_ntoa(cfg.addr.sin_addr), ntohs(cfg.addr.sin_port),
+            cfg.conns, cfg.threads);
+    fprintf(fp, "\"size\": %lu, \"depth\": %d, \"duration_s\": %.3f, ",
+            (unsigned long)cfg.size, cfg.depth, elapsed);
+    fprintf(fp, "\"requests\": %lu, \"requests_per_s\": %.1f, \"bytes_per_s\": %.0f, "
+            "\"errors\": %lu, \"lost\": %lu, ",
+            sum->done, (double)sum->done / elapsed, sum->bytes / elapsed, sum->errors, sum->lost);
+    fprintf(fp, "\"latency_us\": {\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+            "\"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f, \"distribution\": ",
+            h->min / 1e3, hdr_hist_mean(h) / 1e3,
+            hdr_hist_percentile(h, 50.0) / 1e3, hdr_hist_percentile(h, 90.0) / 1e3,
+            hdr_hist_percentile(h, 99.0) / 1e3, hdr_hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+    hdr_hist_print_json(h, fp, 1e3);
+    fprintf(fp, "}}\n");
+    if (fp != stdout) fclose(fp);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    size_t i;
+
+    fprintf(stderr, "Usage: %s -m mode [-H host] [-p port] [-c conns] [-t threads]\n"
+            "          [-s size] [-n depth] [-d seconds] [-u path] [-j file|-]\n", prog);
+    fprintf(stderr, "  -m  target server:\n");
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        fprintf(stderr, "        %-6s %s, default port %d\n", modes[i].name, modes[i].desc, modes[i].port);
+    }
+    fprintf(stderr, "  -H  server IPv4 address (default 127.0.0.1)\n"
+            "  -c  concurrent connections / UDP flows (default 16)\n"
+            "  -t  client threads (default 1)\n"
+            "  -s  message size in bytes, ignored for http (default 64, at most %d)\n", FRAME_REQ_MAX);
+    fprintf(stderr, "  -n  outstanding requests per connection (default 1)\n"
+            "  -d  test duration in seconds (default 5)\n"
+            "  -u  HTTP request path (default /)\n"
+            "  -j  also write the results as JSON to file, - for stdout\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct bench_thread *threads, sum;
+    const char *host = "127.0.0.1";
+    int port = 0, opt, i, k, per, ok;
+    size_t m;
+    double start, elapsed;
+
+    cfg.mode_idx = -1;
+    cfg.conns = 16;
+    cfg.threads = 1;
+    cfg.size = 64;
+    cfg.depth = 1;
+    cfg.duration = 5.0;
+    cfg.path = "/";
+
+    while ((opt = getopt(argc, argv, "m:H:p:c:t:s:n:d:u:j:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                if (strcmp(optarg, modes[m].name) == 0) cfg.mode_idx = (int)m;
+            }
+            break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'c': cfg.conns = atoi(optarg); break;
+        case 't': cfg.threads = atoi(optarg); break;
+        case 's': cfg.size = (size_t)atol(optarg); break;
+        case 'n': cfg.depth = atoi(optarg); break;
+        case 'd': cfg.duration = atof(optarg); break;
+        case 'u': cfg.path = optarg; break;
+        case 'j': cfg.json = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (cfg.mode_idx < 0 || cfg.conns <= 0 || cfg.threads <= 0 || cfg.depth <= 0 ||
+        cfg.duration <= 0 || cfg.size > FRAME_REQ_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.mode = modes[cfg.mode_idx].mode;
+    if (cfg.threads > cfg.conns) cfg.threads = cfg.conns;
+    if (cfg.mode == MODE_TCP) {
+        /* 原始模式下多条消息可能被服务器一次 recv 读入，无法区分边界 */
+        if (cfg.depth != 1) fprintf(stderr, "tcp mode: pipelining is not possible, using depth 1\n");
+        cfg.depth = 1;
+        if (cfg.size > TCP_MAX_SIZE) cfg.size = TCP_MAX_SIZE;
+    }
+    if (port == 0) port = modes[cfg.mode_idx].port;
+    if (cfg.mode == MODE_UDP && cfg.size < UDP_TAG_LEN + 1) cfg.size = UDP_TAG_LEN + 1;
+    if (cfg.mode == MODE_UDP && cfg.size > RECV_CHUNK - 1024) cfg.size = RECV_CHUNK - 1024;
+    if (cfg.mode == MODE_UDP && port != UDP_ECHO_PORT && cfg.size > UDP_MAX_SIZE) cfg.size = UDP_MAX_SIZE;
+
+    memset(&cfg.addr, 0, sizeof(cfg.addr));
+    cfg.addr.sin_family = AF_INET;
+    cfg.addr.sin_port = htons((unsigned short)port);
+    if (inet_pton(AF_INET, host, &cfg.addr.sin_addr) <= 0) {
+        fprintf(stderr, "invalid address: %s\n", host);
+        return 1;
+    }
+    if (build_request() != 0) {
+        perror("malloc");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    threads = (struct bench_thread *)calloc((size_t)cfg.threads, sizeof(*threads));
+    if (threads == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    /* 先建立全部连接，再统一开始计时 */
+    for (i = 0, k = 0; i < cfg.threads; i++) {
+        per = cfg.conns / cfg.threads + (i < cfg.conns % cfg.threads ? 1 : 0);
+        threads[i].conns = (struct bench_conn *)calloc((size_t)per, sizeof(struct bench_conn));
+        if (threads[i].conns == NULL) {
+            perror("calloc");
+            return 1;
+        }
+        hdr_hist_init(&threads[i].hist);
+        for (ok = 0; ok < per; ok++, k++) {
+            if (conn_open(&threads[i].conns[ok]) != 0) {
+                fprintf(stderr, "connection %d to %s:%d failed: %s\n", k, host,
+                        ntohs(cfg.addr.sin_port), strerror(errno));
+                return 1;
+            }
+        }
+        threads[i].nconns = per;
+        threads[i].alive = per;
+    }
+
+    start = now_sec();
+    cfg.end = start + cfg.duration;
+    for (i = 0; i < cfg.threads; i++) {
+        if (pthread_create(&threads[i].tid, NULL, bench_thread_main, &threads[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    memset(&sum, 0, sizeof(sum));
+    hdr_hist_init(&sum.hist);
+    for (i = 0; i < cfg.threads; i++) {
+        pthread_join(threads[i].tid, NULL);
+        hdr_hist_merge(&sum.hist, &threads[i].hist);
+        sum.done += threads[i].done;
+        sum.errors += threads[i].errors;
+        sum.lost += threads[i].lost;
+        sum.bytes += threads[i].bytes;
+        free(threads[i].conns);
+    }
+    elapsed = now_sec() - start;
+
+    print_text(&sum, elapsed);
+    if (cfg.json != NULL && print_json(&sum, elapsed) != 0) return 1;
+    free(threads);
+    free(cfg.req);
+    return 0;
+}
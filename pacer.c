@@ -0,0 +1,60 @@
+#define _GNU_SOURCE  /* clock_nanosleep */
+
+#include <errno.h>
+#include "pacer.h"
+
+#define NSEC_PER_SEC 1000000000L
+
+static void ts_add_ns(struct timespec *ts, long ns)
+{
+    ts->tv_sec += ns / NSEC_PER_SEC;
+    ts->tv_nsec += ns % NSEC_PER_SEC;
+    if (ts->tv_nsec >= NSEC_PER_SEC) {
+        ts->tv_nsec -= NSEC_PER_SEC;
+        ts->tv_sec++;
+    }
+}
+
+/* a - b in ns; callers only compare values a few seconds apart */
+static long ts_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (long)(a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+void pacer_init(struct pacer *p, long period_ms)
+{
+    p->period_ns = period_ms * 1000000L;
+    p->frames = 0;
+    p->late = 0;
+    p->missed = 0;
+    p->max_late_ns = 0;
+    clock_gettime(CLOCK_MONOTONIC, &p->next);
+    ts_add_ns(&p->next, p->period_ns);
+}
+
+unsigned long pacer_wait(struct pacer *p)
+{
+    struct timespec now;
+    unsigned long skipped = 0;
+    long late;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->next, NULL) == EINTR)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late = ts_diff_ns(&now, &p->next);
+    if (late > p->max_late_ns)
+        p->max_late_ns = late;
+
+    if (late >= p->period_ns) {
+        /* a whole period or more behind: drop those deadlines, keep the grid */
+        skipped = (unsigned long)(late / p->period_ns);
+        p->missed += skipped;
+        ts_add_ns(&p->next, (long)skipped * p->period_ns);
+        late -= (long)skipped * p->period_ns;
+    }
+    if (late > PACER_LATE_NS)
+        p->late++;
+    p->frames++;
+    ts_add_ns(&p->next, p->period_ns);
+    return skipped;
+}
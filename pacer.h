@@ -0,0 +1,37 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <time.h>  /* struct timespec */
+
+/*
+ * Absolute-deadline frame pacer. Deadlines are start + k * period on
+ * CLOCK_MONOTONIC and the thread sleeps with clock_nanosleep(TIMER_ABSTIME),
+ * so processing time and wakeup latency never accumulate into drift.
+ * A wakeup more than PACER_LATE_NS past its deadline counts as late; if
+ * whole periods have already elapsed, those deadlines are skipped (counted
+ * as missed) instead of being sent in a burst.
+ */
+
+#define PACER_LATE_NS 1000000L    /* 1 ms of wakeup latency is tolerated */
+
+struct pacer
+{
+    struct timespec next;         /* next deadline */
+    long period_ns;
+    unsigned long frames;         /* deadlines met (frames emitted) */
+    unsigned long late;           /* frames emitted more than PACER_LATE_NS late */
+    unsigned long missed;         /* deadlines skipped entirely */
+    long max_late_ns;             /* worst wakeup latency seen */
+};
+
+/* Start pacing now; the first pacer_wait() returns one period from now */
+void pacer_init(struct pacer *p, long period_ms);
+
+/*
+ * Sleep until the next deadline. Returns the number of deadlines that were
+ * skipped because the caller fell more than a period behind (0 normally),
+ * so a sender can advance its sequence numbers to match.
+ */
+unsigned long pacer_wait(struct pacer *p);
+
+#endif /* PACER_H */
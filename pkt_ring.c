@@ -0,0 +1,266 @@
+#define _GNU_SOURCE  /* struct ifreq, poll */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/if_arp.h>          /* ARPHRD_ETHER, ARPHRD_LOOPBACK */
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>      /* ETH_P_IP */
+#include "pkt_ring.h"
+
+#define RX_BLOCK_SIZE (1 << 18)  /* 256 KB per block */
+#define RX_BLOCK_NR 16
+#define RX_FRAME_SIZE 2048       /* only used for the ring geometry in V3 */
+#define RX_BLOCK_TOV_MS 1        /* retire partially filled blocks after 1 ms */
+#define TX_BLOCK_SIZE (1 << 16)
+#define TX_BLOCK_NR 16
+#define TX_FRAME_SIZE 2048       /* 512 queued frames */
+
+/* frame data offset inside a TX slot (kernel: tp_hdrlen - sizeof(sockaddr_ll)) */
+#define TX_DATA_OFF TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+#define SLL_OFF TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+struct pkt_ring
+{
+    int fd;
+    unsigned char *map;          /* RX ring, then TX ring */
+    size_t map_len;
+    unsigned int rx_block;       /* next RX block to look at */
+    unsigned char *tx;           /* start of the TX ring, NULL without one */
+    unsigned int tx_frame;       /* next TX frame to fill */
+    unsigned int tx_frames;
+    unsigned int tx_pending;     /* committed since the last flush */
+    unsigned char hwaddr[6];
+};
+
+/* Accept IPv4 packets of one protocol; SKF_NET_OFF makes the offset
+   independent of the link header length */
+static int attach_proto_filter(int fd, int proto)
+{
+    struct sock_filter code[4];
+    struct sock_fprog prog;
+
+    code[0].code = BPF_LD | BPF_B | BPF_ABS;
+    code[0].jt = 0;
+    code[0].jf = 0;
+    code[0].k = (unsigned int)(SKF_NET_OFF + 9);   /* ip->protocol */
+    code[1].code = BPF_JMP | BPF_JEQ | BPF_K;
+    code[1].jt = 0;
+    code[1].jf = 1;
+    code[1].k = (unsigned int)proto;
+    code[2].code = BPF_RET | BPF_K;
+    code[2].jt = 0;
+    code[2].jf = 0;
+    code[2].k = 0xffff;
+    code[3].code = BPF_RET | BPF_K;
+    code[3].jt = 0;
+    code[3].jf = 0;
+    code[3].k = 0;
+    prog.len = 4;
+    prog.filter = code;
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+struct pkt_ring *pkt_ring_open(const char *ifname, int proto, int fanout_id, int with_tx)
+{
+    struct pkt_ring *r;
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    struct ifreq ifr;
+    size_t rx_len, tx_len = 0;
+    int ver = TPACKET_V3;
+    int arg, err;
+
+    r = (struct pkt_ring *)calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+    r->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+    if (r->fd < 0)
+        goto fail;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(r->fd, SIOCGIFHWADDR, &ifr) < 0)
+        goto fail;
+    if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER && ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK) {
+        errno = EPROTONOSUPPORT;  /* TX frames carry an Ethernet header */
+        goto fail;
+    }
+    memcpy(r->hwaddr, ifr.ifr_hwaddr.sa_data, 6);
+    if (ioctl(r->fd, SIOCGIFINDEX, &ifr) < 0)
+        goto fail;
+
+    if (attach_proto_filter(r->fd, proto) < 0)
+        goto fail;
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0)
+        goto fail;
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RX_BLOCK_SIZE;
+    req.tp_block_nr = RX_BLOCK_NR;
+    req.tp_frame_size = RX_FRAME_SIZE;
+    req.tp_frame_nr = (RX_BLOCK_SIZE / RX_FRAME_SIZE) * RX_BLOCK_NR;
+    req.tp_retire_blk_tov = RX_BLOCK_TOV_MS;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+        goto fail;
+    rx_len = (size_t)RX_BLOCK_SIZE * RX_BLOCK_NR;
+
+    if (with_tx) {
+        /* V3 TX rings are frame based: block timeout and private area must be 0 */
+        memset(&req, 0, sizeof(req));
+        req.tp_block_size = TX_BLOCK_SIZE;
+        req.tp_block_nr = TX_BLOCK_NR;
+        req.tp_frame_size = TX_FRAME_SIZE;
+        req.tp_frame_nr = (TX_BLOCK_SIZE / TX_FRAME_SIZE) * TX_BLOCK_NR;
+        if (setsockopt(r->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+            goto fail;
+        tx_len = (size_t)TX_BLOCK_SIZE * TX_BLOCK_NR;
+        r->tx_frames = req.tp_frame_nr;
+    }
+
+    r->map_len = rx_len + tx_len;
+    r->map = (unsigned char *)mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_LOCKED | MAP_POPULATE, r->fd, 0);
+    if (r->map == MAP_FAILED) {
+        /* MAP_LOCKED needs RLIMIT_MEMLOCK headroom; fall back to pageable */
+        r->map = (unsigned char *)mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, r->fd, 0);
+        if (r->map == MAP_FAILED) {
+            r->map = NULL;
+            goto fail;
+        }
+    }
+    if (with_tx)
+        r->tx = r->map + rx_len;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifr.ifr_ifindex;
+    if (bind(r->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+        goto fail;
+
+    if (fanout_id >= 0) {
+        arg = (fanout_id & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(r->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+            goto fail;
+    }
+    return r;
+
+fail:
+    err = errno;
+    pkt_ring_close(r);
+    errno = err;
+    return NULL;
+}
+
+void pkt_ring_close(struct pkt_ring *r)
+{
+    if (r == NULL)
+        return;
+    if (r->map != NULL)
+        munmap(r->map, r->map_len);
+    if (r->fd >= 0)
+        close(r->fd);
+    free(r);
+}
+
+const unsigned char *pkt_ring_hwaddr(const struct pkt_ring *r)
+{
+    return r->hwaddr;
+}
+
+/* Walk one retired block in place, then give it back to the kernel */
+static int walk_block(struct tpacket_block_desc *bd, pkt_ring_cb cb, void *ctx)
+{
+    struct tpacket3_hdr *h;
+    const struct sockaddr_ll *sll;
+    unsigned int i, n;
+    int delivered = 0;
+    int len;
+
+    n = bd->hdr.bh1.num_pkts;
+    h = (struct tpacket3_hdr *)((unsigned char *)bd + bd->hdr.bh1.offset_to_first_pkt);
+    for (i = 0; i < n; i++) {
+        sll = (const struct sockaddr_ll *)((unsigned char *)h + SLL_OFF);
+        len = (int)h->tp_snaplen - (int)(h->tp_net - h->tp_mac);
+        if (sll->sll_pkttype != PACKET_OUTGOING && sll->sll_pkttype != PACKET_OTHERHOST && len > 0) {
+            cb(ctx, (unsigned char *)h + h->tp_net, len, sll);
+            delivered++;
+        }
+        h = (struct tpacket3_hdr *)((unsigned char *)h + h->tp_next_offset);
+    }
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    return delivered;
+}
+
+int pkt_ring_poll(struct pkt_ring *r, int timeout_ms, pkt_ring_cb cb, void *ctx)
+{
+    struct tpacket_block_desc *bd;
+    struct pollfd pfd;
+    int total = 0;
+    int waited = 0;
+
+    for (;;) {
+        bd = (struct tpacket_block_desc *)(r->map + (size_t)r->rx_block * RX_BLOCK_SIZE);
+        if (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) {
+            total += walk_block(bd, cb, ctx);
+            r->rx_block = (r->rx_block + 1) % RX_BLOCK_NR;
+            continue;
+        }
+        if (total > 0 || waited)
+            return total;
+        pfd.fd = r->fd;
+        pfd.events = POLLIN | POLLERR;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout_ms) < 0)
+            return errno == EINTR ? 0 : -1;
+        waited = 1;
+    }
+}
+
+unsigned char *pkt_ring_tx_frame(struct pkt_ring *r, size_t *room)
+{
+    struct tpacket3_hdr *h;
+    unsigned int status;
+
+    if (r->tx == NULL)
+        return NULL;
+    h = (struct tpacket3_hdr *)(r->tx + (size_t)r->tx_frame * TX_FRAME_SIZE);
+    status = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+        return NULL;  /* the kernel has not sent this slot yet */
+    *room = TX_FRAME_SIZE - TX_DATA_OFF;
+    return (unsigned char *)h + TX_DATA_OFF;
+}
+
+void pkt_ring_tx_commit(struct pkt_ring *r, size_t len)
+{
+    struct tpacket3_hdr *h;
+
+    h = (struct tpacket3_hdr *)(r->tx + (size_t)r->tx_frame * TX_FRAME_SIZE);
+    h->tp_len = (unsigned int)len;
+    h->tp_next_offset = 0;
+    __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    r->tx_frame = (r->tx_frame + 1) % r->tx_frames;
+    r->tx_pending++;
+}
+
+int pkt_ring_tx_flush(struct pkt_ring *r)
+{
+    if (r->tx_pending == 0)
+        return 0;
+    r->tx_pending = 0;
+    /* a zero-length send() transmits every SEND_REQUEST frame in the ring */
+    if (send(r->fd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS)
+        return -1;
+    return 0;
+}
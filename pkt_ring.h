@@ -0,0 +1,56 @@
+#ifndef PKT_RING_H
+#define PKT_RING_H
+
+#include <stddef.h>              /* size_t */
+#include <linux/if_packet.h>     /* struct sockaddr_ll */
+
+/*
+ * Interface-bound packet socket with memory-mapped TPACKET_V3 rings.
+ *
+ * The RX ring is filled by the kernel in blocks of many packets; the
+ * caller walks each ready block in place (no recvfrom, no copy) and then
+ * hands it back. The optional TX ring takes complete link-layer frames,
+ * written straight into shared memory; one send() kicks off every frame
+ * queued since the last flush.
+ *
+ * Only CUSTOM_PROTO IPv4 packets are delivered, via a classic BPF filter
+ * supplied by the caller's protocol number. Ethernet-style links
+ * (including loopback) are supported.
+ */
+
+#define PKT_RING_ETH_HLEN 14     /* link header written in front of TX frames */
+
+struct pkt_ring;                 /* opaque */
+
+/* Called for every received packet: ip points at the IPv4 header inside the
+   ring, sll describes the link-layer source (sll_addr is its MAC) */
+typedef void (*pkt_ring_cb)(void *ctx, unsigned char *ip, int len, const struct sockaddr_ll *sll);
+
+/*
+ * Open a ring on ifname accepting IP protocol `proto`. fanout_id >= 0 joins
+ * a PACKET_FANOUT_HASH group so several rings can share the interface;
+ * with_tx also maps a TX ring. Returns NULL on failure (errno set).
+ */
+struct pkt_ring *pkt_ring_open(const char *ifname, int proto, int fanout_id, int with_tx);
+void pkt_ring_close(struct pkt_ring *r);
+
+/*
+ * Process every ready RX block; if none is ready, wait up to timeout_ms for
+ * one. Outgoing and other-host packets are skipped. Returns the number of
+ * packets passed to cb, 0 on timeout, -1 on error.
+ */
+int pkt_ring_poll(struct pkt_ring *r, int timeout_ms, pkt_ring_cb cb, void *ctx);
+
+/* Interface hardware address (6 bytes), used as the source of TX frames */
+const unsigned char *pkt_ring_hwaddr(const struct pkt_ring *r);
+
+/*
+ * Reserve the next TX frame: returns where the link-layer frame goes and
+ * stores its capacity in *room, or NULL if every frame is still queued.
+ * pkt_ring_tx_commit() queues it; pkt_ring_tx_flush() transmits the queue.
+ */
+unsigned char *pkt_ring_tx_frame(struct pkt_ring *r, size_t *room);
+void pkt_ring_tx_commit(struct pkt_ring *r, size_t len);
+int pkt_ring_tx_flush(struct pkt_ring *r);
+
+#endif /* PKT_RING_H */
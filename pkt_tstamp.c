@@ -0,0 +1,169 @@
+#define _GNU_SOURCE  /* clock_gettime, struct ifreq, MSG_ERRQUEUE */
+
+#include <string.h>
+#include <errno.h>
+#include <math.h>                  /* sqrt */
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/sockios.h>         /* SIOCSHWTSTAMP */
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>        /* struct sock_extended_err, struct scm_timestamping */
+#include "pkt_tstamp.h"
+
+#ifndef SO_TIMESTAMPING
+#define SO_TIMESTAMPING 37
+#endif
+#ifndef SCM_TIMESTAMPING
+#define SCM_TIMESTAMPING SO_TIMESTAMPING
+#endif
+
+#define TS_FLAGS_SW (SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE)
+#define TS_FLAGS_HW (SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE)
+/* OPT_ID 给发送时间戳编号；OPT_TSONLY 让错误队列只带时间戳，不回传整个报文 */
+#define TS_FLAGS_OPT (SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)
+
+static int ts_valid(const struct timespec *t) {
+    return t->tv_sec != 0 || t->tv_nsec != 0;
+}
+
+static double ts_diff_us(const struct timespec *a, const struct timespec *b) {
+    return (double)(a->tv_sec - b->tv_sec) * 1e6 + (double)(a->tv_nsec - b->tv_nsec) / 1e3;
+}
+
+/* 打开网卡的硬件时间戳（需要驱动支持和 CAP_NET_ADMIN），成功返回 0 */
+static int enable_hw(int fd, const char *ifname) {
+    struct hwtstamp_config cfg;
+    struct ifreq ifr;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.tx_type = HWTSTAMP_TX_ON;
+    cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    ifr.ifr_data = (char *)&cfg;
+    if (ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0) return -1;
+    /* 驱动可能退而只给 PTP 报文打时间戳，那对 ICMP 没有用 */
+    return cfg.tx_type == HWTSTAMP_TX_ON && cfg.rx_filter != HWTSTAMP_FILTER_NONE ? 0 : -1;
+}
+
+int pkt_ts_enable(int fd, const char *hw_ifname) {
+    int flags = TS_FLAGS_SW | TS_FLAGS_HW | TS_FLAGS_OPT;
+    int hw = hw_ifname != NULL && enable_hw(fd, hw_ifname) == 0;
+
+    /* 硬件上报标志总是带上：网卡已被别的程序（如 ptp4l）打开时也能用上 */
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        flags = TS_FLAGS_SW | TS_FLAGS_OPT;
+        if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) return -1;
+        hw = 0;
+    }
+    return hw ? TS_SRC_HARDWARE : TS_SRC_SOFTWARE;
+}
+
+void pkt_ts_from_msg(struct msghdr *msg, struct pkt_ts *ts) {
+    struct cmsghdr *c;
+    struct scm_timestamping st;
+
+    memset(ts, 0, sizeof(*ts));
+    for (c = CMSG_FIRSTHDR(msg); c != NULL; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPING) continue;
+        memcpy(&st, CMSG_DATA(c), sizeof(st));
+        ts->sw = st.ts[0];         /* ts[1] 已废弃，ts[2] 是网卡原始时间 */
+        ts->hw = st.ts[2];
+    }
+}
+
+int pkt_ts_read_tx(int fd, unsigned long *key, struct pkt_ts *ts) {
+    char data[64];
+    char control[512];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *c;
+    struct sock_extended_err ee;
+    int have_key;
+
+    for (;;) {
+        have_key = 0;
+        iov.iov_base = data;
+        iov.iov_len = sizeof(data);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        pkt_ts_from_msg(&msg, ts);
+        for (c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (!((c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR) ||
+                  (c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR))) continue;
+            memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+            if (ee.ee_errno == ENOMSG && ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                *key = (unsigned long)ee.ee_data;
+                have_key = 1;
+            }
+        }
+        /* 错误队列里也可能是真正的 ICMP 错误（开启了 IP_RECVERR 时），跳过 */
+        if (have_key && (ts_valid(&ts->sw) || ts_valid(&ts->hw))) return 1;
+    }
+}
+
+void pkt_ts_now(struct timespec *mono) {
+    clock_gettime(CLOCK_MONOTONIC, mono);
+}
+
+double pkt_ts_rtt_us(const struct pkt_ts *tx, const struct pkt_ts *rx,
+                     const struct timespec *mono_tx, const struct timespec *mono_rx, int *src) {
+    int s = TS_SRC_MONO;
+    double us;
+
+    if (tx != NULL && rx != NULL && ts_valid(&tx->hw) && ts_valid(&rx->hw)) {
+        s = TS_SRC_HARDWARE;
+        us = ts_diff_us(&rx->hw, &tx->hw);
+    } else if (tx != NULL && rx != NULL && ts_valid(&tx->sw) && ts_valid(&rx->sw)) {
+        s = TS_SRC_SOFTWARE;
+        us = ts_diff_us(&rx->sw, &tx->sw);
+    } else {
+        us = ts_diff_us(mono_rx, mono_tx);
+    }
+    if (us < 0.0) {                /* 时钟被调整等异常 */
+        s = TS_SRC_MONO;
+        us = ts_diff_us(mono_rx, mono_tx);
+    }
+    if (src != NULL) *src = s;
+    return us;
+}
+
+const char *pkt_ts_src_name(int src) {
+    if (src == TS_SRC_HARDWARE) return "hw";
+    if (src == TS_SRC_SOFTWARE) return "sw";
+    return "mono";
+}
+
+void rtt_stats_init(struct rtt_stats *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void rtt_stats_add(struct rtt_stats *s, double us) {
+    if (s->n == 0 || us < s->min) s->min = us;
+    if (us > s->max) s->max = us;
+    s->sum += us;
+    s->sumsq += us * us;
+    s->n++;
+}
+
+double rtt_stats_avg(const struct rtt_stats *s) {
+    return s->n > 0 ? s->sum / (double)s->n : 0.0;
+}
+
+double rtt_stats_mdev(const struct rtt_stats *s) {
+    double avg, var;
+
+    if (s->n == 0) return 0.0;
+    avg = s->sum / (double)s->n;
+    var = s->sumsq / (double)s->n - avg * avg;
+    return var > 0.0 ? sqrt(var) : 0.0;
+}
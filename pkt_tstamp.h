@@ -0,0 +1,70 @@
+#ifndef PKT_TSTAMP_H
+#define PKT_TSTAMP_H
+
+#include <time.h>          /* struct timespec */
+#include <sys/socket.h>    /* struct msghdr */
+
+/*
+ * 内核收发时间戳（SO_TIMESTAMPING），用于测量不含调度与唤醒延迟的 RTT。
+ *
+ * 接收时间戳随 recvmsg 的控制消息返回；发送时间戳由内核在报文交给网卡
+ * 驱动（软件）或网卡发出（硬件）时记录，放在套接字的错误队列里，按
+ * SOF_TIMESTAMPING_OPT_ID 的序号（每次成功发送加一，从 0 开始）对应到
+ * 具体报文。收发两端都有同一种时间戳时才用它计算 RTT（硬件优先），否则
+ * 退回到用户态 CLOCK_MONOTONIC 读数。
+ */
+
+#define TS_SRC_MONO 0              /* 用户态单调时钟 */
+#define TS_SRC_SOFTWARE 1          /* 内核软件时间戳 */
+#define TS_SRC_HARDWARE 2          /* 网卡硬件时间戳 */
+
+/* 一个报文的内核时间戳，tv_sec 与 tv_nsec 都为 0 表示没有 */
+struct pkt_ts {
+    struct timespec sw;
+    struct timespec hw;
+};
+
+/* RTT 汇总（微秒），mdev 与 ping 相同：sqrt(E[x^2] - E[x]^2) */
+struct rtt_stats {
+    unsigned long n;
+    double min;
+    double max;
+    double sum;
+    double sumsq;
+};
+
+/*
+ * 在 fd 上开启收发时间戳。hw_ifname 非 NULL 时先尝试用 SIOCSHWTSTAMP
+ * 打开该网卡的硬件时间戳。返回 TS_SRC_HARDWARE / TS_SRC_SOFTWARE 表示
+ * 最好能得到哪种时间戳，内核不支持时返回 -1（调用者只用单调时钟）。
+ */
+int pkt_ts_enable(int fd, const char *hw_ifname);
+
+/* 从 recvmsg() 返回的控制消息中取出接收时间戳（没有则清零） */
+void pkt_ts_from_msg(struct msghdr *msg, struct pkt_ts *ts);
+
+/*
+ * 从错误队列读取一个发送时间戳（非阻塞）：返回 1 并给出 OPT_ID 序号，
+ * 队列为空返回 0，出错返回 -1。
+ */
+int pkt_ts_read_tx(int fd, unsigned long *key, struct pkt_ts *ts);
+
+/* 当前 CLOCK_MONOTONIC 时间 */
+void pkt_ts_now(struct timespec *mono);
+
+/*
+ * 计算 RTT（微秒）：两端都有硬件时间戳用硬件的，其次软件的，
+ * 否则用 mono_tx/mono_rx。*src 给出所用的来源（可为 NULL）。
+ */
+double pkt_ts_rtt_us(const struct pkt_ts *tx, const struct pkt_ts *rx,
+                     const struct timespec *mono_tx, const struct timespec *mono_rx, int *src);
+
+/* 来源名称："hw"、"sw"、"mono" */
+const char *pkt_ts_src_name(int src);
+
+void rtt_stats_init(struct rtt_stats *s);
+void rtt_stats_add(struct rtt_stats *s, double us);
+double rtt_stats_avg(const struct rtt_stats *s);
+double rtt_stats_mdev(const struct rtt_stats *s);
+
+#endif /* PKT_TSTAMP_H */
@@ -0,0 +1,477 @@
+#define _GNU_SOURCE /* poll, select and epoll declarations under -std=c89 */
+
+#include <stdlib.h>     /* calloc, realloc, free */
+#include <string.h>     /* memset, strcmp */
+#include <errno.h>      /* errno */
+#include <unistd.h>     /* close */
+#include <sys/time.h>   /* struct timeval */
+#include <sys/select.h> /* select */
+#ifndef POLLER_NO_POLL
+#include <poll.h> /* poll */
+#endif
+#if defined(__linux__) && !defined(POLLER_NO_EPOLL)
+#define POLLER_HAVE_EPOLL
+#include <sys/epoll.h> /* epoll */
+#endif
+#include "poller.h"
+
+/* Per-fd registration shared by all backends */
+struct poller_slot
+{
+    int used;            /* fd is registered */
+    unsigned int events; /* POLLER_IN / POLLER_OUT interest */
+    void *data;          /* caller's cookie */
+    int index;           /* poll backend: position in pfds[] */
+};
+
+/* Operations a backend provides; slot bookkeeping is done by the caller */
+struct poller_ops
+{
+    const char *name;
+    int (*init)(struct poller *p);
+    int (*add)(struct poller *p, int fd, unsigned int events);
+    int (*mod)(struct poller *p, int fd, unsigned int events);
+    int (*del)(struct poller *p, int fd);
+    int (*wait)(struct poller *p, struct poller_event *evs, int max, int timeout_ms);
+    void (*fini)(struct poller *p);
+};
+
+struct poller
+{
+    const struct poller_ops *ops; /* backend */
+    struct poller_slot *slots;    /* indexed by fd */
+    int nslots;                   /* size of slots[] */
+#ifdef POLLER_HAVE_EPOLL
+    int epfd;                     /* epoll instance */
+    struct epoll_event *epev;     /* epoll_wait output buffer */
+    int epev_cap;                 /* size of epev[] */
+#endif
+#ifndef POLLER_NO_POLL
+    struct pollfd *pfds;          /* dense array of watched fds */
+    int npfds;                    /* used entries in pfds[] */
+    int pfd_cap;                  /* size of pfds[] */
+    int rr;                       /* round-robin start so no fd starves */
+#endif
+    fd_set rset;                  /* select: read interest */
+    fd_set wset;                  /* select: write interest */
+    int maxfd;                    /* select: highest watched fd, -1 if none */
+};
+
+/* Grow slots[] so that fd is a valid index; 0 on success */
+static int slots_reserve(struct poller *p, int fd)
+{
+    int n;
+    struct poller_slot *ns;
+
+    if (fd < p->nslots)
+        return 0;
+    n = p->nslots == 0 ? 64 : p->nslots;
+    while (n <= fd)
+        n *= 2;
+    ns = (struct poller_slot *)realloc(p->slots, (size_t)n * sizeof(*ns));
+    if (ns == NULL)
+        return -1;
+    memset(ns + p->nslots, 0, (size_t)(n - p->nslots) * sizeof(*ns));
+    p->slots = ns;
+    p->nslots = n;
+    return 0;
+}
+
+/* ---------- epoll ---------- */
+
+#ifdef POLLER_HAVE_EPOLL
+static unsigned int to_epoll(unsigned int events)
+{
+    unsigned int e = 0;
+    if (events & POLLER_IN)
+        e |= EPOLLIN;
+    if (events & POLLER_OUT)
+        e |= EPOLLOUT;
+    return e;
+}
+
+static int ep_init(struct poller *p)
+{
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+    return p->epfd < 0 ? -1 : 0;
+}
+
+static int ep_ctl(struct poller *p, int op, int fd, unsigned int events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = to_epoll(events);
+    ev.data.fd = fd;
+    return epoll_ctl(p->epfd, op, fd, &ev);
+}
+
+static int ep_add(struct poller *p, int fd, unsigned int events)
+{
+    return ep_ctl(p, EPOLL_CTL_ADD, fd, events);
+}
+
+static int ep_mod(struct poller *p, int fd, unsigned int events)
+{
+    return ep_ctl(p, EPOLL_CTL_MOD, fd, events);
+}
+
+static int ep_del(struct poller *p, int fd)
+{
+    return ep_ctl(p, EPOLL_CTL_DEL, fd, 0);
+}
+
+static int ep_wait(struct poller *p, struct poller_event *evs, int max, int timeout_ms)
+{
+    int n;
+    int i;
+
+    if (max > p->epev_cap)
+    {
+        struct epoll_event *ne = (struct epoll_event *)realloc(p->epev, (size_t)max * sizeof(*ne));
+        if (ne == NULL)
+            return -1;
+        p->epev = ne;
+        p->epev_cap = max;
+    }
+    n = epoll_wait(p->epfd, p->epev, max, timeout_ms);
+    for (i = 0; i < n; i++)
+    {
+        unsigned int e = p->epev[i].events;
+        int fd = p->epev[i].data.fd;
+        evs[i].fd = fd;
+        evs[i].events = 0;
+        if (e & (EPOLLIN | EPOLLPRI))
+            evs[i].events |= POLLER_IN;
+        if (e & EPOLLOUT)
+            evs[i].events |= POLLER_OUT;
+        if (e & (EPOLLERR | EPOLLHUP))
+            evs[i].events |= POLLER_ERR;
+        evs[i].data = p->slots[fd].data;
+    }
+    return n;
+}
+
+static void ep_fini(struct poller *p)
+{
+    close(p->epfd);
+    free(p->epev);
+}
+
+static const struct poller_ops epoll_ops = {
+    "epoll", ep_init, ep_add, ep_mod, ep_del, ep_wait, ep_fini};
+#endif /* POLLER_HAVE_EPOLL */
+
+/* ---------- poll ---------- */
+
+#ifndef POLLER_NO_POLL
+static short to_poll(unsigned int events)
+{
+    short e = 0;
+    if (events & POLLER_IN)
+        e |= POLLIN;
+    if (events & POLLER_OUT)
+        e |= POLLOUT;
+    return e;
+}
+
+static int pl_init(struct poller *p)
+{
+    (void)p;
+    return 0;
+}
+
+static int pl_add(struct poller *p, int fd, unsigned int events)
+{
+    if (p->npfds == p->pfd_cap)
+    {
+        int ncap = p->pfd_cap == 0 ? 64 : p->pfd_cap * 2;
+        struct pollfd *np = (struct pollfd *)realloc(p->pfds, (size_t)ncap * sizeof(*np));
+        if (np == NULL)
+            return -1;
+        p->pfds = np;
+        p->pfd_cap = ncap;
+    }
+    p->pfds[p->npfds].fd = fd;
+    p->pfds[p->npfds].events = to_poll(events);
+    p->pfds[p->npfds].revents = 0;
+    p->slots[fd].index = p->npfds++;
+    return 0;
+}
+
+static int pl_mod(struct poller *p, int fd, unsigned int events)
+{
+    p->pfds[p->slots[fd].index].events = to_poll(events);
+    return 0;
+}
+
+static int pl_del(struct poller *p, int fd)
+{
+    int i = p->slots[fd].index;
+    p->npfds--;
+    if (i != p->npfds)
+    { /* move the last entry into the hole */
+        p->pfds[i] = p->pfds[p->npfds];
+        p->slots[p->pfds[i].fd].index = i;
+    }
+    return 0;
+}
+
+static int pl_wait(struct poller *p, struct poller_event *evs, int max, int timeout_ms)
+{
+    int ready;
+    int n = 0;
+    int k;
+
+    ready = poll(p->pfds, (nfds_t)p->npfds, timeout_ms);
+    if (ready <= 0)
+        return ready;
+    for (k = 0; k < p->npfds && n < ready && n < max; k++)
+    {
+        struct pollfd *pf = &p->pfds[(p->rr + k) % p->npfds];
+        if (pf->revents == 0)
+            continue;
+        evs[n].fd = pf->fd;
+        evs[n].events = 0;
+        if (pf->revents & (POLLIN | POLLPRI))
+            evs[n].events |= POLLER_IN;
+        if (pf->revents & POLLOUT)
+            evs[n].events |= POLLER_OUT;
+        if (pf->revents & (POLLERR | POLLHUP | POLLNVAL))
+            evs[n].events |= POLLER_ERR;
+        evs[n].data = p->slots[pf->fd].data;
+        n++;
+    }
+    p->rr = p->npfds > 0 ? (p->rr + 1) % p->npfds : 0;
+    return n;
+}
+
+static void pl_fini(struct poller *p)
+{
+    free(p->pfds);
+}
+
+static const struct poller_ops poll_ops = {
+    "poll", pl_init, pl_add, pl_mod, pl_del, pl_wait, pl_fini};
+#endif /* POLLER_NO_POLL */
+
+/* ---------- select ---------- */
+
+static void sel_update(struct poller *p, int fd, unsigned int events)
+{
+    FD_CLR(fd, &p->rset);
+    FD_CLR(fd, &p->wset);
+    if (events & POLLER_IN)
+        FD_SET(fd, &p->rset);
+    if (events & POLLER_OUT)
+        FD_SET(fd, &p->wset);
+}
+
+static int sel_init(struct poller *p)
+{
+    FD_ZERO(&p->rset);
+    FD_ZERO(&p->wset);
+    p->maxfd = -1;
+    return 0;
+}
+
+static int sel_add(struct poller *p, int fd, unsigned int events)
+{
+    if (fd >= FD_SETSIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    sel_update(p, fd, events);
+    if (fd > p->maxfd)
+        p->maxfd = fd;
+    return 0;
+}
+
+static int sel_mod(struct poller *p, int fd, unsigned int events)
+{
+    sel_update(p, fd, events);
+    return 0;
+}
+
+static int sel_del(struct poller *p, int fd)
+{
+    sel_update(p, fd, 0);
+    if (fd == p->maxfd)
+    { /* slot for fd is cleared by the caller afterwards */
+        p->maxfd--;
+        while (p->maxfd >= 0 && (p->maxfd == fd || !p->slots[p->maxfd].used))
+            p->maxfd--;
+    }
+    return 0;
+}
+
+static int sel_wait(struct poller *p, struct poller_event *evs, int max, int timeout_ms)
+{
+    fd_set r = p->rset;
+    fd_set w = p->wset;
+    struct timeval tv;
+    int ready;
+    int n = 0;
+    int fd;
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    ready = select(p->maxfd + 1, &r, &w, NULL, timeout_ms < 0 ? NULL : &tv);
+    if (ready <= 0)
+        return ready;
+    for (fd = 0; fd <= p->maxfd && n < max; fd++)
+    {
+        unsigned int e = 0;
+        if (FD_ISSET(fd, &r))
+            e |= POLLER_IN;
+        if (FD_ISSET(fd, &w))
+            e |= POLLER_OUT;
+        if (e == 0)
+            continue;
+        evs[n].fd = fd;
+        evs[n].events = e;
+        evs[n].data = p->slots[fd].data;
+        n++;
+    }
+    return n;
+}
+
+static void sel_fini(struct poller *p)
+{
+    (void)p;
+}
+
+static const struct poller_ops select_ops = {
+    "select", sel_init, sel_add, sel_mod, sel_del, sel_wait, sel_fini};
+
+/* ---------- public interface ---------- */
+
+struct poller *poller_create(enum poller_backend backend)
+{
+    struct poller *p;
+    const struct poller_ops *ops = NULL;
+
+    switch (backend)
+    {
+    case POLLER_AUTO:
+#ifdef POLLER_HAVE_EPOLL
+        ops = &epoll_ops;
+#elif !defined(POLLER_NO_POLL)
+        ops = &poll_ops;
+#else
+        ops = &select_ops;
+#endif
+        break;
+    case POLLER_EPOLL:
+#ifdef POLLER_HAVE_EPOLL
+        ops = &epoll_ops;
+#endif
+        break;
+    case POLLER_POLL:
+#ifndef POLLER_NO_POLL
+        ops = &poll_ops;
+#endif
+        break;
+    case POLLER_SELECT:
+        ops = &select_ops;
+        break;
+    }
+    if (ops == NULL)
+    {
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    p = (struct poller *)calloc(1, sizeof(*p));
+    if (p == NULL)
+        return NULL;
+    p->ops = ops;
+    if (ops->init(p) != 0)
+    {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+const char *poller_name(const struct poller *p)
+{
+    return p->ops->name;
+}
+
+int poller_parse_backend(const char *name, enum poller_backend *out)
+{
+    if (strcmp(name, "auto") == 0)
+        *out = POLLER_AUTO;
+    else if (strcmp(name, "epoll") == 0)
+        *out = POLLER_EPOLL;
+    else if (strcmp(name, "poll") == 0)
+        *out = POLLER_POLL;
+    else if (strcmp(name, "select") == 0)
+        *out = POLLER_SELECT;
+    else
+        return -1;
+    return 0;
+}
+
+int poller_add(struct poller *p, int fd, unsigned int events, void *data)
+{
+    if (fd < 0 || slots_reserve(p, fd) != 0)
+        return -1;
+    if (p->slots[fd].used)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    if (p->ops->add(p, fd, events) != 0)
+        return -1;
+    p->slots[fd].used = 1;
+    p->slots[fd].events = events;
+    p->slots[fd].data = data;
+    return 0;
+}
+
+int poller_mod(struct poller *p, int fd, unsigned int events, void *data)
+{
+    if (fd < 0 || fd >= p->nslots || !p->slots[fd].used)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    if (events != p->slots[fd].events && p->ops->mod(p, fd, events) != 0)
+        return -1;
+    p->slots[fd].events = events;
+    p->slots[fd].data = data;
+    return 0;
+}
+
+int poller_del(struct poller *p, int fd)
+{
+    if (fd < 0 || fd >= p->nslots || !p->slots[fd].used)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    p->ops->del(p, fd);
+    memset(&p->slots[fd], 0, sizeof(p->slots[fd]));
+    return 0;
+}
+
+int poller_wait(struct poller *p, struct poller_event *evs, int max, int timeout_ms)
+{
+    if (max <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return p->ops->wait(p, evs, max, timeout_ms);
+}
+
+void poller_destroy(struct poller *p)
+{
+    if (p == NULL)
+        return;
+    p->ops->fini(p);
+    free(p->slots);
+    free(p);
+}
@@ -0,0 +1,64 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+/*
+ * Small readiness-multiplexing core with interchangeable backends:
+ * epoll on Linux, poll() as the portable fallback and select() for
+ * legacy systems. All backends are level-triggered, so a caller that
+ * does not drain a socket is simply told about it again on the next
+ * poller_wait().
+ *
+ * Backends can be compiled out with -DPOLLER_NO_EPOLL / -DPOLLER_NO_POLL.
+ */
+
+#define POLLER_IN  0x1 /* readable (or a pending connection on a listener) */
+#define POLLER_OUT 0x2 /* writable */
+#define POLLER_ERR 0x4 /* error or hangup; reported even if not requested */
+
+enum poller_backend
+{
+    POLLER_AUTO,  /* best backend available in this build */
+    POLLER_EPOLL, /* Linux epoll */
+    POLLER_POLL,  /* POSIX poll() */
+    POLLER_SELECT /* select(); fds are limited to FD_SETSIZE */
+};
+
+/* One ready descriptor returned by poller_wait() */
+struct poller_event
+{
+    int fd;              /* ready descriptor */
+    unsigned int events; /* POLLER_* bits that are ready */
+    void *data;          /* pointer given to poller_add()/poller_mod() */
+};
+
+struct poller; /* opaque */
+
+/* Create a poller; returns NULL if the backend is unavailable */
+struct poller *poller_create(enum poller_backend backend);
+
+/* Name of the backend in use ("epoll", "poll" or "select") */
+const char *poller_name(const struct poller *p);
+
+/* Parse "epoll", "poll", "select" or "auto"; returns 0 on success */
+int poller_parse_backend(const char *name, enum poller_backend *out);
+
+/* Start watching fd for the given POLLER_IN/POLLER_OUT mask; 0 on success */
+int poller_add(struct poller *p, int fd, unsigned int events, void *data);
+
+/* Change the interest mask (and data) of a watched fd; 0 on success */
+int poller_mod(struct poller *p, int fd, unsigned int events, void *data);
+
+/* Stop watching fd; must be called before the fd is closed. 0 on success */
+int poller_del(struct poller *p, int fd);
+
+/*
+ * Wait up to timeout_ms (-1 = forever) and store at most max ready
+ * descriptors in evs. Returns the number stored, 0 on timeout, or -1
+ * with errno set (EINTR is returned to the caller).
+ */
+int poller_wait(struct poller *p, struct poller_event *evs, int max, int timeout_ms);
+
+/* Release the poller (watched fds are not closed) */
+void poller_destroy(struct poller *p);
+
+#endif /* POLLER_H */
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE /* getopt、poll、clock_gettime */
+
 #include <stdio.h> /* 标准输入输出库 */
 #include <stdlib.h> /* 标准库（exit、malloc 等） */
 #include <string.h> /* 字符串处理函数 */
@@ -11,13 +13,26 @@
 #include <arpa/inet.h> /* inet_ntoa、inet_addr */
 #include <netdb.h> /* gethostbyname */
 #include <errno.h> /* errno */
+#include <poll.h> /* poll */
+#include <time.h> /* clock_gettime */
+#include "timer_wheel.h" /* 探测超时用的时间轮 */
+#include "pkt_tstamp.h" /* 内核收发时间戳与 RTT 汇总 */
+#include "inet_csum.h" /* Internet 校验和 */
 
 /* 定义常量 */
 #define PACKET_SIZE 64 /* 原有的包定义（用于 ICMP 数据长度参考） */
 #define DATA_SIZE 56 /* ICMP 数据区长度（与 PACKET_SIZE 对应） */
-#define MAX_WAIT_TIME 3 /* select 等待超时时间（秒） */
-#define MAX_PACKETS 5 /* 发送包个数 */
-#define TARGET_HOST "127.0.0.1" /* 目标地址常量 */
+#define MAX_WAIT_TIME 3 /* 默认探测超时时间（秒），-t 可改 */
+#define MAX_PACKETS 5 /* 默认每个目标发送的包数，-c 可改 */
+#define TARGET_HOST "127.0.0.1" /* 未给出目标时使用的地址 */
+#define DEFAULT_PERIOD_MS 1000 /* 同一目标两次探测的间隔（毫秒），-p 可改 */
+#define DEFAULT_GAP_MS 1 /* 任意两次发送之间的最小间隔（毫秒），即全局限速，-i 可改 */
+#define PROBE_POOL 4096 /* 同时在途的探测上限（必须小于 65536，保证序号不重复） */
+#define PROBE_HASH 8192 /* 在途探测哈希表的桶数（2 的幂） */
+#define WHEEL_SLOTS 1024 /* 时间轮槽数 */
+#define WHEEL_TICK_MS 10 /* 时间轮精度（毫秒），也是接收循环最长的 poll 等待 */
+#define RCVBUF_BYTES (1 << 20) /* 接收缓冲：成千上万个目标的回复可能同时到达 */
+#define TXKEY_MAP (PROBE_POOL * 2) /* 发送时间戳序号 -> 探测 的映射表大小（2 的幂） */
 
 #ifndef ICMP_ECHO /* 如果系统头文件未定义 ICMP_ECHO，则定义它 */
 #define ICMP_ECHO 8 /* ICMP ECHO 请求类型 */
@@ -33,46 +48,54 @@ struct icmp_packet { /* 定义 icmp_packet 结构 */
     char data[DATA_SIZE]; /* ICMP 数据区，固定长度 DATA_SIZE */
 }; /* 结束 icmp_packet 结构 */
 
+/* 一个探测目标及其统计 */
+struct target { /* 定义 target 结构 */
+    struct sockaddr_in addr; /* 目标地址 */
+    char name[64]; /* 命令行或文件中给出的名字 */
+    unsigned long sent; /* 已发送的探测数 */
+    unsigned long recv; /* 收到的回复数 */
+    struct rtt_stats rtt; /* RTT 汇总（微秒） */
+}; /* 结束 target 结构 */
+
+/* 一个在途探测：在哈希表中等待回复，同时在时间轮中等待超时 */
+struct probe { /* 定义 probe 结构 */
+    struct tw_timer timer; /* 超时定时器，必须是第一个成员（回调里由它转回 probe） */
+    struct probe *hnext; /* 哈希链（空闲时串成空闲链表） */
+    unsigned short id; /* ICMP id（主机序） */
+    unsigned short seq; /* ICMP 序号（主机序） */
+    int target; /* 所属目标下标 */
+    struct timespec sent_mono; /* 发送前的单调时钟读数（没有内核时间戳时使用） */
+    struct pkt_ts tx_ts; /* 内核发送时间戳（从错误队列取得后填入） */
+    unsigned long tskey; /* 发送时间戳序号（SOF_TIMESTAMPING_OPT_ID） */
+}; /* 结束 probe 结构 */
+
 /* 全局变量 */
 static int sockfd; /* 原始套接字文件描述符 */
 static int packet_count = 0; /* 已发送包计数 */
 static pid_t pid; /* 进程 ID，用作 ICMP id 标识 */
+static struct target *targets = NULL; /* 目标数组 */
+static int ntargets = 0; /* 目标个数 */
+static struct probe probes[PROBE_POOL]; /* 探测对象池，避免热路径上 malloc */
+static struct probe *free_probes = NULL; /* 空闲探测链表 */
+static struct probe *probe_hash[PROBE_HASH]; /* 按 id/序号索引的在途探测 */
+static unsigned long outstanding = 0; /* 在途探测数 */
+static struct timer_wheel wheel; /* 探测超时时间轮 */
+static unsigned short next_seq = 0; /* 下一个序号，所有目标共用，保证在途探测各不相同 */
+static int opt_quiet = 0; /* -q：不打印每个回复，只打印汇总 */
+static int opt_verbose = 0; /* -v：打印每次发送 */
+static int ts_mode = -1; /* 内核时间戳能力：TS_SRC_*，-1 表示只用单调时钟 */
+static unsigned long tx_key_next = 0; /* 下一次成功发送的时间戳序号，与内核计数同步 */
+static struct probe *tx_key_map[TXKEY_MAP]; /* 按序号找发送时间戳所属的探测 */
+static unsigned long rtt_src_count[3]; /* 各 RTT 来源（mono/sw/hw）的使用次数 */
 
 /* 函数声明 */
-unsigned short calculate_checksum(unsigned short *ptr, int nbytes); /* 计算校验和函数声明 */
 void build_icmp_echo_header(struct icmp_packet *packet, int seq); /* 仅构建 ICMP 头并计算 checksum 的函数声明 */
-int parse_icmp_reply(char *buf, int len, struct sockaddr_in *from); /* 解析 ICMP 回复函数声明 */
-void send_icmp_echo(struct sockaddr_in *dest, int seq); /* 发送 ICMP 请求声明 */
-void recv_icmp_reply(); /* 接收并解析 ICMP 回复声明 */
+int parse_icmp_reply(char *buf, int len, unsigned short *seq, int *ttl); /* 解析 ICMP 回复函数声明 */
+int send_icmp_echo(struct sockaddr_in *dest, int seq); /* 发送 ICMP 请求声明 */
+void recv_icmp_replies(void); /* 取走套接字中所有已到达的回复声明 */
 void signal_handler(int sig); /* 信号处理声明 */
 int resolve_hostname(const char *hostname, struct sockaddr_in *dest); /* 解析主机名声明 */
 
-/* 计算 ICMP 校验和（RFC 要求） */
-unsigned short calculate_checksum(unsigned short *ptr, int nbytes) { /* 计算校验和函数定义开始 */
-    unsigned long sum = 0UL; /* 累加和，使用宽类型以避免溢出 */
-    unsigned short odd_byte = 0; /* 用于处理奇数字节 */
-    unsigned short answer = 0; /* 最终返回值 */
-
-    while (nbytes > 1) { /* 处理两字节为一单元的加法 */
-        sum += (unsigned long)(*ptr); /* 将当前 16 位单元加到 sum */
-        ptr++; /* 指针前移 */
-        nbytes -= 2; /* 剩余字节减少 */
-    } /* 结束 while */
-
-    if (nbytes == 1) { /* 若还有 1 字节未处理（奇数字节） */
-        /* 将最后一个字节放到 low-order byte */
-        *((unsigned char *)&odd_byte) = *((unsigned char *)ptr); /* 提取单字节 */
-        sum += (unsigned long)odd_byte; /* 加入 sum */
-    } /* 结束 if */
-
-    /* 将高 16 位加到低 16 位 */
-    sum = (sum >> 16) + (sum & 0xffff); /* 把高位加到低位 */
-    sum += (sum >> 16); /* 若仍有进位再加一次 */
-    answer = (unsigned short)(~sum); /* 取反作为校验和 */
-
-    return answer; /* 返回计算结果 */
-} /* 结束 calculate_checksum */
-
 /* 构建 ICMP 头并对整个 ICMP（头+数据）计算校验和，要求 data 区已填好 */
 void build_icmp_echo_header(struct icmp_packet *packet, int seq) { /* 函数开始 */
     int icmp_len; /* 存放 icmp 的有效长度（头 + data） */
@@ -84,33 +107,31 @@ void build_icmp_echo_header(struct icmp_packet *packet, int seq) { /* 函数开
     packet->hdr.checksum = 0; /* 计算前将 checksum 置 0 */
 
     icmp_len = sizeof(struct icmphdr) + DATA_SIZE; /* 明确计算要参与校验的字节数，避免结构体填充问题 */
-    packet->hdr.checksum = calculate_checksum((unsigned short *)packet, icmp_len); /* 计算并填入 checksum */
+    packet->hdr.checksum = inet_csum(packet, (size_t)icmp_len); /* 计算并填入 checksum */
 } /* 函数结束 build_icmp_echo_header */
 
-/* 解析 ICMP 回复包 */
-int parse_icmp_reply(char *buf, int len, struct sockaddr_in *from) { /* 函数开始 */
+/* 解析 ICMP 回复包：校验类型与 id，取出序号和 TTL；成功返回 ICMP 部分长度，否则返回 -1 */
+int parse_icmp_reply(char *buf, int len, unsigned short *seq, int *ttl) { /* 函数开始 */
     struct iphdr *ip_hdr; /* 指向 IP 头 */
     struct icmphdr *icmp_hdr; /* 指向 ICMP 头 */
     int ip_hdr_len; /* IP 头长度（字节） */
-    struct timeval tv_recv; /* 接收时间 */
-    struct timeval tv_send; /* 发送时间（来自 data） */
-    double rtt; /* 往返时延（毫秒） */
-    int icmp_data_len; /* ICMP 数据长度 */
-    unsigned short recv_seq; /* 从回复中读取到的序列号 */
 
-    if (buf == NULL) { /* 校验参数 */
+    if (buf == NULL || len < (int) sizeof(struct iphdr)) { /* 校验参数 */
         return -1; /* 参数错误返回 */
     } /* 结束 if */
 
-    gettimeofday(&tv_recv, NULL); /* 获取接收时间用于 RTT 计算 */
-
     ip_hdr = (struct iphdr *)buf; /* IP 头起始地址 */
     ip_hdr_len = (int)(ip_hdr->ihl * 4); /* ip->ihl 单位为 32-bit words */
 
-    if (len < ip_hdr_len + (int) sizeof(struct icmphdr)) { /* 若数据不足以包含 ICMP 头则失败 */
+    if (ip_hdr_len < (int) sizeof(struct iphdr) || len < ip_hdr_len + (int) sizeof(struct icmphdr)) { /* 若数据不足以包含 ICMP 头则失败 */
         return -1; /* 数据不完整 */
     } /* 结束 if */
 
+    /* 原始套接字在任何 ICMP 校验之前就交付报文，损坏的回复要在这里丢掉 */
+    if (inet_csum(buf + ip_hdr_len, (size_t)(len - ip_hdr_len)) != 0) { /* 含校验和字段的反码和应为 0 */
+        return -1; /* 校验和错误 */
+    } /* 结束 if */
+
     icmp_hdr = (struct icmphdr *)(buf + ip_hdr_len); /* 定位 ICMP 头 */
 
     if ((int)icmp_hdr->type != ICMP_ECHOREPLY) { /* 只处理 ECHO REPLY */
@@ -122,32 +143,13 @@ int parse_icmp_reply(char *buf, int len, struct sockaddr_in *from) { /* 函数
         return -1; /* 不是发给本进程的回复 */
     } /* 结束 if */
 
-    /* 解析序列号（网络序 -> 主机序） */
-    recv_seq = (unsigned short) ntohs(icmp_hdr->un.echo.sequence); /* 提取并转换序号 */
-
-    /* 计算 RTT：如果 data 部分足够大并且包含发送时的 timeval，则计算 RTT */
-    icmp_data_len = len - ip_hdr_len - (int) sizeof(struct icmphdr); /* ICMP 数据区当前实际长度 */
-    if (icmp_data_len >= (int) sizeof(struct timeval)) { /* 若数据区能包含 timeval */
-        memcpy(&tv_send, buf + ip_hdr_len + sizeof(struct icmphdr), sizeof(struct timeval)); /* 从数据区复制发送时间 */
-        rtt = ((double)(tv_recv.tv_sec - tv_send.tv_sec)) * 1000.0 + ((double)(tv_recv.tv_usec - tv_send.tv_usec)) / 1000.0; /* 计算毫秒级 RTT */
-    } else { /* 数据区不含时间戳 */
-        rtt = 0.0; /* 未能计算 RTT */
-    } /* 结束 if */
-
-    /* 打印回复信息：字节数 = 总长度 - IP 头长度 */
-    printf("%d bytes from %s: icmp_seq=%u ttl=%d", len - ip_hdr_len, inet_ntoa(from->sin_addr), (unsigned int)recv_seq, (int)ip_hdr->ttl); /* 输出基本信息 */
-
-    if (rtt > 0.0) { /* 若有 RTT 才打印 */
-        printf(" time=%.3f ms", rtt); /* 打印 RTT，毫秒格式 */
-    } /* 结束 if */
-
-    printf("\n"); /* 换行 */
-
-    return 0; /* 成功解析 */
+    *seq = (unsigned short) ntohs(icmp_hdr->un.echo.sequence); /* 提取并转换序号 */
+    *ttl = (int)ip_hdr->ttl; /* 回复的 TTL */
+    return len - ip_hdr_len; /* 字节数 = 总长度 - IP 头长度 */
 } /* 结束 parse_icmp_reply */
 
-/* 发送 ICMP ECHO 请求（注意：data 需先填好，再计算 checksum） */
-void send_icmp_echo(struct sockaddr_in *dest, int seq) { /* 函数开始 */
+/* 发送 ICMP ECHO 请求（注意：data 需先填好，再计算 checksum）；成功返回 0 */
+int send_icmp_echo(struct sockaddr_in *dest, int seq) { /* 函数开始 */
     struct icmp_packet packet; /* 声明包变量 */
     struct timeval tv; /* 时间戳变量 */
     int ret; /* sendto 返回值 */
@@ -156,7 +158,7 @@ void send_icmp_echo(struct sockaddr_in *dest, int seq) { /* 函数开始 */
     memset(&packet, 0, sizeof(packet)); /* 清零整个 packet，包括 hdr 和 data */
 
     gettimeofday(&tv, NULL); /* 获取当前时间作为发送时间戳 */
-    memcpy(packet.data, &tv, sizeof(tv)); /* 将 timeval 放在 data 区开头（parse_icmp_reply 期望此处） */
+    memcpy(packet.data, &tv, sizeof(tv)); /* 将 timeval 放在 data 区开头，便于抓包时查看 */
 
     /* 填充剩余 data（可选，用于识别包） */
     i = sizeof(tv); /* 在 C89 中先声明再使用 */
@@ -173,62 +175,204 @@ void send_icmp_echo(struct sockaddr_in *dest, int seq) { /* 函数开始 */
 
     if (ret < 0) { /* 发送失败处理 */
         perror("sendto failed"); /* 打印错误信息 */
-    } else { /* 发送成功 */
-        packet_count++; /* 递增已发送计数 */
+        return -1; /* 返回错误 */
+    } /* 结束 if */
+    packet_count++; /* 递增已发送计数 */
+    if (opt_verbose) { /* 只在 -v 时打印发送日志，目标多时这一行太多 */
         printf("Sent ICMP ECHO request to %s, seq=%d\n", inet_ntoa(dest->sin_addr), seq); /* 打印发送日志 */
     } /* 结束 if */
+    return 0; /* 成功返回 */
 } /* 结束 send_icmp_echo */
 
-/* 接收 ICMP 回复，并在收到匹配的回复时返回 */
-void recv_icmp_reply() { /* 函数开始 */
-    fd_set readfds; /* select 使用的集合 */
-    struct timeval tv; /* select 超时 */
-    char recv_buf[1500]; /* 接收缓冲区，增大到 1500 字节以避免截断 */
-    struct sockaddr_in from; /* 源地址 */
-    socklen_t from_len; /* 源地址长度 */
-    int ret; /* select 返回值 */
-    int n; /* recvfrom 返回的字节数 */
+/* 单调时钟毫秒数，用于发送调度和超时（不受系统时间调整影响） */
+static unsigned long mono_ms(void) { /* 函数开始 */
+    struct timespec ts; /* 当前时间 */
+    clock_gettime(CLOCK_MONOTONIC, &ts); /* 读取单调时钟 */
+    return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L); /* 换算为毫秒 */
+} /* 结束 mono_ms */
+
+/* 在途探测哈希：id 与序号合成键 */
+static unsigned int probe_bucket(unsigned short id, unsigned short seq) { /* 函数开始 */
+    unsigned long key = ((unsigned long)id << 16) | (unsigned long)seq; /* 32 位键 */
+    return (unsigned int)((key * 2654435761UL) >> 11) & (PROBE_HASH - 1); /* 乘法散列取桶号 */
+} /* 结束 probe_bucket */
+
+/* 初始化探测对象池：全部放入空闲链表 */
+static void probe_pool_init(void) { /* 函数开始 */
+    int i; /* 循环索引 */
+    memset(probes, 0, sizeof(probes)); /* 定时器节点首次使用前须清零 */
+    for (i = PROBE_POOL - 1; i >= 0; i--) { /* 倒序入链，使分配从第 0 个开始 */
+        probes[i].hnext = free_probes; /* 串到链表头 */
+        free_probes = &probes[i]; /* 更新链表头 */
+    } /* 结束 for */
+} /* 结束 probe_pool_init */
+
+/* 从哈希表中摘下探测并归还对象池（定时器须已摘下） */
+static void probe_release(struct probe *p) { /* 函数开始 */
+    struct probe **pp; /* 指向链上指针的指针 */
+
+    pp = &probe_hash[probe_bucket(p->id, p->seq)]; /* 所在桶 */
+    while (*pp != NULL && *pp != p) { /* 在链上查找 */
+        pp = &(*pp)->hnext; /* 下一个 */
+    } /* 结束 while */
+    if (*pp == p) { /* 找到则摘链 */
+        *pp = p->hnext; /* 跳过 p */
+    } /* 结束 if */
+    p->hnext = free_probes; /* 放回空闲链表 */
+    free_probes = p; /* 更新链表头 */
+    outstanding--; /* 在途数减一 */
+} /* 结束 probe_release */
+
+/* 向目标 ti 发送一个探测：分配序号、登记到哈希表和时间轮；成功返回 0 */
+static int probe_send(int ti, unsigned long now, unsigned long timeout_ms) { /* 函数开始 */
+    struct probe *p; /* 新探测 */
+    unsigned int b; /* 哈希桶 */
+
+    p = free_probes; /* 取一个空闲探测 */
+    if (p == NULL) { /* 在途探测已满 */
+        return -1; /* 调用者等待回复或超时后再发 */
+    } /* 结束 if */
+    p->id = (unsigned short)(pid & 0xFFFF); /* 与 build_icmp_echo_header 使用的 id 一致 */
+    p->seq = next_seq++; /* 全局递增序号（16 位回绕；在途数远小于 65536，不会重复） */
+    p->target = ti; /* 记下目标 */
+    memset(&p->tx_ts, 0, sizeof(p->tx_ts)); /* 发送时间戳稍后从错误队列取得 */
+    targets[ti].sent++; /* 发送计数（发送失败也算一次丢失） */
+    pkt_ts_now(&p->sent_mono); /* 紧挨着发送读取单调时钟 */
+    if (send_icmp_echo(&targets[ti].addr, (int)p->seq) < 0) { /* 发送失败 */
+        return 0; /* 探测不入表，直接计为丢失 */
+    } /* 结束 if */
+    p->tskey = tx_key_next++; /* 内核对每次成功发送依次编号 */
+    tx_key_map[p->tskey & (TXKEY_MAP - 1)] = p; /* 登记序号 */
+    free_probes = p->hnext; /* 从空闲链表取下 */
+    b = probe_bucket(p->id, p->seq); /* 计算桶号 */
+    p->hnext = probe_hash[b]; /* 插入桶链表头 */
+    probe_hash[b] = p; /* 更新桶 */
+    outstanding++; /* 在途数加一 */
+    tw_add(&wheel, &p->timer, now + timeout_ms); /* 登记超时 */
+    return 0; /* 成功返回 */
+} /* 结束 probe_send */
+
+/* 时间轮回调：探测超时未收到回复 */
+static void probe_timeout(void *ctx, struct tw_timer *t) { /* 函数开始 */
+    struct probe *p = (struct probe *)t; /* timer 是第一个成员 */
+    (void)ctx; /* 未使用参数 */
+    if (!opt_quiet) { /* 安静模式不打印 */
+        printf("Request timeout for %s icmp_seq=%u\n", targets[p->target].name, (unsigned int)p->seq); /* 打印超时 */
+    } /* 结束 if */
+    probe_release(p); /* 归还探测 */
+} /* 结束 probe_timeout */
 
-    while (1) { /* 循环等待直到超时或收到匹配回复 */
-        FD_ZERO(&readfds); /* 清空集合 */
-        FD_SET(sockfd, &readfds); /* 将套接字加入集合 */
+/* 取走错误队列中的发送时间戳，填到对应的在途探测上 */
+static void drain_tx_timestamps(void) { /* 函数开始 */
+    struct pkt_ts ts; /* 时间戳 */
+    unsigned long key; /* 序号 */
+    struct probe *p; /* 对应探测 */
+
+    if (ts_mode < 0) { /* 没有开启内核时间戳 */
+        return; /* 无事可做 */
+    } /* 结束 if */
+    while (pkt_ts_read_tx(sockfd, &key, &ts) == 1) { /* 逐个读取 */
+        p = tx_key_map[key & (TXKEY_MAP - 1)]; /* 查映射 */
+        if (p != NULL && p->tskey == key && p->timer.pending) { /* 仍在途（已超时或已回复的忽略） */
+            p->tx_ts = ts; /* 记下发送时间戳 */
+        } /* 结束 if */
+    } /* 结束 while */
+} /* 结束 drain_tx_timestamps */
+
+/* 处理一个收到的报文：按 id/序号找到在途探测，核对来源地址后计算 RTT */
+static void handle_reply(char *buf, int len, struct sockaddr_in *from,
+                         const struct pkt_ts *rx_ts, const struct timespec *rx_mono) { /* 函数开始 */
+    struct probe *p; /* 匹配的探测 */
+    struct target *tg; /* 所属目标 */
+    unsigned short seq; /* 回复序号 */
+    int ttl; /* 回复 TTL */
+    int icmp_len; /* ICMP 部分长度 */
+    int src; /* RTT 来源 */
+    double rtt; /* 往返时延（微秒） */
+
+    icmp_len = parse_icmp_reply(buf, len, &seq, &ttl); /* 解析 */
+    if (icmp_len < 0) { /* 不是本进程的 ECHO REPLY */
+        return; /* 忽略 */
+    } /* 结束 if */
+    p = probe_hash[probe_bucket((unsigned short)(pid & 0xFFFF), seq)]; /* 查哈希表 */
+    while (p != NULL && p->seq != seq) { /* 沿链查找 */
+        p = p->hnext; /* 下一个 */
+    } /* 结束 while */
+    if (p == NULL) { /* 已超时或重复的回复 */
+        return; /* 忽略 */
+    } /* 结束 if */
+    tg = &targets[p->target]; /* 所属目标 */
+    if (tg->addr.sin_addr.s_addr != from->sin_addr.s_addr) { /* 来源不是该目标 */
+        return; /* 忽略（可能是伪造或错乱的回复） */
+    } /* 结束 if */
 
-        tv.tv_sec = MAX_WAIT_TIME; /* 设置秒级超时时间 */
-        tv.tv_usec = 0; /* 微秒清零 */
+    rtt = pkt_ts_rtt_us(&p->tx_ts, rx_ts, &p->sent_mono, rx_mono, &src); /* 优先用内核时间戳，微秒精度 */
+    rtt_stats_add(&tg->rtt, rtt); /* 计入目标汇总 */
+    rtt_src_count[src]++; /* 统计 RTT 来源 */
+    tg->recv++; /* 回复计数 */
 
-        ret = select(sockfd + 1, &readfds, NULL, NULL, &tv); /* 等待数据可读 */
-        if (ret < 0) { /* select 出错处理 */
-            if (errno == EINTR) { /* 被信号中断，继续等待 */
-                continue; /* 继续循环 */
+    if (!opt_quiet) { /* 安静模式不打印 */
+        printf("%d bytes from %s: icmp_seq=%u ttl=%d time=%.3f ms\n", icmp_len, inet_ntoa(from->sin_addr), (unsigned int)seq, ttl, rtt / 1000.0); /* 输出 */
+    } /* 结束 if */
+    tw_del(&wheel, &p->timer); /* 取消超时 */
+    probe_release(p); /* 归还探测 */
+} /* 结束 handle_reply */
+
+/* 取走套接字中所有已到达的回复（非阻塞），同时取出内核接收时间戳 */
+void recv_icmp_replies(void) { /* 函数开始 */
+    char recv_buf[1500]; /* 接收缓冲区，1500 字节以避免截断 */
+    char control[512]; /* 控制消息缓冲（时间戳） */
+    struct sockaddr_in from; /* 源地址 */
+    struct iovec iov; /* 数据缓冲描述 */
+    struct msghdr msg; /* recvmsg 参数 */
+    struct pkt_ts rx_ts; /* 内核接收时间戳 */
+    struct timespec rx_mono; /* 用户态接收时间 */
+    int n; /* recvmsg 返回的字节数 */
+
+    drain_tx_timestamps(); /* 回复可能比发送时间戳先被读到，先取发送时间戳 */
+    while (1) { /* 直到没有数据 */
+        iov.iov_base = recv_buf; /* 数据缓冲 */
+        iov.iov_len = sizeof(recv_buf); /* 缓冲长度 */
+        memset(&msg, 0, sizeof(msg)); /* 清零 */
+        msg.msg_name = &from; /* 源地址 */
+        msg.msg_namelen = sizeof(from); /* 源地址长度 */
+        msg.msg_iov = &iov; /* 数据 */
+        msg.msg_iovlen = 1; /* 一段 */
+        msg.msg_control = control; /* 控制消息 */
+        msg.msg_controllen = sizeof(control); /* 控制消息长度 */
+        n = recvmsg(sockfd, &msg, MSG_DONTWAIT); /* 接收数据 */
+        if (n < 0) { /* 没有更多数据或出错 */
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) { /* 真正的错误 */
+                perror("recvmsg failed"); /* 打印错误信息 */
             } /* 结束 if */
-            perror("select failed"); /* 打印错误 */
-            break; /* 跳出循环 */
-        } else if (ret == 0) { /* 超时 */
-            printf("Request timeout\n"); /* 打印超时信息 */
-            break; /* 跳出等待循环 */
-        } else { /* 有套接字可读 */
-            if (FD_ISSET(sockfd, &readfds)) { /* 确认 sockfd 可读 */
-                from_len = sizeof(from); /* 设置 from 长度 */
-                n = recvfrom(sockfd, recv_buf, sizeof(recv_buf), 0, (struct sockaddr *)&from, &from_len); /* 接收数据 */
-                if (n < 0) { /* recvfrom 错误处理 */
-                    perror("recvfrom failed"); /* 打印错误信息 */
-                    continue; /* 继续等待下一次 */
-                } /* 结束 if */
-
-                /* 尝试解析 ICMP 回复，若成功则返回（只接受第一个匹配的回复） */
-                if (parse_icmp_reply(recv_buf, n, &from) == 0) { /* 解析成功 */
-                    break; /* 收到匹配回复，跳出循环 */
-                } /* 结束 if */
-            } /* 结束 FD_ISSET 判断 */
-        } /* 结束 select 结果判断 */
+            break; /* 结束本轮接收 */
+        } /* 结束 if */
+        pkt_ts_now(&rx_mono); /* 用户态接收时间（没有内核时间戳时使用） */
+        pkt_ts_from_msg(&msg, &rx_ts); /* 内核接收时间戳 */
+        handle_reply(recv_buf, n, &from, &rx_ts, &rx_mono); /* 处理回复 */
     } /* 结束 while */
-} /* 结束 recv_icmp_reply */
+} /* 结束 recv_icmp_replies */
 
-/* 信号处理函数：打印统计并退出 */
+/* 信号处理函数：打印每个目标的统计并退出 */
 void signal_handler(int sig) { /* 函数开始 */
+    int i; /* 循环索引 */
+    struct target *tg; /* 当前目标 */
+
     (void)sig; /* 避免未使用参数的编译警告 */
     printf("\n--- Statistics ---\n"); /* 打印分隔线 */
+    for (i = 0; i < ntargets; i++) { /* 逐个目标输出（fping 风格） */
+        tg = &targets[i]; /* 当前目标 */
+        printf("%-24s : xmt/rcv/%%loss = %lu/%lu/%lu%%", tg->name, tg->sent, tg->recv,
+               tg->sent > 0 ? (tg->sent - tg->recv) * 100UL / tg->sent : 0UL); /* 收发与丢包率 */
+        if (tg->recv > 0) { /* 有回复才有 RTT */
+            printf(", min/avg/max/mdev = %.3f/%.3f/%.3f/%.3f ms", tg->rtt.min / 1000.0, rtt_stats_avg(&tg->rtt) / 1000.0,
+                   tg->rtt.max / 1000.0, rtt_stats_mdev(&tg->rtt) / 1000.0); /* RTT 汇总 */
+        } /* 结束 if */
+        printf("\n"); /* 换行 */
+    } /* 结束 for */
     printf("%d packets sent\n", packet_count); /* 打印已发送包数量 */
+    printf("RTT source: hw=%lu sw=%lu mono=%lu\n", rtt_src_count[TS_SRC_HARDWARE], rtt_src_count[TS_SRC_SOFTWARE],
+           rtt_src_count[TS_SRC_MONO]); /* 各次 RTT 用的时间戳来源 */
     if (sockfd >= 0) { /* 若套接字有效则关闭 */
         close(sockfd); /* 关闭套接字 */
     } /* 结束 if */
@@ -241,7 +385,7 @@ int resolve_hostname(const char *hostname, struct sockaddr_in *dest) { /* 函数
 
     he = gethostbyname(hostname); /* 调用 DNS/hosts 解析 */
     if (he == NULL) { /* 解析失败 */
-        perror("gethostbyname failed"); /* 打印错误信息 */
+        fprintf(stderr, "gethostbyname failed: %s\n", hostname); /* 打印错误信息（h_errno 不是 errno） */
         return -1; /* 返回错误 */
     } /* 结束 if */
 
@@ -252,13 +396,106 @@ int resolve_hostname(const char *hostname, struct sockaddr_in *dest) { /* 函数
     return 0; /* 成功返回 */
 } /* 结束 resolve_hostname */
 
-/* 主程序入口 */
+/* 加入一个目标；无法解析的名字跳过 */
+static void add_target(const char *name) { /* 函数开始 */
+    struct target *t; /* 扩容后的数组 */
+
+    t = (struct target *)realloc(targets, (size_t)(ntargets + 1) * sizeof(*targets)); /* 扩容一个 */
+    if (t == NULL) { /* 内存不足 */
+        fprintf(stderr, "out of memory, skipping %s\n", name); /* 提示 */
+        return; /* 跳过 */
+    } /* 结束 if */
+    targets = t; /* 更新数组 */
+    memset(&targets[ntargets], 0, sizeof(*targets)); /* 清零新目标 */
+    if (resolve_hostname(name, &targets[ntargets].addr) < 0) { /* 解析地址 */
+        return; /* 跳过该目标 */
+    } /* 结束 if */
+    strncpy(targets[ntargets].name, name, sizeof(targets[ntargets].name) - 1); /* 保存名字 */
+    ntargets++; /* 计数 */
+} /* 结束 add_target */
+
+/* 从文件读取目标，每行一个，# 开头为注释；"-" 表示标准输入；成功返回 0 */
+static int load_targets_file(const char *path) { /* 函数开始 */
+    FILE *fp; /* 文件 */
+    char line[256]; /* 一行 */
+    char *p; /* 行首 */
+    char *end; /* 行尾 */
+
+    fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r"); /* 打开文件 */
+    if (fp == NULL) { /* 打开失败 */
+        perror(path); /* 打印原因 */
+        return -1; /* 返回错误 */
+    } /* 结束 if */
+    while (fgets(line, sizeof(line), fp) != NULL) { /* 逐行读取 */
+        p = line; /* 从行首开始 */
+        while (*p == ' ' || *p == '\t') { /* 跳过前导空白 */
+            p++; /* 下一个字符 */
+        } /* 结束 while */
+        end = p; /* 找名字结尾 */
+        while (*end != '\0' && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n' && *end != '#') { /* 名字字符 */
+            end++; /* 下一个字符 */
+        } /* 结束 while */
+        *end = '\0'; /* 截断 */
+        if (*p != '\0') { /* 非空行 */
+            add_target(p); /* 加入目标 */
+        } /* 结束 if */
+    } /* 结束 while */
+    if (fp != stdin) { /* 标准输入不关闭 */
+        fclose(fp); /* 关闭文件 */
+    } /* 结束 if */
+    return 0; /* 成功返回 */
+} /* 结束 load_targets_file */
+
+/* 打印用法 */
+static void usage(const char *prog) { /* 函数开始 */
+    fprintf(stderr, "Usage: %s [-c count] [-p period_ms] [-i gap_ms] [-t timeout_ms] [-f file] [-I ifname] [-q] [-v] [host...]\n", prog); /* 用法 */
+    fprintf(stderr, "  -c  probes per target (default %d)\n", MAX_PACKETS); /* 每个目标的探测数 */
+    fprintf(stderr, "  -p  interval between probes to one target (default %d ms)\n", DEFAULT_PERIOD_MS); /* 同一目标的间隔 */
+    fprintf(stderr, "  -i  minimum gap between any two sends, i.e. the rate limit (default %d ms)\n", DEFAULT_GAP_MS); /* 全局限速 */
+    fprintf(stderr, "  -t  reply timeout (default %d ms)\n", MAX_WAIT_TIME * 1000); /* 超时 */
+    fprintf(stderr, "  -f  read targets from file, one per line (\"-\" = stdin)\n"); /* 目标文件 */
+    fprintf(stderr, "  -I  try hardware timestamps on this interface (default: kernel software timestamps)\n"); /* 硬件时间戳 */
+    fprintf(stderr, "  -q  only print the per-target summary; -v also log every send\n"); /* 输出控制 */
+    fprintf(stderr, "  without targets, %s is pinged\n", TARGET_HOST); /* 默认目标 */
+} /* 结束 usage */
+
+/* 主程序入口：单个原始套接字，按轮次交错向所有目标发送，同一个循环接收回复 */
 int main(int argc, char *argv[]) { /* main 开始 */
-    struct sockaddr_in dest_addr; /* 目的地址结构 */
+    int count = MAX_PACKETS; /* 每个目标的探测数 */
+    unsigned long period_ms = DEFAULT_PERIOD_MS; /* 同一目标的探测间隔 */
+    unsigned long gap_ms = DEFAULT_GAP_MS; /* 任意两次发送的最小间隔 */
+    unsigned long timeout_ms = MAX_WAIT_TIME * 1000UL; /* 回复超时 */
+    const char *file = NULL; /* 目标文件 */
+    const char *hw_if = NULL; /* -I：尝试硬件时间戳的网卡 */
+    unsigned long start; /* 开始时间 */
+    unsigned long now; /* 当前时间 */
+    unsigned long next_send; /* 下一次允许发送的时间 */
+    unsigned long round_start; /* 当前轮次最早开始时间 */
+    struct pollfd pfd; /* poll 描述 */
+    int rcvbuf = RCVBUF_BYTES; /* 接收缓冲大小 */
+    int round = 0; /* 当前轮次（每轮向每个目标发一个探测） */
+    int ti = 0; /* 本轮下一个目标 */
+    int wait; /* poll 超时 */
+    int opt; /* getopt 返回值 */
     int i; /* 循环索引变量 */
 
-    (void)argc; /* 未使用参数避免警告 */
-    (void)argv; /* 未使用参数避免警告 */
+    while ((opt = getopt(argc, argv, "c:p:i:t:f:I:qv")) != -1) { /* 解析选项 */
+        switch (opt) { /* 按选项处理 */
+        case 'c': count = atoi(optarg); break; /* 探测数 */
+        case 'p': period_ms = (unsigned long)atol(optarg); break; /* 同一目标间隔 */
+        case 'i': gap_ms = (unsigned long)atol(optarg); break; /* 全局间隔 */
+        case 't': timeout_ms = (unsigned long)atol(optarg); break; /* 超时 */
+        case 'f': file = optarg; break; /* 目标文件 */
+        case 'I': hw_if = optarg; break; /* 硬件时间戳网卡 */
+        case 'q': opt_quiet = 1; break; /* 安静模式 */
+        case 'v': opt_verbose = 1; break; /* 详细模式 */
+        default: usage(argv[0]); return 1; /* 未知选项 */
+        } /* 结束 switch */
+    } /* 结束 while */
+    if (count <= 0 || timeout_ms == 0) { /* 参数检查 */
+        usage(argv[0]); /* 打印用法 */
+        return 1; /* 退出 */
+    } /* 结束 if */
 
     pid = getpid(); /* 获取进程 ID 作为 ICMP id 的来源 */
 
@@ -270,23 +507,85 @@ int main(int argc, char *argv[]) { /* main 开始 */
         } /* 结束 if */
         return 1; /* 退出程序 */
     } /* 结束 if */
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)); /* 加大接收缓冲，失败不影响功能 */
+    ts_mode = pkt_ts_enable(sockfd, hw_if); /* 开启内核收发时间戳，不支持时退回单调时钟 */
 
     signal(SIGINT, signal_handler); /* 捕捉 Ctrl-C（SIGINT） */
     signal(SIGTERM, signal_handler); /* 捕捉终止信号（SIGTERM） */
 
-    if (resolve_hostname(TARGET_HOST, &dest_addr) < 0) { /* 解析目标地址 */
-        close(sockfd); /* 解析失败则关闭套接字 */
+    if (file != NULL && load_targets_file(file) < 0) { /* 读取目标文件 */
+        close(sockfd); /* 失败则关闭套接字 */
+        return 1; /* 返回错误 */
+    } /* 结束 if */
+    for (i = optind; i < argc; i++) { /* 命令行上的目标 */
+        add_target(argv[i]); /* 加入目标 */
+    } /* 结束 for */
+    if (file == NULL && optind >= argc) { /* 没有给出任何目标 */
+        add_target(TARGET_HOST); /* 使用默认目标 */
+    } /* 结束 if */
+    if (ntargets == 0) { /* 没有可用目标 */
+        fprintf(stderr, "no resolvable targets\n"); /* 提示 */
+        close(sockfd); /* 关闭套接字 */
+        return 1; /* 返回错误 */
+    } /* 结束 if */
+
+    probe_pool_init(); /* 初始化探测对象池 */
+    start = mono_ms(); /* 开始时间 */
+    if (tw_init(&wheel, WHEEL_SLOTS, WHEEL_TICK_MS, start) < 0) { /* 初始化时间轮 */
+        fprintf(stderr, "out of memory\n"); /* 提示 */
+        close(sockfd); /* 关闭套接字 */
         return 1; /* 返回错误 */
     } /* 结束 if */
 
-    printf("PING %s (%s): %d data bytes\n", TARGET_HOST, inet_ntoa(dest_addr.sin_addr), DATA_SIZE); /* 打印启动信息 */
+    if (ntargets == 1) { /* 单目标时保持原来的启动信息 */
+        printf("PING %s (%s): %d data bytes\n", targets[0].name, inet_ntoa(targets[0].addr.sin_addr), DATA_SIZE); /* 打印启动信息 */
+    } else { /* 多目标 */
+        printf("PING %d targets, %d probes each, %d data bytes\n", ntargets, count, DATA_SIZE); /* 打印启动信息 */
+    } /* 结束 if */
+    printf("timestamps: %s\n", ts_mode == TS_SRC_HARDWARE ? "hardware (software fallback)" :
+           ts_mode == TS_SRC_SOFTWARE ? "kernel software" : "CLOCK_MONOTONIC"); /* 打印时间戳方式 */
+
+    pfd.fd = sockfd; /* 只有一个套接字 */
+    pfd.events = POLLIN; /* 等待可读 */
+    next_send = start; /* 立即开始发送 */
+    round_start = start; /* 第 0 轮 */
+    while (round < count || outstanding > 0) { /* 发完且所有探测都有结果时结束 */
+        now = mono_ms(); /* 当前时间 */
+
+        /* 发送所有已到时间的探测：轮次之间间隔 period_ms，任意两次发送间隔 gap_ms */
+        while (round < count && now >= next_send) { /* 到了发送时间 */
+            if (probe_send(ti, now, timeout_ms) < 0) { /* 在途探测已满 */
+                break; /* 等回复或超时腾出位置 */
+            } /* 结束 if */
+            ti++; /* 下一个目标 */
+            if (ti == ntargets) { /* 本轮发完 */
+                ti = 0; /* 回到第一个目标 */
+                round++; /* 下一轮 */
+                round_start = start + (unsigned long)round * period_ms; /* 下一轮最早开始时间 */
+            } /* 结束 if */
+            next_send = now + gap_ms; /* 全局限速 */
+            if (next_send < round_start) { /* 新一轮还没到时间 */
+                next_send = round_start; /* 推迟到轮次开始 */
+            } /* 结束 if */
+        } /* 结束 while */
+
+        tw_advance(&wheel, now, probe_timeout, NULL); /* 处理超时的探测 */
 
-    i = 1; /* 初始化循环计数 */
-    while (i <= MAX_PACKETS) { /* 循环发送若干次 */
-        send_icmp_echo(&dest_addr, i); /* 发送 ICMP ECHO 请求 */
-        recv_icmp_reply(); /* 等待并接收回复（或超时） */
-        sleep(1); /* 等待 1 秒再发下一次 */
-        i++; /* 计数递增 */
+        wait = WHEEL_TICK_MS; /* 最长等到下一个时间轮 tick */
+        if (round < count && free_probes != NULL) { /* 还有要发的探测 */
+            if (next_send <= now) { /* 已经可以发送 */
+                wait = 0; /* 不等待 */
+            } else if (next_send - now < (unsigned long)wait) { /* 发送时间更早 */
+                wait = (int)(next_send - now); /* 等到发送时间 */
+            } /* 结束 if */
+        } /* 结束 if */
+        if (poll(&pfd, 1, wait) < 0 && errno != EINTR) { /* 等待回复 */
+            perror("poll failed"); /* 打印错误 */
+            break; /* 退出循环 */
+        } /* 结束 if */
+        if (pfd.revents & (POLLIN | POLLERR)) { /* 有回复或发送时间戳到达 */
+            recv_icmp_replies(); /* 全部取走 */
+        } /* 结束 if */
     } /* 结束 while */
 
     signal_handler(SIGINT); /* 手动调用以打印统计并退出 */
@@ -12,8 +12,32 @@
  * Notes:
  * - Fixed: replaced inet_aton -> inet_pton, usleep -> nanosleep, marked unused params.
  * - Behavior: supports both server and client modes.
+ * - "server ... [room_size [workers]]": with workers > 0 the server runs that
+ *   many receive threads on PACKET_FANOUT_HASH packet sockets bound to <ifname>,
+ *   all forwarding from the shared lock-free room table.
+ * - "-R server ...": receive through TPACKET_V3 mmap rings (pkt_ring.c), one per
+ *   worker, and forward through the matching TX rings; "-R -i <ifname> client ..."
+ *   receives through an RX ring on that interface.
+ * - Per-stream QoS counters (voice_stats.c) are dumped as JSON lines every
+ *   STATS_DUMP_MS, to stdout or with "-S <ip:port>" as UDP datagrams.
+ * - Clients play received frames out through a per-sender jitter buffer
+ *   (jitter_buf.c) on a FRAME_MS tick, starting at PLAYBACK_DELAY_MS.
+ * - "-A auto|<cpu list>" pins the receive workers (client: sender and
+ *   receiver) to CPUs via cpu_topo.c, preferring the NUMA node of <ifname>,
+ *   and allocates each worker's rings and stats from its own node.
+ * - "-B": negotiated multi-frame packets (voice_bundle.c). "client -B n"
+ *   packs up to n frames per packet once the server acknowledges; "server
+ *   -B ms" accepts them and aggregates the frames for each bundling member
+ *   into one packet within an ms latency budget. Bundle sizes follow the
+ *   loss each side reports; members without -B keep getting single frames.
+ * - Each server receive loop reads into buffers from its own pbuf pool
+ *   (buf_pool.c). Bundle queues take a reference on the buffer instead of
+ *   copying the audio, so a frame fanned out to several bundling members
+ *   shares one buffer until the last of their bundles has left.
  */
 
+#define _GNU_SOURCE  /* clock_gettime, poll */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,11 +50,26 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>      /* struct iovec */
 #include <net/if.h>
+#include <linux/filter.h>     /* classic BPF for the fanout sockets */
+#include <linux/if_ether.h>   /* ETH_P_IP */
+#include <linux/if_packet.h>  /* PACKET_FANOUT, struct sockaddr_ll */
 #include <pthread.h>
 #include <sys/time.h>
 #include <stdarg.h>
 #include <math.h>
+#include <poll.h>
+#include "jitter_buf.h"
+#include "pacer.h"
+#include "client_table.h"
+#include "pkt_ring.h"
+#include "voice_stats.h"
+#include "alog.h"
+#include "inet_csum.h"
+#include "cpu_topo.h"
+#include "voice_bundle.h"
+#include "buf_pool.h"
 
 /* -------- Configuration -------- */
 #define CUSTOM_PROTO 255          /* custom protocol in IP header */
@@ -39,8 +78,20 @@
 #define PLAYBACK_DELAY_MS 60      /* receiver buffering target */
 #define FRAME_BYTES 160           /* simulated audio bytes per frame */
 #define MAX_PACKET_SIZE 1500
-#define MAX_CLIENTS 64
+#define MAX_CLIENTS 64            /* default room size, see "server ... [room_size]" */
 #define HEARTBEAT_INTERVAL_S 10
+#define CLIENT_IDLE_MS (3UL * HEARTBEAT_INTERVAL_S * 1000UL) /* silent clients are dropped */
+#define EXPIRE_SCAN_MS 1000UL     /* how often the server looks for idle clients */
+#define MAX_WORKERS CT_MAX_READERS /* receive threads in the sharded server */
+#define WORKER_STATS_S 10         /* worker counters are logged this often */
+#define PLAYOUT_LOG_FRAMES 250    /* log playout stats every 5 s per sender */
+#define PACER_LOG_FRAMES 500      /* log send pacing stats every 10 s */
+#define MAX_SENDERS 64            /* senders a client plays out concurrently */
+#define STATS_DUMP_MS 5000UL      /* per-stream QoS counters are dumped this often */
+#define VB_HELLO_MS 1000UL        /* client: bundling offers are repeated this often */
+#define VB_ACK_TIMEOUT_MS (3UL * VB_ADAPT_MS) /* client: no ACK this long -> single frames */
+#define MAX_BUDGET_MS 100         /* server: longest -B latency budget */
+#define RX_BUF_SIZE 4096          /* server: receive buffer taken from the worker's pool */
 
 /* -------- Types (C89-friendly) -------- */
 typedef unsigned int u32;
@@ -66,12 +117,13 @@ struct priv_hdr {
 
 #define PRIV_HDR_SIZE (4 + 4 + 4 + 4 + 4) /* 20 */
 
-/* -------- Client list entry (server-side) -------- */
-struct client_entry {
+/* -------- Client: playout state per remote sender -------- */
+struct rx_sender {
     int used;
-    u32 client_id;
-    struct sockaddr_in addr;
-    u_long last_seen_ms;
+    u32 sender_id;
+    unsigned long ticks;          /* playout ticks since the last stats line */
+    unsigned long m2e_ms;         /* mouth-to-ear delay of the last played frame */
+    struct jitter_buf jb;
 };
 
 /* -------- Globals -------- */
@@ -80,8 +132,22 @@ static char g_ifname[64];
 static char g_server_ip_str[64];
 static u32 g_client_id = 0;
 static int raw_send_sock = -1; /* used for sending raw IP packets */
-static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
-static struct client_entry clients[MAX_CLIENTS];
+static struct in_addr g_server_src;     /* server address, parsed once at startup */
+static struct client_table *g_clients;  /* room membership (server-side) */
+static struct iphdr g_fwd_tmpl;         /* forward-path header template, daddr = 0 */
+static __thread unsigned short ip_id_next; /* per-thread IP id counter (rand() takes a lock) */
+static struct rx_sender senders[MAX_SENDERS];
+static int g_use_ring = 0;              /* -R: TPACKET_V3 rings instead of recvfrom */
+static int g_stats_fd = -1;             /* -S: UDP socket for the stats dumps */
+static struct sockaddr_in g_stats_addr;
+static struct vs_table client_stats;    /* client: one stream per remote sender */
+static struct cpu_topo g_topo;          /* -A: CPU placement order */
+static int g_pin = 0;                   /* -A given: pin threads */
+static int g_bundle = 0;                /* -B: client frames per packet / server budget ms, 0 = off */
+static unsigned long g_vb_acked = 0;    /* client: mono_ms of the last VB_F_ACK, 0 = none yet */
+static int g_vb_size = 1;               /* client: frames per packet chosen from the server's reports */
+static int g_vb_rx_loss = VB_LOSS_UNKNOWN; /* client: loss on what we receive, reported to the server */
+static struct vb_adapt g_vb_adapt;      /* client: receive thread only */
 
 /* -------- Utility: get current time in ms (returns unsigned long) -------- */
 static unsigned long now_ms(void)
@@ -91,31 +157,94 @@ static unsigned long now_ms(void)
     return (unsigned long)tv.tv_sec * 1000UL + (unsigned long)(tv.tv_usec / 1000);
 }
 
-/* -------- Utility: simple logging (C89-safe) -------- */
+/* -------- Utility: monotonic time in ms, for playout scheduling -------- */
+static unsigned long mono_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
+/* -------- Utility: timestamped logging --------
+   Lines go into the calling thread's alog ring and are written out by the
+   logger thread, so workers never block on stdout. */
 static void log_printf(const char *fmt, ...)
 {
     va_list ap;
-    unsigned long tms;
-    tms = now_ms();
-    printf("[%lu] ", tms);
     va_start(ap, fmt);
-    vprintf(fmt, ap);
+    alog_vprintf(ALOG_INFO | ALOG_TS, fmt, ap);
     va_end(ap);
-    printf("\n");
-    fflush(stdout);
 }
 
-/* -------- IP checksum (for header) -------- */
-static unsigned short ip_checksum(unsigned short *buf, int nwords)
+/* -------- Utility: one-way delay of a frame stamped ts_sec/ts_usec (host order), in us -------- */
+static long frame_delay_us(unsigned long ts_sec, unsigned long ts_usec)
 {
-    unsigned long sum = 0;
-    int i;
-    for (i = 0; i < nwords; i++) {
-        sum += (unsigned long)buf[i];
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((long)tv.tv_sec - (long)ts_sec) * 1000000L + ((long)tv.tv_usec - (long)ts_usec);
+}
+
+/* -------- Utility: loss percent of a stream since the previous call (prev_* are updated) -------- */
+static int loss_since(unsigned long unique, unsigned long lost,
+                      unsigned long *prev_unique, unsigned long *prev_lost)
+{
+    unsigned long got, miss;
+
+    if (unique < *prev_unique) {  /* streams expired since the last call */
+        *prev_unique = unique;
+        *prev_lost = lost;
+        return VB_LOSS_UNKNOWN;
     }
-    while (sum >> 16)
-        sum = (sum & 0xffff) + (sum >> 16);
-    return (unsigned short)(~sum);
+    got = unique - *prev_unique;
+    miss = lost >= *prev_lost ? lost - *prev_lost : 0;
+    *prev_unique = unique;
+    *prev_lost = lost;
+    if (got + miss == 0)
+        return VB_LOSS_UNKNOWN;
+    return (int)(miss * 100UL / (got + miss));
+}
+
+/* -------- Stats: dump every stream of one table as JSON lines --------
+   Called by the table's owner from its periodic timer; streams idle for
+   CLIENT_IDLE_MS are dropped first. */
+static void stats_dump(struct vs_table *t, const char *origin, int worker, unsigned long now)
+{
+    char line[1024];
+    unsigned int i;
+    int n;
+
+    vs_expire(t, now, CLIENT_IDLE_MS);
+    for (i = 0; i < t->count; i++) {
+        n = vs_format_json(&t->streams[i], origin, worker, line, sizeof(line));
+        if (n < 0)
+            continue;
+        if (g_stats_fd >= 0) {
+            sendto(g_stats_fd, line, (size_t)n, MSG_DONTWAIT,
+                   (struct sockaddr *)&g_stats_addr, sizeof(g_stats_addr));
+        } else {
+            alog_write(ALOG_INFO, line, (size_t)n);
+        }
+    }
+}
+
+/* -------- IP id: per-thread counter, started from a random point -------- */
+static unsigned short next_ip_id(void)
+{
+    if (ip_id_next == 0)
+        ip_id_next = (unsigned short)((rand() & 0xFFFF) | 1);
+    return ip_id_next++;
+}
+
+/* -------- Forward path: fill the per-server header template once -------- */
+static void init_forward_template(struct in_addr ip_src)
+{
+    memset(&g_fwd_tmpl, 0, sizeof(g_fwd_tmpl));
+    g_fwd_tmpl.ihl = sizeof(struct iphdr) / 4;
+    g_fwd_tmpl.version = 4;
+    g_fwd_tmpl.ttl = 64;
+    g_fwd_tmpl.protocol = CUSTOM_PROTO;
+    g_fwd_tmpl.saddr = ip_src.s_addr;
+    g_fwd_tmpl.daddr = 0;   /* patched per recipient */
 }
 
 /* -------- Build IP packet (header+payload) -------- */
@@ -137,7 +266,7 @@ static int build_ip_packet(unsigned char *buf,
     ip->version = 4;
     ip->tos = 0;
     ip->tot_len = htons((unsigned short)total_len);
-    ip->id = htons((unsigned short)(rand() & 0xFFFF));
+    ip->id = htons(next_ip_id());
     ip->frag_off = 0;
     ip->ttl = 64;
     ip->protocol = CUSTOM_PROTO;
@@ -148,8 +277,7 @@ static int build_ip_packet(unsigned char *buf,
     /* copy payload */
     memcpy(buf + iphdr_len, payload, payload_len);
 
-    /* compute checksum (in 16-bit words) */
-    ip->check = ip_checksum((unsigned short *)ip, ip->ihl);
+    ip->check = inet_csum(ip, (size_t)ip->ihl * 4);
 
     return total_len;
 }
@@ -170,7 +298,9 @@ static int parse_ip_packet(unsigned char *buf, int buflen,
     if (ip->protocol != CUSTOM_PROTO) return -1;
 
     ihl = ip->ihl * 4;
-    if (buflen < ihl) return -1;
+    if (ihl < (int)sizeof(struct iphdr) || buflen < ihl) return -1;
+    /* frames off the packet ring never went through the kernel's IP input checks */
+    if (inet_csum(ip, (size_t)ihl) != 0) return -1;
 
     *src_addr = *(struct in_addr *)&ip->saddr;
     *payload_ptr = buf + ihl;
@@ -208,62 +338,457 @@ static ssize_t send_raw_packet(int sock, const unsigned char *packet, int pktlen
     return sent;
 }
 
-/* -------- Server: maintain client list -------- */
-static void server_register_client(u32 client_id, struct sockaddr_in *addr)
+/* -------- Server: one receive loop (the main thread, or a worker in sharded mode) -------- */
+struct server_worker {
+    int id;
+    int recv_fd;                  /* AF_INET raw socket, or AF_PACKET fanout member */
+    int send_fd;                  /* own IP_HDRINCL socket, no sharing between workers */
+    int reader;                   /* client table reader slot */
+    int packet_sock;              /* recv_fd is AF_PACKET: skip our own outgoing copies */
+    int expire;                   /* this loop also expires idle clients */
+    struct pkt_ring *ring;        /* -R: RX/TX ring instead of recv_fd and sendmsg */
+    struct vs_table stats;        /* QoS counters of the streams this loop receives */
+    struct vb_agg *agg;           /* -B: per-destination bundle queues, NULL = off */
+    struct pbuf_pool pool;        /* receive buffers; used by this loop's thread only */
+    pthread_t tid;
+    unsigned long rx;             /* voice frames received */
+    unsigned long fwd;            /* copies forwarded */
+    unsigned long bundles;        /* multi-frame packets sent */
+};
+
+/* -------- Server: maintain client list --------
+   Known clients are found in the current snapshot without locking; only a
+   join or an address change goes through the table's writer path. */
+static void server_register_client(const struct ct_snap *snap, u32 client_id,
+                                   struct sockaddr_in *addr, const unsigned char *lladdr,
+                                   unsigned int lladdr_len, unsigned long now)
 {
-    int i;
-    pthread_mutex_lock(&clients_lock);
-    for (i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i].used && clients[i].client_id == client_id) {
-            clients[i].addr = *addr;
-            clients[i].last_seen_ms = now_ms();
-            pthread_mutex_unlock(&clients_lock);
-            return;
-        }
-    }
-    for (i = 0; i < MAX_CLIENTS; i++) {
-        if (!clients[i].used) {
-            clients[i].used = 1;
-            clients[i].client_id = client_id;
-            clients[i].addr = *addr;
-            clients[i].last_seen_ms = now_ms();
-            log_printf("Registered client id=%u addr=%s", client_id, inet_ntoa(addr->sin_addr));
-            break;
+    struct ct_entry *e;
+    int r;
+
+    e = ct_lookup(snap, (unsigned long)client_id);
+    if (e != NULL && ct_same_addr(e, addr, lladdr, lladdr_len)) {
+        ct_touch(e, now);
+        return;
+    }
+    r = ct_register(g_clients, (unsigned long)client_id, addr, lladdr, lladdr_len, now);
+    if (r == 1) {
+        log_printf("Registered client id=%u addr=%s", client_id, inet_ntoa(addr->sin_addr));
+    } else if (r == 0) {
+        log_printf("Client id=%u moved to addr=%s", client_id, inet_ntoa(addr->sin_addr));
+    } else if (e == NULL) {
+        /* room full: frames from this client are still forwarded to the room */
+        static u32 last_rejected = 0;
+        if (client_id != last_rejected)
+            log_printf("Room full, client id=%u not registered", client_id);
+        last_rejected = client_id;
+    }
+}
+
+/* -------- Server: send one copy to member c --------
+   msg carries the IP header (already addressed to c) and the payload as
+   iovecs. With a TX ring, copies to members whose next-hop MAC is known
+   are written straight into the ring behind an Ethernet header instead;
+   they leave on the worker's next pkt_ring_tx_flush(). */
+static int server_send_copy(struct server_worker *w, const struct ct_entry *c, struct msghdr *msg)
+{
+    unsigned char *frame;
+    size_t room;
+    size_t len;
+    size_t i;
+
+    if (w->ring != NULL && c->lladdr_len == 6) {
+        len = 0;
+        for (i = 0; i < msg->msg_iovlen; i++)
+            len += msg->msg_iov[i].iov_len;
+        frame = pkt_ring_tx_frame(w->ring, &room);
+        if (frame == NULL) {
+            /* ring full: push the queue out and retry once */
+            pkt_ring_tx_flush(w->ring);
+            frame = pkt_ring_tx_frame(w->ring, &room);
+        }
+        if (frame != NULL && room >= PKT_RING_ETH_HLEN + len) {
+            memcpy(frame, c->lladdr, 6);
+            memcpy(frame + 6, pkt_ring_hwaddr(w->ring), 6);
+            frame[12] = (unsigned char)(ETH_P_IP >> 8);
+            frame[13] = (unsigned char)(ETH_P_IP & 0xff);
+            len = PKT_RING_ETH_HLEN;
+            for (i = 0; i < msg->msg_iovlen; i++) {
+                memcpy(frame + len, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+                len += msg->msg_iov[i].iov_len;
+            }
+            pkt_ring_tx_commit(w->ring, len);
+            return 0;
         }
     }
-    pthread_mutex_unlock(&clients_lock);
+    ((struct sockaddr_in *)msg->msg_name)->sin_addr = c->addr.sin_addr;
+    if (sendmsg(w->send_fd, msg, 0) < 0) {
+        log_printf("Forward to %s failed: %s", inet_ntoa(c->addr.sin_addr), strerror(errno));
+        return -1;
+    }
+    return 0;
 }
 
-/* -------- Server: forward payload to all other clients -------- */
-static void server_forward_payload(unsigned char *payload, int payload_len,
-                                   const struct in_addr src_addr)
+/* -------- Server: send a bundle (or control packet) built in wr to member c;
+   referenced audio is gathered straight from the receive buffers -------- */
+static int server_send_bundle(struct server_worker *w, const struct ct_entry *c, const struct vb_writer *wr)
 {
-    unsigned char pktbuf[MAX_PACKET_SIZE];
+    struct iphdr hdr;
+    struct iovec iov[1 + VB_MAX_IOV];
+    struct msghdr msg;
+    struct sockaddr_in dst;
+
+    hdr = g_fwd_tmpl;
+    hdr.tot_len = htons((unsigned short)(sizeof(hdr) + wr->len));
+    hdr.id = htons(next_ip_id());
+    hdr.daddr = c->addr.sin_addr.s_addr;
+    hdr.check = 0;
+    hdr.check = inet_csum(&hdr, (size_t)hdr.ihl * 4);
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    memset(&msg, 0, sizeof(msg));
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+    msg.msg_name = &dst;
+    msg.msg_namelen = sizeof(dst);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 1 + (size_t)vb_iov(wr, iov + 1);
+    if (server_send_copy(w, c, &msg) < 0)
+        return -1;
+    if (wr->nframes > 0)
+        __atomic_store_n(&w->bundles, w->bundles + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* -------- Server: vb_agg_flush callback, the destination is looked up in the current snapshot -------- */
+struct flush_ctx {
+    struct server_worker *w;
+    const struct ct_snap *snap;
+};
+
+static void server_flush_queue(void *arg, struct vb_queue *q)
+{
+    struct flush_ctx *fc = (struct flush_ctx *)arg;
+    const struct ct_entry *c;
+
+    c = ct_lookup(fc->snap, q->id);
+    if (c != NULL)               /* gone from the room: its frames are dropped */
+        server_send_bundle(fc->w, c, &q->wr);
+}
+
+/* -------- Server: send the bundles whose latency budget has run out -------- */
+static void server_flush_due(struct server_worker *w, unsigned long now)
+{
+    struct flush_ctx fc;
+
+    if (w->agg == NULL || !vb_agg_due(w->agg, now))
+        return;
+    fc.w = w;
+    fc.snap = ct_read_begin(g_clients, w->reader);
+    vb_agg_flush(w->agg, now, server_flush_queue, &fc);
+    ct_read_end(g_clients, w->reader);
+}
+
+/* -------- Server: queue a frame for bundling member c; it leaves when the
+   queue reaches c's bundle size or at the end of the latency budget.
+   Returns -1 if the frame has to go out on its own -------- */
+static int server_queue_frame(struct server_worker *w, const struct ct_entry *c,
+                              const struct vb_frame *f, unsigned long now)
+{
+    struct vb_queue *q;
+    int n;
+
+    q = vb_agg_get(w->agg, c->id, now);
+    if (q == NULL)
+        return -1;
+    vb_adapt_limit(&q->adapt, __atomic_load_n(&c->bundle, __ATOMIC_RELAXED));
+    vb_adapt_update(&q->adapt, __atomic_load_n(&c->loss, __ATOMIC_RELAXED), now);
+    n = vb_queue_add(w->agg, q, f, now);
+    if (n < 0) {
+        /* full (MTU or frame count): send what is queued and start over */
+        server_send_bundle(w, c, &q->wr);
+        vb_queue_sent(w->agg, q);
+        n = vb_queue_add(w->agg, q, f, now);
+        if (n < 0)
+            return -1;
+    }
+    if (n >= q->adapt.size) {
+        server_send_bundle(w, c, &q->wr);
+        vb_queue_sent(w->agg, q);
+    }
+    return 0;
+}
+
+/* -------- Server: forward one frame to all other clients (lock-free snapshot walk) --------
+   Bundling members get it through their queue, which holds a reference on
+   the frame's receive buffer (f->buf) until the bundle is sent; sendmsg
+   and the TX ring copy synchronously, so the direct copies need none. For the others the header
+   is built and checksummed once per frame from the template with
+   daddr = 0; each copy only patches daddr and updates the checksum
+   incrementally. IP header, private header and audio go out as three
+   iovecs, so the audio is never copied. */
+static unsigned int server_forward_frame(struct server_worker *w, const struct ct_snap *snap,
+                                         const struct vb_frame *f, const struct in_addr src_addr,
+                                         unsigned long now)
+{
+    struct iphdr hdr;
+    struct priv_hdr ph;
+    unsigned short base_check;
+    struct iovec iov[3];
+    struct msghdr msg;
+    struct sockaddr_in dst;
+    const struct ct_entry *c;
+    unsigned int i;
+    unsigned int sent = 0;
+
+    ph.magic = htonl((u32)MAGIC);
+    ph.client_id = htonl((u32)f->id);
+    ph.seq = htonl((u32)f->seq);
+    ph.ts_sec = htonl((u32)f->ts_sec);
+    ph.ts_usec = htonl((u32)f->ts_usec);
+
+    hdr = g_fwd_tmpl;
+    hdr.tot_len = htons((unsigned short)(sizeof(hdr) + sizeof(ph) + f->len));
+    hdr.id = htons(next_ip_id());
+    hdr.check = 0;
+    base_check = inet_csum(&hdr, (size_t)hdr.ihl * 4);
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = &ph;
+    iov[1].iov_len = sizeof(ph);
+    iov[2].iov_base = (void *)f->data;
+    iov[2].iov_len = (size_t)f->len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &dst;
+    msg.msg_namelen = sizeof(dst);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+
+    for (i = 0; i < snap->count; i++) {
+        c = snap->members[i];
+        if (c->addr.sin_addr.s_addr == src_addr.s_addr) continue;
+
+        if (w->agg != NULL && __atomic_load_n(&c->bundle, __ATOMIC_RELAXED) > 1
+            && server_queue_frame(w, c, f, now) == 0) {
+            sent++;
+            continue;
+        }
+        hdr.daddr = c->addr.sin_addr.s_addr;
+        hdr.check = csum_update32(base_check, 0, (u32)hdr.daddr);
+        if (server_send_copy(w, c, &msg) == 0)
+            sent++;
+    }
+    return sent;
+}
+
+/* -------- Server: a bundling client's capability and loss report; answer
+   with VB_F_ACK (carrying the loss on its stream) once per VB_ADAPT_MS -------- */
+static void server_bundle_control(struct server_worker *w, const struct ct_snap *snap,
+                                  const struct vb_info *info, unsigned long now)
+{
+    struct vb_writer ack;
+    struct ct_entry *e;
+    struct vb_queue *q;
+    struct vs_stream *vs;
+    int loss = VB_LOSS_UNKNOWN;
+
+    e = ct_lookup(snap, info->origin);
+    if (e == NULL)               /* joined with this packet: handled from the next one */
+        return;
+    ct_set_bundle(e, info->accept, info->loss);
+    if (info->accept == 0)
+        return;
+    q = vb_agg_get(w->agg, e->id, now);
+    if (q == NULL || (q->fb_ms != 0 && now - q->fb_ms < VB_ADAPT_MS))
+        return;
+    vs = vs_stream_get(&w->stats, e->id);
+    if (vs != NULL)
+        loss = loss_since(vs->unique, vs_lost(vs), &q->fb_unique, &q->fb_lost);
+    if (q->fb_ms == 0)
+        log_printf("Client id=%lu bundles up to %d frames", e->id, info->accept);
+    q->fb_ms = now;
+    vb_begin(&ack, 0, VB_F_ACK, VB_MAX_FRAMES, loss);
+    server_send_bundle(w, e, &ack);
+}
+
+/* -------- Server: validate one received IP packet, register its sender and fan it out --------
+   owner is the pooled buffer buf lives in, NULL for a packet parsed in
+   place in the RX ring (bundle queues then copy its frames) */
+static void server_handle_packet(struct server_worker *w, unsigned char *buf, int len, struct pbuf *owner,
+                                 const struct sockaddr_ll *from, unsigned long now)
+{
+    struct in_addr pkt_src;
+    unsigned char *payload;
+    int payload_len;
+    struct priv_hdr ph;
+    struct vb_frame frames[VB_MAX_FRAMES];
+    struct vb_info info;
+    const struct ct_snap *snap;
+    struct sockaddr_in client_addr;
+    struct vs_stream *vs;
+    unsigned int fwd;
+    u32 magic;
+    int nframes;
     int i;
-    struct in_addr server_src;
-    if (inet_pton(AF_INET, g_server_ip_str, &server_src) != 1) {
-        log_printf("server_forward_payload: invalid server ip %s", g_server_ip_str);
+
+    if (parse_ip_packet(buf, len, &pkt_src, &payload, &payload_len) < 0) return;
+    if (payload_len < (int)sizeof(magic)) return;
+    memcpy(&magic, payload, sizeof(magic));
+    magic = ntohl(magic);
+    if (magic == MAGIC && payload_len >= (int)sizeof(struct priv_hdr)) {
+        memcpy(&ph, payload, sizeof(ph));
+        frames[0].id = ntohl(ph.client_id);
+        frames[0].seq = ntohl(ph.seq);
+        frames[0].ts_sec = ntohl(ph.ts_sec);
+        frames[0].ts_usec = ntohl(ph.ts_usec);
+        frames[0].data = payload + PRIV_HDR_SIZE;
+        frames[0].len = payload_len - PRIV_HDR_SIZE;
+        info.origin = frames[0].id;
+        nframes = 1;
+    } else if (magic == VB_MAGIC && w->agg != NULL) {
+        nframes = vb_parse(payload, payload_len, &info, frames, VB_MAX_FRAMES);
+        if (nframes < 0) return;
+    } else {
         return;
     }
+    if (pkt_src.s_addr == g_server_src.s_addr) return;  /* our own forwarded copy (loopback) */
+    /* single writer per counter; relaxed stores let the main thread read them */
+    __atomic_store_n(&w->rx, w->rx + (unsigned long)nframes, __ATOMIC_RELAXED);
+    /* FANOUT_HASH keeps a client on one worker; its stats stay thread-local */
+    for (i = 0; i < nframes; i++) {
+        frames[i].buf = owner;
+        vs = vs_stream_get(&w->stats, frames[i].id);
+        if (vs != NULL)
+            vs_record(vs, frames[i].seq, (unsigned int)(PRIV_HDR_SIZE + frames[i].len),
+                      frame_delay_us(frames[i].ts_sec, frames[i].ts_usec), now);
+    }
 
-    pthread_mutex_lock(&clients_lock);
-    for (i = 0; i < MAX_CLIENTS; i++) {
-        if (!clients[i].used) continue;
-        if (clients[i].addr.sin_addr.s_addr == src_addr.s_addr) continue;
+    /* register client and forward against one snapshot of the room */
+    snap = ct_read_begin(g_clients, w->reader);
+    memset(&client_addr, 0, sizeof(client_addr));
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_addr = pkt_src;
+    /* with a TX ring the frame's link-layer source is where copies go back to */
+    if (w->ring != NULL && from != NULL)
+        server_register_client(snap, (u32)info.origin, &client_addr,
+                               from->sll_addr, from->sll_halen, now);
+    else
+        server_register_client(snap, (u32)info.origin, &client_addr, NULL, 0, now);
+    if (magic == VB_MAGIC)
+        server_bundle_control(w, snap, &info, now);
 
-        {
-            int pktlen;
-            struct sockaddr_in dst;
-            pktlen = build_ip_packet(pktbuf, server_src, clients[i].addr.sin_addr,
-                                     payload, payload_len);
-            dst = clients[i].addr;
-            dst.sin_port = 0;
-            if (send_raw_packet(raw_send_sock, pktbuf, pktlen, &dst) < 0) {
-                log_printf("Forward to %s failed: %s", inet_ntoa(clients[i].addr.sin_addr), strerror(errno));
+    /* forward every frame (private hdr + audio) to the other clients */
+    fwd = 0;
+    for (i = 0; i < nframes; i++)
+        fwd += server_forward_frame(w, snap, &frames[i], pkt_src, now);
+    __atomic_store_n(&w->fwd, w->fwd + fwd, __ATOMIC_RELAXED);
+    ct_read_end(g_clients, w->reader);
+}
+
+/* -------- Server: pkt_ring callback, packets are parsed in place in the ring -------- */
+static void server_ring_packet(void *ctx, unsigned char *ip, int len, const struct sockaddr_ll *sll)
+{
+    server_handle_packet((struct server_worker *)ctx, ip, len, NULL, sll, now_ms());
+}
+
+/* -------- Pin the calling thread to placement slot `index` (-A); memory it
+   allocates or first touches from now on comes from that CPU's node -------- */
+static void pin_thread(int index)
+{
+    if (g_pin && cpu_topo_pin(&g_topo, index) < 0)
+        log_printf("pthread_setaffinity_np failed: %s", strerror(errno));
+}
+
+/* -------- Log which CPU/node each of the first n placement slots got -------- */
+static void log_layout(const char *what, int n)
+{
+    char buf[512];
+
+    if (!g_pin)
+        return;
+    cpu_topo_describe(&g_topo, n, buf, sizeof(buf));
+    log_printf("CPU layout: %d CPUs on %d NUMA node(s); %s -> %s", g_topo.ncpus, g_topo.nnodes, what, buf);
+}
+
+/* -------- Server: longest a receive loop blocks; with -B short enough to keep the budget -------- */
+static int worker_wait_ms(void)
+{
+    if (is_server && g_bundle > 0)
+        return (g_bundle + 1) / 2;
+    return (int)EXPIRE_SCAN_MS;
+}
+
+/* -------- Server: receive loop; returns only on a fatal socket error -------- */
+static void *server_worker_loop(void *arg)
+{
+    struct server_worker *w;
+    struct pbuf *rx = NULL;      /* reused until a bundle queue keeps a reference */
+    struct sockaddr_ll from;
+    socklen_t slen;
+    unsigned long now;
+    unsigned long last_expire;
+    unsigned long last_dump;
+    unsigned int expired;
+    int r;
+
+    w = (struct server_worker *)arg;
+    pin_thread(w->id);
+    last_expire = now_ms();
+    last_dump = last_expire;
+    for (;;) {
+        now = now_ms();
+        if (w->expire && now - last_expire >= EXPIRE_SCAN_MS) {
+            expired = ct_expire(g_clients, now, CLIENT_IDLE_MS);
+            if (expired > 0)
+                log_printf("Expired %u idle client(s)", expired);
+            last_expire = now;
+        }
+        if (now - last_dump >= STATS_DUMP_MS) {
+            stats_dump(&w->stats, "server", w->id, now);
+            if (w->agg != NULL)
+                vb_agg_expire(w->agg, now, CLIENT_IDLE_MS);
+            last_dump = now;
+        }
+
+        if (w->ring != NULL) {
+            /* one batch per ready block; its forwarded copies leave in one send() */
+            if (pkt_ring_poll(w->ring, worker_wait_ms(), server_ring_packet, w) < 0) {
+                log_printf("worker %d ring poll error: %s", w->id, strerror(errno));
+                return NULL;
             }
+            server_flush_due(w, now_ms());
+            if (pkt_ring_tx_flush(w->ring) < 0)
+                log_printf("worker %d ring send error: %s", w->id, strerror(errno));
+            continue;
+        }
+
+        server_flush_due(w, now);
+        if (rx == NULL && (rx = pbuf_get(&w->pool, RX_BUF_SIZE)) == NULL) {
+            log_printf("worker %d: out of receive buffers", w->id);
+            return NULL;
+        }
+        slen = sizeof(from);
+        r = recvfrom(w->recv_fd, rx->data, RX_BUF_SIZE, 0, (struct sockaddr *)&from, &slen);
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            continue;
+        if (r <= 0) {
+            log_printf("worker %d recvfrom error: %s", w->id, strerror(errno));
+            continue;
+        }
+        /* a packet socket also sees the frames we forward, and other hosts' traffic */
+        if (w->packet_sock && (from.sll_pkttype == PACKET_OUTGOING || from.sll_pkttype == PACKET_OTHERHOST))
+            continue;
+        server_handle_packet(w, rx->data, r, rx, w->packet_sock ? &from : NULL, now_ms());
+        if (rx->refs > 1) {      /* queued frames point into it: take a fresh one next time */
+            pbuf_put(rx);
+            rx = NULL;
         }
     }
-    pthread_mutex_unlock(&clients_lock);
+    return NULL;
 }
 
 /* -------- Client: sending thread arg -------- */
@@ -272,17 +797,51 @@ struct send_thread_arg {
     int recv_sock; /* not used by sender but kept for compatibility */
 };
 
-/* -------- Client: sending thread (uses nanosleep instead of usleep) -------- */
+/* -------- Client: wrap payload in an IP header and send it to the server -------- */
+static void client_send_payload(struct send_thread_arg *sarg, struct in_addr src_addr,
+                                const unsigned char *payload, int len)
+{
+    unsigned char pktbuf[MAX_PACKET_SIZE];
+    int pktlen;
+
+    pktlen = build_ip_packet(pktbuf, src_addr, sarg->server_addr.sin_addr, payload, len);
+    if (send_raw_packet(raw_send_sock, pktbuf, pktlen, &sarg->server_addr) < 0) {
+        log_printf("client send failed: %s", strerror(errno));
+    }
+}
+
+/* -------- Client: the server acknowledged bundling recently enough -------- */
+static int client_bundling(unsigned long now)
+{
+    unsigned long acked;
+
+    if (g_bundle == 0)
+        return 0;
+    acked = __atomic_load_n(&g_vb_acked, __ATOMIC_ACQUIRE);
+    return acked != 0 && now - acked < VB_ACK_TIMEOUT_MS;
+}
+
+/* -------- Client: sending thread, one frame per FRAME_MS on an absolute-deadline pacer --------
+   With -B the frames are collected into bundles of the size the receive
+   thread picked from the server's loss reports, once the server has
+   answered our VB_F_HELLO; until then (and whenever its ACKs stop) every
+   frame goes out on its own. */
 static void *client_send_thread(void *arg)
 {
     struct send_thread_arg *sarg;
     unsigned int seq;
     unsigned char payload[PRIV_HDR_SIZE + FRAME_BYTES];
-    unsigned char pktbuf[MAX_PACKET_SIZE];
     struct in_addr src_addr;
+    struct pacer pacer;
+    struct vb_writer bundle;
+    struct vb_frame f;
+    unsigned long now;
+    unsigned long last_hello = 0;
     int tmp;
     sarg = (struct send_thread_arg *)arg;
     seq = 0;
+    pin_thread(0);
+    vb_begin(&bundle, g_client_id, 0, g_bundle, VB_LOSS_UNKNOWN);
 
     /* determine local source IP by connecting a UDP socket to server (non-raw) */
     tmp = socket(AF_INET, SOCK_DGRAM, 0);
@@ -309,8 +868,15 @@ static void *client_send_thread(void *arg)
         inet_pton(AF_INET, "0.0.0.0", &src_addr);
     }
 
+    pacer_init(&pacer, FRAME_MS);
     for (;;) {
-        sleep(FRAME_MS / 1000);
+        /* skipped deadlines still consume sequence numbers, so receivers
+           see them as losses rather than as a timing shift */
+        seq += (unsigned int)pacer_wait(&pacer);
+        if (pacer.frames % PACER_LOG_FRAMES == 0) {
+            log_printf("Pacer: frames=%lu late=%lu missed=%lu max_late=%.2fms",
+                       pacer.frames, pacer.late, pacer.missed, (double)pacer.max_late_ns / 1e6);
+        }
 
         /* build private header */
         {
@@ -318,6 +884,13 @@ static void *client_send_thread(void *arg)
             struct timeval tv;
             int i;
             gettimeofday(&tv, NULL);
+            f.id = g_client_id;
+            f.seq = seq;
+            f.ts_sec = (unsigned long)tv.tv_sec;
+            f.ts_usec = (unsigned long)tv.tv_usec;
+            f.data = payload + PRIV_HDR_SIZE;
+            f.len = FRAME_BYTES;
+            f.buf = NULL;
             ph.magic = htonl((u32)MAGIC);
             ph.client_id = htonl((u32)g_client_id);
             ph.seq = htonl((u32)seq++);
@@ -333,33 +906,187 @@ static void *client_send_thread(void *arg)
             }
         }
 
-        {
-            int pktlen;
-            pktlen = build_ip_packet(pktbuf, src_addr, sarg->server_addr.sin_addr,
-                                     payload, PRIV_HDR_SIZE + FRAME_BYTES);
-            if (send_raw_packet(raw_send_sock, pktbuf, pktlen, &sarg->server_addr) < 0) {
-                log_printf("client send failed: %s", strerror(errno));
+        now = mono_ms();
+        if (client_bundling(now)) {
+            if (vb_add(&bundle, &f) < 0) {
+                client_send_payload(sarg, src_addr, bundle.buf, (int)bundle.len);
+                vb_begin(&bundle, g_client_id, 0, g_bundle, __atomic_load_n(&g_vb_rx_loss, __ATOMIC_RELAXED));
+                vb_add(&bundle, &f);
+            }
+            if (bundle.nframes >= __atomic_load_n(&g_vb_size, __ATOMIC_RELAXED)) {
+                client_send_payload(sarg, src_addr, bundle.buf, (int)bundle.len);
+                vb_begin(&bundle, g_client_id, 0, g_bundle, __atomic_load_n(&g_vb_rx_loss, __ATOMIC_RELAXED));
             }
+            continue;
+        }
+        if (bundle.nframes > 0) {
+            /* the server stopped answering: what is queued goes first */
+            client_send_payload(sarg, src_addr, bundle.buf, (int)bundle.len);
+            vb_begin(&bundle, g_client_id, 0, g_bundle, VB_LOSS_UNKNOWN);
+        }
+        client_send_payload(sarg, src_addr, payload, PRIV_HDR_SIZE + FRAME_BYTES);
+        if (g_bundle > 0 && (last_hello == 0 || now - last_hello >= VB_HELLO_MS)) {
+            struct vb_writer hello;
+            vb_begin(&hello, g_client_id, VB_F_HELLO, g_bundle, __atomic_load_n(&g_vb_rx_loss, __ATOMIC_RELAXED));
+            client_send_payload(sarg, src_addr, hello.buf, (int)hello.len);
+            last_hello = now;
         }
     }
     /* not reached */
     return NULL;
 }
 
-/* -------- Open raw sockets helper (returns recv_fd for recv; sets raw_send_sock for sending) --------
-   For server: returns a recv socket bound to protocol CUSTOM_PROTO, sets raw_send_sock to IPPROTO_RAW send socket.
-   For client: same behavior.
-*/
-static int open_raw_socket_and_bind(const char *ifname, int is_server_mode)
+/* -------- Client: look up (or create) the playout state of a sender -------- */
+static struct rx_sender *client_find_sender(u32 sender_id)
+{
+    int i;
+    int free_slot = -1;
+    for (i = 0; i < MAX_SENDERS; i++) {
+        if (senders[i].used && senders[i].sender_id == sender_id)
+            return &senders[i];
+        if (!senders[i].used && free_slot < 0)
+            free_slot = i;
+    }
+    if (free_slot < 0)
+        return NULL;
+    senders[free_slot].used = 1;
+    senders[free_slot].sender_id = sender_id;
+    senders[free_slot].ticks = 0;
+    senders[free_slot].m2e_ms = 0;
+    jb_init(&senders[free_slot].jb, FRAME_MS, PLAYBACK_DELAY_MS);
+    log_printf("New sender id=%u, playout delay %d ms", (unsigned int)sender_id, PLAYBACK_DELAY_MS);
+    return &senders[free_slot];
+}
+
+/* -------- Client: queue one received frame in its sender's jitter buffer -------- */
+static void client_handle_frame(const struct vb_frame *f)
+{
+    unsigned long ts_ms;
+    struct rx_sender *rs;
+    struct vs_stream *vs;
+
+    vs = vs_stream_get(&client_stats, f->id);
+    if (vs != NULL)
+        vs_record(vs, f->seq, (unsigned int)(PRIV_HDR_SIZE + f->len),
+                  frame_delay_us(f->ts_sec, f->ts_usec), now_ms());
+
+    ts_ms = f->ts_sec * 1000UL + f->ts_usec / 1000UL;
+    rs = client_find_sender((u32)f->id);
+    if (rs == NULL)
+        return;
+    jb_put(&rs->jb, f->seq, ts_ms, mono_ms(), f->data, f->len);
+}
+
+/* -------- Client: the server's VB_F_ACK; pick the bundle size from the loss
+   it saw on our stream, and report ours on what we receive -------- */
+static void client_bundle_ack(const struct vb_info *info)
+{
+    static unsigned long prev_unique = 0, prev_lost = 0;
+    unsigned long unique = 0, lost = 0;
+    unsigned long now = mono_ms();
+    unsigned int i;
+    int old_size = g_vb_adapt.size;
+    int size;
+
+    if (!client_bundling(now)) {
+        vb_adapt_init(&g_vb_adapt, g_bundle < info->accept ? g_bundle : info->accept);
+        old_size = 0;
+        log_printf("Server accepts bundles of up to %d frames", info->accept);
+    }
+    size = vb_adapt_update(&g_vb_adapt, info->loss, now);
+    if (size != old_size)
+        log_printf("Bundling %d frame(s) per packet (uplink loss %d%%)", size, info->loss);
+    __atomic_store_n(&g_vb_size, size, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_vb_acked, now, __ATOMIC_RELEASE);
+
+    for (i = 0; i < client_stats.count; i++) {
+        unique += client_stats.streams[i].unique;
+        lost += vs_lost(&client_stats.streams[i]);
+    }
+    __atomic_store_n(&g_vb_rx_loss, loss_since(unique, lost, &prev_unique, &prev_lost), __ATOMIC_RELAXED);
+}
+
+/* -------- Client: one received packet, a single frame or a bundle -------- */
+static void client_handle_packet(unsigned char *buf, int len)
+{
+    struct in_addr pkt_src;
+    unsigned char *payload;
+    int payload_len;
+    struct priv_hdr ph;
+    struct vb_frame frames[VB_MAX_FRAMES];
+    struct vb_info info;
+    u32 magic;
+    int n;
+    int i;
+
+    if (parse_ip_packet(buf, len, &pkt_src, &payload, &payload_len) < 0) return;
+    if (payload_len < (int)sizeof(magic)) return;
+    memcpy(&magic, payload, sizeof(magic));
+    magic = ntohl(magic);
+    if (magic == MAGIC && payload_len >= (int)sizeof(struct priv_hdr)) {
+        memcpy(&ph, payload, sizeof(ph));
+        frames[0].id = ntohl(ph.client_id);
+        frames[0].seq = ntohl(ph.seq);
+        frames[0].ts_sec = ntohl(ph.ts_sec);
+        frames[0].ts_usec = ntohl(ph.ts_usec);
+        frames[0].data = payload + PRIV_HDR_SIZE;
+        frames[0].len = payload_len - PRIV_HDR_SIZE;
+        client_handle_frame(&frames[0]);
+    } else if (magic == VB_MAGIC && g_bundle > 0) {
+        n = vb_parse(payload, payload_len, &info, frames, VB_MAX_FRAMES);
+        if (n < 0) return;
+        if (info.flags & VB_F_ACK)
+            client_bundle_ack(&info);
+        for (i = 0; i < n; i++)
+            client_handle_frame(&frames[i]);
+    }
+}
+
+/* -------- Client: pkt_ring callback -------- */
+static void client_ring_packet(void *ctx, unsigned char *ip, int len, const struct sockaddr_ll *sll)
+{
+    (void)ctx;
+    (void)sll;
+    client_handle_packet(ip, len);
+}
+
+/* -------- Client: one FRAME_MS playout tick for every sender -------- */
+static void client_playout_tick(unsigned long now)
+{
+    unsigned char frame[JB_FRAME_MAX];
+    unsigned long send_ts;
+    const struct jb_stats *st;
+    struct rx_sender *rs;
+    int len;
+    int i;
+
+    for (i = 0; i < MAX_SENDERS; i++) {
+        rs = &senders[i];
+        if (!rs->used)
+            continue;
+        /* In prototype: "play" is a no-op; a lost frame would be concealed
+           and a stall would play silence */
+        if (jb_get(&rs->jb, now, frame, &len, &send_ts) == JB_PLAY)
+            rs->m2e_ms = now_ms() - send_ts;
+
+        if (++rs->ticks >= PLAYOUT_LOG_FRAMES) {
+            st = &rs->jb.stats;
+            log_printf("Playout %u: played=%lu lost=%lu late=%lu dup=%lu dropped=%lu stalled=%lu "
+                       "jitter=%.1fms target=%.0fms buffered=%ldms m2e=%lums",
+                       (unsigned int)rs->sender_id, st->played, st->lost, st->late, st->duplicate,
+                       st->dropped, st->stalled, rs->jb.jitter_ms, rs->jb.target_ms,
+                       jb_level_ms(&rs->jb), rs->m2e_ms);
+            rs->ticks = 0;
+        }
+    }
+}
+
+/* -------- Open an IP_HDRINCL send socket -------- */
+static int open_raw_send_socket(void)
 {
     int ssend;
-    int srecv;
     int on;
 
-    /* Mark unused parameters to avoid warnings when not used */
-    (void)ifname;
-    (void)is_server_mode;
-
     ssend = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
     if (ssend < 0) {
         log_printf("socket(AF_INET, SOCK_RAW, IPPROTO_RAW) failed: %s", strerror(errno));
@@ -371,6 +1098,74 @@ static int open_raw_socket_and_bind(const char *ifname, int is_server_mode)
         close(ssend);
         return -1;
     }
+    return ssend;
+}
+
+/* -------- Open one member of a PACKET_FANOUT group on ifindex --------
+   Raw AF_INET sockets each get a copy of every packet, so they cannot share
+   the load; packet sockets in a fanout group split it instead. FANOUT_HASH
+   hashes on the flow (source/destination address), so all frames of a client
+   land on the same worker. A classic BPF filter keeps everything but
+   CUSTOM_PROTO out of userspace. */
+static int open_fanout_socket(int ifindex, int fanout_id)
+{
+    static struct sock_filter code[] = {
+        { BPF_LD | BPF_B | BPF_ABS, 0, 0, 9 },            /* A = ip->protocol */
+        { BPF_JMP | BPF_JEQ | BPF_K, 0, 1, CUSTOM_PROTO },
+        { BPF_RET | BPF_K, 0, 0, 0xffff },                /* accept */
+        { BPF_RET | BPF_K, 0, 0, 0 }                      /* drop */
+    };
+    struct sock_fprog prog;
+    struct sockaddr_ll sll;
+    int fd;
+    int arg;
+
+    fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (fd < 0) {
+        log_printf("socket(AF_PACKET) failed: %s", strerror(errno));
+        return -1;
+    }
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        log_printf("SO_ATTACH_FILTER failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifindex;
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        log_printf("bind(AF_PACKET) failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    arg = (fanout_id & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+        log_printf("PACKET_FANOUT failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* -------- Open raw sockets helper (returns recv_fd for recv; sets raw_send_sock for sending) --------
+   For server: returns a recv socket bound to protocol CUSTOM_PROTO, sets raw_send_sock to IPPROTO_RAW send socket.
+   For client: same behavior.
+*/
+static int open_raw_socket_and_bind(const char *ifname, int is_server_mode)
+{
+    int ssend;
+    int srecv;
+
+    /* Mark unused parameters to avoid warnings when not used */
+    (void)ifname;
+    (void)is_server_mode;
+
+    ssend = open_raw_send_socket();
+    if (ssend < 0)
+        return -1;
 
     srecv = socket(AF_INET, SOCK_RAW, CUSTOM_PROTO);
     if (srecv < 0) {
@@ -386,29 +1181,129 @@ static int open_raw_socket_and_bind(const char *ifname, int is_server_mode)
     return srecv;
 }
 
+/* -------- Stats: "-S ip:port" opens the UDP socket the dumps go to -------- */
+static int open_stats_socket(const char *spec)
+{
+    char host[64];
+    const char *colon;
+
+    colon = strrchr(spec, ':');
+    if (colon == NULL || colon == spec || (size_t)(colon - spec) >= sizeof(host))
+        return -1;
+    memcpy(host, spec, (size_t)(colon - spec));
+    host[colon - spec] = '\0';
+    memset(&g_stats_addr, 0, sizeof(g_stats_addr));
+    g_stats_addr.sin_family = AF_INET;
+    g_stats_addr.sin_port = htons((unsigned short)atoi(colon + 1));
+    if (inet_pton(AF_INET, host, &g_stats_addr.sin_addr) != 1 || g_stats_addr.sin_port == 0)
+        return -1;
+    g_stats_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    return g_stats_fd < 0 ? -1 : 0;
+}
+
+/* -------- Server: -B gives every receive loop its own bundle queues -------- */
+static int open_bundle_queues(struct server_worker *w, int room_size)
+{
+    if (g_bundle == 0)
+        return 0;
+    w->agg = (struct vb_agg *)malloc(sizeof(*w->agg));
+    if (w->agg == NULL || vb_agg_init(w->agg, (unsigned int)room_size, (unsigned int)g_bundle) < 0) {
+        free(w->agg);
+        w->agg = NULL;
+        return -1;
+    }
+    return 0;
+}
+
 /* -------- Main -------- */
 int main(int argc, char **argv)
 {
+    const char *ring_if = NULL;
+    const char *cpus = NULL;
+    int opt;
+
+    /* log lines leave through the alog writer thread, not one write per line */
+    alog_init(STDOUT_FILENO, STDERR_FILENO);
+
+    /* "+": options come before the mode, positional arguments are left alone */
+    while ((opt = getopt(argc, argv, "+Ri:S:A:B:")) != -1) {
+        switch (opt) {
+        case 'R':
+            g_use_ring = 1;
+            break;
+        case 'i':
+            ring_if = optarg;
+            break;
+        case 'S':
+            if (open_stats_socket(optarg) < 0) {
+                fprintf(stderr, "invalid stats address (want ip:port): %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'A':
+            cpus = optarg;
+            break;
+        case 'B':
+            g_bundle = atoi(optarg);
+            break;
+        default:
+            argc = 0;
+            break;
+        }
+    }
+    if (argc > 0) {
+        argv[optind - 1] = argv[0];
+        argv += optind - 1;
+        argc -= optind - 1;
+    }
     if (argc < 2) {
-        printf("Usage:\n  %s server <ifname> <server_ip>\n  %s client <server_ip> <client_id>\n", argv[0], argv[0]);
+        printf("Usage:\n  %s [-R] [-S ip:port] [-A cpus] [-B ms] server <ifname> <server_ip> [room_size [workers]]\n"
+               "  %s [-R -i <ifname>] [-S ip:port] [-A cpus] [-B n] client <server_ip> <client_id>\n", argv[0], argv[0]);
+        printf("  -R  receive (and on the server also forward) through TPACKET_V3 mmap rings\n");
+        printf("  -S  send the per-stream JSON stats to this UDP address instead of stdout\n");
+        printf("  -A  pin threads to CPUs with node-local memory: \"auto\" or a list like 0-3,8\n");
+        printf("  -B  multi-frame packets: server accepts them and bundles within ms (1-%d);\n"
+               "      client offers to send up to n frames per packet (2-%d)\n", MAX_BUDGET_MS, VB_MAX_FRAMES);
         return 1;
     }
+    if (cpus != NULL) {
+        if (cpu_topo_init(&g_topo, cpus) < 0) {
+            fprintf(stderr, "invalid or unavailable CPU list: %s\n", cpus);
+            return 1;
+        }
+        g_pin = 1;
+    }
     srand((unsigned int)(time(NULL) ^ getpid()));
 
     if (strcmp(argv[1], "server") == 0) {
         int recv_fd;
-        unsigned char rxbuf[4096];
-        struct sockaddr_in src_sock;
-        socklen_t slen;
-        int r;
-        struct in_addr pkt_src;
-        unsigned char *payload;
-        int payload_len;
-        struct priv_hdr ph;
-        int cid;
+        int room_size;
+        int nworkers;
+        int ifindex;
+        int i;
+        int small;
+        struct timeval rcv_timeout;
+        struct server_worker single;
+        struct server_worker *workers;
+        unsigned long elapsed;
+        unsigned int expired;
 
         if (argc < 4) {
-            fprintf(stderr, "server usage: %s server <ifname> <server_ip>\n", argv[0]);
+            fprintf(stderr, "server usage: %s server <ifname> <server_ip> [room_size [workers]]\n", argv[0]);
+            return 1;
+        }
+        room_size = argc > 4 ? atoi(argv[4]) : MAX_CLIENTS;
+        if (room_size <= 0) {
+            fprintf(stderr, "invalid room size: %s\n", argv[4]);
+            return 1;
+        }
+        nworkers = argc > 5 ? atoi(argv[5]) : 0;
+        if (nworkers < 0 || nworkers > MAX_WORKERS) {
+            fprintf(stderr, "workers must be between 0 and %d\n", MAX_WORKERS);
+            return 1;
+        }
+        if (g_bundle < 0 || g_bundle > MAX_BUDGET_MS) {
+            fprintf(stderr, "bundling budget must be between 1 and %d ms\n", MAX_BUDGET_MS);
             return 1;
         }
         is_server = 1;
@@ -416,6 +1311,19 @@ int main(int argc, char **argv)
         g_ifname[sizeof(g_ifname)-1] = '\0';
         strncpy(g_server_ip_str, argv[3], sizeof(g_server_ip_str)-1);
         g_server_ip_str[sizeof(g_server_ip_str)-1] = '\0';
+        if (inet_pton(AF_INET, g_server_ip_str, &g_server_src) != 1) {
+            log_printf("Invalid server ip %s", g_server_ip_str);
+            return 1;
+        }
+        init_forward_template(g_server_src);
+        /* workers go to the NIC's node first: its RX queues and DMA buffers live there */
+        if (g_pin)
+            cpu_topo_prefer_node(&g_topo, cpu_topo_netdev_node(g_ifname));
+        g_clients = ct_create((unsigned int)room_size);
+        if (g_clients == NULL) {
+            log_printf("Server: failed to create client table");
+            return 1;
+        }
 
         recv_fd = open_raw_socket_and_bind(g_ifname, 1);
         if (recv_fd < 0) {
@@ -423,32 +1331,113 @@ int main(int argc, char **argv)
             return 1;
         }
 
-        log_printf("Server started on interface=%s ip=%s", g_ifname, g_server_ip_str);
+        if (g_use_ring) {
+            /* the rings replace the raw socket for receiving; keep it open only
+               so the kernel does not answer with ICMP protocol-unreachable */
+            small = 1;
+            setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        }
 
-        for (;;) {
-            slen = sizeof(src_sock);
-            r = recvfrom(recv_fd, rxbuf, sizeof(rxbuf), 0, (struct sockaddr *)&src_sock, &slen);
-            if (r <= 0) {
-                log_printf("server recvfrom error: %s", strerror(errno));
-                continue;
+        if (nworkers == 0) {
+            /* single receive loop on the raw AF_INET socket; it also expires clients,
+               so wake up periodically even when the room is silent */
+            rcv_timeout.tv_sec = worker_wait_ms() / 1000;
+            rcv_timeout.tv_usec = (worker_wait_ms() % 1000) * 1000L;
+            setsockopt(recv_fd, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout));
+            memset(&single, 0, sizeof(single));
+            single.recv_fd = recv_fd;
+            single.send_fd = raw_send_sock;
+            single.reader = ct_reader_register(g_clients);
+            single.expire = 1;
+            if (vs_init(&single.stats, (unsigned int)room_size) < 0 || open_bundle_queues(&single, room_size) < 0
+                || pbuf_pool_init(&single.pool, 0) < 0) {
+                log_printf("Server: out of memory");
+                return 1;
+            }
+            if (g_use_ring) {
+                single.ring = pkt_ring_open(g_ifname, CUSTOM_PROTO, -1, 1);
+                if (single.ring == NULL) {
+                    log_printf("Server: failed to open packet ring on %s: %s", g_ifname, strerror(errno));
+                    return 1;
+                }
+            }
+            log_printf("Server started on interface=%s ip=%s room_size=%d%s bundle_ms=%d", g_ifname, g_server_ip_str,
+                       room_size, g_use_ring ? " rings=1" : "", g_bundle);
+            log_layout("receive loop", 1);
+            server_worker_loop(&single);
+            return 1;
+        }
+
+        /* sharded mode: the raw AF_INET socket stays open only so the kernel does
+           not answer CUSTOM_PROTO with ICMP protocol-unreachable; the workers'
+           packet sockets do the receiving */
+        small = 1;
+        setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        ifindex = (int)if_nametoindex(g_ifname);
+        if (ifindex == 0) {
+            log_printf("Unknown interface %s", g_ifname);
+            return 1;
+        }
+        workers = (struct server_worker *)calloc((size_t)nworkers, sizeof(*workers));
+        if (workers == NULL) {
+            log_printf("Server: out of memory");
+            return 1;
+        }
+        for (i = 0; i < nworkers; i++) {
+            /* the ring blocks and stats are allocated here, on the worker's node */
+            if (g_pin)
+                cpu_topo_mem_node(&g_topo, g_topo.node[i % g_topo.ncpus]);
+            workers[i].id = i;
+            workers[i].packet_sock = 1;
+            workers[i].reader = ct_reader_register(g_clients);
+            if (g_use_ring) {
+                /* each worker's ring joins the same fanout group */
+                workers[i].ring = pkt_ring_open(g_ifname, CUSTOM_PROTO, (int)getpid(), 1);
+                if (workers[i].ring == NULL)
+                    log_printf("Server: packet ring for worker %d: %s", i, strerror(errno));
+                workers[i].recv_fd = -1;
+            } else {
+                workers[i].recv_fd = open_fanout_socket(ifindex, (int)getpid());
+                /* wake up for the stats dumps even when no frames arrive */
+                rcv_timeout.tv_sec = worker_wait_ms() / 1000;
+                rcv_timeout.tv_usec = (worker_wait_ms() % 1000) * 1000L;
+                if (workers[i].recv_fd >= 0)
+                    setsockopt(workers[i].recv_fd, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout));
+            }
+            workers[i].send_fd = open_raw_send_socket();
+            if (workers[i].reader < 0 || workers[i].send_fd < 0 || vs_init(&workers[i].stats, (unsigned int)room_size) < 0
+                || open_bundle_queues(&workers[i], room_size) < 0 || pbuf_pool_init(&workers[i].pool, 0) < 0
+                || (g_use_ring ? workers[i].ring == NULL : workers[i].recv_fd < 0)) {
+                log_printf("Server: failed to set up worker %d", i);
+                return 1;
             }
-            if (parse_ip_packet(rxbuf, r, &pkt_src, &payload, &payload_len) < 0) continue;
-            if (payload_len < (int)sizeof(struct priv_hdr)) continue;
-            memcpy(&ph, payload, sizeof(ph));
-            if (ntohl((u32)ph.magic) != MAGIC) continue;
-            cid = ntohl(ph.client_id);
-
-            /* register client */
-            {
-                struct sockaddr_in client_addr;
-                memset(&client_addr, 0, sizeof(client_addr));
-                client_addr.sin_family = AF_INET;
-                client_addr.sin_addr = pkt_src;
-                server_register_client((u32)cid, &client_addr);
+        }
+        if (g_pin)
+            cpu_topo_mem_node(&g_topo, -1);
+        for (i = 0; i < nworkers; i++) {
+            if (pthread_create(&workers[i].tid, NULL, server_worker_loop, &workers[i]) != 0) {
+                log_printf("pthread_create worker %d failed", i);
+                return 1;
             }
+        }
+        log_printf("Server started on interface=%s ip=%s room_size=%d workers=%d%s bundle_ms=%d",
+                   g_ifname, g_server_ip_str, room_size, nworkers, g_use_ring ? " rings=1" : "", g_bundle);
+        log_layout("workers", nworkers);
 
-            /* forward payload (private hdr + audio) to other clients */
-            server_forward_payload(payload, payload_len, pkt_src);
+        /* the main thread only does housekeeping: expiry and per-worker counters */
+        for (elapsed = 1; ; elapsed++) {
+            sleep(EXPIRE_SCAN_MS / 1000);
+            expired = ct_expire(g_clients, now_ms(), CLIENT_IDLE_MS);
+            if (expired > 0)
+                log_printf("Expired %u idle client(s)", expired);
+            if (elapsed % WORKER_STATS_S == 0) {
+                for (i = 0; i < nworkers; i++) {
+                    log_printf("Worker %d: rx=%lu fwd=%lu bundles=%lu", i,
+                               __atomic_load_n(&workers[i].rx, __ATOMIC_RELAXED),
+                               __atomic_load_n(&workers[i].fwd, __ATOMIC_RELAXED),
+                               __atomic_load_n(&workers[i].bundles, __ATOMIC_RELAXED));
+                }
+            }
         }
 
     } else if (strcmp(argv[1], "client") == 0) {
@@ -460,23 +1449,24 @@ int main(int argc, char **argv)
         struct sockaddr_in src_sock;
         socklen_t slen;
         int r;
-        struct in_addr pkt_src;
-        unsigned char *payload;
-        int payload_len;
-        struct priv_hdr ph;
-        u32 sender_id;
-        u32 seq;
-        unsigned long ts_ms;
-        u32 secs;
-        u32 usec;
+        struct pkt_ring *ring = NULL;
+        struct pollfd pfd;
+        unsigned long now;
+        unsigned long next_tick;
+        unsigned long last_dump;
+        int timeout;
 
-        if (argc < 4) {
-            fprintf(stderr, "client usage: %s client <server_ip> <client_id>\n", argv[0]);
+        if (argc < 4 || (g_use_ring && ring_if == NULL)) {
+            fprintf(stderr, "client usage: %s [-R -i <ifname>] client <server_ip> <client_id>\n", argv[0]);
             return 1;
         }
         strncpy(g_server_ip_str, argv[2], sizeof(g_server_ip_str)-1);
         g_server_ip_str[sizeof(g_server_ip_str)-1] = '\0';
         g_client_id = (u32)atoi(argv[3]);
+        if (g_bundle == 1 || g_bundle < 0 || g_bundle > VB_MAX_FRAMES) {
+            fprintf(stderr, "frames per packet must be between 2 and %d\n", VB_MAX_FRAMES);
+            return 1;
+        }
 
         recv_fd = open_raw_socket_and_bind(NULL, 0);
         if (recv_fd < 0) {
@@ -491,6 +1481,18 @@ int main(int argc, char **argv)
             return 1;
         }
 
+        if (g_use_ring) {
+            /* receive-only ring; the raw socket stays open so the kernel does
+               not answer with ICMP protocol-unreachable */
+            ring = pkt_ring_open(ring_if, CUSTOM_PROTO, -1, 0);
+            if (ring == NULL) {
+                log_printf("Client: failed to open packet ring on %s: %s", ring_if, strerror(errno));
+                return 1;
+            }
+            r = 1;
+            setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &r, sizeof(r));
+        }
+
         sarg.server_addr = server_addr;
         sarg.recv_sock = recv_fd;
 
@@ -499,29 +1501,59 @@ int main(int argc, char **argv)
             return 1;
         }
         pthread_detach(send_tid);
+        pin_thread(1);            /* receive and playout on the next CPU */
+        log_layout("sender, receiver", 2);
 
+        /* Receive frames into the jitter buffers and play them out on a
+           fixed FRAME_MS tick, instead of dropping them as they arrive */
+        if (vs_init(&client_stats, MAX_SENDERS) < 0) {
+            log_printf("Client: out of memory");
+            return 1;
+        }
+        pfd.fd = recv_fd;
+        pfd.events = POLLIN;
+        next_tick = mono_ms() + FRAME_MS;
+        last_dump = now_ms();
         for (;;) {
-            slen = sizeof(src_sock);
-            r = recvfrom(recv_fd, rxbuf, sizeof(rxbuf), 0, (struct sockaddr *)&src_sock, &slen);
-            if (r <= 0) {
-                log_printf("client recvfrom error: %s", strerror(errno));
-                continue;
+            now = mono_ms();
+            timeout = next_tick > now ? (int)(next_tick - now) : 0;
+            if (ring != NULL) {
+                if (pkt_ring_poll(ring, timeout, client_ring_packet, NULL) < 0) {
+                    log_printf("client ring poll error: %s", strerror(errno));
+                    return 1;
+                }
+                pfd.revents = 0;
+            } else if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+                log_printf("client poll error: %s", strerror(errno));
+                return 1;
             }
-            if (parse_ip_packet(rxbuf, r, &pkt_src, &payload, &payload_len) < 0) continue;
-            if (payload_len < (int)sizeof(struct priv_hdr)) continue;
-            memcpy(&ph, payload, sizeof(ph));
-            if (ntohl((u32)ph.magic) != MAGIC) continue;
-
-            sender_id = ntohl(ph.client_id);
-            seq = ntohl(ph.seq);
-            secs = ntohl(ph.ts_sec);
-            usec = ntohl(ph.ts_usec);
-            ts_ms = (unsigned long)secs * 1000UL + (unsigned long)(usec / 1000);
-            if ((seq % 50) == 0) {
-                unsigned long delay = now_ms() - ts_ms;
-                log_printf("RX from %u seq=%u delay=%lu ms", (unsigned int)sender_id, (unsigned int)seq, delay);
+            while ((pfd.revents & POLLIN) != 0) {
+                slen = sizeof(src_sock);
+                r = recvfrom(recv_fd, rxbuf, sizeof(rxbuf), MSG_DONTWAIT, (struct sockaddr *)&src_sock, &slen);
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                if (r <= 0) {
+                    log_printf("client recvfrom error: %s", strerror(errno));
+                    break;
+                }
+                client_handle_packet(rxbuf, r);
+            }
+
+            /* play every tick that is due; after a long stall resync
+               rather than bursting through the backlog */
+            now = mono_ms();
+            if (now > next_tick + (unsigned long)(JB_SLOTS * FRAME_MS))
+                next_tick = now;
+            while (next_tick <= now) {
+                client_playout_tick(next_tick);
+                next_tick += FRAME_MS;
+            }
+
+            now = now_ms();
+            if (now - last_dump >= STATS_DUMP_MS) {
+                stats_dump(&client_stats, "client", 0, now);
+                last_dump = now;
             }
-            /* In prototype: "play" is a no-op (drop) or log */
         }
     } else {
         fprintf(stderr, "Unknown mode: %s\n", argv[1]);
@@ -1,51 +1,170 @@
+#define _GNU_SOURCE /* getopt under -std=c89 */
+
 #include <stdio.h>      /* printf */
 #include <stdlib.h>     /* exit */
 #include <string.h>     /* memset */
-#include <unistd.h>     /* close */
+#include <unistd.h>     /* close, getopt */
+#include <errno.h>      /* errno */
 #include <sys/types.h>  /* socket */
 #include <sys/socket.h> /* socket */
 #include <netinet/in.h> /* sockaddr_in */
 #include <arpa/inet.h>  /* inet_addr */
+#include "conn_pool.h"  /* pipelined persistent TCP connections */
 
 #define TCP_PORT 80   /* TCP port */
 #define UDP_PORT 53   /* UDP port */
 #define BUF_SIZE 1024 /* buffer size */
 
-int main()
+struct echo_stats
+{
+    unsigned long ok;     /* echoes received */
+    unsigned long failed; /* requests lost with their connection */
+    int quiet;            /* -q: count only */
+};
+
+/* Completion callback: print one echo */
+static void on_echo(void *ctx, unsigned long tag, int status, const char *resp, size_t len)
+{
+    struct echo_stats *st = (struct echo_stats *)ctx; /* counters */
+
+    if (status != 0)
+    {
+        st->failed++;
+        fprintf(stderr, "TCP request %lu: %s\n", tag, strerror(status));
+        return;
+    }
+    st->ok++;
+    if (!st->quiet)
+        printf("TCP echo: %.*s\n", (int)len, resp); /* print */
+}
+
+/* Send every line of f over the pool, keeping the pipelines full, until a
+   request fails; 0 if all echoed */
+static int tcp_batch(struct conn_pool *pool, FILE *f, struct echo_stats *st)
+{
+    char buf[BUF_SIZE];      /* one line */
+    unsigned long tag = 0;   /* line number */
+    int failed = 0;          /* could not submit */
+
+    while (!failed && st->failed == 0 && fgets(buf, BUF_SIZE, f) != NULL)
+    {
+        buf[strcspn(buf, "\r\n")] = '\0'; /* strip newline */
+        if (buf[0] == '\0')
+            continue;
+        tag++;
+        while (cp_submit(pool, buf, strlen(buf), tag) != 0) /* queue, copied */
+        {
+            if (errno != EAGAIN || (cp_poll(pool, -1, on_echo, st) < 0 && errno != EINTR))
+            {
+                perror("tcp submit");
+                failed = 1;
+                break;
+            }
+        }
+    }
+    while (cp_inflight(pool) > 0) /* collect the rest */
+    {
+        if (cp_poll(pool, -1, on_echo, st) < 0 && errno != EINTR)
+        {
+            perror("tcp poll");
+            return 1;
+        }
+    }
+    fprintf(stderr, "TCP: %lu sent, %lu echoed, %lu failed\n", tag, st->ok, st->failed);
+    return failed || st->ok != tag;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-b file|-] [-c conns] [-d depth] [-q]\n"
+                    "  -b  send every line of file (- for stdin) over TCP instead of one greeting\n"
+                    "  -c  persistent TCP connections (default 1)\n"
+                    "  -d  requests in flight per connection (default 8)\n"
+                    "  -q  do not print the TCP echoes\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
 {
-    int tcp_fd;              /* TCP socket */
     int udp_fd;              /* UDP socket */
     struct sockaddr_in addr; /* server addr */
+    struct cp_config cfg;    /* TCP pool settings */
+    struct conn_pool *pool;  /* TCP connections */
+    struct echo_stats st;    /* TCP results */
+    const char *batch = NULL; /* -b input */
+    FILE *f;                 /* batch input */
     char buf[BUF_SIZE];      /* buffer */
     int ret;                 /* return value */
+    int status = 0;          /* exit status */
+    int opt;                 /* getopt */
 
-    tcp_fd = socket(AF_INET, SOCK_STREAM, 0); /* create TCP socket */
-    if (tcp_fd < 0)
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&st, 0, sizeof(st));
+    cfg.proto = CP_ECHO;  /* the server echoes bytes back unchanged */
+    cfg.conns = 1;
+    cfg.depth = 8;
+    cfg.nodelay = 1;
+    while ((opt = getopt(argc, argv, "b:c:d:qh")) != -1)
     {
-        perror("socket tcp");
-        exit(1);
+        switch (opt)
+        {
+        case 'b':
+            batch = optarg;
+            break;
+        case 'c':
+            cfg.conns = atoi(optarg);
+            break;
+        case 'd':
+            cfg.depth = atoi(optarg);
+            break;
+        case 'q':
+            st.quiet = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
     }
+    if (cfg.conns <= 0 || cfg.depth <= 0)
+        usage(argv[0]);
 
-    memset(&addr, 0, sizeof(addr));                /* clear */
-    addr.sin_family = AF_INET;                     /* IPv4 */
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1"); /* server addr */
-    addr.sin_port = htons(TCP_PORT);               /* port */
+    cfg.addr.sin_family = AF_INET;                     /* IPv4 */
+    cfg.addr.sin_addr.s_addr = inet_addr("127.0.0.1"); /* server addr */
+    cfg.addr.sin_port = htons(TCP_PORT);               /* port */
 
-    if (connect(tcp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    pool = cp_create(&cfg); /* connects on first use */
+    if (pool == NULL)
     {
-        perror("connect");
+        perror("tcp pool");
         exit(1);
     }
 
-    strcpy(buf, "Hello via TCP");    /* message */
-    write(tcp_fd, buf, strlen(buf)); /* send */
-
-    memset(buf, 0, BUF_SIZE);              /* clear */
-    ret = read(tcp_fd, buf, BUF_SIZE - 1); /* recv */
-    if (ret > 0)
-        printf("TCP echo: %s\n", buf); /* print */
+    if (batch != NULL)
+    {
+        f = strcmp(batch, "-") == 0 ? stdin : fopen(batch, "r");
+        if (f == NULL)
+        {
+            perror(batch);
+            exit(1);
+        }
+        status = tcp_batch(pool, f, &st);
+        if (f != stdin)
+            fclose(f);
+    }
+    else
+    {
+        strcpy(buf, "Hello via TCP");                 /* message */
+        if (cp_submit(pool, buf, strlen(buf), 1) < 0) /* send */
+        {
+            perror("connect");
+            exit(1);
+        }
+        while (cp_inflight(pool) > 0 && cp_poll(pool, -1, on_echo, &st) >= 0) /* recv */
+            ;
+        if (st.failed > 0)
+            exit(1);
+    }
 
-    close(tcp_fd); /* close tcp */
+    cp_destroy(pool); /* close tcp */
 
     udp_fd = socket(AF_INET, SOCK_DGRAM, 0); /* create udp */
     if (udp_fd < 0)
@@ -69,5 +188,5 @@ int main()
 
     close(udp_fd); /* close */
 
-    return 0; /* end */
+    return status; /* end */
 }
@@ -1,119 +1,343 @@
+#define _GNU_SOURCE /* accept4 and friends under -std=c89 */
+
 #include <stdio.h>      /* printf */
 #include <stdlib.h>     /* exit */
 #include <string.h>     /* memset */
 #include <unistd.h>     /* close */
+#include <errno.h>      /* errno */
+#include <fcntl.h>      /* fcntl, O_NONBLOCK */
 #include <sys/types.h>  /* socket types */
 #include <sys/socket.h> /* socket */
 #include <netinet/in.h> /* sockaddr_in */
+#include <netinet/tcp.h> /* TCP_FASTOPEN */
 #include <arpa/inet.h>  /* inet_addr */
-#include <sys/select.h>
+#include "poller.h"     /* epoll / poll / select backends */
+#include "udp_batch.h"  /* recvmmsg / sendmmsg batches */
+#include "buf_pool.h"   /* connection slab and echo buffers */
 
 #define TCP_PORT 80   /* TCP server port */
 #define UDP_PORT 53   /* UDP server port */
-#define BUF_SIZE 1024 /* buffer size */
 
-int main()
+#define MAX_EVENTS 64         /* events handled per poller_wait */
+#define UDP_BATCH 32          /* datagrams per wakeup before giving TCP a turn */
+#define OUT_MAX (16 * 1024)   /* per-connection echo backlog; reading pauses when full */
+
+/* State of one accepted TCP connection */
+struct client
 {
-    int tcp_fd;                 /* TCP listening socket */
-    int udp_fd;                 /* UDP socket */
-    int maxfd;                  /* max fd for select */
-    fd_set rfds;                /* read fd set */
-    struct sockaddr_in addr;    /* generic address */
-    struct sockaddr_in cliaddr; /* client address */
-    socklen_t cliaddr_len;      /* length of client address */
-    int conn_fd;                /* TCP connection fd */
-    int ret;                    /* return value */
-    char buf[BUF_SIZE];         /* buffer */
+    int fd;                   /* non-blocking connection socket */
+    struct pbuf *out;         /* data received but not yet echoed back; NULL while idle */
+    size_t out_off;           /* first unsent byte in out */
+    int eof;                  /* peer closed its side; close once out is drained */
+    char addr[INET_ADDRSTRLEN]; /* peer address for logging */
+};
 
-    tcp_fd = socket(AF_INET, SOCK_STREAM, 0); /* create TCP socket */
-    if (tcp_fd < 0)
+static struct poller *g_poller; /* the multiplexing core */
+static struct slab g_clients;   /* struct client objects, reused without malloc */
+static struct pbuf_pool g_bufs; /* echo backlogs: received into and sent from the same buffer */
+static int tcp_fd = -1;         /* TCP listening socket */
+static int udp_fd = -1;         /* UDP socket */
+static struct udp_batch g_udp;  /* preallocated UDP receive/transmit ring */
+
+/* Put fd into non-blocking mode; 0 on success */
+static int set_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0); /* current flags */
+    if (flags < 0)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* Create a non-blocking socket of the given type bound to 127.0.0.1:port */
+static int make_socket(int type, unsigned short port)
+{
+    struct sockaddr_in addr; /* local address */
+    int reuse = 1;           /* SO_REUSEADDR value */
+    int tfo_qlen = 256;      /* TCP_FASTOPEN: pending fast-open handshakes */
+    int fd;
+
+    fd = socket(AF_INET, type, 0); /* create socket */
+    if (fd < 0)
     {
-        perror("socket tcp");
+        perror(type == SOCK_STREAM ? "socket tcp" : "socket udp");
         exit(1);
     }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); /* quick restarts */
 
     memset(&addr, 0, sizeof(addr));                /* clear address */
     addr.sin_family = AF_INET;                     /* IPv4 */
     addr.sin_addr.s_addr = inet_addr("127.0.0.1"); /* loopback */
-    addr.sin_port = htons(TCP_PORT);               /* port 80 */
+    addr.sin_port = htons(port);                   /* port */
 
-    if (bind(tcp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
     {
-        perror("bind tcp");
+        perror(type == SOCK_STREAM ? "bind tcp" : "bind udp");
         exit(1);
     }
-
-    if (listen(tcp_fd, 5) < 0)
+#ifdef TCP_FASTOPEN
+    if (type == SOCK_STREAM) /* accept data on the SYN; ignored unless the sysctl allows it */
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &tfo_qlen, sizeof(tfo_qlen));
+#endif
+    if (type == SOCK_STREAM && listen(fd, SOMAXCONN) < 0)
     {
         perror("listen");
         exit(1);
     }
-
-    udp_fd = socket(AF_INET, SOCK_DGRAM, 0); /* create UDP socket */
-    if (udp_fd < 0)
+    if (set_nonblock(fd) < 0)
     {
-        perror("socket udp");
+        perror("fcntl");
         exit(1);
     }
+    return fd;
+}
 
-    memset(&addr, 0, sizeof(addr));                /* reinit for UDP */
-    addr.sin_family = AF_INET;                     /* IPv4 */
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1"); /* loopback */
-    addr.sin_port = htons(UDP_PORT);               /* port 53 */
+/* Interest mask for a client: read while there is room, write while data is pending */
+static unsigned int client_interest(const struct client *c)
+{
+    unsigned int ev = 0;
+    if (!c->eof && (c->out == NULL || c->out->len < OUT_MAX))
+        ev |= POLLER_IN;
+    if (c->out != NULL && c->out_off < c->out->len)
+        ev |= POLLER_OUT;
+    return ev;
+}
+
+static void client_close(struct client *c)
+{
+    poller_del(g_poller, c->fd); /* unregister before close */
+    close(c->fd);                /* close connection */
+    pbuf_put(c->out);
+    slab_free(&g_clients, c);
+}
 
-    if (bind(udp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+/* Write as much of the backlog as the socket takes; -1 on error */
+static int client_flush(struct client *c)
+{
+    ssize_t n;
+    while (c->out != NULL && c->out_off < c->out->len)
     {
-        perror("bind udp");
-        exit(1);
+        n = send(c->fd, c->out->data + c->out_off, c->out->len - c->out_off, MSG_NOSIGNAL); /* echo back */
+        if (n > 0)
+        {
+            c->out_off += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0; /* socket full: wait for POLLER_OUT */
+        return -1;
     }
+    pbuf_put(c->out); /* drained: idle connections hold no buffer */
+    c->out = NULL;
+    c->out_off = 0;
+    return 0;
+}
 
-    printf("Server started: TCP on 127.0.0.1:80, UDP on 127.0.0.1:53\n");
+/* Read until EAGAIN or the backlog is full; -1 on error */
+static int client_read(struct client *c)
+{
+    ssize_t n;
+    while (!c->eof)
+    {
+        if (c->out == NULL)
+        { /* first data since the last drain: take a backlog buffer */
+            c->out = pbuf_get(&g_bufs, OUT_MAX);
+            if (c->out == NULL)
+            {
+                errno = ENOMEM;
+                return -1;
+            }
+            c->out_off = 0;
+        }
+        if (c->out->len >= OUT_MAX)
+            break;
+        n = recv(c->fd, c->out->data + c->out->len, OUT_MAX - c->out->len, 0); /* read */
+        if (n > 0)
+        {
+            printf("TCP received from %s: %.*s\n", c->addr, (int)n, (char *)c->out->data + c->out->len); /* print */
+            c->out->len += (size_t)n;
+            continue;
+        }
+        if (n == 0)
+        {
+            c->eof = 1; /* finish echoing, then close */
+            break;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        return -1;
+    }
+    return 0;
+}
 
-    for (;;)
-    {                          /* infinite loop */
-        FD_ZERO(&rfds);        /* clear fd set */
-        FD_SET(tcp_fd, &rfds); /* watch TCP listen */
-        FD_SET(udp_fd, &rfds); /* watch UDP */
+/* Service one client event: read, echo, then re-arm or close */
+static void client_event(struct client *c, unsigned int events)
+{
+    if ((events & POLLER_IN) || (events & POLLER_ERR))
+    {
+        if (client_read(c) < 0)
+        {
+            perror("recv");
+            client_close(c);
+            return;
+        }
+    }
+    if (client_flush(c) < 0)
+    {
+        if (errno != EPIPE && errno != ECONNRESET)
+            perror("send");
+        client_close(c);
+        return;
+    }
+    if (c->eof && c->out == NULL)
+    {
+        client_close(c);
+        return;
+    }
+    if (c->out != NULL && c->out_off > 0 && c->out->len == OUT_MAX)
+    { /* compact so reading can resume */
+        memmove(c->out->data, c->out->data + c->out_off, c->out->len - c->out_off);
+        c->out->len -= c->out_off;
+        c->out_off = 0;
+    }
+    poller_mod(g_poller, c->fd, client_interest(c), c);
+}
 
-        maxfd = tcp_fd > udp_fd ? tcp_fd : udp_fd; /* find max for select */
+/* Accept every pending connection and register it non-blocking */
+static void handle_accept(void)
+{
+    struct sockaddr_in cliaddr; /* client address */
+    socklen_t cliaddr_len;      /* length of client address */
+    struct client *c;
+    int conn_fd;
 
-        ret = select(maxfd + 1, &rfds, NULL, NULL, NULL); /* blocking select */
-        if (ret < 0)
+    for (;;)
+    {
+        cliaddr_len = sizeof(cliaddr);
+        conn_fd = accept4(tcp_fd, (struct sockaddr *)&cliaddr, &cliaddr_len, SOCK_NONBLOCK); /* accept */
+        if (conn_fd < 0)
         {
-            perror("select");
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept");
+            return;
+        }
+        c = (struct client *)slab_alloc(&g_clients);
+        if (c == NULL)
+        {
+            close(conn_fd);
             continue;
         }
+        c->fd = conn_fd;
+        c->out = NULL;
+        c->out_off = 0;
+        c->eof = 0;
+        inet_ntop(AF_INET, &cliaddr.sin_addr, c->addr, sizeof(c->addr));
+        if (poller_add(g_poller, conn_fd, POLLER_IN, c) < 0)
+        {
+            perror("poller_add");
+            close(conn_fd);
+            slab_free(&g_clients, c);
+        }
+    }
+}
 
-        if (FD_ISSET(tcp_fd, &rfds))
-        {                                                                        /* new TCP connection */
-            cliaddr_len = sizeof(cliaddr);                                       /* length */
-            conn_fd = accept(tcp_fd, (struct sockaddr *)&cliaddr, &cliaddr_len); /* accept */
-            if (conn_fd < 0)
-            {
-                perror("accept");
-                continue;
-            }
+/* Echo one recvmmsg batch with one sendmmsg; never blocks, so TCP clients are not starved */
+static void handle_udp(void)
+{
+    const struct sockaddr *peer; /* sender */
+    socklen_t peer_len;          /* sender address length */
+    const char *data;            /* received payload */
+    size_t len;                  /* payload length */
+    size_t seg;                  /* GRO segment size, 0 for a single datagram */
+    size_t off;
+    char *slot;
+    int n;
+    int i;
 
-            memset(buf, 0, BUF_SIZE);               /* clear buffer */
-            ret = read(conn_fd, buf, BUF_SIZE - 1); /* read */
-            if (ret > 0)
-            {
-                printf("TCP received: %s\n", buf); /* print */
-                write(conn_fd, buf, ret);          /* echo back */
-            }
-            close(conn_fd); /* close connection */
+    n = udp_batch_recv(&g_udp, udp_fd, MSG_DONTWAIT); /* up to UDP_BATCH datagrams */
+    if (n < 0)
+    {
+        perror("recvmmsg");
+        return;
+    }
+    for (i = 0; i < n; i++)
+    {
+        data = udp_batch_data(&g_udp, i, &len, &seg);
+        peer = udp_batch_peer(&g_udp, i, &peer_len);
+        for (off = 0; off < len; off += seg ? seg : len)
+        { /* a GRO buffer holds several datagrams */
+            size_t plen = seg && len - off > seg ? seg : len - off;
+            printf("UDP received: %.*s\n", (int)plen, data + off); /* print */
         }
+        slot = udp_batch_slot(&g_udp);
+        memcpy(slot, data, len);
+        udp_batch_commit(&g_udp, len, peer, peer_len, seg); /* GSO splits it back up */
+    }
+    if (udp_batch_flush(&g_udp, udp_fd, 1) < 0) /* a full send buffer drops echoes rather than stalling */
+        perror("sendmmsg");
+}
 
-        if (FD_ISSET(udp_fd, &rfds))
-        {                                                                                            /* UDP message */
-            cliaddr_len = sizeof(cliaddr);                                                           /* length */
-            memset(buf, 0, BUF_SIZE);                                                                /* clear */
-            ret = recvfrom(udp_fd, buf, BUF_SIZE - 1, 0, (struct sockaddr *)&cliaddr, &cliaddr_len); /* receive */
-            if (ret > 0)
-            {
-                printf("UDP received: %s\n", buf);                                     /* print */
-                sendto(udp_fd, buf, ret, 0, (struct sockaddr *)&cliaddr, cliaddr_len); /* echo */
-            }
+int main(int argc, char *argv[])
+{
+    enum poller_backend backend = POLLER_AUTO; /* requested backend */
+    struct poller_event evs[MAX_EVENTS];       /* ready descriptors */
+    int n;                                     /* number of events */
+    int i;
+
+    if (argc > 2 || (argc == 2 && poller_parse_backend(argv[1], &backend) != 0))
+    {
+        fprintf(stderr, "Usage: %s [auto|epoll|poll|select]\n", argv[0]);
+        exit(1);
+    }
+
+    g_poller = poller_create(backend); /* multiplexing core */
+    if (g_poller == NULL)
+    {
+        perror("poller_create");
+        exit(1);
+    }
+    slab_init(&g_clients, sizeof(struct client), 0, 0); /* grows on demand */
+    pbuf_pool_init(&g_bufs, 0);
+
+    tcp_fd = make_socket(SOCK_STREAM, TCP_PORT); /* TCP listener */
+    udp_fd = make_socket(SOCK_DGRAM, UDP_PORT);  /* UDP socket */
+    if (udp_batch_init(&g_udp, UDP_BATCH, UDP_BATCH_GRO_BUF) < 0)
+    {
+        perror("udp_batch_init");
+        exit(1);
+    }
+    udp_batch_offload(&g_udp, udp_fd); /* GRO/GSO where the kernel has them */
+    if (poller_add(g_poller, tcp_fd, POLLER_IN, NULL) < 0 || poller_add(g_poller, udp_fd, POLLER_IN, NULL) < 0)
+    {
+        perror("poller_add");
+        exit(1);
+    }
+
+    printf("Server started (%s): TCP on 127.0.0.1:80, UDP on 127.0.0.1:53\n", poller_name(g_poller));
+
+    for (;;)
+    { /* infinite loop */
+        fflush(stdout);
+        n = poller_wait(g_poller, evs, MAX_EVENTS, -1); /* blocking wait */
+        if (n < 0)
+        {
+            if (errno != EINTR)
+                perror("poller_wait");
+            continue;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (evs[i].fd == tcp_fd)
+                handle_accept(); /* new TCP connections */
+            else if (evs[i].fd == udp_fd)
+                handle_udp(); /* UDP messages */
+            else
+                client_event((struct client *)evs[i].data, evs[i].events); /* TCP data */
         }
     }
     return 0; /* never reached */
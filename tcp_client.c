@@ -1,12 +1,16 @@
+#define _GNU_SOURCE  /* getopt、clock_gettime 声明 */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include "safeio.h"
+#include "conn_pool.h"
 
 #define BUFFER_SIZE 1024
 #define SERVER_PORT 8080
@@ -18,36 +22,168 @@ void prepare_packet(const char* input, char* packet, int packet_size) {
     snprintf(packet, packet_size, "[Client] %s", input);
 }
 
-int main() {
-    int sockfd;
-    struct sockaddr_in server_addr;
+/* 完成回调的统计与输出选项 */
+struct client_stats {
+    unsigned long ok;
+    unsigned long failed;
+    int quiet;                   /* -q：只统计不打印响应 */
+    int batch;                   /* 批量模式：响应前打印请求序号 */
+};
+
+static void on_done(void *ctx, unsigned long tag, int status, const char *resp, size_t len) {
+    struct client_stats *st = (struct client_stats *)ctx;
+
+    if (status != 0) {
+        st->failed++;
+        if (status == EPIPE) fprintf(stderr, "Request %lu: server closed the connection\n", tag);
+        else fprintf(stderr, "Request %lu failed: %s\n", tag, strerror(status));
+        return;
+    }
+    st->ok++;
+    if (st->quiet) return;
+    if (st->batch) printf("%lu: %.*s\n", tag, (int)len, resp);
+    else printf("Server response %lu: %.*s\n", tag, (int)len, resp);
+}
+
+/* 提交一个请求；所有连接都已挂满时先收取响应腾出位置。成功返回 0 */
+static int submit(struct conn_pool *pool, const char *msg, unsigned long tag, struct client_stats *st) {
+    while (cp_submit(pool, msg, strlen(msg), tag) != 0) {
+        if (errno != EAGAIN) {
+            perror("submit failed");
+            return -1;
+        }
+        if (cp_poll(pool, -1, on_done, st) < 0 && errno != EINTR) {
+            perror("poll failed");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* 收取所有挂起请求的响应 */
+static void drain(struct conn_pool *pool, struct client_stats *st) {
+    while (cp_inflight(pool) > 0) {
+        if (cp_poll(pool, -1, on_done, st) < 0 && errno != EINTR) {
+            perror("poll failed");
+            return;
+        }
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* 批量模式：每行一条消息，各重复 repeat 次，尽量填满所有连接的流水线；
+ * 出现失败的请求（服务器不可达或断开）后不再读取新的输入 */
+static int run_batch(struct conn_pool *pool, FILE *f, int repeat, struct client_stats *st) {
     char buffer[BUFFER_SIZE];
     char packet[BUFFER_SIZE];
-    ssize_t recv_len;
-    int ret;
+    unsigned long tag = 0;
+    double t0, t;
+    int i;
+
+    t0 = now_sec();
+    while (st->failed == 0 && fgets(buffer, BUFFER_SIZE, f) != NULL) {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if (strlen(buffer) == 0) continue;
+        prepare_packet(buffer, packet, BUFFER_SIZE);
+        for (i = 0; i < repeat; i++) {
+            if (submit(pool, packet, ++tag, st) != 0) break;
+        }
+        if (i < repeat) break;
+    }
+    drain(pool, st);
+    t = now_sec() - t0;
 
-    /* 创建TCP套接字 */
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        perror("socket creation failed");
-        exit(EXIT_FAILURE);
+    fprintf(stderr, "%lu requests: %lu ok, %lu failed in %.3f s (%.0f req/s)\n",
+            tag, st->ok, st->failed, t, t > 0 ? (double)st->ok / t : 0.0);
+    return st->failed == 0 && tag == st->ok ? 0 : 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-f] [-n count] [-b file|-] [-c conns] [-d depth] [-q] [-F] [-H host] [-p port]\n",
+            prog);
+    fprintf(stderr, "  -f  framed protocol (server must run with -f too)\n"
+                    "  -n  send each message count times\n"
+                    "  -b  batch mode: send every line of file (- for stdin), print a summary\n"
+                    "  -c  keep up to conns persistent connections (default 1)\n");
+    fprintf(stderr, "  -d  with -f, requests in flight per connection (default: count)\n"
+                    "  -q  batch mode: do not print responses\n"
+                    "  -F  TCP Fast Open: send the first requests with the SYN\n"
+                    "  -H  server address (default %s), -p server port (default %d)\n",
+            SERVER_IP, SERVER_PORT);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    struct cp_config cfg;
+    struct conn_pool *pool;
+    struct client_stats st;
+    char buffer[BUFFER_SIZE];
+    char packet[BUFFER_SIZE];
+    const char *host = SERVER_IP;
+    const char *batch = NULL;    /* -b：批量输入文件 */
+    FILE *f;
+    int port = SERVER_PORT;
+    int repeat = 1;              /* -n：每条消息发送的次数 */
+    int opt;
+    int ret = 0;
+    int i;
+
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&st, 0, sizeof(st));
+    cfg.proto = CP_RAW;
+    cfg.conns = 1;
+    cfg.nodelay = 1;
+    while ((opt = getopt(argc, argv, "fn:b:c:d:qFH:p:h")) != -1) {
+        switch (opt) {
+        case 'f': cfg.proto = CP_FRAMED; break;
+        case 'n': repeat = atoi(optarg); if (repeat <= 0) usage(argv[0]); break;
+        case 'b': batch = optarg; break;
+        case 'c': cfg.conns = atoi(optarg); if (cfg.conns <= 0) usage(argv[0]); break;
+        case 'd': cfg.depth = atoi(optarg); if (cfg.depth <= 0) usage(argv[0]); break;
+        case 'q': st.quiet = 1; break;
+        case 'F': cfg.fastopen = 1; break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
     }
+    if (cfg.depth == 0) cfg.depth = repeat;  /* 默认一轮的 count 条消息一次发出 */
 
     /* 设置服务器地址结构 */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
-
-    /* 连接到服务器 */
-    ret = connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    if (ret < 0) {
-        perror("connect failed");
-        close(sockfd);
+    cfg.addr.sin_family = AF_INET;
+    cfg.addr.sin_port = htons((unsigned short)port);
+    if (inet_pton(AF_INET, host, &cfg.addr.sin_addr) <= 0) {
+        fprintf(stderr, "Bad server address: %s\n", host);
         exit(EXIT_FAILURE);
     }
 
-    printf("Connected to TCP server %s:%d\n", SERVER_IP, SERVER_PORT);
+    /* 连接在第一次提交时建立，之后所有消息复用 */
+    pool = cp_create(&cfg);
+    if (pool == NULL) {
+        perror("cp_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch != NULL) {
+        f = strcmp(batch, "-") == 0 ? stdin : fopen(batch, "r");
+        if (f == NULL) {
+            perror(batch);
+            cp_destroy(pool);
+            exit(EXIT_FAILURE);
+        }
+        st.batch = 1;
+        ret = run_batch(pool, f, repeat, &st);
+        if (f != stdin) fclose(f);
+        cp_destroy(pool);
+        return ret;
+    }
+
+    printf("Using TCP server %s:%d\n", host, port);
     printf("Enter messages to send (type 'exit' to quit):\n");
 
     /* 主循环：读取用户输入并发送 */
@@ -57,8 +193,8 @@ int main() {
 
         /* 读取用户输入 */
         printf("Client> ");
+        fflush(stdout);
         if (fgets(buffer, BUFFER_SIZE, stdin) == NULL) {
-            perror("fgets failed");
             break;
         }
 
@@ -79,33 +215,17 @@ int main() {
         /* 封装数据包 */
         prepare_packet(buffer, packet, BUFFER_SIZE);
 
-        /* 发送TCP数据包到服务器 */
-        ret = send(sockfd, packet, strlen(packet), 0);
-        if (ret < 0) {
-            perror("send failed");
-            break;
-        }
-
-        printf("Message sent: %s\n", packet);
-
-        /* 接收服务器响应 */
-        memset(buffer, 0, BUFFER_SIZE);
-        recv_len = recv(sockfd, buffer, BUFFER_SIZE - 1, 0);
-        if (recv_len < 0) {
-            perror("recv failed");
-            break;
-        } else if (recv_len == 0) {
-            printf("Server closed the connection\n");
-            break;
+        /* 同一连接上流水线发送，响应按提交顺序编号；
+         * 连接若被服务器关闭，下一条消息会重新连接 */
+        printf("Sending %d time(s): %s\n", repeat, packet);
+        for (i = 0; i < repeat; i++) {
+            if (submit(pool, packet, (unsigned long)i + 1, &st) != 0) break;
         }
-
-        /* 确保字符串以null结尾 */
-        buffer[recv_len] = '\0';
-        printf("Server response: %s\n", buffer);
+        drain(pool, &st);
     }
 
-    /* 关闭套接字 */
-    close(sockfd);
+    /* 关闭连接 */
+    cp_destroy(pool);
     printf("Disconnected from server\n");
     return 0;
 }
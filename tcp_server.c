@@ -1,43 +1,167 @@
+#define _GNU_SOURCE  /* getopt、accept4 等声明 */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "safeio.h"
+#include "poller.h"
+#include "uring.h"
+#include "frame.h"
+#include "ascii_xform.h"
+#include "buf_pool.h"
+#include "alog.h"
 
 #define BUFFER_SIZE 1024
 #define SERVER_PORT 8080
+#define TFO_QLEN 256          /* 尚未完成握手的 TFO 连接上限 */
 #define MAX_PENDING 5
+#define MAX_WORKERS 256      /* 预派生进程数上限 */
+#define MAX_EVENTS 64        /* 每次 poller_wait 处理的事件数 */
+#define OUT_CAP (16 * BUFFER_SIZE) /* 每连接未发出响应的上限，超过后暂停读取 */
+#define PREFIX_MAX FRAME_REQ_EXTRA  /* "Processed[N bytes]: " 前缀的最大长度 */
+#define URING_CONNS 1024     /* io_uring 后端：注册文件表大小，即每个工作进程的连接上限 */
+#define URING_BUFS 512       /* io_uring 后端：接收用的提供缓冲个数 */
+#define URING_SEND_CHUNK 4096 /* io_uring 后端：每连接一块注册发送缓冲 */
+#define LOG_PKT_PER_SEC 100  /* 逐包日志每秒的上限，超出的条数汇总成一行 */
 
-/* 数据包处理函数 */
-void process_packet(const char* data, ssize_t data_len, char* response) {
-    int prefix_len;
-    int i;
+/* 事件循环模式下的每连接状态：收发缓冲都属于连接自己，互不干扰 */
+struct tcp_conn {
+    int fd;
+    struct sockaddr_in addr;     /* 对端地址 */
+    struct frame_buf in;         /* 分帧模式：尚未切分的接收数据（可增长） */
+    struct frame_buf out;        /* 已生成但未发出的响应 */
+};
+
+static int worker_id = -1;       /* 当前进程的工作进程编号，-1 表示单进程模式 */
+static pid_t workers[MAX_WORKERS]; /* 预派生的子进程 */
+static int nworkers = 0;
+static int framed = 0;           /* -f：长度前缀分帧协议 */
+static enum poller_backend backend = POLLER_AUTO; /* -e：工作进程的事件后端 */
+static int use_uring = 0;        /* -e uring：工作进程改用 io_uring（不可用时回退到 poller） */
+static struct slab conn_slab;    /* 事件循环模式的连接状态，按缓存行对齐复用 */
+static struct alog_limit pkt_log = ALOG_LIMIT_INIT; /* 逐包日志的节流 */
+static int ev_frame = -1;        /* 二进制事件："Frame of N bytes" */
+static int ev_slot_recv = -1;    /* 二进制事件：io_uring 连接上收到的数据 */
+
+/* 消息处理：将数据转换为大写并添加前缀，写入容量为 cap 的 response，
+ * 返回响应长度（不含结尾的 '\0'） */
+static size_t process_message(const char* data, size_t data_len, char* response, size_t cap) {
+    size_t prefix_len;
+    size_t n;
 
     /* 简单的数据处理：将接收到的数据转换为大写并添加前缀 */
-    snprintf(response, BUFFER_SIZE, "Processed[%lu bytes]: ", (unsigned long int) data_len);
+    snprintf(response, cap, "Processed[%lu bytes]: ", (unsigned long int) data_len);
     prefix_len = strlen(response);
-    /* 处理数据内容（简单示例） */
-    for (i = 0; i < data_len && i < BUFFER_SIZE - prefix_len - 1; i++) {
-        if (data[i] >= 'a' && data[i] <= 'z') {
-            response[prefix_len + i] = data[i] - 32; /* 小写转大写 */
+    /* 大写转换交给向量化内核，超出容量的部分截断 */
+    n = data_len < cap - prefix_len - 1 ? data_len : cap - prefix_len - 1;
+    ascii_upper(response + prefix_len, data, n);
+    response[prefix_len + n] = '\0';
+    return prefix_len + n;
+}
+
+/* 数据包处理函数 */
+void process_packet(const char* data, ssize_t data_len, char* response) {
+    process_message(data, (size_t)data_len, response, BUFFER_SIZE);
+}
+
+/* 分帧模式：为 in 中每条完整消息向 out 追加一条响应消息，不完整的尾部留在 in 中。
+ * peer 仅用于日志，可为 NULL。返回 0 表示正常，-1 表示消息超长或内存不足。
+ * 请求不得超过 FRAME_REQ_MAX，否则响应加上前缀后会超过 FRAME_MAX */
+static int handle_frames(struct frame_buf *in, struct frame_buf *out, const struct sockaddr_in *peer) {
+    const char *msg;
+    size_t len;
+    char *dst;
+    int r;
+
+    while ((r = frame_next(in, &msg, &len)) == 1) {
+        if (!alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+            /* 节流：本秒的额度已用完 */
+        } else if (peer != NULL) {
+            alog_printf(ALOG_INFO, "Frame of %lu bytes from %s:%d", (unsigned long int) len,
+                   inet_ntoa(peer->sin_addr), ntohs(peer->sin_port));
         } else {
-            response[prefix_len + i] = data[i];
+            alog_event(ALOG_INFO, ev_frame, (unsigned long) len, 0, 0, 0);  /* io_uring 直接描述符取不到对端地址 */
+        }
+        if (len > FRAME_REQ_MAX) {
+            alog_printf(ALOG_ERROR, "Request of %lu bytes exceeds the %lu-byte limit",
+                        (unsigned long int) len, (unsigned long int) FRAME_REQ_MAX);
+            return -1;
         }
+        /* 响应直接生成在输出缓冲中，长度不受 BUFFER_SIZE 限制 */
+        dst = frame_begin(out, len + PREFIX_MAX);
+        if (dst == NULL) return -1;
+        frame_commit(out, process_message(msg, len, dst, len + PREFIX_MAX));
     }
-    response[prefix_len + i] = '\0';
+    return r;
 }
 
-int main() {
-    int server_fd, client_fd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len;
-    char buffer[BUFFER_SIZE];
-    char response[BUFFER_SIZE];
+/* 阻塞地发送全部数据，成功返回 0 */
+static int send_all(int fd, const char *p, size_t len) {
+    ssize_t n;
+    while (len > 0) {
+        n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* 单进程模式下的分帧连接：一次 recv 可能含多条或半条消息，
+ * 本批所有完整消息的响应合并为一次发送 */
+static void serve_framed(int client_fd, const struct sockaddr_in *peer) {
+    struct frame_buf in, out;
     ssize_t recv_len;
+
+    memset(&in, 0, sizeof(in));
+    memset(&out, 0, sizeof(out));
+    while (1) {
+        if (frame_buf_reserve(&in, BUFFER_SIZE) != 0) {
+            alog_printf(ALOG_ERROR, "malloc failed");
+            break;
+        }
+        recv_len = recv(client_fd, in.data + in.len, in.cap - in.len, 0);
+        if (recv_len < 0) {
+            if (errno == EINTR) continue;
+            perror("recv failed");
+            break;
+        } else if (recv_len == 0) {
+            alog_printf(ALOG_INFO, "Client disconnected");
+            break;
+        }
+        in.len += (size_t)recv_len;
+        if (handle_frames(&in, &out, peer) != 0) {
+            alog_printf(ALOG_ERROR, "Bad frame from %s:%d", inet_ntoa(peer->sin_addr), ntohs(peer->sin_port));
+            break;
+        }
+        if (frame_buf_pending(&out) > 0) {
+            if (send_all(client_fd, out.data + out.off, frame_buf_pending(&out)) != 0) {
+                perror("send failed");
+                break;
+            }
+            frame_buf_consume(&out, frame_buf_pending(&out));
+        }
+    }
+    frame_buf_free(&in);
+    frame_buf_free(&out);
+}
+
+/* 创建监听套接字。reuseport 非零时设置 SO_REUSEPORT，
+ * 使每个工作进程各自绑定同一端口，由内核按四元组哈希分发连接 */
+static int make_listener(int backlog, int reuseport) {
+    int server_fd;
+    struct sockaddr_in server_addr;
     int ret;
     int opt;
 
@@ -56,6 +180,18 @@ int main() {
         close(server_fd);
         exit(EXIT_FAILURE);
     }
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
+#ifdef TCP_FASTOPEN
+    /* 接受 TFO：客户端（tcp_client -F）的首个请求随 SYN 到达，省一个往返；
+     * 还需 net.ipv4.tcp_fastopen 打开服务器位（值含 2），否则内核忽略，不算错误 */
+    opt = TFO_QLEN;
+    setsockopt(server_fd, IPPROTO_TCP, TCP_FASTOPEN, &opt, sizeof(opt));
+    opt = 1;
+#endif
 
     /* 设置服务器地址结构 */
     memset(&server_addr, 0, sizeof(server_addr));
@@ -72,15 +208,63 @@ int main() {
     }
 
     /* 开始监听连接请求 */
-    ret = listen(server_fd, MAX_PENDING);
+    ret = listen(server_fd, backlog);
     if (ret < 0) {
         perror("listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
+    return server_fd;
+}
 
-    printf("TCP server is running on port %d...\n", SERVER_PORT);
-    printf("Waiting for incoming connections...\n");
+/* 单进程模式下的原始连接：每次 recv 视为一条消息（原有行为） */
+static void serve_raw(int client_fd, const struct sockaddr_in *peer) {
+    char buffer[BUFFER_SIZE];
+    char response[BUFFER_SIZE];
+    ssize_t recv_len;
+    int ret;
+
+    while (1) {
+        /* 接收TCP数据包；缓冲无需预先清零，结尾的 '\0' 在收到数据后补上 */
+        recv_len = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
+        if (recv_len < 0) {
+            perror("recv failed");
+            break;
+        } else if (recv_len == 0) {
+            alog_printf(ALOG_INFO, "Client disconnected");
+            break;
+        }
+
+        /* 确保字符串以null结尾 */
+        buffer[recv_len] = '\0';
+
+        /* 解析和处理数据包 */
+        if (alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+            alog_printf(ALOG_INFO, "Received %lu bytes from %s:%d",
+                   (unsigned long int) recv_len, inet_ntoa(peer->sin_addr),
+                   ntohs(peer->sin_port));
+            alog_printf(ALOG_INFO, "Raw data: %s", buffer);
+        }
+
+        /* 处理数据包内容 */
+        process_packet(buffer, recv_len, response);
+
+        /* 发送处理后的响应回客户端 */
+        ret = send(client_fd, response, strlen(response), 0);
+        if (ret < 0) {
+            perror("send failed");
+            break;
+        } else if (alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+            alog_printf(ALOG_INFO, "Response sent: %s", response);
+        }
+    }
+}
+
+/* 单进程模式：逐个接受并处理客户端（原有行为） */
+static void serve_iterative(int server_fd) {
+    int client_fd;
+    struct sockaddr_in client_addr;
+    socklen_t client_len;
 
     /* 主循环：接受和处理客户端连接 */
     while (1) {
@@ -95,50 +279,639 @@ int main() {
         }
 
         /* 打印客户端连接信息 */
-        printf("New connection from %s:%d\n",
+        alog_printf(ALOG_INFO, "New connection from %s:%d",
                inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
 
         /* 处理客户端数据 */
-        while (1) {
-            memset(buffer, 0, BUFFER_SIZE);
+        if (framed) {
+            serve_framed(client_fd, &client_addr);
+        } else {
+            serve_raw(client_fd, &client_addr);
+        }
 
-            /* 接收TCP数据包 */
-            recv_len = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
-            if (recv_len < 0) {
-                perror("recv failed");
-                break;
-            } else if (recv_len == 0) {
-                printf("Client disconnected\n");
-                break;
+        /* 关闭客户端连接 */
+        close(client_fd);
+        alog_printf(ALOG_INFO, "Connection closed");
+    }
+}
+
+/* 关闭连接并释放其状态 */
+static void conn_close(struct poller *p, struct tcp_conn *c) {
+    poller_del(p, c->fd);
+    close(c->fd);
+    frame_buf_free(&c->in);
+    frame_buf_free(&c->out);
+    slab_free(&conn_slab, c);
+    alog_printf(ALOG_INFO, "[worker %d] Connection closed (%lu open, peak %lu)", worker_id,
+           conn_slab.in_use, conn_slab.high_water);
+}
+
+/* 尽量发出积压的响应，返回 -1 表示出错 */
+static int conn_flush(struct tcp_conn *c) {
+    ssize_t n;
+    while (frame_buf_pending(&c->out) > 0) {
+        n = send(c->fd, c->out.data + c->out.off, frame_buf_pending(&c->out), MSG_NOSIGNAL);
+        if (n > 0) {
+            frame_buf_consume(&c->out, (size_t)n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;  /* 发送缓冲满，等待可写 */
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* 读取一次数据并生成响应。返回 1 表示对端关闭，-1 表示出错 */
+static int conn_read(struct tcp_conn *c) {
+    char buffer[BUFFER_SIZE];
+    char response[BUFFER_SIZE];
+    ssize_t recv_len;
+
+    if (framed) {
+        /* 分帧模式：读入连接自己的可增长缓冲，切出所有完整消息 */
+        if (frame_buf_reserve(&c->in, BUFFER_SIZE) != 0) return -1;
+        recv_len = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+    } else {
+        recv_len = recv(c->fd, buffer, BUFFER_SIZE - 1, 0);
+    }
+    if (recv_len == 0) return 1;
+    if (recv_len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        perror("recv failed");
+        return -1;
+    }
+
+    if (framed) {
+        c->in.len += (size_t)recv_len;
+        if (handle_frames(&c->in, &c->out, &c->addr) != 0) {
+            alog_printf(ALOG_ERROR, "[worker %d] Bad frame from %s:%d", worker_id,
+                    inet_ntoa(c->addr.sin_addr), ntohs(c->addr.sin_port));
+            return -1;
+        }
+        return 0;
+    }
+
+    buffer[recv_len] = '\0';
+    if (alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+        alog_printf(ALOG_INFO, "[worker %d] Received %lu bytes from %s:%d", worker_id,
+               (unsigned long int) recv_len, inet_ntoa(c->addr.sin_addr),
+               ntohs(c->addr.sin_port));
+        alog_printf(ALOG_INFO, "Raw data: %s", buffer);
+    }
+
+    /* 响应写入栈上缓冲，再追加到本连接的积压中 */
+    process_packet(buffer, recv_len, response);
+    return frame_buf_append(&c->out, response, strlen(response));
+}
+
+/* 处理连接上的一次就绪事件：每次最多读取一个数据块，保证各连接公平轮转 */
+static void conn_event(struct poller *p, struct tcp_conn *c, unsigned int events) {
+    unsigned int want;
+    int r;
+
+    if ((events & (POLLER_IN | POLLER_ERR)) && frame_buf_pending(&c->out) < OUT_CAP) {
+        r = conn_read(c);
+        if (r != 0) {
+            if (r > 0) alog_printf(ALOG_INFO, "[worker %d] Client disconnected", worker_id);
+            conn_close(p, c);
+            return;
+        }
+    }
+
+    if (conn_flush(c) < 0) {
+        perror("send failed");
+        conn_close(p, c);
+        return;
+    }
+
+    want = 0;
+    if (frame_buf_pending(&c->out) < OUT_CAP) want |= POLLER_IN; /* 积压过多时暂停读取 */
+    if (frame_buf_pending(&c->out) > 0) want |= POLLER_OUT;
+    poller_mod(p, c->fd, want, c);
+}
+
+/* 接受所有待处理的连接并注册到事件循环 */
+static void accept_all(struct poller *p, int server_fd) {
+    struct tcp_conn *c;
+    struct sockaddr_in client_addr;
+    socklen_t client_len;
+    int client_fd;
+
+    while (1) {
+        client_len = sizeof(client_addr);
+        client_fd = accept4(server_fd, (struct sockaddr*)&client_addr, &client_len, SOCK_NONBLOCK);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed");
+            return;
+        }
+        c = (struct tcp_conn *)slab_alloc(&conn_slab);
+        if (c == NULL) {
+            close(client_fd);
+            continue;
+        }
+        memset(c, 0, sizeof(*c));
+        c->fd = client_fd;
+        c->addr = client_addr;
+        if (poller_add(p, client_fd, POLLER_IN, c) < 0) {
+            perror("poller_add failed");
+            close(client_fd);
+            slab_free(&conn_slab, c);
+            continue;
+        }
+        alog_printf(ALOG_INFO, "[worker %d] New connection from %s:%d", worker_id,
+               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+    }
+}
+
+/* ---------- io_uring 后端 ----------
+ * 监听套接字上挂一个多次接受（multishot accept）请求，新连接直接放进注册文件表，
+ * 之后只用表中的槽号引用，省去每次操作的 fd 查找。每个连接挂一个多次接收请求，
+ * 数据落在内核从提供缓冲环中挑出的缓冲里；响应从 out 复制到该连接在注册缓冲中的
+ * 发送块，用 WRITE_FIXED 发出，免去每次操作的页面钉住。需要关闭时，最后一次写与
+ * 关闭用 IOSQE_IO_LINK 链接提交；写不完整时内核取消关闭，由我们补发剩余部分。
+ * 提交队列满且一时腾不出来时，连接（或监听）记为待重试，下一轮 io_uring_enter
+ * 之后重新推进，不会没有请求在途而挂住。 */
+
+enum { UOP_ACCEPT, UOP_RECV, UOP_WRITE, UOP_CLOSE, UOP_CANCEL };
+#define UDATA(op, slot) (((unsigned long)(slot) << 8) | (unsigned long)(op))
+
+/* io_uring 后端的每连接状态，按注册文件表槽号索引 */
+struct uring_conn {
+    int recv_armed;              /* 多次接收请求仍在内核中 */
+    int cancel_sent;             /* 已请求取消接收 */
+    int writing;                 /* 有一个 WRITE_FIXED 在途 */
+    int close_queued;            /* 已提交关闭（可能链接在写之后） */
+    int closing;                 /* 不再处理输入，发完积压后关闭 */
+    int paused;                  /* 积压过多，接收已取消，等发送追上 */
+    int retry;                   /* 取不到提交项，等下一轮再推进 */
+    struct frame_buf in;         /* 分帧模式：尚未切分的接收数据 */
+    struct frame_buf out;        /* 已生成但未发出的响应 */
+};
+
+struct uring_loop {
+    struct uring ring;
+    struct uring_bufs bufs;      /* 接收缓冲环，组号 0 */
+    char *send_area;             /* URING_CONNS 个发送块，整体注册为固定缓冲 0 */
+    struct uring_conn *conns;    /* URING_CONNS 个连接 */
+    int lfd;
+    int retry;                   /* 有连接记为待重试 */
+    int accept_retry;            /* 接受请求没能挂上 */
+};
+
+static void uring_loop_free(struct uring_loop *l) {
+    int i;
+
+    uring_bufs_free(&l->ring, &l->bufs);
+    uring_exit(&l->ring);        /* 注册文件表中的连接随之关闭 */
+    free(l->send_area);
+    if (l->conns != NULL) {
+        for (i = 0; i < URING_CONNS; i++) {
+            frame_buf_free(&l->conns[i].in);
+            frame_buf_free(&l->conns[i].out);
+        }
+    }
+    free(l->conns);
+}
+
+/* 建立 io_uring 后端；内核缺少所需功能时返回 -1，调用者回退到 poller */
+static int uring_loop_init(struct uring_loop *l, int lfd) {
+    /* 多次接收是 6.0 加入的，探测不到它本身，用同版本加入的 SEND_ZC 代替 */
+    static const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_WRITE_FIXED,
+                               IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL, IORING_OP_SEND_ZC };
+
+    memset(l, 0, sizeof(*l));
+    l->lfd = lfd;
+    if (uring_init(&l->ring, 256, 4096) != 0) return -1;
+    if (!uring_supported(&l->ring, ops, (int)(sizeof(ops) / sizeof(ops[0])))) {
+        errno = ENOSYS;
+        goto fail;
+    }
+    l->send_area = (char *)malloc((size_t)URING_CONNS * URING_SEND_CHUNK);
+    l->conns = (struct uring_conn *)calloc(URING_CONNS, sizeof(*l->conns));
+    if (l->send_area == NULL || l->conns == NULL) goto fail;
+    if (uring_register_files(&l->ring, URING_CONNS) != 0) goto fail;
+    if (uring_register_buffer(&l->ring, l->send_area, (size_t)URING_CONNS * URING_SEND_CHUNK) != 0) goto fail;
+    /* 原始模式一次 recv 即一条消息，缓冲长度与阻塞路径的 BUFFER_SIZE - 1 相同 */
+    if (uring_bufs_init(&l->ring, &l->bufs, 0, URING_BUFS, BUFFER_SIZE - 1) != 0) goto fail;
+    return 0;
+
+fail:
+    uring_loop_free(l);
+    return -1;
+}
+
+/* 取不到提交项：记下连接，uring_retry() 在下一轮重新推进它 */
+static void uconn_defer(struct uring_loop *l, int slot) {
+    l->conns[slot].retry = 1;
+    l->retry = 1;
+}
+
+static void uq_accept(struct uring_loop *l) {
+    struct io_uring_sqe *sqe = uring_sqe(&l->ring);
+    l->accept_retry = sqe == NULL;
+    if (sqe != NULL) uring_prep_accept_multi(sqe, l->lfd, UDATA(UOP_ACCEPT, 0));
+}
+
+static void uq_recv(struct uring_loop *l, int slot) {
+    struct io_uring_sqe *sqe = uring_sqe(&l->ring);
+    if (sqe == NULL) {
+        uconn_defer(l, slot);
+        return;
+    }
+    uring_prep_recv_multi(sqe, slot, l->bufs.bgid, UDATA(UOP_RECV, slot));
+    l->conns[slot].recv_armed = 1;
+    l->conns[slot].cancel_sent = 0;
+}
+
+static void uq_cancel_recv(struct uring_loop *l, int slot) {
+    struct io_uring_sqe *sqe;
+    if (l->conns[slot].cancel_sent) return;
+    sqe = uring_sqe(&l->ring);
+    if (sqe == NULL) {
+        uconn_defer(l, slot);
+        return;
+    }
+    uring_prep_cancel(sqe, UDATA(UOP_RECV, slot), UDATA(UOP_CANCEL, slot));
+    l->conns[slot].cancel_sent = 1;
+}
+
+static void uconn_finish(struct uring_loop *l, int slot);
+
+/* 发出积压中的下一块；连接正在关闭且这是最后一块时，把关闭链接在写之后。
+ * 两个提交项先一起预留，链接的写与关闭总在同一次 io_uring_enter 中提交 */
+static void uconn_send(struct uring_loop *l, int slot) {
+    struct uring_conn *c = &l->conns[slot];
+    struct io_uring_sqe *sqe, *close_sqe;
+    char *chunk = l->send_area + (size_t)slot * URING_SEND_CHUNK;
+    size_t len = frame_buf_pending(&c->out);
+    int link;
+
+    if (c->writing || c->close_queued) return;
+    if (len == 0) {
+        if (c->closing) uconn_finish(l, slot);
+        return;
+    }
+    if (len > URING_SEND_CHUNK) len = URING_SEND_CHUNK;
+    link = c->closing && !c->recv_armed && len == frame_buf_pending(&c->out);
+    if (uring_sq_reserve(&l->ring, link ? 2 : 1) != 0) {
+        uconn_defer(l, slot);    /* 数据仍在 out 中，重试时再复制 */
+        return;
+    }
+    memcpy(chunk, c->out.data + c->out.off, len);  /* 写完成前 out 可能扩容，发送块不会动 */
+    sqe = uring_sqe(&l->ring);
+    uring_prep_write_fixed(sqe, slot, chunk, (unsigned int)len, UDATA(UOP_WRITE, slot));
+    c->writing = 1;
+    if (link) {
+        close_sqe = uring_sqe(&l->ring);
+        uring_prep_close(close_sqe, slot, UDATA(UOP_CLOSE, slot));
+        sqe->flags |= IOSQE_IO_LINK;  /* 关闭已取得，才把它链接在写之后 */
+        c->close_queued = 1;
+    }
+}
+
+/* 推进关闭：先让接收请求结束（它持有文件引用），再发完积压，最后关闭槽位 */
+static void uconn_finish(struct uring_loop *l, int slot) {
+    struct uring_conn *c = &l->conns[slot];
+    struct io_uring_sqe *sqe;
+
+    c->closing = 1;
+    if (c->recv_armed) {
+        uq_cancel_recv(l, slot);
+        return;
+    }
+    if (c->writing || c->close_queued) return;
+    if (frame_buf_pending(&c->out) > 0) {
+        uconn_send(l, slot);
+        return;
+    }
+    sqe = uring_sqe(&l->ring);
+    if (sqe == NULL) {
+        uconn_defer(l, slot);
+        return;
+    }
+    uring_prep_close(sqe, slot, UDATA(UOP_CLOSE, slot));
+    c->close_queued = 1;
+}
+
+/* 重新推进记为待重试的连接和接受请求；仍取不到提交项的会再次记下 */
+static void uring_retry(struct uring_loop *l) {
+    struct uring_conn *c;
+    int slot;
+
+    if (l->accept_retry) uq_accept(l);
+    if (!l->retry) return;
+    l->retry = 0;
+    for (slot = 0; slot < URING_CONNS; slot++) {
+        c = &l->conns[slot];
+        if (!c->retry) continue;
+        c->retry = 0;
+        if (c->closing) {
+            uconn_finish(l, slot);
+            continue;
+        }
+        if (c->paused && c->recv_armed) uq_cancel_recv(l, slot);
+        uconn_send(l, slot);
+        if (!c->recv_armed && !c->paused) uq_recv(l, slot);
+    }
+}
+
+/* 处理一块收到的数据，与 conn_read 相同。返回 0 表示正常，-1 表示出错 */
+static int uconn_input(struct uring_loop *l, int slot, const char *data, size_t len) {
+    struct uring_conn *c = &l->conns[slot];
+    char buffer[BUFFER_SIZE];
+    char response[BUFFER_SIZE];
+
+    if (framed) {
+        if (frame_buf_append(&c->in, data, len) != 0) return -1;
+        return handle_frames(&c->in, &c->out, NULL);
+    }
+    memcpy(buffer, data, len);   /* len 不超过提供缓冲的 BUFFER_SIZE - 1 */
+    buffer[len] = '\0';
+    if (alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+        alog_event(ALOG_INFO, ev_slot_recv, (unsigned long) worker_id, (unsigned long) len, (unsigned long) slot, 0);
+        alog_printf(ALOG_INFO, "Raw data: %s", buffer);
+    }
+    process_packet(buffer, (ssize_t)len, response);
+    return frame_buf_append(&c->out, response, strlen(response));
+}
+
+/* 分派一个完成事件 */
+static void uring_complete(struct uring_loop *l, const struct io_uring_cqe *cqe) {
+    int op = (int)(cqe->user_data & 0xff);
+    int slot = (int)(cqe->user_data >> 8);
+    int res = cqe->res;
+    struct uring_conn *c = &l->conns[slot];
+
+    switch (op) {
+    case UOP_ACCEPT:
+        if (res >= 0 && res < URING_CONNS) {
+            memset(&l->conns[res], 0, sizeof(l->conns[res]));
+            alog_printf(ALOG_INFO, "[worker %d] New connection on slot %d", worker_id, res);
+            uq_recv(l, res);
+        } else if (res < 0) {
+            alog_printf(ALOG_ERROR, "[worker %d] accept failed: %s", worker_id, strerror(-res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) uq_accept(l);  /* 多次接受被内核终止，重新挂上 */
+        break;
+    case UOP_RECV:
+        if (!(cqe->flags & IORING_CQE_F_MORE)) c->recv_armed = 0;
+        if (res > 0) {
+            unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            if (!c->closing && uconn_input(l, slot, uring_buf(&l->bufs, bid), (size_t)res) != 0) {
+                alog_printf(ALOG_ERROR, "[worker %d] Bad frame on connection %d", worker_id, slot);
+                frame_buf_consume(&c->out, frame_buf_pending(&c->out));
+                c->closing = 1;
             }
+            uring_buf_recycle(&l->bufs, bid);
+        } else if (res == 0) {
+            alog_printf(ALOG_INFO, "[worker %d] Client disconnected", worker_id);
+            c->closing = 1;
+        } else if (res != -ENOBUFS && res != -ECANCELED) {  /* ENOBUFS：缓冲暂时用完，重新挂上即可 */
+            alog_printf(ALOG_ERROR, "[worker %d] recv failed: %s", worker_id, strerror(-res));
+            frame_buf_consume(&c->out, frame_buf_pending(&c->out));
+            c->closing = 1;
+        }
+        if (c->closing) {
+            uconn_finish(l, slot);
+            break;
+        }
+        if (frame_buf_pending(&c->out) >= OUT_CAP) c->paused = 1;  /* 积压过多时暂停读取 */
+        if (c->paused && c->recv_armed) uq_cancel_recv(l, slot);
+        uconn_send(l, slot);
+        if (!c->recv_armed && !c->paused) uq_recv(l, slot);
+        break;
+    case UOP_WRITE:
+        c->writing = 0;
+        if (res > 0) {
+            frame_buf_consume(&c->out, (size_t)res);
+        } else {
+            if (res != -ECANCELED) alog_printf(ALOG_ERROR, "[worker %d] send failed: %s", worker_id, strerror(res < 0 ? -res : EIO));
+            frame_buf_consume(&c->out, frame_buf_pending(&c->out));
+            c->closing = 1;
+        }
+        if (c->close_queued) break;  /* 结果由链接的关闭报告 */
+        if (c->paused && frame_buf_pending(&c->out) < OUT_CAP && !c->closing) {
+            c->paused = 0;
+            if (!c->recv_armed) uq_recv(l, slot);
+        }
+        if (c->closing) uconn_finish(l, slot);
+        else uconn_send(l, slot);
+        break;
+    case UOP_CLOSE:
+        c->close_queued = 0;
+        if (res == -ECANCELED) {     /* 链接的写不完整或失败：补发剩余部分后再关 */
+            uconn_finish(l, slot);
+            break;
+        }
+        frame_buf_free(&c->in);
+        frame_buf_free(&c->out);
+        memset(c, 0, sizeof(*c));
+        alog_printf(ALOG_INFO, "[worker %d] Connection closed", worker_id);
+        break;
+    default:                         /* UOP_CANCEL：结果体现在被取消的接收上 */
+        break;
+    }
+}
 
-            /* 确保字符串以null结尾 */
-            buffer[recv_len] = '\0';
+/* io_uring 事件循环；初始化失败或 io_uring_enter 出错时释放整个后端
+ * （连接随之关闭）并返回 -1，errno 保留原因，调用者回退到 poller */
+static int serve_uring(int server_fd) {
+    struct uring_loop l;
+    struct io_uring_cqe *cqe;
+    struct io_uring_cqe ev;
+    int err;
 
-            /* 解析和处理数据包 */
-            printf("Received %lu bytes from %s:%d\n",
-                   (unsigned long int) recv_len, inet_ntoa(client_addr.sin_addr),
-                   ntohs(client_addr.sin_port));
-            printf("Raw data: %s\n", buffer);
+    if (uring_loop_init(&l, server_fd) != 0) return -1;
+    signal(SIGPIPE, SIG_IGN);    /* 写没有 MSG_NOSIGNAL，对端关闭时改由 EPIPE 报告 */
+    alog_printf(ALOG_INFO, "[worker %d] pid %d serving with io_uring", worker_id, (int)getpid());
+    uq_accept(&l);
+    while (1) {
+        if (uring_submit_wait(&l.ring, 1, -1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            err = errno;
+            perror("io_uring_enter failed");
+            uring_loop_free(&l);
+            errno = err;
+            return -1;
+        }
+        while ((cqe = uring_cqe(&l.ring)) != NULL) {
+            ev = *cqe;           /* 先释放 CQ 槽位，回调中可以继续提交 */
+            uring_cqe_done(&l.ring);
+            uring_complete(&l, &ev);
+        }
+        uring_retry(&l);
+    }
+    return 0;
+}
 
-            /* 处理数据包内容 */
-            memset(response, 0, BUFFER_SIZE);
-            process_packet(buffer, recv_len, response);
+/* 工作进程：在自己的 SO_REUSEPORT 监听套接字上运行事件循环，同时服务多个连接 */
+static void worker_main(int backlog) {
+    struct poller *p;
+    struct poller_event evs[MAX_EVENTS];
+    int server_fd;
+    int n, i;
 
-            /* 发送处理后的响应回客户端 */
-            ret = send(client_fd, response, strlen(response), 0);
-            if (ret < 0) {
-                perror("send failed");
-                break;
+    alog_init(STDOUT_FILENO, STDERR_FILENO);  /* 写线程没有随 fork 带过来，每个工作进程各起一个 */
+    server_fd = make_listener(backlog, 1);
+    if (use_uring && serve_uring(server_fd) != 0) {
+        alog_printf(ALOG_WARN, "[worker %d] io_uring unavailable (%s), falling back to poller", worker_id, strerror(errno));
+    }
+    /* 监听套接字非阻塞：accept_all 取到 EAGAIN 即返回事件循环 */
+    if (fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        perror("fcntl failed");
+        exit(EXIT_FAILURE);
+    }
+    p = poller_create(backend);
+    slab_init(&conn_slab, sizeof(struct tcp_conn), 0, 0);
+    if (p == NULL || poller_add(p, server_fd, POLLER_IN, NULL) < 0) {
+        perror("poller setup failed");
+        exit(EXIT_FAILURE);
+    }
+    alog_printf(ALOG_INFO, "[worker %d] pid %d serving with %s", worker_id, (int)getpid(), poller_name(p));
+
+    while (1) {
+        n = poller_wait(p, evs, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno != EINTR) perror("poller_wait failed");
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (evs[i].fd == server_fd) {
+                accept_all(p, server_fd);
             } else {
-                printf("Response sent: %s\n", response);
+                conn_event(p, (struct tcp_conn *)evs[i].data, evs[i].events);
             }
         }
+    }
+}
 
-        /* 关闭客户端连接 */
-        close(client_fd);
-        printf("Connection closed\n");
+/* 派生第 id 个工作进程 */
+static pid_t spawn_worker(int id, int backlog) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        worker_id = id;
+        worker_main(backlog);
+        exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+/* 父进程收到终止信号时结束所有工作进程 */
+static void stop_workers(int signo) {
+    int i;
+    for (i = 0; i < nworkers; i++) {
+        if (workers[i] > 0) kill(workers[i], SIGTERM);
     }
+    signal(signo, SIG_DFL);
+    raise(signo);
+}
+
+/* 预派生模式：父进程只负责派生并在工作进程异常退出时重新派生 */
+static void run_prefork(int count, int backlog) {
+    int i;
+    int status;
+    pid_t pid;
+
+    nworkers = count;
+    signal(SIGINT, stop_workers);
+    signal(SIGTERM, stop_workers);
+    for (i = 0; i < count; i++) {
+        workers[i] = spawn_worker(i, backlog);
+    }
+    while (1) {
+        pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("wait failed");
+            return;
+        }
+        for (i = 0; i < count; i++) {
+            if (workers[i] == pid) {
+                fprintf(stderr, "worker %d (pid %d) exited, respawning\n", i, (int)pid);
+                sleep(1);  /* 避免启动即失败时忙等 */
+                workers[i] = spawn_worker(i, backlog);
+            }
+        }
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-w workers] [-e backend] [-l backlog] [-f]\n"
+                    "  -w  pre-fork this many event-loop workers sharing the port via SO_REUSEPORT\n"
+                    "      (default: serve one client at a time in a single process)\n"
+                    "  -e  worker event backend: auto, epoll, poll, select or uring (implies -w 1;\n"
+                    "      uring falls back to auto when the kernel lacks the needed io_uring ops)\n"
+                    "  -l  listen backlog (default: %d, or SOMAXCONN with -w)\n"
+                    "  -f  framed protocol: every message carries a 4-byte big-endian length\n", prog, MAX_PENDING);
+    fprintf(stderr, "      requests may be at most %d bytes; longer ones close the connection\n", FRAME_REQ_MAX);
+}
+
+int main(int argc, char *argv[]) {
+    int server_fd;
+    int count = 0;               /* 工作进程数，0 表示单进程逐个处理 */
+    int backlog = -1;            /* listen backlog，-1 表示按模式取默认值 */
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:e:l:fh")) != -1) {
+        switch (opt) {
+        case 'w':
+            count = atoi(optarg);
+            if (count <= 0 || count > MAX_WORKERS) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'e':
+            if (strcmp(optarg, "uring") == 0) {
+                use_uring = 1;
+            } else if (poller_parse_backend(optarg, &backend) != 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            if (count == 0) count = 1;
+            break;
+        case 'f':
+            framed = 1;
+            break;
+        case 'l':
+            backlog = atoi(optarg);
+            if (backlog <= 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (backlog < 0) backlog = count > 0 ? SOMAXCONN : MAX_PENDING;
+    ev_frame = alog_event_define("Frame of %lu bytes");
+    ev_slot_recv = alog_event_define("[worker %lu] Received %lu bytes on connection %lu");
+
+    printf("TCP server is running on port %d...\n", SERVER_PORT);
+
+    if (count > 0) {
+        printf("Pre-forking %d workers, backlog %d each\n", count, backlog);
+        fflush(stdout);          /* 避免缓冲内容在 fork 后重复输出 */
+        run_prefork(count, backlog);
+        return 0;
+    }
+
+    server_fd = make_listener(backlog, 0);
+    printf("Waiting for incoming connections...\n");
+    fflush(stdout);              /* 之后的输出都经由 alog 的写线程 */
+    alog_init(STDOUT_FILENO, STDERR_FILENO);
+    serve_iterative(server_fd);
 
     /* 关闭服务器套接字（实际上不会执行到这里） */
     close(server_fd);
@@ -0,0 +1,99 @@
+#include <stdlib.h>  /* malloc, free */
+#include "timer_wheel.h"
+
+static void slot_init(struct tw_timer *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void link_tail(struct tw_timer *head, struct tw_timer *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void unlink_node(struct tw_timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t;
+    t->prev = t;
+}
+
+int tw_init(struct timer_wheel *w, unsigned int nslots, unsigned long tick_ms, unsigned long now_ms) {
+    unsigned int n = 1;
+    unsigned int i;
+
+    while (n < nslots) n *= 2;
+    w->slots = (struct tw_timer *)malloc(n * sizeof(w->slots[0]));
+    if (w->slots == NULL) return -1;
+    for (i = 0; i < n; i++) slot_init(&w->slots[i]);
+    w->mask = n - 1;
+    w->tick_ms = tick_ms > 0 ? tick_ms : 1;
+    w->cur = now_ms / w->tick_ms;
+    w->count = 0;
+    return 0;
+}
+
+void tw_free(struct timer_wheel *w) {
+    free(w->slots);
+    w->slots = NULL;
+}
+
+void tw_add(struct timer_wheel *w, struct tw_timer *t, unsigned long expires_ms) {
+    unsigned long tick;
+
+    if (t->pending) tw_del(w, t);
+    /* 向上取整：处理到第 tick 个槽时（now >= tick * tick_ms）定时器一定已到期，
+     * 最多晚一个 tick 触发，不会提前 */
+    tick = (expires_ms + w->tick_ms - 1) / w->tick_ms;
+    if (tick < w->cur) tick = w->cur;   /* 已过期：放到下一个要处理的槽 */
+    t->expires = expires_ms;
+    t->pending = 1;
+    link_tail(&w->slots[tick & w->mask], t);
+    w->count++;
+}
+
+void tw_del(struct timer_wheel *w, struct tw_timer *t) {
+    if (!t->pending) return;
+    unlink_node(t);
+    t->pending = 0;
+    w->count--;
+}
+
+unsigned long tw_advance(struct timer_wheel *w, unsigned long now_ms, tw_cb cb, void *ctx) {
+    struct tw_timer local;
+    struct tw_timer *head, *t;
+    unsigned long end = now_ms / w->tick_ms;
+    unsigned long n, i, first, fired = 0;
+
+    if (end < w->cur) return 0;
+    n = end - w->cur + 1;
+    if (n > (unsigned long)w->mask + 1) n = (unsigned long)w->mask + 1;  /* 落后超过一圈：每槽看一次即可 */
+    first = w->cur;
+    w->cur = end + 1;                   /* 回调中新加的定时器落在后面的槽 */
+
+    for (i = 0; i < n; i++) {
+        head = &w->slots[(first + i) & w->mask];
+        if (head->next == head) continue;
+        /* 先把整槽摘到本地链表，回调里对本槽的增删不会打乱遍历 */
+        local.next = head->next;
+        local.prev = head->prev;
+        local.next->prev = &local;
+        local.prev->next = &local;
+        slot_init(head);
+        while (local.next != &local) {
+            t = local.next;
+            unlink_node(t);
+            if (t->expires <= now_ms) {
+                t->pending = 0;
+                w->count--;
+                fired++;
+                cb(ctx, t);
+            } else {
+                link_tail(head, t);     /* 后面几圈才到期 */
+            }
+        }
+    }
+    return fired;
+}
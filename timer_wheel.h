@@ -0,0 +1,42 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/*
+ * 哈希时间轮：定时器按到期 tick 散列到 2 的幂个槽中，槽内是双向链表。
+ * 添加、删除都是 O(1)；推进时只检查经过的槽，超过一圈的定时器留在槽里
+ * 等后面的圈。定时器节点嵌入在调用者自己的结构体中，模块不做内存分配
+ * （除了槽数组），节点首次使用前须清零。时间单位为毫秒，时钟由调用者提供。
+ */
+
+struct tw_timer {
+    struct tw_timer *next;         /* 槽内链表 */
+    struct tw_timer *prev;
+    unsigned long expires;         /* 到期时间（毫秒） */
+    int pending;                   /* 在时间轮中为 1 */
+};
+
+struct timer_wheel {
+    struct tw_timer *slots;        /* 每槽一个哨兵节点 */
+    unsigned int mask;             /* 槽数 - 1 */
+    unsigned long tick_ms;         /* 每槽对应的时间 */
+    unsigned long cur;             /* 下一个尚未处理的 tick */
+    unsigned long count;           /* 等待中的定时器数 */
+};
+
+/* 到期回调：调用前定时器已从时间轮摘下，可在回调中重新 tw_add */
+typedef void (*tw_cb)(void *ctx, struct tw_timer *t);
+
+/* nslots 向上取整为 2 的幂；成功返回 0 */
+int tw_init(struct timer_wheel *w, unsigned int nslots, unsigned long tick_ms, unsigned long now_ms);
+void tw_free(struct timer_wheel *w);
+
+/* 加入（或改期）一个定时器；已过期的在下一次 tw_advance() 时触发 */
+void tw_add(struct timer_wheel *w, struct tw_timer *t, unsigned long expires_ms);
+
+/* 取消定时器；不在时间轮中时什么也不做 */
+void tw_del(struct timer_wheel *w, struct tw_timer *t);
+
+/* 触发所有 expires <= now_ms 的定时器，返回触发个数 */
+unsigned long tw_advance(struct timer_wheel *w, unsigned long now_ms, tw_cb cb, void *ctx);
+
+#endif /* TIMER_WHEEL_H */
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE                     /* recvmsg/MSG_DONTWAIT、clock_gettime 等 */
+
 #include <stdio.h>                      /* 标准输入输出 */
 #include <stdlib.h>                     /* 标准库：malloc, free, atoi, exit */
 #include <string.h>                     /* 字符串处理，如 memset, memcpy, strcmp, strncpy */
@@ -11,6 +13,8 @@
 #include <sys/time.h>                   /* gettimeofday, struct timeval */
 #include <signal.h>                     /* signal */
 #include <netinet/icmp6.h>              /* ICMPv6 报文结构与常量（在 Linux 下通常可用） */
+#include <netinet/ip6.h>                /* struct ip6_hdr，解析差错报文中引用的原始报文 */
+#include "pkt_tstamp.h"                 /* 内核收发时间戳与 RTT 汇总 */
 
 /* 常量定义 */
 #define DEFAULT_MAX_HOPS 30            /* 默认最大跳数 */
@@ -18,6 +22,22 @@
 #define DEFAULT_TIMEOUT_MS 3000        /* 默认超时 3000 毫秒 */
 #define PACKET_SIZE 56                 /* ICMP payload 大小（字节） */
 #define INET6_STRLEN 46                /* IPv6 文本最长长度（INET6_ADDRSTRLEN 常量通常为46） */
+#define MAX_HOP_LIMIT 255              /* IPv6 hop limit 上限 */
+
+/* 并行模式下一个探测的状态，按 (hop - 1) * probes + probe 编号，序号即该编号 */
+struct hop_probe {
+    int hop;                            /* 此探测的 hop limit */
+    int sent;                           /* 已成功发送 */
+    int replied;                        /* 已收到回应 */
+    unsigned long tx_key;               /* 发送时间戳序号 */
+    struct timespec mono_tx;            /* 发送前的单调时钟读数 */
+    struct timespec mono_rx;            /* 接收时的单调时钟读数 */
+    struct pkt_ts tx_ts;                /* 内核发送时间戳 */
+    struct pkt_ts rx_ts;                /* 内核接收时间戳 */
+    struct sockaddr_in6 from;           /* 回应来源 */
+    unsigned char type;                 /* 回应的 ICMPv6 类型 */
+    unsigned char code;                 /* 回应的 ICMPv6 代码 */
+};
 
 /* 全局套接字变量，便于在信号处理时关闭 */
 static int g_sock = -1;                 /* 用于发送与接收 ICMPv6 的原始套接字 */
@@ -33,17 +53,148 @@ static void cleanup_and_exit(int signo) /* 信号处理函数声明 */
     _exit(1);                           /* 使用 _exit 在信号处理上下文安全退出 */
 }
 
-/* 计算 timeval 差异并以毫秒返回（整数） */
-static long time_diff_ms(struct timeval *endtv, struct timeval *starttv) /* 返回毫秒差 */
+/* 距 deadline 还剩多少毫秒（单调时钟），已过期返回 0 */
+static long ms_until(const struct timespec *deadline) /* 返回剩余毫秒 */
+{
+    struct timespec now;                /* 当前时间 */
+    long ms;                            /* 剩余毫秒 */
+
+    pkt_ts_now(&now);                   /* 读取单调时钟 */
+    ms = (long)(deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec) / 1000000L; /* 差值 */
+    return ms > 0 ? ms : 0;             /* 不返回负数 */
+}
+
+/*
+ * 判断收到的 ICMPv6 报文是否是对本进程探测（id 为 pid）的回应，是则返回 1
+ * 并在 *seq 中给出探测的序号：Echo Reply 直接带 id/seq，Time Exceeded 与
+ * Destination Unreachable 从引用的原始 Echo 头中取。
+ */
+static int reply_seq(const char *buf, ssize_t n, int pid, int *seq) /* 匹配返回 1 */
+{
+    const struct icmp6_hdr *icmp6;      /* 收到的 ICMPv6 头 */
+    const struct icmp6_hdr *inner;      /* 差错报文中引用的原始 Echo 头 */
+    const struct ip6_hdr *ip6;          /* 差错报文中引用的原始 IPv6 头 */
+
+    if (n < (ssize_t)sizeof(struct icmp6_hdr)) return 0; /* 太短 */
+    icmp6 = (const struct icmp6_hdr *)buf; /* ICMPv6 头 */
+    if (icmp6->icmp6_type == ICMP6_ECHO_REPLY) { /* Echo Reply 直接带 id/seq */
+        if (ntohs(icmp6->icmp6_id) != (unsigned short)pid) return 0; /* 不是本进程的 */
+        *seq = ntohs(icmp6->icmp6_seq); /* 序号 */
+        return 1;                       /* 匹配 */
+    }
+    if (icmp6->icmp6_type != ICMP6_TIME_EXCEEDED && icmp6->icmp6_type != ICMP6_DST_UNREACH) return 0; /* 其它类型（包括回环上看到的自己的请求）忽略 */
+    if (n < (ssize_t)(sizeof(struct icmp6_hdr) + sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr))) return 0; /* 引用部分不完整 */
+    ip6 = (const struct ip6_hdr *)(buf + sizeof(struct icmp6_hdr)); /* 原始 IPv6 头 */
+    if (ip6->ip6_nxt != IPPROTO_ICMPV6) return 0; /* 原始报文不是 ICMPv6 */
+    inner = (const struct icmp6_hdr *)(buf + sizeof(struct icmp6_hdr) + sizeof(struct ip6_hdr)); /* 原始 Echo 头 */
+    if (inner->icmp6_type != ICMP6_ECHO_REQUEST || ntohs(inner->icmp6_id) != (unsigned short)pid) return 0; /* 不是本进程的 */
+    *seq = ntohs(inner->icmp6_seq);     /* 原始报文的序号 */
+    return 1;                           /* 匹配 */
+}
+
+/* 设置 *deadline 为 ms 毫秒之后（单调时钟） */
+static void deadline_after(struct timespec *deadline, int ms) /* 无返回值 */
+{
+    pkt_ts_now(deadline);               /* 从现在起计时 */
+    deadline->tv_sec += ms / 1000;      /* 加秒 */
+    deadline->tv_nsec += (long)(ms % 1000) * 1000000L; /* 加纳秒 */
+    if (deadline->tv_nsec >= 1000000000L) { /* 进位 */
+        deadline->tv_sec++;             /* 秒加一 */
+        deadline->tv_nsec -= 1000000000L; /* 纳秒减一秒 */
+    }
+}
+
+/* 等待套接字可读（错误队列非空也算）直到 deadline：可读返回 1，超时 0，出错 -1 */
+static int wait_readable(int sock, const struct timespec *deadline) /* 等待可读 */
+{
+    struct timeval select_tv;           /* select 超时 */
+    fd_set readfds;                     /* select 读集合 */
+    long left;                          /* 剩余毫秒 */
+    int rv;                             /* select 返回值 */
+
+    for (;;) {                          /* 被信号打断时重试 */
+        left = ms_until(deadline);      /* 剩余时间 */
+        FD_ZERO(&readfds);              /* 清空 readfds */
+        FD_SET(sock, &readfds);         /* 加入套接字 */
+        select_tv.tv_sec = left / 1000; /* 超时秒 */
+        select_tv.tv_usec = (left % 1000) * 1000; /* 超时微秒 */
+        rv = select(sock + 1, &readfds, NULL, NULL, &select_tv); /* 等待 */
+        if (rv < 0 && errno == EINTR) continue; /* 重试 */
+        if (rv < 0) perror("select");   /* 打印错误 */
+        return rv < 0 ? -1 : (rv > 0);  /* 返回结果 */
+    }
+}
+
+/*
+ * 非阻塞接收一个 ICMPv6 报文，同时取出内核接收时间戳和用户态接收时间。
+ * 返回报文长度，没有数据返回 0，出错返回 -1。
+ */
+static ssize_t recv_icmp6(int sock, char *buf, size_t buflen, struct sockaddr_in6 *from,
+                          struct pkt_ts *rx_ts, struct timespec *rx_mono) /* 接收一个报文 */
 {
-    long sec_diff;                      /* 秒差变量 */
-    long usec_diff;                     /* 微秒差变量 */
-    long msec;                          /* 结果毫秒变量 */
-
-    sec_diff = endtv->tv_sec - starttv->tv_sec; /* 计算秒差 */
-    usec_diff = endtv->tv_usec - starttv->tv_usec; /* 计算微秒差 */
-    msec = sec_diff * 1000L + usec_diff / 1000L;   /* 转换并合并为毫秒 */
-    return msec;                        /* 返回毫秒差 */
+    char control[512];                  /* 控制消息缓冲（接收时间戳） */
+    struct iovec iov;                   /* 数据缓冲描述 */
+    struct msghdr msg;                  /* recvmsg 参数 */
+    ssize_t n;                          /* recvmsg 返回值 */
+
+    iov.iov_base = buf;                 /* 数据缓冲 */
+    iov.iov_len = buflen;               /* 缓冲长度 */
+    memset(&msg, 0, sizeof(msg));       /* 清零 */
+    msg.msg_name = from;                /* 源地址 */
+    msg.msg_namelen = sizeof(*from);    /* 源地址长度 */
+    msg.msg_iov = &iov;                 /* 数据 */
+    msg.msg_iovlen = 1;                 /* 一段 */
+    msg.msg_control = control;          /* 控制消息 */
+    msg.msg_controllen = sizeof(control); /* 控制消息长度 */
+    n = recvmsg(sock, &msg, MSG_DONTWAIT); /* 非阻塞接收 */
+    if (n < 0) {                        /* 没有数据或出错 */
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0; /* 暂时没有 */
+        perror("recvmsg");              /* 其它错误打印 */
+        return -1;                      /* 失败 */
+    }
+    pkt_ts_now(rx_mono);                /* 用户态接收时间（没有内核时间戳时使用） */
+    pkt_ts_from_msg(&msg, rx_ts);       /* 内核接收时间戳 */
+    return n;                           /* 报文长度 */
+}
+
+/* 取走错误队列中的发送时间戳，序号为 tx_key 的存入 *tx_ts */
+static void drain_tx_timestamps(int sock, unsigned long tx_key, struct pkt_ts *tx_ts) /* 无返回值 */
+{
+    struct pkt_ts ts;                   /* 时间戳 */
+    unsigned long key;                  /* 序号 */
+
+    while (pkt_ts_read_tx(sock, &key, &ts) == 1) { /* 逐个读取 */
+        if (key == tx_key) *tx_ts = ts; /* 本次探测的发送时间戳；更早的是超时探测留下的 */
+    }
+}
+
+/*
+ * 在 timeout_ms 内等待本次探测的回应。其它报文（迟到的旧回应、别的进程
+ * 的 ICMPv6）会被跳过而不是当作结果。收到返回报文长度，超时返回 0，
+ * 出错返回 -1；rx_ts、rx_mono 为接收时间，tx_ts 为发送时间戳（若有）。
+ */
+static ssize_t wait_for_reply(int sock, int pid, int seq, unsigned long tx_key, int timeout_ms,
+                              char *buf, size_t buflen, struct sockaddr_in6 *from,
+                              struct pkt_ts *tx_ts, struct pkt_ts *rx_ts, struct timespec *rx_mono) /* 等待回应 */
+{
+    struct timespec deadline;           /* 截止时间 */
+    ssize_t n;                          /* 接收长度 */
+    int rv;                             /* 等待结果 */
+    int got;                            /* 回应中的序号 */
+
+    deadline_after(&deadline, timeout_ms); /* 从现在起计时 */
+    for (;;) {                          /* 直到收到回应或超时 */
+        rv = wait_readable(sock, &deadline); /* 等待 */
+        if (rv <= 0) return rv;         /* 超时或出错 */
+        drain_tx_timestamps(sock, tx_key, tx_ts); /* 先收发送时间戳 */
+        while ((n = recv_icmp6(sock, buf, buflen, from, rx_ts, rx_mono)) > 0) { /* 取走所有已到达的报文 */
+            if (!reply_seq(buf, n, pid, &got) || got != (seq & 0xFFFF)) continue; /* 不是本次探测的回应 */
+            drain_tx_timestamps(sock, tx_key, tx_ts); /* 发送时间戳可能这时才到 */
+            return n;                   /* 成功 */
+        }
+        if (n < 0) return -1;           /* 接收出错 */
+        if (ms_until(&deadline) == 0) return 0; /* 只收到无关报文且已到时 */
+    }
 }
 
 /* 将 sockaddr_in6 地址转换为文本字符串，buf 长度应至少为 INET6_STRLEN */
@@ -70,6 +221,172 @@ static void print_icmp6_info(unsigned char type, unsigned char code) /* 根据
     }
 }
 
+/* 打印本跳 RTT 汇总并换行 */
+static void print_hop_summary(const struct rtt_stats *st) /* 无返回值 */
+{
+    printf("  min/avg/max/mdev = %.3f/%.3f/%.3f/%.3f ms\n", st->min / 1000.0, rtt_stats_avg(st) / 1000.0,
+           st->max / 1000.0, rtt_stats_mdev(st) / 1000.0); /* 单位毫秒，微秒精度 */
+}
+
+/* 用 sendmsg 发送一个 Echo 请求，hop limit 通过 IPV6_HOPLIMIT 控制消息逐包指定 */
+static ssize_t send_echo_hoplimit(int sock, const struct sockaddr_in6 *dest, int pid, int seq, int hop) /* 返回发送字节数 */
+{
+    char sendbuf[PACKET_SIZE];          /* 发送缓冲 */
+    char control[CMSG_SPACE(sizeof(int))]; /* 控制消息缓冲 */
+    struct icmp6_hdr *icmp6;            /* ICMPv6 头 */
+    struct iovec iov;                   /* 数据缓冲描述 */
+    struct msghdr msg;                  /* sendmsg 参数 */
+    struct cmsghdr *cmsg;               /* hop limit 控制消息 */
+
+    memset(sendbuf, 0, sizeof(sendbuf)); /* 清零发送缓冲 */
+    icmp6 = (struct icmp6_hdr *)sendbuf; /* ICMPv6 头 */
+    icmp6->icmp6_type = ICMP6_ECHO_REQUEST; /* Echo 请求 */
+    icmp6->icmp6_code = 0;              /* code 为 0 */
+    icmp6->icmp6_cksum = 0;             /* 检查和由内核计算 */
+    icmp6->icmp6_id = htons((unsigned short)pid); /* 标识 */
+    icmp6->icmp6_seq = htons((unsigned short)seq); /* 序号 */
+
+    iov.iov_base = sendbuf;             /* 数据 */
+    iov.iov_len = sizeof(sendbuf);      /* 长度 */
+    memset(&msg, 0, sizeof(msg));       /* 清零 */
+    memset(control, 0, sizeof(control)); /* 清零控制消息 */
+    msg.msg_name = (void *)dest;        /* 目标地址 */
+    msg.msg_namelen = sizeof(*dest);    /* 地址长度 */
+    msg.msg_iov = &iov;                 /* 数据 */
+    msg.msg_iovlen = 1;                 /* 一段 */
+    msg.msg_control = control;          /* 控制消息 */
+    msg.msg_controllen = sizeof(control); /* 控制消息长度 */
+    cmsg = CMSG_FIRSTHDR(&msg);         /* 唯一的控制消息 */
+    cmsg->cmsg_level = IPPROTO_IPV6;    /* IPv6 层 */
+    cmsg->cmsg_type = IPV6_HOPLIMIT;    /* 本包的 hop limit */
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int)); /* 长度 */
+    memcpy(CMSG_DATA(cmsg), &hop, sizeof(int)); /* 写入 hop limit */
+    return sendmsg(sock, &msg, 0);      /* 发送 */
+}
+
+/*
+ * 并行模式：所有跳的所有探测一次发出，每个探测用 sendmsg 逐包携带自己的
+ * hop limit，然后在一个接收循环里按回应（或差错报文所引用的原始 Echo 头）
+ * 中的序号分发到对应探测。目的地回应后、比它近的跳都已回应即提前结束，
+ * 否则最多等到最后一次发送之后 timeout_ms。整个过程约为一个 RTT 加超时。
+ * 成功返回 0。
+ */
+static int trace_parallel(int sock, const struct sockaddr_in6 *dest, int pid, int max_hops, int probes,
+                          int timeout_ms, int ts_mode) /* 并行追踪 */
+{
+    struct hop_probe *pr;               /* 探测数组 */
+    int *key_probe;                     /* 发送时间戳序号 -> 探测编号 */
+    int total;                          /* 探测总数 */
+    int nsent;                          /* 成功发送的个数 */
+    int dest_hop;                       /* 目的地所在的跳（未知时为 max_hops + 1） */
+    int pending;                        /* dest_hop 之内尚未回应的探测数 */
+    int i;                              /* 探测编号 */
+    int hop;                            /* 跳号 */
+    int got;                            /* 回应中的序号 */
+    int rv;                             /* 等待结果 */
+    ssize_t n;                          /* 接收长度 */
+    unsigned long key;                  /* 发送时间戳序号 */
+    struct pkt_ts ts;                   /* 发送时间戳 */
+    struct pkt_ts rx_ts;                /* 接收时间戳 */
+    struct timespec rx_mono;            /* 接收时间 */
+    struct timespec deadline;           /* 截止时间 */
+    struct sockaddr_in6 from;           /* 回应来源 */
+    struct rtt_stats hop_rtt;           /* 本跳 RTT 汇总 */
+    char recvbuf[1500];                 /* 接收缓冲 */
+    char addrstr[INET6_STRLEN];         /* 地址文本 */
+    double rtt;                         /* 单次 RTT（微秒） */
+    int rtt_src;                        /* RTT 来源 */
+    int printed;                        /* 本跳已打印过的地址所属探测，-1 为无 */
+
+    total = max_hops * probes;          /* 探测总数，不超过 16 位序号空间 */
+    pr = (struct hop_probe *)calloc((size_t)total, sizeof(*pr)); /* 分配探测数组 */
+    key_probe = (int *)calloc((size_t)total, sizeof(*key_probe)); /* 分配序号映射 */
+    if (pr == NULL || key_probe == NULL) { /* 分配失败 */
+        fprintf(stderr, "out of memory\n"); /* 提示 */
+        free(pr);                       /* 释放 */
+        free(key_probe);                /* 释放 */
+        return -1;                      /* 失败 */
+    }
+
+    /* 一次发出全部探测：近的跳先发，让它们的差错报文先回来 */
+    nsent = 0;                          /* 尚未发送 */
+    for (i = 0; i < total; i++) {       /* 逐个探测 */
+        pr[i].hop = i / probes + 1;     /* 所属跳 */
+        pkt_ts_now(&pr[i].mono_tx);     /* 紧挨着发送读取单调时钟 */
+        if (send_echo_hoplimit(sock, dest, pid, i, pr[i].hop) < 0) { /* 发送失败 */
+            perror("sendmsg");          /* 打印错误，该探测记为丢失 */
+            continue;                   /* 继续下一个 */
+        }
+        pr[i].sent = 1;                 /* 已发送 */
+        pr[i].tx_key = (unsigned long)nsent; /* 内核按成功发送次数编号 */
+        key_probe[nsent++] = i;         /* 登记序号 */
+    }
+
+    /* 接收循环：按序号分发回应 */
+    dest_hop = max_hops + 1;            /* 目的地未知 */
+    pending = nsent;                    /* 所有已发送的探测都在等 */
+    deadline_after(&deadline, timeout_ms); /* 最后一次发送之后开始计时 */
+    while (pending > 0) {               /* 还有要等的探测 */
+        rv = wait_readable(sock, &deadline); /* 等待 */
+        if (rv <= 0) break;             /* 超时或出错：剩下的都记为丢失 */
+        while (pkt_ts_read_tx(sock, &key, &ts) == 1) { /* 先收发送时间戳 */
+            if (key < (unsigned long)nsent) pr[key_probe[key]].tx_ts = ts; /* 填到对应探测 */
+        }
+        while ((n = recv_icmp6(sock, recvbuf, sizeof(recvbuf), &from, &rx_ts, &rx_mono)) > 0) { /* 取走所有已到达的报文 */
+            if (!reply_seq(recvbuf, n, pid, &got) || got >= total) continue; /* 不是本进程的探测 */
+            if (!pr[got].sent || pr[got].replied) continue; /* 重复的回应 */
+            pr[got].replied = 1;        /* 已回应 */
+            pr[got].rx_ts = rx_ts;      /* 接收时间戳 */
+            pr[got].mono_rx = rx_mono;  /* 接收时间 */
+            pr[got].from = from;        /* 来源 */
+            pr[got].type = ((struct icmp6_hdr *)recvbuf)->icmp6_type; /* 类型 */
+            pr[got].code = ((struct icmp6_hdr *)recvbuf)->icmp6_code; /* 代码 */
+            if (pr[got].hop <= dest_hop) pending--; /* 在关心的范围内 */
+            if (pr[got].type != ICMP6_TIME_EXCEEDED && pr[got].hop < dest_hop &&
+                memcmp(&from.sin6_addr, &dest->sin6_addr, sizeof(struct in6_addr)) == 0) { /* 目的地在更近的跳回应 */
+                for (i = pr[got].hop * probes; i < dest_hop * probes && i < total; i++) { /* 更远的跳不用再等 */
+                    if (pr[i].sent && !pr[i].replied) pending--; /* 移出等待 */
+                }
+                dest_hop = pr[got].hop; /* 记下目的地所在的跳 */
+            }
+        }
+        if (n < 0) break;               /* 接收出错 */
+    }
+    while (pkt_ts_read_tx(sock, &key, &ts) == 1) { /* 最后一批发送时间戳 */
+        if (key < (unsigned long)nsent) pr[key_probe[key]].tx_ts = ts; /* 填到对应探测 */
+    }
+
+    /* 按跳输出，格式与逐跳模式相同 */
+    for (hop = 1; hop <= max_hops && hop <= dest_hop; hop++) { /* 到目的地为止 */
+        rtt_stats_init(&hop_rtt);       /* 清空本跳汇总 */
+        printed = -1;                   /* 本跳还没打印地址 */
+        printf("%2d  ", hop);           /* 跳号 */
+        for (i = (hop - 1) * probes; i < hop * probes; i++) { /* 本跳的探测 */
+            if (!pr[i].replied) {       /* 没有回应 */
+                printf(" *");           /* 星号 */
+                continue;               /* 下一个 */
+            }
+            rtt = pkt_ts_rtt_us(&pr[i].tx_ts, &pr[i].rx_ts, &pr[i].mono_tx, &pr[i].mono_rx, &rtt_src); /* 微秒 */
+            rtt_stats_add(&hop_rtt, rtt); /* 计入汇总 */
+            if (printed < 0 || memcmp(&pr[printed].from.sin6_addr, &pr[i].from.sin6_addr, sizeof(struct in6_addr)) != 0) { /* 来源变化才打印地址 */
+                printf(" %s", addr6_to_str(&pr[i].from, addrstr, sizeof(addrstr))); /* 地址 */
+                printed = i;            /* 记下 */
+            }
+            printf("  %.3f ms", rtt / 1000.0); /* RTT */
+            if (rtt_src == TS_SRC_MONO && ts_mode >= 0) printf(" (mono)"); /* 标出未能用内核时间戳的样本 */
+        }
+        if (printed >= 0) {             /* 有回应 */
+            print_icmp6_info(pr[printed].type, pr[printed].code); /* 类型说明 */
+            print_hop_summary(&hop_rtt); /* 本跳统计 */
+        } else {
+            printf("\n");              /* 仅换行 */
+        }
+    }
+    free(pr);                           /* 释放 */
+    free(key_probe);                    /* 释放 */
+    return 0;                           /* 成功 */
+}
+
 /* 主程序 */
 int main(int argc, char *argv[]) /* argc/argv 参数 */
 {
@@ -80,37 +397,53 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
     int pid;                            /* 进程 id，用作 ICMP id 字段 */
     int hop;                            /* 当前 hop 索引 */
     int probe;                          /* 当前 probe 索引 */
-    struct timeval tv_start;            /* 发送时间 */
-    struct timeval tv_end;              /* 接收时间 */
-    fd_set readfds;                     /* select 的读集合 */
-    struct timeval select_tv;           /* select 超时时间 */
-    int nfds;                           /* select 的第一个参数 */
-    int rv;                             /* select 返回值 */
-    ssize_t n;                          /* recvfrom/sendto 返回值 */
+    struct timeval tv_start;            /* 写入 payload 的时间 */
+    struct timespec mono_start;         /* 发送前的单调时钟读数 */
+    struct timespec mono_end;           /* 接收时的单调时钟读数 */
+    struct pkt_ts tx_ts;                /* 内核发送时间戳 */
+    struct pkt_ts rx_ts;                /* 内核接收时间戳 */
+    unsigned long tx_key;               /* 下一次成功发送的时间戳序号 */
+    int ts_mode;                        /* 内核时间戳能力（TS_SRC_*，-1 为无） */
+    int rtt_src;                        /* 本次 RTT 的时间戳来源 */
+    ssize_t n;                          /* recvmsg/sendto 返回值 */
     char sendbuf[PACKET_SIZE];          /* 发送缓冲（包含 ICMPv6 头和 payload） */
     char recvbuf[1500];                 /* 接收缓冲 */
     struct sockaddr_in6 dest_sa;        /* 目标 IPv6 地址 */
     socklen_t dest_len;                 /* 目标地址长度 */
     struct sockaddr_in6 from_sa;        /* 接收方地址 */
-    socklen_t from_len;                 /* 接收方地址长度 */
     char addrstr[INET6_STRLEN];         /* 源地址文本缓冲 */
     int hop_limit_opt;                  /* hop limit 用于 setsockopt */
     int seq;                            /* ICMP 序列号 */
     struct icmp6_hdr *icmp6;            /* 指向发送/接收缓冲中 icmp6 头的指针 */
-    long rtt;                           /* 单次 RTT（毫秒） */
-    long rtt_min;                       /* 本跳最小 RTT */
-    long rtt_max;                       /* 本跳最大 RTT */
-    long rtt_sum;                       /* 本跳 RTT 总和（用于计算平均） */
+    double rtt;                         /* 单次 RTT（微秒） */
+    struct rtt_stats hop_rtt;           /* 本跳 RTT 汇总（微秒） */
+    int parallel;                       /* -P：并行探测所有跳 */
+    int opt;                            /* getopt 返回值 */
+    char *prog;                         /* 程序名 */
 
     /* 参数检查与解析 */
+    prog = argv[0];                     /* 保存程序名 */
+    parallel = 0;                       /* 默认逐跳探测 */
+    while ((opt = getopt(argc, argv, "P")) != -1) { /* 解析选项 */
+        if (opt == 'P') {               /* 并行模式 */
+            parallel = 1;               /* 打开 */
+        } else {
+            argc = 0;                   /* 未知选项：打印用法 */
+            break;                      /* 结束解析 */
+        }
+    }
+    argc -= optind - 1;                 /* 去掉选项，位置参数从 argv[1] 开始 */
+    argv += optind - 1;                 /* 同上 */
     if (argc < 2) {                     /* 如果没有提供目标 */
-        fprintf(stderr, "Usage: %s <ipv6-literal-address> [max_hops] [probes] [timeout_ms]\n", argv[0]); /* 打印用法，强调目标必须为 IPv6 字面地址 */
+        fprintf(stderr, "Usage: %s [-P] <ipv6-literal-address> [max_hops] [probes] [timeout_ms]\n", prog); /* 打印用法，强调目标必须为 IPv6 字面地址 */
+        fprintf(stderr, "  -P  probe all hops in parallel (one RTT plus timeout instead of per-hop waits)\n"); /* 并行模式说明 */
         return 1;                       /* 退出 */
     }
     target = argv[1];                   /* 取得目标字符串（应为 IPv6 文本地址，如 2001:db8::1） */
     if (argc >= 3) {                    /* 若提供了 max_hops */
         max_hops = atoi(argv[2]);       /* 转换为整数 */
         if (max_hops <= 0) max_hops = DEFAULT_MAX_HOPS; /* 非法值用默认 */
+        if (max_hops > MAX_HOP_LIMIT) max_hops = MAX_HOP_LIMIT; /* 不超过 hop limit 上限 */
     } else {
         max_hops = DEFAULT_MAX_HOPS;    /* 未提供则用默认 */
     }
@@ -127,6 +460,8 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
         timeout_ms = DEFAULT_TIMEOUT_MS;/* 默认超时 */
     }
 
+    if (parallel && max_hops * probes > 0x10000) probes = 0x10000 / max_hops; /* 并行模式每个探测的序号须在 16 位内唯一 */
+
     /* 注册信号处理器，确保 Ctrl-C 等能干净退出 */
     signal(SIGINT, cleanup_and_exit);   /* 注册 SIGINT （Ctrl-C） */
     signal(SIGTERM, cleanup_and_exit);  /* 注册 SIGTERM */
@@ -149,20 +484,31 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
         return 1;                        /* 退出 */
     }
 
+    /* 开启内核收发时间戳，不支持时退回单调时钟 */
+    ts_mode = pkt_ts_enable(g_sock, NULL); /* 只用软件时间戳（硬件时间戳需指定网卡） */
+    tx_key = 0;                          /* 内核从 0 开始给成功的发送编号 */
+
     /* 取得进程 id 并用作 ICMP 标识 id 字段 */
     pid = getpid() & 0xFFFF;             /* 使用低 16 位作为 id */
 
     /* 打印启动信息 */
-    printf("tr6_icmp_echo_traceroute to %s, max_hops %d, probes %d, timeout %d ms\n", target, max_hops, probes, timeout_ms); /* 输出配置信息 */
+    printf("tr6_icmp_echo_traceroute to %s, max_hops %d, probes %d, timeout %d ms, timestamps %s%s\n", target, max_hops, probes, timeout_ms,
+           ts_mode >= 0 ? "kernel" : "monotonic", parallel ? ", parallel" : ""); /* 输出配置信息 */
+
+    /* 并行模式：一次发出所有探测 */
+    if (parallel) {                      /* 并行 */
+        fflush(stdout);                  /* 先输出启动信息 */
+        opt = trace_parallel(g_sock, &dest_sa, pid, max_hops, probes, timeout_ms, ts_mode); /* 追踪 */
+        close(g_sock);                   /* 关闭套接字 */
+        return opt < 0 ? 1 : 0;          /* 返回结果 */
+    }
 
     /* 主循环：逐跳发送 ICMPv6 Echo 报文 */
     seq = 0;                             /* 初始化序列号 */
     for (hop = 1; hop <= max_hops; hop++) { /* 对每一跳从 1 开始到 max_hops */
         int replied_count;               /* 本跳收到回复的次数计数 */
         replied_count = 0;               /* 初始化为 0 */
-        rtt_min = 0L;                    /* 初始化最小 RTT */
-        rtt_max = 0L;                    /* 初始化最大 RTT */
-        rtt_sum = 0L;                    /* 初始化 RTT 总和 */
+        rtt_stats_init(&hop_rtt);        /* 清空本跳 RTT 汇总 */
 
         printf("%2d  ", hop);            /* 打印当前跳号 */
         fflush(stdout);                  /* 立即刷新输出以便实时显示 */
@@ -195,10 +541,9 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
             sendbuf[sizeof(struct icmp6_hdr) + 2] = (char)((tv_start.tv_usec >> 8) & 0xFF);  /* payload 字节2 */
             sendbuf[sizeof(struct icmp6_hdr) + 3] = (char)(tv_start.tv_usec & 0xFF);         /* payload 字节3 */
 
-            /* 记录发送时刻（再次记录，确保用于 RTT 计算的是发送时间） */
-            if (gettimeofday(&tv_start, NULL) < 0) { /* 获取发送时间 */
-                perror("gettimeofday");    /* 打印但继续 */
-            }
+            /* 记录发送时刻（单调时钟，没有内核时间戳时用它计算 RTT） */
+            memset(&tx_ts, 0, sizeof(tx_ts)); /* 发送时间戳稍后从错误队列取得 */
+            pkt_ts_now(&mono_start);     /* 紧挨着发送读取 */
 
             /* 发送 ICMPv6 Echo 请求到目标地址 */
             n = sendto(g_sock, sendbuf, PACKET_SIZE, 0, (struct sockaddr *)&dest_sa, dest_len); /* 发送 raw ICMPv6 报文（长度为 PACKET_SIZE） */
@@ -210,53 +555,18 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
                 continue;                /* 继续下一个 probe */
             }
 
-            /* 使用 select 等待接收响应或超时 */
-            FD_ZERO(&readfds);            /* 清空 readfds */
-            FD_SET(g_sock, &readfds);     /* 将原始套接字加入集合 */
-            select_tv.tv_sec = timeout_ms / 1000; /* 设置 select 超时秒 */
-            select_tv.tv_usec = (timeout_ms % 1000) * 1000; /* 设置 select 超时微秒 */
-            nfds = g_sock + 1;            /* nfds 为最大 fd + 1 */
-
-            rv = select(nfds, &readfds, NULL, NULL, &select_tv); /* 等待可读事件或超时 */
-            if (rv == -1) {               /* select 出错 */
-                if (errno == EINTR) {     /* 被信号打断 */
-                    printf(" *");         /* 标注为星号 */
-                    fflush(stdout);      /* 刷新 */
-                    seq++;               /* 自增序列号 */
-                    continue;            /* 继续下一个 probe */
-                }
-                perror("select");         /* 其它错误打印 */
-                printf(" *");             /* 标注星号 */
-                fflush(stdout);          /* 刷新 */
-                seq++;                   /* 自增序列号 */
-                continue;                /* 继续下一个 probe */
-            } else if (rv == 0) {         /* 超时 */
+            /* 等待本次探测的回应（跳过无关报文）或超时 */
+            n = wait_for_reply(g_sock, pid, seq, tx_key, timeout_ms, recvbuf, sizeof(recvbuf), &from_sa,
+                               &tx_ts, &rx_ts, &mono_end); /* 等待 */
+            tx_key++;                     /* 成功发送一次，内核序号加一 */
+            if (n <= 0) {                 /* 超时或出错 */
                 printf(" *");             /* 打印星号 */
                 fflush(stdout);          /* 刷新 */
                 seq++;                   /* 自增序列号 */
                 continue;                /* 继续下一个 probe */
-            } else {                       /* 有可读数据 */
-                from_len = sizeof(from_sa); /* 初始化接收地址长度 */
-                n = recvfrom(g_sock, recvbuf, sizeof(recvbuf), 0, (struct sockaddr *)&from_sa, &from_len); /* 接收数据 */
-                if (n < 0) {              /* recvfrom 失败 */
-                    if (errno == EINTR) { /* 信号中断 */
-                        printf(" *");     /* 打星号 */
-                        fflush(stdout);  /* 刷新 */
-                        seq++;           /* 自增序列号 */
-                        continue;        /* 继续下一个 probe */
-                    }
-                    perror("recvfrom");    /* 其它错误打印 */
-                    printf(" *");         /* 标注 */
-                    fflush(stdout);      /* 刷新 */
-                    seq++;               /* 自增序列号 */
-                    continue;            /* 继续下一个 probe */
-                }
-
-                /* 接收到回应，记录时间并计算 RTT */
-                if (gettimeofday(&tv_end, NULL) < 0) { /* 获取接收时间 */
-                    perror("gettimeofday"); /* 打印但继续 */
-                }
-                rtt = time_diff_ms(&tv_end, &tv_start); /* 计算 RTT（毫秒） */
+            } else {                       /* 收到回应 */
+                /* 计算 RTT：两端都有内核时间戳时用内核的，否则用单调时钟 */
+                rtt = pkt_ts_rtt_us(&tx_ts, &rx_ts, &mono_start, &mono_end, &rtt_src); /* 微秒 */
 
                 /* 解析 ICMPv6 报文的类型与代码 */
                 /* 对于原始 ICMPv6 套接字，recvbuf 起始一般就是 icmp6 头 */
@@ -265,7 +575,8 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
                 addr6_to_str(&from_sa, addrstr, sizeof(addrstr)); /* 将来源地址转为文本 */
 
                 /* 打印本次 probe 的结果信息（地址/RTT/ICMP 类型说明） */
-                printf(" %s  %ld ms", addrstr, rtt); /* 仅打印地址与 RTT（无主机名解析） */
+                printf(" %s  %.3f ms", addrstr, rtt / 1000.0); /* 仅打印地址与 RTT（无主机名解析） */
+                if (rtt_src == TS_SRC_MONO && ts_mode >= 0) printf(" (mono)"); /* 标出未能用内核时间戳的样本 */
                 /* 打印 ICMPv6 类型/代码的可读信息 */
                 if (n >= (ssize_t)sizeof(struct icmp6_hdr)) { /* 确保接收到的数据至少包含 icmp6 头 */
                     print_icmp6_info(icmp6->icmp6_type, icmp6->icmp6_code); /* 打印类型/代码说明 */
@@ -273,16 +584,8 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
 
                 fflush(stdout);             /* 刷新输出 */
 
-                /* 累计 RTT 统计量（最小/最大/和） */
-                if (replied_count == 0) {    /* 如果是本跳首次收到回复 */
-                    rtt_min = rtt;           /* 初始化最小 RTT */
-                    rtt_max = rtt;           /* 初始化最大 RTT */
-                    rtt_sum = rtt;           /* 初始化和 */
-                } else {
-                    if (rtt < rtt_min) rtt_min = rtt; /* 更新最小 */
-                    if (rtt > rtt_max) rtt_max = rtt; /* 更新最大 */
-                    rtt_sum += rtt;         /* 累计和 */
-                }
+                /* 累计 RTT 统计量 */
+                rtt_stats_add(&hop_rtt, rtt); /* 计入本跳汇总 */
                 replied_count++;            /* 增加回复计数 */
 
                 /* 如果收到的 ICMP 类型是 Echo Reply 且来源地址就是目标地址，则说明到达目的地 */
@@ -291,9 +594,7 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
                     if (memcmp(&from_sa.sin6_addr, &dest_sa.sin6_addr, sizeof(struct in6_addr)) == 0) { /* 地址相同 */
                         /* 打印换行并打印本跳统计 */
                         if (replied_count > 0) { /* 如果本跳有回复 */
-                            long avg;          /* 平均 RTT 变量 */
-                            avg = rtt_sum / replied_count; /* 计算平均（整数） */
-                            printf("  min/avg/max = %ld/%ld/%ld ms\n", rtt_min, avg, rtt_max); /* 打印统计 */
+                            print_hop_summary(&hop_rtt); /* 打印本跳统计 */
                         } else {
                             printf("\n");     /* 否则仅换行 */
                         }
@@ -307,9 +608,7 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
                     /* 如果来源地址就是目标地址，则我们到达了目的地（Destination Unreachable 的情形下） */
                     if (memcmp(&from_sa.sin6_addr, &dest_sa.sin6_addr, sizeof(struct in6_addr)) == 0) { /* 地址比较 */
                         if (replied_count > 0) { /* 打印本跳统计 */
-                            long avg2;         /* 平均 RTT 变量 */
-                            avg2 = rtt_sum / replied_count; /* 计算平均 */
-                            printf("  min/avg/max = %ld/%ld/%ld ms\n", rtt_min, avg2, rtt_max); /* 打印统计 */
+                            print_hop_summary(&hop_rtt); /* 打印本跳统计 */
                         } else {
                             printf("\n");     /* 仅换行 */
                         }
@@ -324,9 +623,7 @@ int main(int argc, char *argv[]) /* argc/argv 参数 */
 
         /* 在 probes 循环结束后打印本跳汇总（若有收到回复） */
         if (replied_count > 0) {         /* 若至少收到一次回复 */
-            long avg_main;               /* 本跳平均 RTT */
-            avg_main = rtt_sum / replied_count; /* 计算平均 RTT（整数） */
-            printf("  min/avg/max = %ld/%ld/%ld ms\n", rtt_min, avg_main, rtt_max); /* 打印本跳统计 */
+            print_hop_summary(&hop_rtt); /* 打印本跳统计 */
         } else {
             printf("\n");               /* 没有收到回复则换行 */
         }
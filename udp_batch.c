@@ -0,0 +1,184 @@
+#define _GNU_SOURCE              /* recvmmsg、sendmmsg、struct mmsghdr */
+
+#include <stdlib.h>              /* calloc, free */
+#include <string.h>              /* memcpy, memset */
+#include <errno.h>               /* errno */
+#include <sys/socket.h>          /* recvmmsg, sendmmsg, CMSG_* */
+#include <sys/uio.h>             /* struct iovec */
+#include <netinet/in.h>          /* IPPROTO_UDP */
+#include <netinet/udp.h>         /* UDP_SEGMENT, UDP_GRO */
+#include "udp_batch.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103          /* Linux 4.18 */
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104              /* Linux 5.0 */
+#endif
+
+#define CTRL_SPACE CMSG_SPACE(sizeof(int)) /* 每个槽位一个控制消息（GRO 为 int，GSO 为 16 位） */
+
+int udp_batch_init(struct udp_batch *b, int cap, size_t buf_size) {
+    memset(b, 0, sizeof(*b));
+    b->cap = cap;
+    b->buf_size = buf_size;
+    b->rx = (struct mmsghdr *)calloc((size_t)cap, sizeof(struct mmsghdr));
+    b->rx_iov = (struct iovec *)calloc((size_t)cap, sizeof(struct iovec));
+    b->rx_addr = (struct sockaddr_storage *)calloc((size_t)cap, sizeof(struct sockaddr_storage));
+    b->rx_buf = (char *)malloc((size_t)cap * buf_size);
+    b->rx_ctrl = (char *)calloc((size_t)cap, CTRL_SPACE);
+    b->rx_seg = (size_t *)calloc((size_t)cap, sizeof(size_t));
+    b->tx = (struct mmsghdr *)calloc((size_t)cap, sizeof(struct mmsghdr));
+    b->tx_iov = (struct iovec *)calloc((size_t)cap, sizeof(struct iovec));
+    b->tx_addr = (struct sockaddr_storage *)calloc((size_t)cap, sizeof(struct sockaddr_storage));
+    b->tx_buf = (char *)malloc((size_t)cap * buf_size);
+    b->tx_ctrl = (char *)calloc((size_t)cap, CTRL_SPACE);
+    if (b->rx == NULL || b->rx_iov == NULL || b->rx_addr == NULL || b->rx_buf == NULL ||
+        b->rx_ctrl == NULL || b->rx_seg == NULL || b->tx == NULL || b->tx_iov == NULL ||
+        b->tx_addr == NULL || b->tx_buf == NULL || b->tx_ctrl == NULL) {
+        udp_batch_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+void udp_batch_free(struct udp_batch *b) {
+    free(b->rx);
+    free(b->rx_iov);
+    free(b->rx_addr);
+    free(b->rx_buf);
+    free(b->rx_ctrl);
+    free(b->rx_seg);
+    free(b->tx);
+    free(b->tx_iov);
+    free(b->tx_addr);
+    free(b->tx_buf);
+    free(b->tx_ctrl);
+    memset(b, 0, sizeof(*b));
+}
+
+int udp_batch_offload(struct udp_batch *b, int fd) {
+    int on = 1;
+    int val;
+    socklen_t len = sizeof(val);
+
+    /* GRO 合并后的包可达 64KB，缓冲不够大时不能开启，否则会被截断 */
+    if (b->buf_size >= UDP_BATCH_GRO_BUF &&
+        setsockopt(fd, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0) {
+        b->gro = 1;
+    }
+    /* 能读取 UDP_SEGMENT 说明内核支持 GSO */
+    if (getsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &val, &len) == 0) {
+        b->gso = 1;
+    }
+    return 0;
+}
+
+int udp_batch_recv(struct udp_batch *b, int fd, int flags) {
+    int i;
+    int n;
+    struct cmsghdr *cm;
+
+    for (i = 0; i < b->cap; i++) { /* recvmmsg 会改写长度字段，每批重新设置 */
+        struct msghdr *h = &b->rx[i].msg_hdr;
+        b->rx_iov[i].iov_base = b->rx_buf + (size_t)i * b->buf_size;
+        b->rx_iov[i].iov_len = b->buf_size;
+        h->msg_name = &b->rx_addr[i];
+        h->msg_namelen = sizeof(b->rx_addr[i]);
+        h->msg_iov = &b->rx_iov[i];
+        h->msg_iovlen = 1;
+        h->msg_control = b->gro ? b->rx_ctrl + (size_t)i * CTRL_SPACE : NULL;
+        h->msg_controllen = b->gro ? CTRL_SPACE : 0;
+        h->msg_flags = 0;
+        b->rx[i].msg_len = 0;
+    }
+
+    do {
+        n = recvmmsg(fd, b->rx, (unsigned int)b->cap, flags == 0 ? MSG_WAITFORONE : flags, NULL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        b->nrx = 0;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) && (flags & MSG_DONTWAIT) ? 0 : -1;
+    }
+
+    for (i = 0; i < n; i++) {    /* 取出 GRO 段长 */
+        b->rx_seg[i] = 0;
+        if (!b->gro) continue;
+        for (cm = CMSG_FIRSTHDR(&b->rx[i].msg_hdr); cm != NULL; cm = CMSG_NXTHDR(&b->rx[i].msg_hdr, cm)) {
+            if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+                int seg;
+                memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+                if ((size_t)seg < b->rx[i].msg_len) b->rx_seg[i] = (size_t)seg;
+            }
+        }
+    }
+    b->nrx = n;
+    return n;
+}
+
+const char *udp_batch_data(const struct udp_batch *b, int i, size_t *len, size_t *seg) {
+    *len = b->rx[i].msg_len;
+    if (seg != NULL) *seg = b->rx_seg[i];
+    return b->rx_buf + (size_t)i * b->buf_size;
+}
+
+const struct sockaddr *udp_batch_peer(const struct udp_batch *b, int i, socklen_t *len) {
+    *len = b->rx[i].msg_hdr.msg_namelen;
+    return (const struct sockaddr *)&b->rx_addr[i];
+}
+
+char *udp_batch_slot(struct udp_batch *b) {
+    if (b->ntx == b->cap) return NULL;
+    return b->tx_buf + (size_t)b->ntx * b->buf_size;
+}
+
+void udp_batch_commit(struct udp_batch *b, size_t len, const struct sockaddr *to, socklen_t tolen,
+                      size_t seg) {
+    int i = b->ntx;
+    struct msghdr *h = &b->tx[i].msg_hdr;
+
+    memcpy(&b->tx_addr[i], to, tolen);
+    b->tx_iov[i].iov_base = b->tx_buf + (size_t)i * b->buf_size;
+    b->tx_iov[i].iov_len = len;
+    h->msg_name = &b->tx_addr[i];
+    h->msg_namelen = tolen;
+    h->msg_iov = &b->tx_iov[i];
+    h->msg_iovlen = 1;
+    h->msg_control = NULL;
+    h->msg_controllen = 0;
+    h->msg_flags = 0;
+    if (seg > 0 && seg < len && b->gso) { /* 交给内核按段切分 */
+        struct cmsghdr *cm;
+        unsigned short s = (unsigned short)seg; /* 内核要求 UDP_SEGMENT 为 16 位整数 */
+        h->msg_control = b->tx_ctrl + (size_t)i * CTRL_SPACE;
+        h->msg_controllen = CMSG_SPACE(sizeof(s));
+        cm = CMSG_FIRSTHDR(h);
+        cm->cmsg_level = IPPROTO_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(s));
+        memcpy(CMSG_DATA(cm), &s, sizeof(s));
+    }
+    b->ntx++;
+}
+
+int udp_batch_flush(struct udp_batch *b, int fd, int nonblock) {
+    int off = 0;
+    int sent = 0;
+    int failed = 0;
+    int n;
+
+    while (off < b->ntx) {
+        n = sendmmsg(fd, b->tx + off, (unsigned int)(b->ntx - off), nonblock ? MSG_DONTWAIT : 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break; /* 发送缓冲满：丢弃其余回复 */
+            off++;               /* sendmmsg 在第一条失败的消息处停下：跳过它继续 */
+            failed++;
+            continue;
+        }
+        off += n;
+        sent += n;
+    }
+    b->ntx = 0;
+    return sent == 0 && failed > 0 ? -1 : sent;
+}
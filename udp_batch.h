@@ -0,0 +1,74 @@
+#ifndef UDP_BATCH_H
+#define UDP_BATCH_H
+
+#include <stddef.h>     /* size_t */
+#include <sys/types.h>  /* ssize_t */
+#include <sys/socket.h> /* struct sockaddr, socklen_t */
+
+/*
+ * 批量收发 UDP 数据报：一次 recvmmsg 最多取回 cap 个数据报到预分配的缓冲环，
+ * 一次 sendmmsg 发出本批所有回复。内核支持时启用 UDP GRO（多个同流数据报
+ * 合并为一个缓冲，段长由控制消息给出）和 UDP GSO（一个缓冲按段长切分发出）。
+ */
+
+#define UDP_BATCH_GRO_BUF 65536  /* 启用 GRO 所需的最小接收缓冲（一个合并后的超级包） */
+
+struct mmsghdr;                  /* <sys/socket.h>，需 _GNU_SOURCE */
+
+struct udp_batch {
+    int cap;                     /* 每批最多数据报数 */
+    size_t buf_size;             /* 每个接收/发送槽位的缓冲大小 */
+    int gro;                     /* 接收端已启用 UDP_GRO */
+    int gso;                     /* 内核支持 UDP_SEGMENT */
+
+    /* 接收侧：cap 个槽位，recvmmsg 直接写入 */
+    struct mmsghdr *rx;          /* recvmmsg 消息数组 */
+    struct iovec *rx_iov;        /* 每个槽位一个 iovec */
+    struct sockaddr_storage *rx_addr; /* 对端地址 */
+    char *rx_buf;                /* cap * buf_size 连续缓冲 */
+    char *rx_ctrl;               /* GRO 段长控制消息 */
+    size_t *rx_seg;              /* 解析出的 GRO 段长，0 表示单个数据报 */
+    int nrx;                     /* 最近一次收到的数据报数 */
+
+    /* 发送侧：累积回复，udp_batch_flush 一次 sendmmsg 发出 */
+    struct mmsghdr *tx;          /* sendmmsg 消息数组 */
+    struct iovec *tx_iov;
+    struct sockaddr_storage *tx_addr;
+    char *tx_buf;                /* cap * buf_size 连续缓冲 */
+    char *tx_ctrl;               /* GSO 段长控制消息 */
+    int ntx;                     /* 已排队的回复数 */
+};
+
+/* 分配 cap 个槽位、每个 buf_size 字节的批量收发结构，成功返回 0 */
+int udp_batch_init(struct udp_batch *b, int cap, size_t buf_size);
+
+/* 释放 */
+void udp_batch_free(struct udp_batch *b);
+
+/* 尝试在 fd 上启用 GRO（需 buf_size >= UDP_BATCH_GRO_BUF）并探测 GSO 支持。
+ * 返回 0；不支持时对应标志保持为 0，收发照常逐个数据报进行 */
+int udp_batch_offload(struct udp_batch *b, int fd);
+
+/* 一次 recvmmsg 收取最多 cap 个数据报。flags 为 0 时阻塞到至少一个到达
+ * （MSG_WAITFORONE），为 MSG_DONTWAIT 时不阻塞。返回收到的数据报数，
+ * 没有数据时返回 0（仅 MSG_DONTWAIT），出错返回 -1 */
+int udp_batch_recv(struct udp_batch *b, int fd, int flags);
+
+/* 第 i 个接收槽位的数据、长度、GRO 段长（0 表示未合并）与对端地址 */
+const char *udp_batch_data(const struct udp_batch *b, int i, size_t *len, size_t *seg);
+const struct sockaddr *udp_batch_peer(const struct udp_batch *b, int i, socklen_t *len);
+
+/* 取得一个发送槽位的缓冲（容量 buf_size），队列满时返回 NULL；
+ * 填好后调用 udp_batch_commit 入队 */
+char *udp_batch_slot(struct udp_batch *b);
+
+/* 将当前发送槽位中的 len 字节发往 to。seg 非 0 且内核支持 GSO 时，
+ * 由内核按 seg 字节切分为多个数据报 */
+void udp_batch_commit(struct udp_batch *b, size_t len, const struct sockaddr *to, socklen_t tolen,
+                      size_t seg);
+
+/* 一次 sendmmsg 发出所有排队的回复（部分发送时继续发剩余部分）。
+ * nonblock 非零时遇到发送缓冲满即丢弃剩余回复。返回发出的消息数，出错返回 -1 */
+int udp_batch_flush(struct udp_batch *b, int fd, int nonblock);
+
+#endif /* UDP_BATCH_H */
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE  /* getopt、recvmmsg 等声明 */
+
 #include <memory.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -8,23 +10,132 @@
 #include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include "safeio.h"
+#include "udp_batch.h"
+#include "alog.h"
+#include "buf_pool.h"
 
 
 #define BUFFER_SIZE 1024
 #define SERVER_PORT 8080
+#define RESPONSE_PREFIX "Server received your message: "
+#define LOG_PKT_PER_SEC 100      /* 逐包日志每秒的上限，超出的条数汇总成一行 */
+
+static int quiet = 0;            /* -q：不逐包打印，每秒汇报一次包速率 */
+static unsigned long pkt_count;  /* 本秒已处理的数据报数 */
+static time_t pkt_second;        /* 当前统计的秒 */
+static struct alog_limit pkt_log = ALOG_LIMIT_INIT; /* 逐包日志的节流 */
+static int ev_rate = -1;         /* 二进制事件：每秒包速率 */
+
+/* 计数一个已处理的数据报，安静模式下每秒打印一次包速率 */
+static void count_packets(unsigned long n) {
+    time_t now = time(NULL);
+    pkt_count += n;
+    if (now != pkt_second) {
+        if (quiet && pkt_second != 0) alog_event(ALOG_INFO, ev_rate, pkt_count, 0, 0, 0);
+        pkt_count = 0;
+        pkt_second = now;
+    }
+}
+
+/* 批量模式：一次 recvmmsg 取回最多 batch 个数据报，本批回复一次 sendmmsg 发出。
+ * GRO 合并的超级包按段长拆开后逐个生成回复 */
+static void run_batched(int sockfd, int batch) {
+    struct udp_batch b;
+    int n, i;
+    size_t len, seg, off, plen;
+    const char *data;
+    const struct sockaddr *peer;
+    socklen_t peerlen;
+    char *slot;
+    int rlen;
+    unsigned long handled;
+
+    if (udp_batch_init(&b, batch, UDP_BATCH_GRO_BUF) != 0) {
+        fprintf(stderr, "malloc failed\n");
+        exit(EXIT_FAILURE);
+    }
+    udp_batch_offload(&b, sockfd);
+    alog_printf(ALOG_INFO, "Batched mode: %d datagrams per recvmmsg, GRO %s, GSO %s", batch,
+                b.gro ? "on" : "off", b.gso ? "available" : "unavailable");
+
+    while (1) {
+        n = udp_batch_recv(&b, sockfd, 0);
+        if (n < 0) {
+            perror("recvmmsg failed");
+            continue;
+        }
+        handled = 0;
+        for (i = 0; i < n; i++) {
+            data = udp_batch_data(&b, i, &len, &seg);
+            peer = udp_batch_peer(&b, i, &peerlen);
+            if (seg == 0) seg = len;
+            for (off = 0; off < len; off += seg) { /* 每个原始数据报一条回复 */
+                plen = len - off < seg ? len - off : seg;
+                if (plen > BUFFER_SIZE - 1) plen = BUFFER_SIZE - 1; /* 与逐包模式一致地截断 */
+                if (!quiet && alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+                    alog_printf(ALOG_INFO, "Received %lu bytes from %s:%d", (unsigned long)plen,
+                                inet_ntoa(((const struct sockaddr_in *)peer)->sin_addr),
+                                ntohs(((const struct sockaddr_in *)peer)->sin_port));
+                    alog_printf(ALOG_INFO, "Content: %.*s", (int)plen, data + off);
+                }
+                if ((slot = udp_batch_slot(&b)) == NULL) { /* 发送队列满：先发出 */
+                    udp_batch_flush(&b, sockfd, 0);
+                    slot = udp_batch_slot(&b);
+                }
+                rlen = snprintf(slot, b.buf_size, RESPONSE_PREFIX "%.*s", (int)plen, data + off);
+                udp_batch_commit(&b, (size_t)rlen, peer, peerlen, 0);
+                handled++;
+            }
+        }
+        count_packets(handled);
+        if (udp_batch_flush(&b, sockfd, 0) < 0) {
+            perror("sendmmsg failed");
+        } else if (!quiet && alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+            alog_printf(ALOG_INFO, "Responses sent successfully");
+        }
+    }
+}
 
-int main() {
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-b batch] [-q]\n"
+                    "  -b  receive up to batch datagrams per recvmmsg and reply with one sendmmsg\n"
+                    "  -q  quiet: print packets per second instead of every packet\n", prog);
+}
+
+int main(int argc, char *argv[]) {
     int sockfd;
     struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len;
-    char buffer[BUFFER_SIZE];
+    struct pbuf_pool pool;
+    struct pbuf *buf;
+    struct iovec iov[2];
+    struct msghdr msg;
     ssize_t recv_len;
     int ret;
-    char response[BUFFER_SIZE];
+    int batch = 0;               /* 0：逐包 recvfrom/sendto */
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:qh")) != -1) {
+        switch (opt) {
+        case 'b':
+            batch = atoi(optarg);
+            if (batch <= 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     /* 创建UDP套接字 */
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -48,40 +159,65 @@ int main() {
     }
 
     printf("UDP server is running on port %d...\n", SERVER_PORT);
+    fflush(stdout);              /* 之后的输出都经由 alog 的写线程 */
+    ev_rate = alog_event_define("%lu pkts/s");
+    alog_init(STDOUT_FILENO, STDERR_FILENO);
+
+    if (batch > 0) {
+        run_batched(sockfd, batch);  /* 不会返回 */
+    }
 
-    /* 主循环：接收和处理数据包 */
+    /* 主循环：接收和处理数据包。数据报收进池里的缓冲，回复由前缀和
+     * 同一缓冲中的内容拼成一次 sendmsg 发出，内容不再复制 */
+    pbuf_pool_init(&pool, 0);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &client_addr;
+    iov[0].iov_base = RESPONSE_PREFIX;
+    iov[0].iov_len = sizeof(RESPONSE_PREFIX) - 1;
     while (1) {
-        client_len = sizeof(client_addr);
-        memset(buffer, 0, BUFFER_SIZE);
+        buf = pbuf_get(&pool, BUFFER_SIZE);
+        if (buf == NULL) {
+            fprintf(stderr, "pbuf_get failed\n");
+            exit(EXIT_FAILURE);
+        }
 
         /* 接收UDP数据包 */
-        recv_len = recvfrom(sockfd, buffer, BUFFER_SIZE - 1, 0,
-                           (struct sockaddr*)&client_addr, &client_len);
+        msg.msg_namelen = sizeof(client_addr);
+        msg.msg_iov = &iov[1];       /* 只收进缓冲 */
+        msg.msg_iovlen = 1;
+        iov[1].iov_base = buf->data;
+        iov[1].iov_len = BUFFER_SIZE - 1;
+        recv_len = recvmsg(sockfd, &msg, 0);
         if (recv_len < 0) {
-            perror("recvfrom failed");
+            perror("recvmsg failed");
+            pbuf_put(buf);
             continue;  /* 继续处理下一个数据包 */
         }
+        buf->len = (size_t)recv_len;
 
         /* 确保字符串以null结尾 */
-        buffer[recv_len] = '\0';
+        buf->data[buf->len] = '\0';
 
         /* 解析和处理数据包：打印客户端信息和内容 */
-        printf("Received %lu bytes from %s:%d\n",
-               (unsigned long int) recv_len, inet_ntoa(client_addr.sin_addr),
-               ntohs(client_addr.sin_port));
-        printf("Content: %s\n", buffer);
-
-        /* 构造响应消息 */
-        snprintf(response, BUFFER_SIZE, "Server received your message: %s", buffer);
+        if (!quiet && alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+            alog_printf(ALOG_INFO, "Received %lu bytes from %s:%d",
+                        (unsigned long int) recv_len, inet_ntoa(client_addr.sin_addr),
+                        ntohs(client_addr.sin_port));
+            alog_printf(ALOG_INFO, "Content: %s", (char *)buf->data);
+        }
 
-        /* 发送响应回客户端 */
-        ret = sendto(sockfd, response, strlen(response), 0,
-                    (struct sockaddr*)&client_addr, client_len);
+        /* 发送响应回客户端：前缀 + 收到的内容 */
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        iov[1].iov_len = buf->len;
+        ret = sendmsg(sockfd, &msg, 0);
         if (ret < 0) {
-            perror("sendto failed");
-        } else {
-            printf("Response sent successfully\n");
+            perror("sendmsg failed");
+        } else if (!quiet && alog_allow(&pkt_log, LOG_PKT_PER_SEC)) {
+            alog_printf(ALOG_INFO, "Response sent successfully");
         }
+        pbuf_put(buf);
+        count_packets(1);
     }
 
     /* 关闭套接字（实际上不会执行到这里） */
@@ -0,0 +1,375 @@
+#define _GNU_SOURCE /* syscall, mmap and MAP_ANONYMOUS under -std=c89 */
+
+#include <stdlib.h>            /* malloc, calloc, free */
+#include <string.h>            /* memset */
+#include <errno.h>             /* errno */
+#include <unistd.h>            /* syscall, close */
+#include <sys/mman.h>          /* mmap, munmap */
+#include <sys/uio.h>           /* struct iovec */
+#include <sys/syscall.h>       /* __NR_io_uring_* */
+#include <linux/time_types.h>  /* struct __kernel_timespec */
+#include "uring.h"
+
+#define SETUP_FAST_FLAGS (IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER)
+
+static int sys_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags,
+                     const void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned int opcode, const void *arg, unsigned int nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+static void unmap_rings(struct uring *r)
+{
+    if (r->sqes != NULL)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_ring != NULL && r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_len);
+    if (r->sq_ring != NULL)
+        munmap(r->sq_ring, r->sq_ring_len);
+}
+
+int uring_init(struct uring *r, unsigned int entries, unsigned int cq_entries)
+{
+    struct io_uring_params p;
+    char *sq;
+    char *cq;
+    void *m;
+    unsigned int i;
+
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    p.flags = SETUP_FAST_FLAGS | IORING_SETUP_CQSIZE;
+    p.cq_entries = cq_entries > 0 ? cq_entries : 2 * entries;
+    r->fd = sys_setup(entries, &p);
+    if (r->fd < 0 && errno == EINVAL)
+    {
+        /* Older kernel: retry without the optional setup flags */
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = cq_entries > 0 ? cq_entries : 2 * entries;
+        r->fd = sys_setup(entries, &p);
+    }
+    if (r->fd < 0)
+        return -1;
+    /* Timed waits need IORING_ENTER_EXT_ARG (5.11); anything that old lacks multishot ops too */
+    if (!(p.features & IORING_FEAT_EXT_ARG))
+    {
+        close(r->fd);
+        errno = ENOSYS;
+        return -1;
+    }
+    r->features = p.features;
+    r->sq_entries = p.sq_entries;
+    r->cq_entries = p.cq_entries;
+
+    r->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) && r->cq_ring_len > r->sq_ring_len)
+        r->sq_ring_len = r->cq_ring_len;
+    m = mmap(NULL, r->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (m == MAP_FAILED)
+        goto fail;
+    r->sq_ring = m;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        r->cq_ring = m;
+    }
+    else
+    {
+        m = mmap(NULL, r->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (m == MAP_FAILED)
+            goto fail;
+        r->cq_ring = m;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    m = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (m == MAP_FAILED)
+        goto fail;
+    r->sqes = (struct io_uring_sqe *)m;
+
+    sq = (char *)r->sq_ring;
+    cq = (char *)r->cq_ring;
+    r->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    for (i = 0; i < r->sq_entries; i++)
+        r->sq_array[i] = i;    /* SQE slots are used in ring order */
+    r->sqe_tail = *r->sq_tail;
+    return 0;
+
+fail:
+    unmap_rings(r);
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+}
+
+void uring_exit(struct uring *r)
+{
+    if (r->fd < 0)
+        return;
+    unmap_rings(r);
+    close(r->fd);
+    r->fd = -1;
+}
+
+int uring_supported(struct uring *r, const int *ops, int n)
+{
+    struct io_uring_probe *probe;
+    size_t len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+    int ok = 1;
+    int i;
+
+    probe = (struct io_uring_probe *)calloc(1, len);
+    if (probe == NULL)
+        return 0;
+    if (sys_register(r->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        free(probe);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+            ok = 0;
+    }
+    free(probe);
+    return ok;
+}
+
+int uring_sq_reserve(struct uring *r, unsigned int n)
+{
+    if (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) + n > r->sq_entries)
+    {
+        if (uring_submit_wait(r, 0, -1) < 0 && errno != EINTR && errno != EBUSY)
+            return -1;
+        if (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) + n > r->sq_entries)
+        {
+            errno = EBUSY;        /* the kernel has not taken enough of them yet */
+            return -1;
+        }
+    }
+    return 0;
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *r)
+{
+    struct io_uring_sqe *sqe;
+
+    if (uring_sq_reserve(r, 1) != 0)
+        return NULL;
+    sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+    r->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring_submit_wait(struct uring *r, unsigned int wait_nr, int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int to_submit;
+    unsigned int flags = 0;
+    int ret;
+
+    /* count from what the kernel has consumed, so SQEs left over by an
+       earlier short or failed submit are submitted again */
+    to_submit = r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+    if (wait_nr > 0)
+        flags |= IORING_ENTER_GETEVENTS;
+    if (wait_nr > 0 && timeout_ms >= 0)
+    {
+        memset(&arg, 0, sizeof(arg));
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        arg.ts = (unsigned long)&ts;
+        ret = sys_enter(r->fd, to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    else
+    {
+        if (to_submit == 0 && wait_nr == 0)
+            return 0;
+        ret = sys_enter(r->fd, to_submit, wait_nr, flags, NULL, 0);
+    }
+    return ret < 0 ? -1 : 0;
+}
+
+struct io_uring_cqe *uring_cqe(struct uring *r)
+{
+    unsigned int head = *r->cq_head;
+
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &r->cqes[head & *r->cq_mask];
+}
+
+void uring_cqe_done(struct uring *r)
+{
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_register_files(struct uring *r, unsigned int n)
+{
+    int *fds;
+    unsigned int i;
+    int ret;
+
+    fds = (int *)malloc(n * sizeof(*fds));
+    if (fds == NULL)
+        return -1;
+    for (i = 0; i < n; i++)
+        fds[i] = -1;           /* empty slot, filled by direct accept */
+    ret = sys_register(r->fd, IORING_REGISTER_FILES, fds, n);
+    free(fds);
+    return ret < 0 ? -1 : 0;
+}
+
+int uring_register_buffer(struct uring *r, void *base, size_t len)
+{
+    struct iovec iov;
+
+    iov.iov_base = base;
+    iov.iov_len = len;
+    return sys_register(r->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0 ? -1 : 0;
+}
+
+int uring_bufs_init(struct uring *r, struct uring_bufs *b, unsigned short bgid, unsigned int count, unsigned int size)
+{
+    struct io_uring_buf_reg reg;
+    unsigned int n = 1;
+    unsigned int i;
+    void *m;
+
+    while (n < count && n < 32768)
+        n *= 2;
+    memset(b, 0, sizeof(*b));
+    b->count = n;
+    b->size = size;
+    b->bgid = bgid;
+    b->ring_len = n * sizeof(struct io_uring_buf);
+    m = mmap(NULL, b->ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+        return -1;
+    b->ring = (struct io_uring_buf_ring *)m;
+    b->base = (char *)malloc((size_t)n * size);
+    if (b->base == NULL)
+    {
+        munmap(m, b->ring_len);
+        return -1;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)m;
+    reg.ring_entries = n;
+    reg.bgid = bgid;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        free(b->base);
+        munmap(m, b->ring_len);
+        b->ring = NULL;
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+        uring_buf_recycle(b, i);
+    return 0;
+}
+
+void uring_bufs_free(struct uring *r, struct uring_bufs *b)
+{
+    struct io_uring_buf_reg reg;
+
+    if (b->ring == NULL)
+        return;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = b->bgid;
+    sys_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(b->ring, b->ring_len);
+    free(b->base);
+    b->ring = NULL;
+}
+
+char *uring_buf(const struct uring_bufs *b, unsigned int bid)
+{
+    return b->base + (size_t)bid * b->size;
+}
+
+void uring_buf_recycle(struct uring_bufs *b, unsigned int bid)
+{
+    unsigned short tail = b->ring->tail;   /* only this thread writes the tail */
+    struct io_uring_buf *e = &b->ring->bufs[tail & (b->count - 1)];
+
+    e->addr = (unsigned long)uring_buf(b, bid);
+    e->len = b->size;
+    e->bid = (unsigned short)bid;
+    __atomic_store_n(&b->ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+void uring_prep_accept_multi(struct io_uring_sqe *sqe, int lfd, unsigned long data)
+{
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = lfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    sqe->user_data = data;
+}
+
+void uring_prep_recv_multi(struct io_uring_sqe *sqe, int slot, unsigned short bgid, unsigned long data)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = slot;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = bgid;
+    sqe->user_data = data;
+}
+
+void uring_prep_write_fixed(struct io_uring_sqe *sqe, int slot, const void *buf, unsigned int len, unsigned long data)
+{
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = slot;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = data;
+}
+
+void uring_prep_read_fixed(struct io_uring_sqe *sqe, int fd, void *buf, unsigned int len, off_t off, unsigned long data)
+{
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->off = (__u64)off;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = data;
+}
+
+void uring_prep_close(struct io_uring_sqe *sqe, int slot, unsigned long data)
+{
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = (unsigned int)slot + 1;
+    sqe->user_data = data;
+}
+
+void uring_prep_cancel(struct io_uring_sqe *sqe, unsigned long target, unsigned long data)
+{
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = target;
+    sqe->user_data = data;
+}
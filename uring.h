@@ -0,0 +1,120 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>          /* size_t */
+#include <linux/io_uring.h>  /* struct io_uring_sqe, struct io_uring_cqe, IORING_* */
+
+/*
+ * Minimal io_uring core on top of the raw system calls (no liburing).
+ *
+ * The submission and completion rings are mapped once at uring_init();
+ * uring_sqe() hands out zeroed SQEs that are published to the kernel on
+ * the next uring_submit_wait(), which also waits for completions. CQEs
+ * are consumed in order with uring_cqe()/uring_cqe_done().
+ *
+ * The helpers below cover what the servers need: a sparse registered
+ * file table filled by multishot accept (connections are then addressed
+ * by slot number, not fd), provided buffer rings for multishot recv, and
+ * one registered buffer for WRITE_FIXED. A ring belongs to one thread.
+ *
+ * uring_init() fails with ENOSYS/EPERM on kernels or sandboxes without
+ * io_uring, and uring_supported() reports missing opcodes, so callers can
+ * fall back to their epoll path.
+ */
+
+struct uring
+{
+    int fd;
+    unsigned int sq_entries;
+    unsigned int cq_entries;
+    unsigned int features;        /* IORING_FEAT_* */
+    unsigned int *sq_head;        /* shared with the kernel */
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned int sqe_tail;        /* SQEs handed out, published at submit */
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;                /* == sq_ring when the kernel has IORING_FEAT_SINGLE_MMAP */
+    size_t cq_ring_len;
+    size_t sqes_len;
+};
+
+/* A provided buffer ring: count buffers of size bytes, group bgid */
+struct uring_bufs
+{
+    struct io_uring_buf_ring *ring;
+    size_t ring_len;
+    char *base;
+    unsigned int count;           /* power of two */
+    unsigned int size;
+    unsigned short bgid;
+};
+
+/* Set up a ring with entries SQEs and cq_entries CQEs (0 = 2 * entries); 0 or -1 with errno */
+int uring_init(struct uring *r, unsigned int entries, unsigned int cq_entries);
+void uring_exit(struct uring *r);
+
+/* 1 if every opcode in ops[0..n) is supported by the running kernel */
+int uring_supported(struct uring *r, const int *ops, int n);
+
+/*
+ * Make room for n SQEs, submitting pending ones first if needed, so that
+ * the next n uring_sqe() calls neither fail nor submit in between (linked
+ * SQEs must reach the kernel together). Returns 0, or -1 if the ring
+ * stays too full (errno from io_uring_enter, or EBUSY).
+ */
+int uring_sq_reserve(struct uring *r, unsigned int n);
+
+/* Next zeroed SQE; submits pending ones first if the ring is full. NULL on error */
+struct io_uring_sqe *uring_sqe(struct uring *r);
+
+/*
+ * Publish pending SQEs and wait until at least wait_nr CQEs are ready or
+ * timeout_ms passes (-1 = no timeout). Returns 0, or -1 with errno
+ * (EINTR, ETIME on timeout are not errors for the caller).
+ */
+int uring_submit_wait(struct uring *r, unsigned int wait_nr, int timeout_ms);
+
+/* Oldest unconsumed CQE, or NULL; release it with uring_cqe_done() */
+struct io_uring_cqe *uring_cqe(struct uring *r);
+void uring_cqe_done(struct uring *r);
+
+/* Register an empty file table of n slots; 0 or -1 */
+int uring_register_files(struct uring *r, unsigned int n);
+
+/* Register [base, base + len) as fixed buffer 0 (pinned once); 0 or -1 */
+int uring_register_buffer(struct uring *r, void *base, size_t len);
+
+/* Allocate and register a provided buffer ring; count is rounded to a power of two */
+int uring_bufs_init(struct uring *r, struct uring_bufs *b, unsigned short bgid, unsigned int count, unsigned int size);
+void uring_bufs_free(struct uring *r, struct uring_bufs *b);
+
+/* Buffer bid of the ring, and giving it back to the kernel once consumed */
+char *uring_buf(const struct uring_bufs *b, unsigned int bid);
+void uring_buf_recycle(struct uring_bufs *b, unsigned int bid);
+
+/* Multishot accept into a kernel-chosen free slot of the file table; cqe->res is the slot */
+void uring_prep_accept_multi(struct io_uring_sqe *sqe, int lfd, unsigned long data);
+
+/* Multishot recv on a registered slot, picking buffers from group bgid */
+void uring_prep_recv_multi(struct io_uring_sqe *sqe, int slot, unsigned short bgid, unsigned long data);
+
+/* Write len bytes of fixed buffer 0, starting at buf, to a registered slot */
+void uring_prep_write_fixed(struct io_uring_sqe *sqe, int slot, const void *buf, unsigned int len, unsigned long data);
+
+/* Read len bytes at offset off of a regular (unregistered) fd into fixed buffer 0 */
+void uring_prep_read_fixed(struct io_uring_sqe *sqe, int fd, void *buf, unsigned int len, off_t off, unsigned long data);
+
+/* Close a registered slot */
+void uring_prep_close(struct io_uring_sqe *sqe, int slot, unsigned long data);
+
+/* Cancel the request whose user data is target */
+void uring_prep_cancel(struct io_uring_sqe *sqe, unsigned long target, unsigned long data);
+
+#endif /* URING_H */
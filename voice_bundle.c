@@ -0,0 +1,367 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "voice_bundle.h"
+#include "buf_pool.h"
+
+#define SEQ_MASK 0xffffffffUL
+#define MAX_DELTA_MS 0xffffUL
+
+static void put16(unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+static void put32(unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static unsigned long get16(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 8) | p[1];
+}
+
+static unsigned long get32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+void vb_begin(struct vb_writer *w, unsigned long origin, int flags, int accept, int loss)
+{
+    put32(w->buf, VB_MAGIC);
+    put32(w->buf + 4, origin);
+    w->buf[8] = 0;
+    w->buf[9] = (unsigned char)flags;
+    w->buf[10] = (unsigned char)accept;
+    w->buf[11] = (unsigned char)(loss < 0 || loss > 100 ? VB_LOSS_UNKNOWN : loss);
+    w->len = VB_HDR_SIZE;
+    w->used = VB_HDR_SIZE;
+    w->nframes = 0;
+    w->nrefs = 0;
+}
+
+int vb_add(struct vb_writer *w, const struct vb_frame *f)
+{
+    unsigned char *p;
+    struct vb_ref *r;
+    unsigned long dseq;
+    long dus;
+    int delta = 0;
+
+    if (w->nframes >= VB_MAX_FRAMES || f->len < 0 || f->len > 0xffff)
+        return -1;
+    if (w->nframes > 0 && f->id == w->last_id) {
+        dseq = (f->seq - w->last_seq) & SEQ_MASK;
+        dus = ((long)f->ts_sec - (long)w->last_sec) * 1000000L + ((long)f->ts_usec - (long)w->last_usec);
+        delta = dseq >= 1 && dseq <= 255 && dus >= 0 && dus / 1000 <= (long)MAX_DELTA_MS;
+    }
+    if (w->len + (delta ? VB_DELTA_SIZE : VB_FULL_SIZE) + (size_t)f->len > VB_MAX_BYTES)
+        return -1;
+
+    p = w->buf + w->used;
+    if (delta) {
+        p[0] = (unsigned char)dseq;
+        put16(p + 1, (unsigned long)(dus / 1000));
+        put16(p + 3, (unsigned long)f->len);
+        w->len += VB_DELTA_SIZE;
+        w->used += VB_DELTA_SIZE;
+        /* track the truncated time the receiver reconstructs, so the
+           sub-millisecond remainders do not add up along the bundle */
+        w->last_usec += (unsigned long)(dus / 1000) * 1000UL;
+        w->last_sec += w->last_usec / 1000000UL;
+        w->last_usec %= 1000000UL;
+    } else {
+        p[0] = 0;
+        put32(p + 1, f->id);
+        put32(p + 5, f->seq);
+        put32(p + 9, f->ts_sec);
+        put32(p + 13, f->ts_usec);
+        put16(p + 17, (unsigned long)f->len);
+        w->len += VB_FULL_SIZE;
+        w->used += VB_FULL_SIZE;
+        w->last_id = f->id;
+        w->last_sec = f->ts_sec;
+        w->last_usec = f->ts_usec;
+    }
+    w->last_seq = f->seq & SEQ_MASK;
+    if (f->buf != NULL) {
+        r = &w->refs[w->nrefs++];
+        r->at = w->used;
+        r->data = f->data;
+        r->len = (size_t)f->len;
+        r->buf = pbuf_ref(f->buf);
+    } else {
+        memcpy(w->buf + w->used, f->data, (size_t)f->len);
+        w->used += (size_t)f->len;
+    }
+    w->len += (size_t)f->len;
+    w->buf[8] = (unsigned char)++w->nframes;
+    return w->nframes;
+}
+
+int vb_iov(const struct vb_writer *w, struct iovec *iov)
+{
+    size_t off = 0;
+    int i, n = 0;
+
+    for (i = 0; i < w->nrefs; i++) {
+        if (w->refs[i].at > off) {
+            iov[n].iov_base = (void *)(w->buf + off);
+            iov[n++].iov_len = w->refs[i].at - off;
+            off = w->refs[i].at;
+        }
+        iov[n].iov_base = (void *)w->refs[i].data;
+        iov[n++].iov_len = w->refs[i].len;
+    }
+    if (w->used > off) {
+        iov[n].iov_base = (void *)(w->buf + off);
+        iov[n++].iov_len = w->used - off;
+    }
+    return n;
+}
+
+void vb_release(struct vb_writer *w)
+{
+    int i;
+
+    for (i = 0; i < w->nrefs; i++)
+        pbuf_put(w->refs[i].buf);
+    w->nrefs = 0;
+}
+
+int vb_parse(const unsigned char *p, int len, struct vb_info *info,
+             struct vb_frame *frames, int max)
+{
+    struct vb_frame *f;
+    const struct vb_frame *prev = NULL;
+    int off, n, i;
+
+    if (len < VB_HDR_SIZE || get32(p) != VB_MAGIC)
+        return -1;
+    info->origin = get32(p + 4);
+    info->nframes = n = p[8];
+    info->flags = p[9];
+    info->accept = p[10];
+    info->loss = p[11];
+    if (n > max)
+        return -1;
+
+    off = VB_HDR_SIZE;
+    for (i = 0; i < n; i++) {
+        f = &frames[i];
+        if (off >= len)
+            return -1;
+        if (p[off] == 0) {
+            if (len - off < VB_FULL_SIZE)
+                return -1;
+            f->id = get32(p + off + 1);
+            f->seq = get32(p + off + 5);
+            f->ts_sec = get32(p + off + 9);
+            f->ts_usec = get32(p + off + 13);
+            f->len = (int)get16(p + off + 17);
+            off += VB_FULL_SIZE;
+        } else {
+            if (prev == NULL || len - off < VB_DELTA_SIZE)
+                return -1;
+            f->id = prev->id;
+            f->seq = (prev->seq + p[off]) & SEQ_MASK;
+            f->ts_usec = prev->ts_usec + get16(p + off + 1) * 1000UL;
+            f->ts_sec = prev->ts_sec + f->ts_usec / 1000000UL;
+            f->ts_usec %= 1000000UL;
+            f->len = (int)get16(p + off + 3);
+            off += VB_DELTA_SIZE;
+        }
+        if (len - off < f->len)
+            return -1;
+        f->data = p + off;
+        f->buf = NULL;
+        off += f->len;
+        prev = f;
+    }
+    return n;
+}
+
+void vb_adapt_init(struct vb_adapt *a, int max)
+{
+    a->size = 2;
+    a->max = 1;
+    a->last_ms = 0;
+    vb_adapt_limit(a, max);
+}
+
+void vb_adapt_limit(struct vb_adapt *a, int max)
+{
+    if (max < 1)
+        max = 1;
+    if (max > VB_MAX_FRAMES)
+        max = VB_MAX_FRAMES;
+    a->max = max;
+    if (a->size > max)
+        a->size = max;
+}
+
+int vb_adapt_update(struct vb_adapt *a, int loss, unsigned long now_ms)
+{
+    if (loss < 0 || loss > 100 || now_ms - a->last_ms < VB_ADAPT_MS)
+        return a->size;
+    a->last_ms = now_ms;
+    if (loss > VB_LOSS_HIGH && a->size > 1)
+        a->size--;
+    else if (loss <= VB_LOSS_LOW && a->size < a->max)
+        a->size++;
+    return a->size;
+}
+
+static unsigned int vb_hash(unsigned long id)
+{
+    unsigned long h = id * 2654435761UL;
+    return (unsigned int)(h ^ (h >> 15));
+}
+
+static void vb_reindex(struct vb_agg *a)
+{
+    unsigned int i, j;
+
+    for (i = 0; i <= a->mask; i++)
+        a->index[i] = -1;
+    for (i = 0; i < a->count; i++) {
+        j = vb_hash(a->queues[i].id) & a->mask;
+        while (a->index[j] >= 0)
+            j = (j + 1) & a->mask;
+        a->index[j] = (int)i;
+    }
+}
+
+int vb_agg_init(struct vb_agg *a, unsigned int cap, unsigned int budget_ms)
+{
+    unsigned int nslots = 4;
+
+    while (nslots < 2 * cap)
+        nslots *= 2;
+    a->cap = cap;
+    a->count = 0;
+    a->mask = nslots - 1;
+    a->budget_ms = budget_ms;
+    a->pending = 0;
+    a->due_ms = 0;
+    a->index = (int *)malloc(nslots * sizeof(a->index[0]));
+    a->queues = (struct vb_queue *)calloc(cap > 0 ? cap : 1, sizeof(a->queues[0]));
+    if (a->index == NULL || a->queues == NULL) {
+        vb_agg_free(a);
+        return -1;
+    }
+    vb_reindex(a);
+    return 0;
+}
+
+void vb_agg_free(struct vb_agg *a)
+{
+    unsigned int i;
+
+    for (i = 0; i < a->count; i++)
+        vb_release(&a->queues[i].wr);
+    free(a->index);
+    free(a->queues);
+    a->index = NULL;
+    a->queues = NULL;
+    a->count = 0;
+}
+
+struct vb_queue *vb_agg_get(struct vb_agg *a, unsigned long id, unsigned long now_ms)
+{
+    struct vb_queue *q;
+    unsigned int j = vb_hash(id) & a->mask;
+
+    while (a->index[j] >= 0) {
+        q = &a->queues[a->index[j]];
+        if (q->id == id) {
+            q->last_ms = now_ms;
+            return q;
+        }
+        j = (j + 1) & a->mask;
+    }
+    if (a->count >= a->cap)
+        return NULL;
+    q = &a->queues[a->count];
+    memset(q, 0, sizeof(*q) - sizeof(q->wr)); /* the buffer is rewritten by vb_begin */
+    q->id = id;
+    q->last_ms = now_ms;
+    vb_adapt_init(&q->adapt, 1);
+    vb_begin(&q->wr, 0, 0, 0, VB_LOSS_UNKNOWN);
+    a->index[j] = (int)a->count++;
+    return q;
+}
+
+int vb_queue_add(struct vb_agg *a, struct vb_queue *q, const struct vb_frame *f, unsigned long now_ms)
+{
+    int was_empty = q->wr.nframes == 0;
+    int n = vb_add(&q->wr, f);
+
+    if (n > 0 && was_empty) {
+        q->first_ms = now_ms;
+        /* frames arrive in time order, so an older deadline never comes later */
+        if (a->pending++ == 0)
+            a->due_ms = now_ms + a->budget_ms;
+    }
+    return n;
+}
+
+void vb_queue_sent(struct vb_agg *a, struct vb_queue *q)
+{
+    if (q->wr.nframes > 0)
+        a->pending--;
+    vb_release(&q->wr);
+    vb_begin(&q->wr, 0, 0, 0, VB_LOSS_UNKNOWN);
+}
+
+int vb_agg_due(const struct vb_agg *a, unsigned long now_ms)
+{
+    return a->pending > 0 && (long)(now_ms - a->due_ms) >= 0;
+}
+
+void vb_agg_flush(struct vb_agg *a, unsigned long now_ms,
+                  void (*send)(void *ctx, struct vb_queue *q), void *ctx)
+{
+    struct vb_queue *q;
+    unsigned long due;
+    unsigned int i;
+    int first = 1;
+
+    for (i = 0; i < a->count && a->pending > 0; i++) {
+        q = &a->queues[i];
+        if (q->wr.nframes == 0)
+            continue;
+        due = q->first_ms + a->budget_ms;
+        if ((long)(now_ms - due) >= 0) {
+            send(ctx, q);
+            vb_queue_sent(a, q);
+        } else if (first || (long)(due - a->due_ms) < 0) {
+            a->due_ms = due;
+            first = 0;
+        }
+    }
+}
+
+unsigned int vb_agg_expire(struct vb_agg *a, unsigned long now_ms, unsigned long idle_ms)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < a->count; i++) {
+        if (a->queues[i].wr.nframes == 0 && now_ms - a->queues[i].last_ms > idle_ms && now_ms > a->queues[i].last_ms)
+            continue;
+        if (n != i)
+            memcpy(&a->queues[n], &a->queues[i], sizeof(a->queues[0]));
+        n++;
+    }
+    i = a->count - n;
+    if (i > 0) {
+        a->count = n;
+        vb_reindex(a);
+    }
+    return i;
+}
@@ -0,0 +1,202 @@
+#ifndef VOICE_BUNDLE_H
+#define VOICE_BUNDLE_H
+
+#include <stddef.h>               /* size_t */
+
+struct pbuf;                      /* buf_pool.h */
+struct iovec;                     /* <sys/uio.h> */
+
+/*
+ * Multi-frame voice packets ("bundles").
+ *
+ * A bundle replaces one priv_hdr packet per 20 ms frame with a single
+ * packet carrying up to VB_MAX_FRAMES frames, so the per-packet cost
+ * (IP header, syscall or ring slot, NIC descriptor) is paid once per
+ * bundle. Layout after the IP header, all fields in network byte order:
+ *
+ *   header (VB_HDR_SIZE):  u32 magic, u32 origin id, u8 nframes,
+ *                          u8 flags, u8 accept, u8 loss
+ *   full entry:            u8 0, u32 client id, u32 seq, u32 ts_sec,
+ *                          u32 ts_usec, u16 len, len audio bytes
+ *   delta entry:           u8 seq delta (1..255), u16 ms since the
+ *                          previous entry, u16 len, len audio bytes
+ *
+ * A delta entry continues the stream of the entry before it, so a
+ * client's own bundle costs one full entry plus 5 bytes per extra frame,
+ * against 40 bytes of headers per frame unbundled. Bundles the server
+ * aggregates for one destination mix senders and start a full entry at
+ * every change of sender.
+ *
+ * Bundling is negotiated: accept is the largest bundle the origin is
+ * willing to receive (0: single frames only) and loss the loss percentage
+ * it measured on the packets it gets from the destination (VB_LOSS_UNKNOWN
+ * if not measured). A client sends VB_F_HELLO packets (no frames) until
+ * the server answers with VB_F_ACK; old peers drop VB_MAGIC packets, so
+ * the client keeps sending single frames to them.
+ *
+ * vb_adapt picks the frames per packet from the peer's loss reports: a
+ * lost bundle takes all its frames with it, so the size shrinks while
+ * loss is high and grows back toward the negotiated maximum when it is
+ * low. vb_agg is the server side: one queue per destination, flushed
+ * when it reaches the destination's bundle size or when its oldest frame
+ * has waited the latency budget; under light load queues run out of
+ * budget first and packets leave with fewer frames.
+ *
+ * A frame whose audio lives in a pooled buffer (buf_pool.h) is not
+ * copied into a bundle: vb_add takes a reference on the buffer and the
+ * bundle goes out gathered from its own headers and the referenced audio
+ * (vb_iov). One received packet queued for several destinations is then
+ * shared by all of their bundles and returns to its pool when the last
+ * of them has been sent.
+ */
+
+#define VB_MAGIC 0xA1B2C3D5UL     /* differs from the single-frame MAGIC */
+#define VB_MAX_FRAMES 8           /* 8 x 160-byte frames still fit a 1500-byte MTU */
+#define VB_MAX_BYTES 1480         /* bundle payload limit: MTU minus the IP header */
+#define VB_HDR_SIZE 12
+#define VB_FULL_SIZE 19           /* full entry without the audio bytes */
+#define VB_DELTA_SIZE 5           /* delta entry without the audio bytes */
+#define VB_LOSS_UNKNOWN 255
+#define VB_MAX_IOV (2 * VB_MAX_FRAMES + 1) /* vb_iov: header runs around every referenced frame */
+
+/* header flags */
+#define VB_F_HELLO 0x01           /* client: "I can bundle", no frames */
+#define VB_F_ACK 0x02             /* server: bundling accepted, loss is valid */
+
+/* adaptation */
+#define VB_ADAPT_MS 1000UL        /* size changes at most this often */
+#define VB_LOSS_HIGH 5            /* percent: shrink bundles above this */
+#define VB_LOSS_LOW 1             /* percent: grow bundles at or below this */
+
+struct vb_frame
+{
+    unsigned long id;             /* sender client id */
+    unsigned long seq;            /* 32-bit frame sequence number */
+    unsigned long ts_sec;         /* sender timestamp, host byte order */
+    unsigned long ts_usec;
+    const unsigned char *data;    /* audio bytes */
+    int len;
+    struct pbuf *buf;             /* pooled buffer holding data, NULL if not pooled */
+};
+
+struct vb_info
+{
+    unsigned long origin;         /* client id of the packet's builder, 0 = server */
+    int nframes;
+    int flags;
+    int accept;
+    int loss;
+};
+
+/* Audio a bundle references instead of copying */
+struct vb_ref
+{
+    size_t at;                    /* position in buf the audio follows */
+    const unsigned char *data;
+    size_t len;
+    struct pbuf *buf;             /* held until vb_release() */
+};
+
+struct vb_writer
+{
+    size_t len;                   /* packet length, header included */
+    size_t used;                  /* bytes in buf: len minus the referenced audio */
+    int nframes;
+    int nrefs;
+    unsigned long last_id;        /* previous entry, for delta encoding */
+    unsigned long last_seq;
+    unsigned long last_sec;       /* its timestamp as the receiver will decode it */
+    unsigned long last_usec;
+    unsigned char buf[VB_MAX_BYTES];
+    struct vb_ref refs[VB_MAX_FRAMES];
+};
+
+/* Start an empty bundle (or, with no frames added, a control packet).
+   References still held by w are forgotten, not released: call
+   vb_release() first on a writer that may hold any */
+void vb_begin(struct vb_writer *w, unsigned long origin, int flags, int accept, int loss);
+
+/* Append a frame; returns the frame count, or -1 if it does not fit.
+   The audio is copied, or referenced if f->buf is set */
+int vb_add(struct vb_writer *w, const struct vb_frame *f);
+
+/* The packet as at most VB_MAX_IOV iovecs; returns how many were filled.
+   A bundle without references is a single iovec over buf */
+int vb_iov(const struct vb_writer *w, struct iovec *iov);
+
+/* Drop the buffer references taken by vb_add() */
+void vb_release(struct vb_writer *w);
+
+/* Decode a bundle into at most max frames (data points into p, buf is
+   NULL); returns the frame count, or -1 if the packet is malformed */
+int vb_parse(const unsigned char *p, int len, struct vb_info *info,
+             struct vb_frame *frames, int max);
+
+struct vb_adapt
+{
+    int size;                     /* frames per packet now */
+    int max;                      /* negotiated limit */
+    unsigned long last_ms;        /* last size change considered */
+};
+
+void vb_adapt_init(struct vb_adapt *a, int max);
+
+/* Change the negotiated limit, clamping the current size */
+void vb_adapt_limit(struct vb_adapt *a, int max);
+
+/* Feed the latest loss report (percent, VB_LOSS_UNKNOWN is ignored);
+   steps the size by one at most every VB_ADAPT_MS and returns it */
+int vb_adapt_update(struct vb_adapt *a, int loss, unsigned long now_ms);
+
+/* Server: frames waiting for one destination */
+struct vb_queue
+{
+    unsigned long id;             /* destination client id */
+    unsigned long first_ms;       /* arrival of the oldest queued frame */
+    unsigned long last_ms;        /* last use, for vb_agg_expire() */
+    struct vb_adapt adapt;        /* frames per packet toward this destination */
+    unsigned long fb_ms;          /* last VB_F_ACK sent to this client */
+    unsigned long fb_unique;      /* its stream's counters at that time */
+    unsigned long fb_lost;
+    struct vb_writer wr;          /* the bundle being filled, origin 0 */
+};
+
+/* One table per receive loop, used by that thread only (like vs_table) */
+struct vb_agg
+{
+    unsigned int cap;
+    unsigned int count;           /* queues[0..count) */
+    unsigned int mask;            /* index has mask + 1 slots */
+    unsigned int budget_ms;       /* longest a frame waits for company */
+    unsigned int pending;         /* queues holding frames */
+    unsigned long due_ms;         /* no queue is due before this (when pending) */
+    int *index;                   /* open-addressed by id: queue number, -1 = empty */
+    struct vb_queue *queues;
+};
+
+/* Allocate room for cap destinations; returns 0, or -1 if out of memory */
+int vb_agg_init(struct vb_agg *a, unsigned int cap, unsigned int budget_ms);
+void vb_agg_free(struct vb_agg *a);
+
+/* Queue for destination id, created on first use; NULL if the table is full */
+struct vb_queue *vb_agg_get(struct vb_agg *a, unsigned long id, unsigned long now_ms);
+
+/* Queue a frame; returns the frame count now in q, or -1 if it does not
+   fit (send q and call vb_queue_sent() first) */
+int vb_queue_add(struct vb_agg *a, struct vb_queue *q, const struct vb_frame *f, unsigned long now_ms);
+
+/* q->wr has been sent: release its references and start its next bundle */
+void vb_queue_sent(struct vb_agg *a, struct vb_queue *q);
+
+/* Nonzero if some queue may have run out of budget */
+int vb_agg_due(const struct vb_agg *a, unsigned long now_ms);
+
+/* Call send() for every queue whose oldest frame has waited budget_ms,
+   then empty it */
+void vb_agg_flush(struct vb_agg *a, unsigned long now_ms,
+                  void (*send)(void *ctx, struct vb_queue *q), void *ctx);
+
+/* Drop empty queues unused for more than idle_ms; returns how many */
+unsigned int vb_agg_expire(struct vb_agg *a, unsigned long now_ms, unsigned long idle_ms);
+
+#endif /* VOICE_BUNDLE_H */
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "voice_stats.h"
+
+#define SEQ_MASK 0xffffffffUL
+#define JSON_MAX 768              /* longest line vs_format_json() produces */
+
+/* Signed distance a - b between two 32-bit sequence numbers */
+static long seq_diff(unsigned long a, unsigned long b)
+{
+    unsigned long d = (a - b) & SEQ_MASK;
+    if (d & 0x80000000UL)
+        return -(long)((~d + 1) & SEQ_MASK);
+    return (long)d;
+}
+
+static unsigned int vs_hash(unsigned long id)
+{
+    unsigned long h = id * 2654435761UL;
+    return (unsigned int)(h ^ (h >> 15));
+}
+
+static void vs_reindex(struct vs_table *t)
+{
+    unsigned int i, j;
+
+    for (i = 0; i <= t->mask; i++)
+        t->index[i] = -1;
+    for (i = 0; i < t->count; i++) {
+        j = vs_hash(t->streams[i].id) & t->mask;
+        while (t->index[j] >= 0)
+            j = (j + 1) & t->mask;
+        t->index[j] = (int)i;
+    }
+}
+
+int vs_init(struct vs_table *t, unsigned int cap)
+{
+    unsigned int nslots = 4;
+
+    while (nslots < 2 * cap)
+        nslots *= 2;
+    t->cap = cap;
+    t->count = 0;
+    t->mask = nslots - 1;
+    t->index = (int *)malloc(nslots * sizeof(t->index[0]));
+    t->streams = (struct vs_stream *)calloc(cap > 0 ? cap : 1, sizeof(t->streams[0]));
+    if (t->index == NULL || t->streams == NULL) {
+        vs_free(t);
+        return -1;
+    }
+    vs_reindex(t);
+    return 0;
+}
+
+void vs_free(struct vs_table *t)
+{
+    free(t->index);
+    free(t->streams);
+    t->index = NULL;
+    t->streams = NULL;
+    t->count = 0;
+}
+
+struct vs_stream *vs_stream_get(struct vs_table *t, unsigned long id)
+{
+    struct vs_stream *s;
+    unsigned int j = vs_hash(id) & t->mask;
+
+    while (t->index[j] >= 0) {
+        s = &t->streams[t->index[j]];
+        if (s->id == id)
+            return s;
+        j = (j + 1) & t->mask;
+    }
+    if (t->count >= t->cap)
+        return NULL;
+    s = &t->streams[t->count];
+    memset(s, 0, sizeof(*s));
+    s->id = id;
+    t->index[j] = (int)t->count++;
+    return s;
+}
+
+/* Track the sequence number; returns 0 if the frame is a duplicate or too
+   old to classify */
+static int vs_track_seq(struct vs_stream *s, unsigned long seq)
+{
+    long d;
+
+    if (s->unique == 0) {
+        s->first_seq = seq;
+        s->max_seq = seq;
+        s->window = 1;
+        s->unique = 1;
+        return 1;
+    }
+    d = seq_diff(seq, s->max_seq);
+    if (d > 0) {
+        if (d > 1)
+            s->gaps++;
+        s->window = (unsigned long)d < VS_SEQ_WINDOW ? (s->window << d) | 1 : 1;
+        s->max_seq = seq & SEQ_MASK;
+    } else if ((unsigned long)-d >= VS_SEQ_WINDOW || seq_diff(seq, s->first_seq) < 0) {
+        /* too old to tell apart from a duplicate: counted, but kept out of
+           the loss and delay figures */
+        s->reorders++;
+        return 0;
+    } else if (s->window & (1UL << -d)) {
+        s->duplicates++;
+        return 0;
+    } else {
+        s->window |= 1UL << -d;
+        s->reorders++;
+    }
+    s->unique++;
+    return 1;
+}
+
+void vs_record(struct vs_stream *s, unsigned long seq, unsigned int bytes,
+               long delay_us, unsigned long now_ms)
+{
+    unsigned long ms;
+    long d;
+    int b;
+
+    s->last_seen_ms = now_ms;
+    s->packets++;
+    s->bytes += bytes;
+    if (!vs_track_seq(s, seq))
+        return;
+
+    /* RFC 3550 A.8: the transit time differs from the one-way delay only by
+       the clock offset, which cancels out of D */
+    if (s->unique > 1) {
+        d = delay_us - s->prev_transit_us;
+        if (d < 0)
+            d = -d;
+        s->jitter_q4 += (unsigned long)d - ((s->jitter_q4 + 8) >> 4);
+    }
+    s->prev_transit_us = delay_us;
+
+    if (delay_us < 0) {
+        s->clock_skew++;
+        return;
+    }
+    if (s->unique - s->clock_skew == 1 || delay_us < s->delay_min_us)
+        s->delay_min_us = delay_us;
+    if (delay_us > s->delay_max_us)
+        s->delay_max_us = delay_us;
+    s->delay_sum_us += (double)delay_us;
+    ms = (unsigned long)delay_us / 1000UL;
+    for (b = 0; ms > 0 && b < VS_DELAY_BUCKETS - 1; b++)
+        ms >>= 1;
+    s->delay_hist[b]++;
+}
+
+unsigned long vs_lost(const struct vs_stream *s)
+{
+    unsigned long expected;
+
+    if (s->unique == 0)
+        return 0;
+    expected = (unsigned long)seq_diff(s->max_seq, s->first_seq) + 1;
+    return expected > s->unique ? expected - s->unique : 0;
+}
+
+unsigned int vs_expire(struct vs_table *t, unsigned long now_ms, unsigned long idle_ms)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < t->count; i++) {
+        if (now_ms - t->streams[i].last_seen_ms > idle_ms && now_ms > t->streams[i].last_seen_ms)
+            continue;
+        if (n != i)
+            t->streams[n] = t->streams[i];
+        n++;
+    }
+    i = t->count - n;
+    if (i > 0) {
+        t->count = n;
+        vs_reindex(t);
+    }
+    return i;
+}
+
+int vs_format_json(const struct vs_stream *s, const char *origin, int worker,
+                   char *buf, size_t size)
+{
+    char line[JSON_MAX];
+    unsigned long samples;
+    int n, i;
+
+    samples = s->unique - s->clock_skew;
+    n = sprintf(line, "{\"origin\":\"%s\",\"worker\":%d,\"id\":%lu,\"packets\":%lu,\"bytes\":%lu,"
+                "\"lost\":%lu,\"gaps\":%lu,\"reorders\":%lu,\"duplicates\":%lu,",
+                origin, worker, s->id, s->packets, s->bytes,
+                vs_lost(s), s->gaps, s->reorders, s->duplicates);
+    n += sprintf(line + n, "\"jitter_us\":%lu,\"clock_skew\":%lu,"
+                 "\"delay_us\":{\"min\":%ld,\"mean\":%.0f,\"max\":%ld,\"hist_ms\":[",
+                 s->jitter_q4 >> 4, s->clock_skew,
+                 samples > 0 ? s->delay_min_us : 0L,
+                 samples > 0 ? s->delay_sum_us / (double)samples : 0.0,
+                 samples > 0 ? s->delay_max_us : 0L);
+    for (i = 0; i < VS_DELAY_BUCKETS; i++)
+        n += sprintf(line + n, "%s%lu", i > 0 ? "," : "", s->delay_hist[i]);
+    n += sprintf(line + n, "]}}");
+    if ((size_t)n >= size)
+        return -1;
+    memcpy(buf, line, (size_t)n + 1);
+    return n;
+}
@@ -0,0 +1,81 @@
+#ifndef VOICE_STATS_H
+#define VOICE_STATS_H
+
+#include <stddef.h>               /* size_t */
+
+/*
+ * Per-stream QoS counters for voice frames, keyed by client id.
+ *
+ * A table belongs to exactly one thread (a server worker, or the client
+ * receive loop): vs_record() is the only call on the per-packet path and
+ * it is plain arithmetic on that thread's memory, with no locks or
+ * atomics. The owner formats the counters with vs_format_json() from its
+ * own periodic timer, off the packet path; they are cumulative for the
+ * life of the stream.
+ *
+ * Delays are one-way (sender wall clock to receiver wall clock) in
+ * microseconds, so they are only meaningful when the clocks are synced;
+ * negative samples are counted as clock_skew and kept out of the
+ * histogram. Jitter does not depend on clock offset.
+ */
+
+#define VS_DELAY_BUCKETS 16       /* <1 ms, then [2^(k-1), 2^k) ms, last is open ended */
+#define VS_SEQ_WINDOW (8 * sizeof(unsigned long)) /* sequence numbers tracked for duplicates */
+
+struct vs_stream
+{
+    unsigned long id;
+    unsigned long last_seen_ms;
+    unsigned long packets;        /* every frame, duplicates included */
+    unsigned long bytes;          /* payload bytes (private header + audio) */
+    unsigned long gaps;           /* times the sequence jumped ahead by more than one */
+    unsigned long reorders;       /* arrived behind a newer frame */
+    unsigned long duplicates;
+    unsigned long clock_skew;     /* samples with negative one-way delay */
+    unsigned long first_seq;
+    unsigned long max_seq;
+    unsigned long unique;         /* distinct sequence numbers, for the loss count */
+    unsigned long window;         /* bit k set: max_seq - k was received */
+    long prev_transit_us;
+    unsigned long jitter_q4;      /* RFC 3550 A.8 jitter estimate, us << 4 */
+    long delay_min_us;
+    long delay_max_us;
+    double delay_sum_us;
+    unsigned long delay_hist[VS_DELAY_BUCKETS];
+};
+
+struct vs_table
+{
+    unsigned int cap;
+    unsigned int count;           /* streams[0..count) */
+    unsigned int mask;            /* index has mask + 1 slots */
+    int *index;                   /* open-addressed by id: stream number, -1 = empty */
+    struct vs_stream *streams;
+};
+
+/* Allocate room for cap streams; returns 0, or -1 if out of memory */
+int vs_init(struct vs_table *t, unsigned int cap);
+void vs_free(struct vs_table *t);
+
+/* Stream for id, created on first use; NULL if the table is full */
+struct vs_stream *vs_stream_get(struct vs_table *t, unsigned long id);
+
+/* Account one frame: 32-bit sequence number, payload size, one-way delay */
+void vs_record(struct vs_stream *s, unsigned long seq, unsigned int bytes,
+               long delay_us, unsigned long now_ms);
+
+/* Frames the sender produced but that never arrived (so far) */
+unsigned long vs_lost(const struct vs_stream *s);
+
+/* Drop streams silent for more than idle_ms; returns how many were dropped */
+unsigned int vs_expire(struct vs_table *t, unsigned long now_ms, unsigned long idle_ms);
+
+/*
+ * Format one stream as a single-line JSON object tagged with origin and
+ * worker, e.g. {"origin":"server","worker":0,"id":7,"packets":...}.
+ * Returns the length written (without the NUL), or -1 if it does not fit.
+ */
+int vs_format_json(const struct vs_stream *s, const char *origin, int worker,
+                   char *buf, size_t size);
+
+#endif /* VOICE_STATS_H */